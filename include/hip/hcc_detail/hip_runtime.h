@@ -842,6 +842,15 @@ do {\
   ihipPostLaunchKernel(#_kernelName, trueStream, lp);\
 } while(0)
 
+// Occupancy of a kernel launched with hipLaunchKernel.  The arguments are those of the CUDA functions, with the
+// kernel passed as the function; it must name a kernel, and is found by the name written here like hipLaunchKernel
+// does.  hipOccupancyMaxPotentialBlockSize's dynamicSMemSize and blockSizeLimit default to 0.
+#define hipOccupancyMaxActiveBlocksPerMultiprocessor(_numBlocks, _kernelName, _blockSize, _dynamicSMemSize) \
+  ((void)(_kernelName), hipHccOccupancyMaxActiveBlocksPerMultiprocessor(_numBlocks, #_kernelName, _blockSize, _dynamicSMemSize))
+
+#define hipOccupancyMaxPotentialBlockSize(_minGridSize, _blockSize, _kernelName, ...) \
+  ((void)(_kernelName), hipHccOccupancyMaxPotentialBlockSize(_minGridSize, _blockSize, #_kernelName, ##__VA_ARGS__))
+
 
 #elif defined (__HCC_C__)
 
@@ -57,18 +57,18 @@ typedef struct ihipDevice_t *hipDevice_t;
 
 typedef struct ihipStream_t *hipStream_t;
 
-//TODO: IPC implementation
-
 #define hipIpcMemLazyEnablePeerAccess 0
 
-typedef struct ihipIpcMemHandle_t *hipIpcMemHandle_t;
-
-//TODO: IPC event handle currently unsupported
-struct ihipIpcEventHandle_t;
-typedef struct ihipIpcEventHandle_t *hipIpcEventHandle_t;
+#define HIP_IPC_HANDLE_SIZE 64
 
+// IPC handles are plain bytes so they can be passed to another process, for example over a pipe or socket.
+typedef struct hipIpcMemHandle_st {
+    char reserved[HIP_IPC_HANDLE_SIZE];
+} hipIpcMemHandle_t;
 
-//END TODO
+typedef struct hipIpcEventHandle_st {
+    char reserved[HIP_IPC_HANDLE_SIZE];
+} hipIpcEventHandle_t;
 
 typedef struct ihipModule_t *hipModule_t;
 
@@ -96,7 +96,7 @@ enum hipLimit_t
 #define hipEventDefault             0x0  ///< Default flags
 #define hipEventBlockingSync        0x1  ///< Waiting will yield CPU.  Power-friendly and usage-friendly but may increase latency.
 #define hipEventDisableTiming       0x2  ///< Disable event's capability to record timing information.  May improve performance.
-#define hipEventInterprocess        0x4  ///< Event can support IPC.  @warning - not supported in HIP.
+#define hipEventInterprocess        0x4  ///< Event can be shared with another process, see hipIpcGetEventHandle.  Must be combined with hipEventDisableTiming.
 
 
 //! Flags that can be used with hipHostMalloc
@@ -104,6 +104,7 @@ enum hipLimit_t
 #define hipHostMallocPortable       0x1
 #define hipHostMallocMapped         0x2
 #define hipHostMallocWriteCombined  0x4
+#define hipHostMallocHugePages      0x8  ///< Back the allocation with 2MB/1GB pages where available.  Falls back to 4KB pages.  Set by default with HIP_HOST_HUGE_PAGES.
 
 //! Flags that can be used with hipHostRegister
 #define hipHostRegisterDefault      0x0  ///< Memory is Mapped and Portable
@@ -111,6 +112,70 @@ enum hipLimit_t
 #define hipHostRegisterMapped       0x2  ///< Map the allocation into the address space for the current device.  The device pointer can be obtained with #hipHostGetDevicePointer.
 #define hipHostRegisterIoMemory     0x4  ///< Not supported.
 
+//! Flags that can be used with hipMallocManaged
+#define hipMemAttachGlobal          0x1  ///< Memory can be accessed by any stream on any device.
+#define hipMemAttachHost            0x2  ///< Memory cannot be accessed by any stream on any device.  Not supported.
+
+#define hipCpuDeviceId              ((int)-1)  ///< Device id of the host, for hipMemPrefetchAsync and hipMemAdvise.
+#define hipInvalidDeviceId          ((int)-2)
+
+//! Advice that can be used with hipMemAdvise
+typedef enum hipMemoryAdvise {
+    hipMemAdviseSetReadMostly = 1,          ///< Data will mostly be read and only occasionally written.
+    hipMemAdviseUnsetReadMostly,
+    hipMemAdviseSetPreferredLocation,       ///< Prefer to keep the data on the specified device.
+    hipMemAdviseUnsetPreferredLocation,
+    hipMemAdviseSetAccessedBy,              ///< Data will be accessed by the specified device.
+    hipMemAdviseUnsetAccessedBy
+} hipMemoryAdvise;
+
+//! Attributes that can be queried with hipMemRangeGetAttribute
+typedef enum hipMemRangeAttribute {
+    hipMemRangeAttributeReadMostly = 1,         ///< int: 1 if hipMemAdviseSetReadMostly is in effect.
+    hipMemRangeAttributePreferredLocation,      ///< int: preferred device, hipCpuDeviceId, or hipInvalidDeviceId.
+    hipMemRangeAttributeAccessedBy,             ///< int array: devices set with hipMemAdviseSetAccessedBy, padded with hipInvalidDeviceId.
+    hipMemRangeAttributeLastPrefetchLocation    ///< int: last hipMemPrefetchAsync destination, or hipInvalidDeviceId.
+} hipMemRangeAttribute;
+
+//! Virtual memory management, see hipMemAddressReserve
+typedef struct ihipMemGenericAllocationHandle *hipMemGenericAllocationHandle_t;
+
+typedef enum hipMemAllocationType {
+    hipMemAllocationTypeInvalid = 0,
+    hipMemAllocationTypePinned  = 1         ///< Physical memory which is resident on the device.
+} hipMemAllocationType;
+
+typedef enum hipMemLocationType {
+    hipMemLocationTypeInvalid = 0,
+    hipMemLocationTypeDevice  = 1           ///< id is a device id.
+} hipMemLocationType;
+
+typedef struct hipMemLocation {
+    hipMemLocationType type;
+    int id;
+} hipMemLocation;
+
+typedef struct hipMemAllocationProp {
+    hipMemAllocationType type;
+    hipMemLocation location;                ///< Device the physical memory is allocated on.
+} hipMemAllocationProp;
+
+typedef enum hipMemAccessFlags {
+    hipMemAccessFlagsProtNone      = 0,
+    hipMemAccessFlagsProtRead      = 1,
+    hipMemAccessFlagsProtReadWrite = 3
+} hipMemAccessFlags;
+
+typedef struct hipMemAccessDesc {
+    hipMemLocation location;                ///< Device the access applies to.
+    hipMemAccessFlags flags;
+} hipMemAccessDesc;
+
+typedef enum hipMemAllocationGranularity_flags {
+    hipMemAllocationGranularityMinimum     = 0,
+    hipMemAllocationGranularityRecommended = 1
+} hipMemAllocationGranularity_flags;
+
 
 #define hipDeviceScheduleAuto       0x0  ///< Automatically select between Spin and Yield
 #define hipDeviceScheduleSpin       0x1  ///< Dedicate a CPU core to spin-wait.  Provides lowest latency, but burns a CPU core and may consume more power.
@@ -571,7 +636,8 @@ hipError_t hipStreamDestroy(hipStream_t stream);
  *
  * @param[in] stream stream to query
  *
- * @return #hipSuccess, #hipErrorNotReady, #hipErrorInvalidResourceHandle
+ * @return #hipSuccess, #hipErrorNotReady, #hipErrorInvalidResourceHandle, or the error of a failed
+ * hipMemcpyFromFileAsync / hipMemcpyToFileAsync in the stream
  *
  * This is thread-safe and returns a snapshot of the current state of the queue.  However, if other host threads are sending work to the stream,
  * the status may change immediately after the function is called.  It is typically used for debug.
@@ -586,7 +652,8 @@ hipError_t hipStreamQuery(hipStream_t stream);
  *
  * @param[in] stream stream identifier.
  *
- * @return #hipSuccess, #hipErrorInvalidResourceHandle
+ * @return #hipSuccess, #hipErrorInvalidResourceHandle, or the error of a failed hipMemcpyFromFileAsync /
+ * hipMemcpyToFileAsync in the stream
  *
  * If the null stream is specified, this command blocks until all
  * This command honors the hipDeviceLaunchBlocking flag, which controls whether the wait is active or blocking.
@@ -756,6 +823,9 @@ hipError_t hipEventDestroy(hipEvent_t event);
  *
  *  TODO-hcc - This function needs to support hipEventBlockingSync parameter.
  *
+ *  A hipMemcpyFromFileAsync or hipMemcpyToFileAsync in the stream which failed after it was enqueued is reported
+ *  here, once.
+ *
  *  @param[in] event Event on which to wait.
  *  @returns #hipSuccess, #hipErrorInvalidValue, #hipErrorInitializationError, #hipErrorInvalidResourceHandle, #hipErrorLaunchFailure
  *
@@ -801,7 +871,9 @@ hipError_t hipEventElapsedTime(float *ms, hipEvent_t start, hipEvent_t stop);
  *
  * Query the status of the specified event.  This function will return #hipErrorNotReady if all commands
  * in the appropriate stream (specified to hipEventRecord()) have completed.  If that work has not completed,
- * or if hipEventRecord() was not called on the event, then #hipSuccess is returned.
+ * or if hipEventRecord() was not called on the event, then #hipSuccess is returned.  Once the event is complete, a
+ * hipMemcpyFromFileAsync or hipMemcpyToFileAsync in its stream which failed after it was enqueued is reported here,
+ * once.
  *
  * @see hipEventCreate, hipEventCreateWithFlags, hipEventRecord, hipEventDestroy, hipEventSynchronize, hipEventElapsedTime
  */
@@ -854,6 +926,179 @@ hipError_t hipPointerGetAttributes(hipPointerAttribute_t *attributes, void* ptr)
  */
 hipError_t hipMalloc(void** ptr, size_t size) ;
 
+/**
+ *  @brief Allocate memory which is accessible from the host and from all devices at the same address
+ *
+ *  The memory is pinned system memory on the NUMA node closest to the current device, mapped into every
+ *  device.  It is never migrated, so neither the host nor the devices take page faults on it.
+ *  Free with hipFree.
+ *
+ *  Memory attached to the host (hipMemAttachHost, attached to streams later) is not supported.
+ *
+ *  @param[out] devPtr Pointer to the allocated memory
+ *  @param[in]  size Requested memory size
+ *  @param[in]  flags hipMemAttachGlobal
+ *
+ *  @return #hipSuccess, #hipErrorMemoryAllocation, #hipErrorInvalidValue, #hipErrorNotSupported (hipMemAttachHost)
+ *
+ *  @see hipMemPrefetchAsync, hipMemAdvise, hipFree
+ */
+#if __cplusplus
+hipError_t hipMallocManaged(void** devPtr, size_t size, unsigned int flags = hipMemAttachGlobal) ;
+#else
+hipError_t hipMallocManaged(void** devPtr, size_t size, unsigned int flags) ;
+#endif
+
+/**
+ *  @brief Prefetch managed memory to a device, or to the host with hipCpuDeviceId
+ *
+ *  A marker is enqueued in @p stream, so the prefetch is ordered with the other work in the stream and events
+ *  recorded after it complete after the work before it.  Memory from hipMallocManaged is resident and mapped on
+ *  the host and on every device, so there is no data to move, as with CUDA on devices without
+ *  concurrentManagedAccess.  The destination is recorded for hipMemRangeGetAttribute.
+ *
+ *  @param[in] devPtr Pointer into memory allocated with hipMallocManaged
+ *  @param[in] count Size of the range in bytes
+ *  @param[in] device Destination device, or hipCpuDeviceId
+ *  @param[in] stream Stream to order the prefetch in
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidDevice
+ */
+#if __cplusplus
+hipError_t hipMemPrefetchAsync(const void* devPtr, size_t count, int device, hipStream_t stream = 0) ;
+#else
+hipError_t hipMemPrefetchAsync(const void* devPtr, size_t count, int device, hipStream_t stream) ;
+#endif
+
+/**
+ *  @brief Advise the runtime about the use of a range of managed memory
+ *
+ *  The advice is a hint.  Managed memory is never migrated, so it does not change where the data lives or how it
+ *  is mapped; it is recorded for the whole allocation and reported by hipMemRangeGetAttribute.
+ *
+ *  @param[in] devPtr Pointer into memory allocated with hipMallocManaged
+ *  @param[in] count Size of the range in bytes
+ *  @param[in] advice See hipMemoryAdvise
+ *  @param[in] device Device the advice applies to, or hipCpuDeviceId.  Ignored for the read-mostly advice.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidDevice
+ */
+hipError_t hipMemAdvise(const void* devPtr, size_t count, hipMemoryAdvise advice, int device) ;
+
+/**
+ *  @brief Query an attribute of a range of managed memory
+ *
+ *  @param[out] data Returns the attribute, see hipMemRangeAttribute
+ *  @param[in]  dataSize Size of @p data in bytes.  A multiple of 4, and 4 for all attributes but hipMemRangeAttributeAccessedBy.
+ *  @param[in]  attribute Attribute to query
+ *  @param[in]  devPtr Pointer into memory allocated with hipMallocManaged
+ *  @param[in]  count Size of the range in bytes
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipMemRangeGetAttribute(void* data, size_t dataSize, hipMemRangeAttribute attribute, const void* devPtr, size_t count) ;
+
+/**
+ *  @defgroup VirtualMemory Virtual Memory Management
+ *  @{
+ *
+ *  Reserve a range of device virtual addresses, create physical memory chunks, and map chunks into the range.
+ *  A buffer can grow in place by mapping more chunks after its end, with no copy and no hipFree.
+ *  Sizes, offsets and addresses must be multiples of the granularity from hipMemGetAllocationGranularity.
+ *
+ *  These APIs need a ROCr which provides the hsa_amd_vmem interface.  Otherwise they return #hipErrorNotSupported.
+ */
+
+/**
+ *  @brief Returns the granularity of sizes and addresses for the virtual memory APIs
+ *
+ *  @param[out] granularity Returned granularity in bytes
+ *  @param[in]  prop Properties of the physical memory, see hipMemCreate
+ *  @param[in]  option hipMemAllocationGranularityMinimum, or hipMemAllocationGranularityRecommended for best performance
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidDevice, #hipErrorNotSupported
+ */
+hipError_t hipMemGetAllocationGranularity(size_t* granularity, const hipMemAllocationProp* prop, hipMemAllocationGranularity_flags option) ;
+
+/**
+ *  @brief Reserve a range of device virtual addresses.  No memory is allocated.
+ *
+ *  @param[out] ptr Returned start of the range
+ *  @param[in]  size Size of the range
+ *  @param[in]  alignment Alignment of the range, 0 for the granularity.  Must be a power of 2.
+ *  @param[in]  addr Requested start of the range, or NULL.  The runtime may return another address.
+ *  @param[in]  flags Must be 0
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorMemoryAllocation, #hipErrorNotSupported
+ */
+hipError_t hipMemAddressReserve(void** ptr, size_t size, size_t alignment, void* addr, unsigned long long flags) ;
+
+/**
+ *  @brief Free a range reserved with hipMemAddressReserve.  All chunks must have been unmapped.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported
+ */
+hipError_t hipMemAddressFree(void* ptr, size_t size) ;
+
+/**
+ *  @brief Create a chunk of physical memory
+ *
+ *  @param[out] handle Returned handle of the chunk
+ *  @param[in]  size Size of the chunk
+ *  @param[in]  prop hipMemAllocationTypePinned on a hipMemLocationTypeDevice
+ *  @param[in]  flags Must be 0
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidDevice, #hipErrorMemoryAllocation, #hipErrorNotSupported
+ */
+hipError_t hipMemCreate(hipMemGenericAllocationHandle_t* handle, size_t size, const hipMemAllocationProp* prop, unsigned long long flags) ;
+
+/**
+ *  @brief Release a chunk created with hipMemCreate.  The memory is freed when it is no longer mapped.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported
+ */
+hipError_t hipMemRelease(hipMemGenericAllocationHandle_t handle) ;
+
+/**
+ *  @brief Map [offset, offset+size) of a chunk at ptr, inside a reserved range
+ *
+ *  The mapping is not accessible by any device until hipMemSetAccess is called.
+ *
+ *  @param[in] ptr Address in a range reserved with hipMemAddressReserve
+ *  @param[in] size Size of the mapping
+ *  @param[in] offset Offset in the chunk
+ *  @param[in] handle Chunk created with hipMemCreate
+ *  @param[in] flags Must be 0
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported
+ */
+hipError_t hipMemMap(void* ptr, size_t size, size_t offset, hipMemGenericAllocationHandle_t handle, unsigned long long flags) ;
+
+/**
+ *  @brief Unmap a mapping made with hipMemMap
+ *
+ *  Unlike hipFree this does not wait for the device.  The caller must make sure no pending work uses the range.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported
+ */
+hipError_t hipMemUnmap(void* ptr, size_t size) ;
+
+/**
+ *  @brief Set the access of devices to mapped memory
+ *
+ *  @param[in] ptr Start of the mapped range
+ *  @param[in] size Size of the range
+ *  @param[in] desc Array of access descriptors, one per device
+ *  @param[in] count Number of descriptors
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidDevice, #hipErrorNotSupported
+ */
+hipError_t hipMemSetAccess(void* ptr, size_t size, const hipMemAccessDesc* desc, size_t count) ;
+
+/**
+ * @}
+ */
+
 /**
  *  @brief Allocate pinned host memory [Deprecated]
  *
@@ -1123,6 +1368,9 @@ hipError_t hipMemcpyDtoDAsync(hipDeviceptr_t dst, hipDeviceptr_t src, size_t siz
  *  naming a variable that resides in global or constant memory space. Kind can be either hipMemcpyHostToDevice or hipMemcpyDeviceToDevice
  *  TODO: cudaErrorInvalidSymbol and cudaErrorInvalidMemcpyDirection is not supported, use hipErrorUnknown for now.
  *
+ *  @p offset + @p sizeBytes must not exceed the size of the symbol, else #hipErrorInvalidValue is returned.  This is
+ *  only checked when the HSA runtime reports symbol sizes (see hipGetSymbolSize).
+ *
  *  @param[in]  symbolName - Symbol destination on device
  *  @param[in]  src - Data being copy from
  *  @param[in]  sizeBytes - Data size in bytes
@@ -1143,6 +1391,8 @@ hipError_t hipMemcpyToSymbol(const char* symbolName, const void *src, size_t siz
  *  hipMemcpyToSymbolAsync() is asynchronous with respect to the host, so the call may return before copy is complete.
  *  TODO: cudaErrorInvalidSymbol and cudaErrorInvalidMemcpyDirection is not supported, use hipErrorUnknown for now.
  *
+ *  The range is checked as for hipMemcpyToSymbol.
+ *
  *  @param[in]  symbolName - Symbol destination on device
  *  @param[in]  src - Data being copy from
  *  @param[in]  sizeBytes - Data size in bytes
@@ -1155,6 +1405,68 @@ hipError_t hipMemcpyToSymbol(const char* symbolName, const void *src, size_t siz
 hipError_t hipMemcpyToSymbolAsync(const char* symbolName, const void *src, size_t sizeBytes, size_t offset, hipMemcpyKind kind, hipStream_t stream);
 
 
+/**
+ *  @brief Copies @p sizeBytes bytes starting @p offset bytes from the start of symbol @p symbolName to the memory area pointed to by @p dst.
+ *
+ *  Kind can be either hipMemcpyDeviceToHost or hipMemcpyDeviceToDevice.
+ *
+ *  @p offset + @p sizeBytes must not exceed the size of the symbol, else #hipErrorInvalidValue is returned.  This is
+ *  only checked when the HSA runtime reports symbol sizes (see hipGetSymbolSize).
+ *
+ *  @param[out] dst - Data being copied to
+ *  @param[in]  symbolName - Symbol source on device
+ *  @param[in]  sizeBytes - Data size in bytes
+ *  @param[in]  offset - Offset from start of symbol in bytes
+ *  @param[in]  kind - Type of transfer
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidSymbol
+ *
+ *  @see hipMemcpyToSymbol, hipMemcpyFromSymbolAsync, hipGetSymbolAddress, hipGetSymbolSize
+ */
+hipError_t hipMemcpyFromSymbol(void *dst, const char* symbolName, size_t sizeBytes, size_t offset, hipMemcpyKind kind);
+
+
+/**
+ *  @brief Copies @p sizeBytes bytes starting @p offset bytes from the start of symbol @p symbolName to the memory area pointed to by @p dst.
+ *
+ *  hipMemcpyFromSymbolAsync() is asynchronous with respect to the host, so the call may return before copy is complete.
+ *
+ *  The range is checked as for hipMemcpyFromSymbol.
+ *
+ *  @param[out] dst - Data being copied to
+ *  @param[in]  symbolName - Symbol source on device
+ *  @param[in]  sizeBytes - Data size in bytes
+ *  @param[in]  offset - Offset from start of symbol in bytes
+ *  @param[in]  kind - Type of transfer
+ *  @param[in]  stream - Stream to enqueue the copy in
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidSymbol
+ *
+ *  @see hipMemcpyToSymbolAsync, hipMemcpyFromSymbol, hipGetSymbolAddress, hipGetSymbolSize
+ */
+hipError_t hipMemcpyFromSymbolAsync(void *dst, const char* symbolName, size_t sizeBytes, size_t offset, hipMemcpyKind kind, hipStream_t stream);
+
+
+/**
+ *  @brief Returns the device address of symbol @p symbolName on the current device
+ *
+ *  Lookups are cached per device, so repeated calls are cheap.
+ *
+ *  @param[out] devPtr - Returned device address
+ *  @param[in]  symbolName - Name of a __device__ or __constant__ variable, see HIP_SYMBOL
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidSymbol
+ */
+hipError_t hipGetSymbolAddress(void** devPtr, const char* symbolName);
+
+
+/**
+ *  @brief Returns the size in bytes of symbol @p symbolName
+ *
+ *  @param[out] size - Returned size
+ *  @param[in]  symbolName - Name of a __device__ or __constant__ variable, see HIP_SYMBOL
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidSymbol, #hipErrorNotSupported if the HSA runtime can't report symbol sizes
+ */
+hipError_t hipGetSymbolSize(size_t* size, const char* symbolName);
+
+
 
 /**
  *  @brief Copy data from src to dst asynchronously.
@@ -1184,6 +1496,123 @@ hipError_t hipMemcpyAsync(void* dst, const void* src, size_t sizeBytes, hipMemcp
 hipError_t hipMemcpyAsync(void* dst, const void* src, size_t sizeBytes, hipMemcpyKind kind, hipStream_t stream);
 #endif
 
+
+/**
+ *  @brief Copy a batch of ranges asynchronously.
+ *
+ *  Range i copies sizes[i] bytes from srcs[i] to dsts[i].  The whole batch costs one API call, one stream lookup
+ *  and one lock.  Ranges which continue the previous range in both dst and src are merged.  Small ranges on device
+ *  memory or pinned host memory are copied together by one kernel, and the remaining ranges use one DMA command each.
+ *  Ranges on pageable host memory are copied as by hipMemcpyAsync.
+ *
+ *  The batch is ordered with respect to other commands in the stream, but ranges within the batch may be copied
+ *  in any order.  Destination ranges must not overlap each other or any source range.
+ *
+ *  @param[in]  dsts Array of count destination pointers
+ *  @param[in]  srcs Array of count source pointers
+ *  @param[in]  sizes Array of count sizes in bytes
+ *  @param[in]  count Number of ranges
+ *  @param[in]  kind Type of transfer
+ *  @param[in]  stream Stream identifier
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorMemoryAllocation
+ *
+ *  @see hipMemcpyAsync, hipMemcpyGatherScatterAsync
+ */
+#if __cplusplus
+hipError_t hipMemcpyBatchAsync(void* const* dsts, const void* const* srcs, const size_t* sizes, size_t count,
+                               hipMemcpyKind kind, hipStream_t stream=0);
+#else
+hipError_t hipMemcpyBatchAsync(void* const* dsts, const void* const* srcs, const size_t* sizes, size_t count,
+                               hipMemcpyKind kind, hipStream_t stream);
+#endif
+
+
+/**
+ *  @brief Gather and/or scatter fixed-size elements asynchronously.
+ *
+ *  Element i copies elementSize bytes from src + srcIndices[i]*elementSize to dst + dstIndices[i]*elementSize.
+ *  A NULL index array selects element i, so passing dstIndices=NULL is a gather and srcIndices=NULL is a scatter.
+ *  Runs of consecutive indices are merged into one copy.  See hipMemcpyBatchAsync for ordering rules.
+ *  Returns #hipErrorInvalidValue if an index times elementSize overflows the address space.
+ *
+ *  @param[out] dst Destination base pointer
+ *  @param[in]  dstIndices Host array of count destination element indices, or NULL
+ *  @param[in]  src Source base pointer
+ *  @param[in]  srcIndices Host array of count source element indices, or NULL
+ *  @param[in]  elementSize Size of one element in bytes
+ *  @param[in]  count Number of elements
+ *  @param[in]  kind Type of transfer
+ *  @param[in]  stream Stream identifier
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorMemoryAllocation
+ *
+ *  @see hipMemcpyBatchAsync
+ */
+#if __cplusplus
+hipError_t hipMemcpyGatherScatterAsync(void* dst, const size_t* dstIndices, const void* src, const size_t* srcIndices,
+                                       size_t elementSize, size_t count, hipMemcpyKind kind, hipStream_t stream=0);
+#else
+hipError_t hipMemcpyGatherScatterAsync(void* dst, const size_t* dstIndices, const void* src, const size_t* srcIndices,
+                                       size_t elementSize, size_t count, hipMemcpyKind kind, hipStream_t stream);
+#endif
+
+
+/**
+ *  @brief Read a file region into device memory, ordered with the other commands in the stream.
+ *
+ *  The file is read with pread on I/O threads into a ring of pinned bounce buffers, and each buffer is copied to
+ *  dst by DMA while the next ones are read.  Reads and DMAs run in stream order, after the earlier commands in
+ *  the stream; the call only blocks while every bounce buffer is in use.  Use hipStreamSynchronize or a hipEvent
+ *  to wait for dst.  If fd was opened with O_DIRECT the reads are aligned to 4KB internally, so offset and
+ *  sizeBytes may have any value.
+ *
+ *  A region past the end of the file is rejected at once, unless file writes pending on the stream may extend the
+ *  file.  A read which fails after the call has returned is reported, once, by the first of: the next
+ *  hipMemcpyToFileAsync or hipMemcpyFromFileAsync on the same stream, hipStreamSynchronize or hipStreamQuery on
+ *  the stream, or hipEventSynchronize or hipEventQuery on a completed event recorded in the stream.
+ *
+ *  @param[out] dst Device memory to fill
+ *  @param[in]  fd File descriptor open for reading
+ *  @param[in]  offset Offset in the file, in bytes
+ *  @param[in]  sizeBytes Number of bytes to read
+ *  @param[in]  stream Stream identifier
+ *  @return #hipSuccess, #hipErrorInvalidValue (bad fd, short read or dst not device memory), #hipErrorMemoryAllocation
+ *
+ *  @see hipMemcpyToFileAsync
+ */
+#if __cplusplus
+hipError_t hipMemcpyFromFileAsync(void* dst, int fd, int64_t offset, size_t sizeBytes, hipStream_t stream=0);
+#else
+hipError_t hipMemcpyFromFileAsync(void* dst, int fd, int64_t offset, size_t sizeBytes, hipStream_t stream);
+#endif
+
+
+/**
+ *  @brief Write device memory to a file region, ordered with the other commands in the stream.
+ *
+ *  Each chunk of src is copied by DMA into a pinned bounce buffer, and written to the file with pwrite by an I/O
+ *  thread once the DMA completes.  The call returns once all DMAs are enqueued.  The writes are complete when
+ *  the stream is synchronized, or an event recorded after the call completes.  If fd was opened with O_DIRECT,
+ *  offset and sizeBytes must be multiples of 4KB.
+ *
+ *  A write which fails after the call has returned is reported, once, by the first of: the next
+ *  hipMemcpyToFileAsync or hipMemcpyFromFileAsync on the same stream, hipStreamSynchronize or hipStreamQuery on
+ *  the stream, or hipEventSynchronize or hipEventQuery on a completed event recorded in the stream.
+ *
+ *  @param[in]  fd File descriptor open for writing
+ *  @param[in]  offset Offset in the file, in bytes
+ *  @param[in]  src Device memory to write
+ *  @param[in]  sizeBytes Number of bytes to write
+ *  @param[in]  stream Stream identifier
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorMemoryAllocation, #hipErrorUnknown (earlier write failed)
+ *
+ *  @see hipMemcpyFromFileAsync
+ */
+#if __cplusplus
+hipError_t hipMemcpyToFileAsync(int fd, int64_t offset, const void* src, size_t sizeBytes, hipStream_t stream=0);
+#else
+hipError_t hipMemcpyToFileAsync(int fd, int64_t offset, const void* src, size_t sizeBytes, hipStream_t stream);
+#endif
+
 /**
  *  @brief Copy data from src to dst asynchronously.
  *
@@ -1772,6 +2201,77 @@ hipError_t hipModuleLaunchKernel(hipFunction_t f,
  */
 
 
+/**
+ *-------------------------------------------------------------------------------------------------
+ *-------------------------------------------------------------------------------------------------
+ *  @defgroup Occupancy Occupancy
+ *  @{
+ *
+ *  Occupancy is computed from the kernel's register and LDS usage, recorded in its code object, and the
+ *  limits of the current device.
+ *
+ *  Kernels launched with hipLaunchKernel are identified by name: use the hipOccupancyMaxActiveBlocksPerMultiprocessor
+ *  and hipOccupancyMaxPotentialBlockSize macros from hip_runtime.h.  They take the same arguments as the CUDA
+ *  functions, and pass the kernel name as it is written at the call site.  All template instantiations of a kernel match, and the most demanding one is reported.
+ */
+
+/**
+ * @brief Returns the number of workgroups of module function @p f which can be active at once on one compute unit.
+ *
+ * @param [out] numBlocks
+ * @param [in] f
+ * @param [in] blockSize            threads per workgroup.
+ * @param [in] dynSharedMemPerBlk   dynamic shared memory bytes per workgroup.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue, hipErrorInvalidContext, hipErrorInvalidDeviceFunction
+ */
+hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, hipFunction_t f, int blockSize,
+                                                              size_t dynSharedMemPerBlk);
+
+/**
+ * @brief Returns the block size which gives the most active threads for module function @p f, and the grid size
+ * which fills the device at that block size.
+ *
+ * @param [out] gridSize
+ * @param [out] blockSize           a multiple of warpSize, or 0 if no block size fits.
+ * @param [in] f
+ * @param [in] dynSharedMemPerBlk   dynamic shared memory bytes per workgroup.
+ * @param [in] blockSizeLimit       largest block size to consider, or 0 for maxThreadsPerBlock.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue, hipErrorInvalidContext, hipErrorInvalidDeviceFunction
+ */
+hipError_t hipModuleOccupancyMaxPotentialBlockSize(int *gridSize, int *blockSize, hipFunction_t f,
+                                                   size_t dynSharedMemPerBlk, int blockSizeLimit);
+
+/**
+ * @brief hipModuleOccupancyMaxActiveBlocksPerMultiprocessor for the hipLaunchKernel kernel @p kernelName.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue, hipErrorInvalidContext, hipErrorInvalidDeviceFunction,
+ * hipErrorNotSupported if the ROCr does not provide the loader extension used to find the kernel.
+ */
+hipError_t hipHccOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, const char *kernelName, int blockSize,
+                                                           size_t dynSharedMemPerBlk);
+
+/**
+ * @brief hipModuleOccupancyMaxPotentialBlockSize for the hipLaunchKernel kernel @p kernelName.
+ *
+ * @returns hipSuccess, hipErrorInvalidValue, hipErrorInvalidContext, hipErrorInvalidDeviceFunction,
+ * hipErrorNotSupported if the ROCr does not provide the loader extension used to find the kernel.
+ */
+#if __cplusplus
+hipError_t hipHccOccupancyMaxPotentialBlockSize(int *gridSize, int *blockSize, const char *kernelName,
+                                                size_t dynSharedMemPerBlk=0, int blockSizeLimit=0);
+#else
+hipError_t hipHccOccupancyMaxPotentialBlockSize(int *gridSize, int *blockSize, const char *kernelName,
+                                                size_t dynSharedMemPerBlk, int blockSizeLimit);
+#endif
+
+// doxygen end Occupancy
+/**
+ * @}
+ */
+
+
 /**
  *-------------------------------------------------------------------------------------------------
  *-------------------------------------------------------------------------------------------------
@@ -1802,10 +2302,39 @@ hipError_t hipProfilerStop();
 
 
 /**
- * @}
+ * Latency statistics for one HIP API, returned by hipApiGetLatency.  Times are in microseconds.
+ */
+typedef struct hipApiLatency_t {
+    uint64_t count;     ///< Number of calls recorded
+    double   totalUs;
+    double   minUs;
+    double   maxUs;
+    double   p50Us;
+    double   p90Us;
+    double   p99Us;
+    double   p999Us;    ///< 99.9th percentile
+} hipApiLatency_t;
+
+
+/**
+ * @brief Return latency statistics for all calls to the named HIP API, from all threads.
+ *
+ * Latencies are recorded when the application is run with HIP_API_LATENCY=1 (or 2, which also prints a
+ * summary to stderr at exit).  Percentiles are read from a log-linear histogram and are accurate to about 6%.
+ * An API which has not been called returns a count of 0.
+ *
+ * @param[in]  apiName - name of the API, for example "hipMemcpyAsync"
+ * @param[out] latency - returned statistics
+ *
+ * @returns #hipSuccess, #hipErrorInvalidValue, #hipErrorProfilerDisabled if HIP_API_LATENCY is not set
+ * @warning This API is HCC-specific.
  */
+hipError_t hipApiGetLatency(const char *apiName, hipApiLatency_t *latency);
 
-//TODO: implement IPC apis
+
+/**
+ * @}
+ */
 
 /**
  * @brief Gets an interprocess memory handle for an existing device memory
@@ -1821,6 +2350,9 @@ hipError_t hipProfilerStop();
  * hipIpcGetMemHandle will return a unique handle for the
  * new memory.
  *
+ * Handles are cached per allocation, so repeated calls return the same handle
+ * until the allocation is freed.
+ *
  * @param handle - Pointer to user allocated hipIpcMemHandle to return
  *                    the handle in.
  * @param devPtr - Base pointer to previously allocated device memory
@@ -1852,6 +2384,10 @@ hipError_t hipIpcGetMemHandle(hipIpcMemHandle_t *handle, void *devPtr);
  * Memory returned from hipIpcOpenMemHandle must be freed with
  * hipIpcCloseMemHandle.
  *
+ * Opening a handle which is already open on the current device returns the
+ * existing mapping and takes another reference to it.  Each open must be
+ * matched by one hipIpcCloseMemHandle.
+ *
  * Calling hipFree on an exported memory region before calling
  * hipIpcCloseMemHandle in the importing context will result in undefined
  * behavior.
@@ -1883,6 +2419,9 @@ hipError_t hipIpcOpenMemHandle(void **devPtr,
  * Any resources used to enable peer access will be freed if this is the
  * last mapping using them.
  *
+ * The memory is unmapped when the last reference taken by hipIpcOpenMemHandle
+ * is closed.
+ *
  * @param devPtr - Device pointer returned by hipIpcOpenMemHandle
  *
  * @returns
@@ -1893,11 +2432,43 @@ hipError_t hipIpcOpenMemHandle(void **devPtr,
  */
 hipError_t hipIpcCloseMemHandle(void *devPtr);
 
+/**
+ * @brief Gets an interprocess handle for a previously allocated event
+ *
+ * Takes as input an event created with the hipEventInterprocess and
+ * hipEventDisableTiming flags, and returns a handle which another process
+ * can open with hipIpcOpenEventHandle.  Both processes see the same HSA
+ * signal, so a stream in one process can wait on work recorded in the
+ * other without a host round trip.
+ *
+ * @param handle - Pointer to a user allocated hipIpcEventHandle to return the handle in.
+ * @param event  - Event allocated with hipEventInterprocess and hipEventDisableTiming.
+ *
+ * @returns
+ * hipSuccess,
+ * hipErrorInvalidResourceHandle,
+ * hipErrorMemoryAllocation
+ *
+ */
+hipError_t hipIpcGetEventHandle(hipIpcEventHandle_t *handle, hipEvent_t event);
 
-// hipError_t hipIpcGetMemHandle(hipIpcMemHandle_t* handle, void* devPtr);
-// hipError_t hipIpcCloseMemHandle(void *devPtr);
-// // hipError_t hipIpcOpenEventHandle(hipEvent_t* event, hipIpcEventHandle_t handle);
-// hipError_t hipIpcOpenMemHandle(void** devPtr, hipIpcMemHandle_t handle, unsigned int flags);
+/**
+ * @brief Opens an interprocess event handle for use in the current process
+ *
+ * Returns an event which can be used with hipEventRecord, hipEventQuery,
+ * hipEventSynchronize and hipStreamWaitEvent.  The event must be freed
+ * with hipEventDestroy.  Timing is not supported on the returned event.
+ *
+ * @param event  - Returns the imported event.
+ * @param handle - Interprocess handle to open.
+ *
+ * @returns
+ * hipSuccess,
+ * hipErrorInvalidValue,
+ * hipErrorMapBufferObjectFailed
+ *
+ */
+hipError_t hipIpcOpenEventHandle(hipEvent_t *event, hipIpcEventHandle_t handle);
 
 
 #ifdef __cplusplus
@@ -32,6 +32,8 @@ THE SOFTWARE.
 
 #include <limits.h>
 
+#include <hip/hcc_detail/host_defines.h>
+
 //#include <hip/hcc_detail/hip_runtime.h>
 
 //----
@@ -57,15 +59,23 @@ typedef struct hipChannelFormatDesc {
 typedef enum hipTextureReadMode
 {
   hipReadModeElementType,  ///< Read texture as specified element type
-//! @warning cudaReadModeNormalizedFloat is not supported.
+  hipReadModeNormalizedFloat,  ///< Read 8- and 16-bit integer textures as float in [0,1] or [-1,1]
 } hipTextureReadMode;
 
 typedef enum hipTextureFilterMode
 {
     hipFilterModePoint,  ///< Point filter mode.
-//! @warning cudaFilterModeLinear is not supported.
+    hipFilterModeLinear,  ///< Bilinear filter mode.  Needs a float texture or hipReadModeNormalizedFloat.
 } hipTextureFilterMode;
 
+typedef enum hipTextureAddressMode
+{
+    hipAddressModeWrap = 0,  ///< Wrap around the edge.
+    hipAddressModeClamp = 1,  ///< Clamp to the edge texel.
+    hipAddressModeMirror = 2,  ///< Mirror at the edge.
+    hipAddressModeBorder = 3,  ///< Return the border color outside the texture.
+} hipTextureAddressMode;
+
 struct textureReference {
     hipTextureFilterMode filterMode;
     bool                 normalized;
@@ -84,19 +94,387 @@ struct texture : public textureReference {
 };
 #endif
 
+//! Flags for hipMallocArray and hipMalloc3DArray.  hipArrayTiled and hipArrayMorton are HIP extensions which
+//! select the storage order of 2D and layered arrays; the default is row-major.  3D arrays are always stored in
+//! bricks.
+#define hipArrayDefault             0x0
+#define hipArrayLayered             0x1     ///< hipMalloc3DArray: depth is the number of 2D layers.
+#define hipArrayTiled               0x100   ///< Store the array in 8x8 tiles.
+#define hipArrayMorton              0x200   ///< Store the array in 32x32 tiles, each in Morton (Z) order.
+
+//! Storage order of a hipArray.
+typedef enum hipArrayLayout {
+    hipArrayLayoutLinear = 0,  ///< Row-major.
+    hipArrayLayoutTiled,       ///< Row-major tiles of HIP_ARRAY_TILE_DIM^2 elements, row-major inside each tile.
+    hipArrayLayoutMorton,      ///< Row-major tiles of HIP_ARRAY_MORTON_DIM^2 elements, Morton order inside each tile.
+    hipArrayLayoutBrick,       ///< 3D arrays: row-major bricks of HIP_ARRAY_BRICK_DIM^3 elements, Morton order inside each brick.
+} hipArrayLayout;
+
+#define HIP_ARRAY_TILE_DIM      8
+#define HIP_ARRAY_MORTON_DIM    32
+#define HIP_ARRAY_BRICK_DIM     8
+
 typedef struct {
   unsigned int width;
   unsigned int height;
   hipChannelFormatKind f;
   void* data; //FIXME: generalize this
+  hipChannelFormatDesc desc;
+  unsigned int flags;
+  hipArrayLayout layout;
+  unsigned int stride;       ///< Elements between rows.  For tiled layouts, width rounded up to whole tiles.
+  unsigned int elementSize;  ///< Bytes per element.
+  unsigned int depth;        ///< 0 for 1D and 2D arrays.  For layered arrays, the number of layers.
 } hipArray;
 
+typedef struct hipExtent {
+    size_t width;   ///< Elements for arrays, bytes for linear memory.
+    size_t height;
+    size_t depth;
+} hipExtent;
+
+typedef struct hipPos {
+    size_t x;       ///< Elements for arrays, bytes for linear memory.
+    size_t y;
+    size_t z;
+} hipPos;
+
+typedef struct hipPitchedPtr {
+    void*  ptr;
+    size_t pitch;   ///< Bytes per row.
+    size_t xsize;   ///< Width in bytes.
+    size_t ysize;   ///< Rows per slice.
+} hipPitchedPtr;
+
+typedef struct hipMemcpy3DParms {
+    hipArray*     srcArray;
+    hipPos        srcPos;
+    hipPitchedPtr srcPtr;
+    hipArray*     dstArray;
+    hipPos        dstPos;
+    hipPitchedPtr dstPtr;
+    hipExtent     extent;
+    hipMemcpyKind kind;
+} hipMemcpy3DParms;
+
+static inline hipExtent make_hipExtent(size_t w, size_t h, size_t d)
+{
+    hipExtent e = {w, h, d};
+    return e;
+}
+
+static inline hipPos make_hipPos(size_t x, size_t y, size_t z)
+{
+    hipPos p = {x, y, z};
+    return p;
+}
+
+static inline hipPitchedPtr make_hipPitchedPtr(void* d, size_t p, size_t xsz, size_t ysz)
+{
+    hipPitchedPtr s = {d, p, xsz, ysz};
+    return s;
+}
+
 
 #define tex1Dfetch(_tex, _addr) (_tex._dataPtr[_addr])
 
 #define tex2D(_tex, _dx, _dy) \
   _tex._dataPtr[(unsigned int)_dx + (unsigned int)_dy*(_tex.width)]
 
+//----
+// Texture objects.
+typedef enum hipResourceType {
+    hipResourceTypeArray = 0,
+    hipResourceTypeMipmappedArray = 1,  ///< Not supported.
+    hipResourceTypeLinear = 2,
+    hipResourceTypePitch2D = 3,
+} hipResourceType;
+
+typedef struct hipResourceDesc {
+    hipResourceType resType;
+    union {
+        struct {
+            hipArray* array;
+        } array;
+        struct {
+            void* devPtr;
+            hipChannelFormatDesc desc;
+            size_t sizeInBytes;
+        } linear;
+        struct {
+            void* devPtr;
+            hipChannelFormatDesc desc;
+            size_t width;
+            size_t height;
+            size_t pitchInBytes;
+        } pitch2D;
+    } res;
+} hipResourceDesc;
+
+typedef struct hipTextureDesc {
+    hipTextureAddressMode addressMode[3];
+    hipTextureFilterMode  filterMode;
+    hipTextureReadMode    readMode;
+    int                   sRGB;            ///< Must be 0.
+    float                 borderColor[4];  ///< Only borderColor[0] is used.
+    int                   normalizedCoords;
+} hipTextureDesc;
+
+//! Not supported; hipCreateTextureObject must be passed NULL.
+typedef struct hipResourceViewDesc {
+    hipChannelFormatKind format;
+    size_t width;
+    size_t height;
+    size_t depth;
+} hipResourceViewDesc;
+
+/**
+ * Descriptor which kernels read to sample a texture object.  hipCreateTextureObject builds it from the resource
+ * and texture descriptors and copies it to device memory; hipTextureObject_t points at that copy.
+ */
+struct __hip_texture {
+    const void*           data;
+    unsigned int          width;
+    unsigned int          height;
+    unsigned int          depth;        // 1 for 2D textures
+    unsigned int          stride;       // elements between rows, see hipArray::stride
+    hipArrayLayout        layout;
+    unsigned int          elementBits;  // 8, 16 or 32
+    hipChannelFormatKind  kind;
+    hipTextureAddressMode addressMode[3];
+    hipTextureFilterMode  filterMode;
+    hipTextureReadMode    readMode;
+    int                   normalizedCoords;
+    float                 borderColor;
+};
+
+typedef struct __hip_texture* hipTextureObject_t;
+
+#if __cplusplus
+//---
+// Sampling.  Shared by the device functions below and by the CPU reference sampler, so both give the same result.
+
+// Element offset of (x,y) in an array with the given layout.
+__host__ __device__ inline size_t __hipArrayOffset(hipArrayLayout layout, unsigned int stride, unsigned int x, unsigned int y)
+{
+    if (layout == hipArrayLayoutTiled) {
+        const unsigned int T = HIP_ARRAY_TILE_DIM;
+        return ((size_t)(y / T) * (stride / T) + x / T) * (T * T) + (y % T) * T + (x % T);
+    } else if (layout == hipArrayLayoutMorton) {
+        const unsigned int M = HIP_ARRAY_MORTON_DIM;
+        // Spread the bits of the in-tile coordinates to the even bit positions and interleave them.
+        unsigned int mx = x % M, my = y % M;
+        mx = (mx | (mx << 4)) & 0x0f0f; mx = (mx | (mx << 2)) & 0x3333; mx = (mx | (mx << 1)) & 0x5555;
+        my = (my | (my << 4)) & 0x0f0f; my = (my | (my << 2)) & 0x3333; my = (my | (my << 1)) & 0x5555;
+        return ((size_t)(y / M) * (stride / M) + x / M) * (M * M) + (mx | (my << 1));
+    } else {
+        return (size_t)y * stride + x;
+    }
+}
+
+// Elements in one slice (or layer) of an array, including the padding of partial tiles.
+__host__ __device__ inline size_t __hipArraySliceElements(hipArrayLayout layout, unsigned int stride, unsigned int height)
+{
+    const unsigned int T = (layout == hipArrayLayoutTiled)  ? HIP_ARRAY_TILE_DIM :
+                           (layout == hipArrayLayoutMorton) ? HIP_ARRAY_MORTON_DIM :
+                           (layout == hipArrayLayoutBrick)  ? HIP_ARRAY_BRICK_DIM : 1;
+    const size_t rows = height ? height : 1;
+    return (size_t)stride * ((rows + T - 1) / T * T);
+}
+
+// Element offset of (x,y,z) in an array with the given layout.  For 2D layouts z selects the slice.
+__host__ __device__ inline size_t __hipArrayOffset3D(hipArrayLayout layout, unsigned int stride, unsigned int height,
+                                                     unsigned int x, unsigned int y, unsigned int z)
+{
+    if (layout == hipArrayLayoutBrick) {
+        const unsigned int B = HIP_ARRAY_BRICK_DIM;
+        const size_t brick = ((size_t)(z / B) * ((height + B - 1) / B) + y / B) * (stride / B) + x / B;
+        const unsigned int bx = x % B, by = y % B, bz = z % B;
+        // Interleave the 3 bits of each in-brick coordinate.
+        const unsigned int m = ((bx & 1)     ) | ((by & 1) << 1) | ((bz & 1) << 2) |
+                               ((bx & 2) << 2) | ((by & 2) << 3) | ((bz & 2) << 4) |
+                               ((bx & 4) << 4) | ((by & 4) << 5) | ((bz & 4) << 6);
+        return brick * (B * B * B) + m;
+    }
+    return z * __hipArraySliceElements(layout, stride, height) + __hipArrayOffset(layout, stride, x, y);
+}
+
+__host__ __device__ inline int __hipTexFloor(float x)
+{
+    int i = (int)x;
+    return (x < (float)i) ? i - 1 : i;
+}
+
+// Applies the address mode to texel index i.  Returns -1 if the texel is outside and the mode is border.
+__host__ __device__ inline int __hipTexAddress(int i, unsigned int n, hipTextureAddressMode mode)
+{
+    if ((i >= 0) && (i < (int)n)) {
+        return i;
+    }
+    switch (mode) {
+        case hipAddressModeWrap:
+            i %= (int)n;
+            return (i < 0) ? i + (int)n : i;
+        case hipAddressModeMirror:
+            i %= (int)(2*n);
+            if (i < 0) {
+                i += 2*n;
+            }
+            return (i < (int)n) ? i : (int)(2*n) - 1 - i;
+        case hipAddressModeBorder:
+            return -1;
+        default:
+            return (i < 0) ? 0 : (int)n - 1;
+    }
+}
+
+// Reads the element at offset off as float, normalizing 8- and 16-bit integers if the read mode asks for it.
+__host__ __device__ inline float __hipTexFetchFloat(const __hip_texture &t, size_t off)
+{
+    const bool norm = (t.readMode == hipReadModeNormalizedFloat);
+    const bool sign = (t.kind == hipChannelFormatKindSigned);
+    float v;
+    switch (t.elementBits) {
+        case 8:
+            if (sign) {
+                v = ((const signed char*)t.data)[off];
+                return norm ? ((v < -127.0f) ? -1.0f : v / 127.0f) : v;
+            }
+            v = ((const unsigned char*)t.data)[off];
+            return norm ? v / 255.0f : v;
+        case 16:
+            if (sign) {
+                v = ((const short*)t.data)[off];
+                return norm ? ((v < -32767.0f) ? -1.0f : v / 32767.0f) : v;
+            }
+            v = ((const unsigned short*)t.data)[off];
+            return norm ? v / 65535.0f : v;
+        default:
+            if (t.kind == hipChannelFormatKindFloat) {
+                return ((const float*)t.data)[off];
+            }
+            return sign ? (float)((const int*)t.data)[off] : (float)((const unsigned int*)t.data)[off];
+    }
+}
+
+// Offset of texel (i,j,k) after the address modes, or -1 if it is in the border.
+__host__ __device__ inline long long __hipTexTexelOffset(const __hip_texture &t, int i, int j, int k)
+{
+    i = __hipTexAddress(i, t.width, t.addressMode[0]);
+    j = __hipTexAddress(j, t.height, t.addressMode[1]);
+    k = __hipTexAddress(k, t.depth, t.addressMode[2]);
+    if ((i < 0) || (j < 0) || (k < 0)) {
+        return -1;
+    }
+    return (long long)__hipArrayOffset3D(t.layout, t.stride, t.height, i, j, k);
+}
+
+__host__ __device__ inline float __hipTexTexelFloat(const __hip_texture &t, int i, int j, int k)
+{
+    const long long off = __hipTexTexelOffset(t, i, j, k);
+    return (off < 0) ? t.borderColor : __hipTexFetchFloat(t, off);
+}
+
+template <typename T>
+__host__ __device__ inline T __hipTexPoint(const __hip_texture &t, int i, int j, int k)
+{
+    const long long off = __hipTexTexelOffset(t, i, j, k);
+    if (off < 0) {
+        return (T)t.borderColor;
+    }
+    if (t.readMode == hipReadModeNormalizedFloat) {
+        return (T)__hipTexFetchFloat(t, off);
+    }
+    return ((const T*)t.data)[off];
+}
+
+// Samples slice or layer k of a 2D, layered or 3D texture.
+template <typename T>
+__host__ __device__ inline T __hipTexSample2D(const __hip_texture &t, float x, float y, int k = 0)
+{
+    if (t.normalizedCoords) {
+        x *= t.width;
+        y *= t.height;
+    }
+
+    if (t.filterMode == hipFilterModeLinear) {
+        const float xb = x - 0.5f;
+        const float yb = y - 0.5f;
+        const int i = __hipTexFloor(xb);
+        const int j = __hipTexFloor(yb);
+        const float a = xb - i;
+        const float b = yb - j;
+        return (T)((1.0f - a) * (1.0f - b) * __hipTexTexelFloat(t, i,   j,   k) +
+                   a          * (1.0f - b) * __hipTexTexelFloat(t, i+1, j,   k) +
+                   (1.0f - a) * b          * __hipTexTexelFloat(t, i,   j+1, k) +
+                   a          * b          * __hipTexTexelFloat(t, i+1, j+1, k));
+    }
+
+    return __hipTexPoint<T>(t, __hipTexFloor(x), __hipTexFloor(y), k);
+}
+
+template <typename T>
+__host__ __device__ inline T __hipTexSample3D(const __hip_texture &t, float x, float y, float z)
+{
+    if (t.normalizedCoords) {
+        x *= t.width;
+        y *= t.height;
+        z *= t.depth;
+    }
+
+    if (t.filterMode == hipFilterModeLinear) {
+        const float zb = z - 0.5f;
+        const int k = __hipTexFloor(zb);
+        const float c = zb - k;
+        // Filter in x and y on the two slices; the coordinates are already unnormalized.
+        __hip_texture s = t;
+        s.normalizedCoords = 0;
+        return (T)((1.0f - c) * __hipTexSample2D<float>(s, x, y, k) + c * __hipTexSample2D<float>(s, x, y, k+1));
+    }
+
+    return __hipTexPoint<T>(t, __hipTexFloor(x), __hipTexFloor(y), __hipTexFloor(z));
+}
+
+//---
+// Device functions.  The names are parenthesized so the texture reference macros above do not expand.
+template <typename T>
+__device__ inline T (tex1Dfetch)(hipTextureObject_t texObject, int x)
+{
+    const __hip_texture &t = *texObject;
+    if ((x < 0) || ((unsigned int)x >= t.width)) {
+        return (T)0;
+    }
+    if (t.readMode == hipReadModeNormalizedFloat) {
+        return (T)__hipTexFetchFloat(t, x);
+    }
+    return ((const T*)t.data)[x];
+}
+
+template <typename T>
+__device__ inline T tex1D(hipTextureObject_t texObject, float x)
+{
+    return __hipTexSample2D<T>(*texObject, x, 0.5f);
+}
+
+template <typename T>
+__device__ inline T (tex2D)(hipTextureObject_t texObject, float x, float y)
+{
+    return __hipTexSample2D<T>(*texObject, x, y);
+}
+
+template <typename T>
+__device__ inline T tex2DLayered(hipTextureObject_t texObject, float x, float y, int layer)
+{
+    return __hipTexSample2D<T>(*texObject, x, y, layer);
+}
+
+template <typename T>
+__device__ inline T tex3D(hipTextureObject_t texObject, float x, float y, float z)
+{
+    return __hipTexSample3D<T>(*texObject, x, y, z);
+}
+#endif
+
 /**
  *  @brief Allocate an array on the device.
  *
@@ -158,13 +536,15 @@ hipError_t hipMemcpy2DToArray(hipArray* dst, size_t wOffset, size_t hOffset, con
 /**
  *  @brief Copies data between host and device.
  *
- *  @param[in]   dst    Destination memory address
- *  @param[in]   dpitch Pitch of destination memory
- *  @param[in]   src    Source memory address
- *  @param[in]   spitch Pitch of source memory
- *  @param[in]   width  Width of matrix transfer (columns in bytes)
- *  @param[in]   height Height of matrix transfer (rows)
- *  @param[in]   kind   Type of transfer
+ *  Copies @p count bytes to the array, starting at column @p wOffset of row @p hOffset and continuing on
+ *  the following rows.
+ *
+ *  @param[in]   dst     Destination array
+ *  @param[in]   wOffset Destination column, in bytes
+ *  @param[in]   hOffset Destination row
+ *  @param[in]   src     Source memory address
+ *  @param[in]   count   Size in bytes
+ *  @param[in]   kind    Type of transfer
  *  @return      #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidPitchValue, #hipErrorInvalidDevicePointer, #hipErrorInvalidMemcpyDirection
  *
  *  @see hipMemcpy, hipMemcpy2DToArray, hipMemcpy2D, hipMemcpyFromArray, hipMemcpyToSymbol, hipMemcpyAsync
@@ -172,6 +552,50 @@ hipError_t hipMemcpy2DToArray(hipArray* dst, size_t wOffset, size_t hOffset, con
 hipError_t hipMemcpyToArray(hipArray* dst, size_t wOffset, size_t hOffset,
                             const void* src, size_t count, hipMemcpyKind kind);
 
+/**
+ *  @brief Allocate a 3D or layered array on the device.
+ *
+ *  3D arrays are stored in bricks of HIP_ARRAY_BRICK_DIM^3 elements so that neighbors in all three dimensions
+ *  share cache lines.  Layered arrays (#hipArrayLayered) are a stack of 2D layers, each stored in the layout
+ *  selected by #hipArrayTiled or #hipArrayMorton.  A depth of 0 allocates a 2D array like hipMallocArray.
+ *
+ *  @param[out]  array  Pointer to allocated array in device memory
+ *  @param[in]   desc   Requested channel format
+ *  @param[in]   extent Requested width, height and depth (or layer count), in elements
+ *  @param[in]   flags  hipArrayDefault, hipArrayLayered, hipArrayTiled, hipArrayMorton
+ *  @return      #hipSuccess, #hipErrorInvalidValue, #hipErrorMemoryAllocation
+ *
+ *  @see hipMallocArray, hipFreeArray, hipMemcpy3D
+ */
+hipError_t hipMalloc3DArray(hipArray** array, const hipChannelFormatDesc* desc, hipExtent extent,
+                            unsigned int flags = 0);
+
+/**
+ *  @brief Allocate pitched linear memory for a volume.
+ *
+ *  @param[out]  pitchedDevPtr  Pointer and pitch of the allocation
+ *  @param[in]   extent         Width in bytes, height and depth
+ *  @return      #hipSuccess, #hipErrorInvalidValue, #hipErrorMemoryAllocation
+ *
+ *  @see hipMallocPitch, hipMemcpy3D
+ */
+hipError_t hipMalloc3D(hipPitchedPtr* pitchedDevPtr, hipExtent extent);
+
+/**
+ *  @brief Copies a box between arrays and pitched memory.
+ *
+ *  Either side may be an array or pitched memory on the host or the device.  Copies between device-side
+ *  resources run as a single kernel.  Copies from the host to an array rewrite the array layout on the host and
+ *  transfer it in one copy when the box covers the whole array; otherwise the host data is packed, copied to a
+ *  scratch buffer and scattered by a kernel.  The call returns when the copy is complete.
+ *
+ *  @param[in]  p  Copy parameters.  Positions and widths are in elements for arrays and in bytes for pitched memory.
+ *  @return     #hipSuccess, #hipErrorInvalidValue, #hipErrorMemoryAllocation
+ *
+ *  @see hipMalloc3DArray, hipMalloc3D, hipMemcpy2DToArray
+ */
+hipError_t hipMemcpy3D(const hipMemcpy3DParms* p);
+
 
 /**
  *  @addtogroup API HIP API
@@ -189,7 +613,9 @@ hipError_t hipMemcpyToArray(hipArray* dst, size_t wOffset, size_t hOffset,
  *
  *
  *  @warning The HIP texture API implements a small subset of full texture API.  Known limitations include:
- *  - Only point sampling is supported.
+ *  - Texture references (texture<T>) only support point sampling of row-major arrays.
+ *  - Texture objects support single-channel 8-, 16- and 32-bit formats only.
+ *  - Sampling is done by the shader, not by the texture unit.
  *  - Only C++ APIs are provided.
  *  - Many APIs and modes are not implemented.
  *
@@ -249,6 +675,126 @@ template <> inline hipChannelFormatDesc hipCreateChannelDesc<float>() {
   int e = (int)sizeof(float) * 8;
   return hipCreateChannelDesc(e, 0, 0, 0, hipChannelFormatKindFloat);
 }
+template <> inline hipChannelFormatDesc hipCreateChannelDesc<char>() {
+  int e = (int)sizeof(char) * 8;
+  return hipCreateChannelDesc(e, 0, 0, 0, hipChannelFormatKindSigned);
+}
+template <> inline hipChannelFormatDesc hipCreateChannelDesc<signed char>() {
+  int e = (int)sizeof(signed char) * 8;
+  return hipCreateChannelDesc(e, 0, 0, 0, hipChannelFormatKindSigned);
+}
+template <> inline hipChannelFormatDesc hipCreateChannelDesc<unsigned char>() {
+  int e = (int)sizeof(unsigned char) * 8;
+  return hipCreateChannelDesc(e, 0, 0, 0, hipChannelFormatKindUnsigned);
+}
+template <> inline hipChannelFormatDesc hipCreateChannelDesc<short>() {
+  int e = (int)sizeof(short) * 8;
+  return hipCreateChannelDesc(e, 0, 0, 0, hipChannelFormatKindSigned);
+}
+template <> inline hipChannelFormatDesc hipCreateChannelDesc<unsigned short>() {
+  int e = (int)sizeof(unsigned short) * 8;
+  return hipCreateChannelDesc(e, 0, 0, 0, hipChannelFormatKindUnsigned);
+}
+
+/**
+ *  @brief Creates a texture object.
+ *
+ *  Arrays, linear memory and pitched 2D memory can be sampled.  Arrays allocated with hipArrayTiled or
+ *  hipArrayMorton keep neighboring texels in the same cache lines, which helps kernels with 2D-local access
+ *  patterns.  Linear filtering needs a float texture or hipReadModeNormalizedFloat.
+ *
+ *  @param[out]  pTexObject   Texture object to create
+ *  @param[in]   pResDesc     Resource to sample
+ *  @param[in]   pTexDesc     Sampling parameters
+ *  @param[in]   pResViewDesc Must be NULL
+ *  @return      #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported, #hipErrorMemoryAllocation
+ *
+ *  @see hipDestroyTextureObject, hipGetTextureObjectResourceDesc, hipGetTextureObjectTextureDesc
+ */
+hipError_t hipCreateTextureObject(hipTextureObject_t* pTexObject, const hipResourceDesc* pResDesc,
+                                  const hipTextureDesc* pTexDesc, const hipResourceViewDesc* pResViewDesc);
+
+/**
+ *  @brief Destroys a texture object.  Waits for outstanding work on the device first.
+ *
+ *  @param[in]  texObject  Texture object to destroy
+ *  @return     #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipDestroyTextureObject(hipTextureObject_t texObject);
+
+/**
+ *  @brief Returns the resource descriptor a texture object was created with.
+ *
+ *  @param[out]  pResDesc   Resource descriptor
+ *  @param[in]   texObject  Texture object
+ *  @return      #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipGetTextureObjectResourceDesc(hipResourceDesc* pResDesc, hipTextureObject_t texObject);
+
+/**
+ *  @brief Returns the texture descriptor a texture object was created with.
+ *
+ *  @param[out]  pTexDesc   Texture descriptor
+ *  @param[in]   texObject  Texture object
+ *  @return      #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipGetTextureObjectTextureDesc(hipTextureDesc* pTexDesc, hipTextureObject_t texObject);
+
+// Describes row-major host data as a texture, for the CPU reference samplers.
+template <typename E>
+inline __hip_texture __hipTexReference(const hipTextureDesc &texDesc, const E *data, unsigned int width,
+                                       unsigned int height, unsigned int depth)
+{
+    hipChannelFormatDesc desc = hipCreateChannelDesc<E>();
+    __hip_texture t;
+    t.data = data;
+    t.width = width;
+    t.height = height;
+    t.depth = depth;
+    t.stride = width;
+    t.layout = hipArrayLayoutLinear;
+    t.elementBits = desc.x;
+    t.kind = desc.f;
+    t.addressMode[0] = texDesc.addressMode[0];
+    t.addressMode[1] = texDesc.addressMode[1];
+    t.addressMode[2] = texDesc.addressMode[2];
+    t.filterMode = texDesc.filterMode;
+    t.readMode = texDesc.readMode;
+    t.normalizedCoords = texDesc.normalizedCoords;
+    t.borderColor = texDesc.borderColor[0];
+    return t;
+}
+
+/**
+ *  @brief CPU reference sampler for testing.
+ *
+ *  Samples row-major host data of element type E the way tex2D<T> samples a texture object created with
+ *  @p texDesc, using the same code as the device.  The result does not depend on the array layout.
+ *
+ *  @param[in]  texDesc  Sampling parameters
+ *  @param[in]  data     Row-major host data, width*height elements
+ *  @param[in]  width    Width in elements
+ *  @param[in]  height   Height in elements; 1 for 1D textures
+ *  @param[in]  x, y     Texture coordinates
+ */
+template <typename T, typename E>
+inline T hipTexSampleReference2D(const hipTextureDesc &texDesc, const E *data, unsigned int width,
+                                 unsigned int height, float x, float y)
+{
+    return __hipTexSample2D<T>(__hipTexReference(texDesc, data, width, height, 1), x, y);
+}
+
+/**
+ *  @brief CPU reference sampler for tex3D; see hipTexSampleReference2D.
+ *
+ *  @param[in]  data     Row-major host data, width*height*depth elements
+ */
+template <typename T, typename E>
+inline T hipTexSampleReference3D(const hipTextureDesc &texDesc, const E *data, unsigned int width,
+                                 unsigned int height, unsigned int depth, float x, float y, float z)
+{
+    return __hipTexSample3D<T>(__hipTexReference(texDesc, data, width, height, depth), x, y, z);
+}
 
 /*
  * @brief hipBindTexture Binds size bytes of the memory area pointed to by @p devPtr to the texture reference tex.
@@ -298,6 +844,9 @@ hipError_t  hipBindTexture(size_t *offset,
 
 template <class T, int dim, enum hipTextureReadMode readMode>
 hipError_t hipBindTextureToArray(struct texture<T, dim, readMode> &tex, hipArray* array) {
+  if (array->layout != hipArrayLayoutLinear) {
+    return hipErrorInvalidValue; // texture references index the array row-major; use a texture object.
+  }
   tex.width = array->width;
   tex.height = array->height;
   tex._dataPtr = static_cast<const T*>(array->data);
@@ -185,6 +185,7 @@ typedef enum hipError_t {
     hipErrorNotFound                = 500,
     hipErrorIllegalAddress          = 700,
     hipErrorInvalidSymbol           = 701,
+    hipErrorNotSupported            = 801,    ///< The operation is not supported by this device or runtime.
 // Runtime Error Codes start here.
     hipErrorMissingConfiguration    = 1001,
     hipErrorMemoryAllocation        = 1002,    ///< Memory allocation error.
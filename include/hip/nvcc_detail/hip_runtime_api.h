@@ -25,6 +25,8 @@ THE SOFTWARE.
 #include <cuda_runtime_api.h>
 #include <cuda.h>
 #include <cuda_profiler_api.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,6 +53,21 @@ hipMemcpyHostToHost
 //! @warning cudaFilterModeLinear is not supported.
 } hipTextureFilterMode;*/
 #define hipFilterModePoint cudaFilterModePoint
+#define hipFilterModeLinear cudaFilterModeLinear
+#define hipReadModeNormalizedFloat cudaReadModeNormalizedFloat
+#define hipAddressModeWrap cudaAddressModeWrap
+#define hipAddressModeClamp cudaAddressModeClamp
+#define hipAddressModeMirror cudaAddressModeMirror
+#define hipAddressModeBorder cudaAddressModeBorder
+#define hipResourceTypeArray cudaResourceTypeArray
+#define hipResourceTypeMipmappedArray cudaResourceTypeMipmappedArray
+#define hipResourceTypeLinear cudaResourceTypeLinear
+#define hipResourceTypePitch2D cudaResourceTypePitch2D
+
+#define hipArrayDefault cudaArrayDefault
+#define hipArrayLayered cudaArrayLayered
+#define hipArrayTiled 0x0 // no CUDA equivalent - ignored.
+#define hipArrayMorton 0x0 // no CUDA equivalent - ignored.
 
 //! Flags that can be used with hipEventCreateWithFlags:
 #define hipEventDefault             cudaEventDefault
@@ -62,6 +79,26 @@ hipMemcpyHostToHost
 #define hipHostMallocPortable cudaHostAllocPortable
 #define hipHostMallocMapped cudaHostAllocMapped
 #define hipHostMallocWriteCombined cudaHostAllocWriteCombined
+#define hipHostMallocHugePages 0x0 // no CUDA equivalent - ignored.
+
+#define hipMemAttachGlobal cudaMemAttachGlobal
+#define hipMemAttachHost cudaMemAttachHost
+#define hipCpuDeviceId cudaCpuDeviceId
+#define hipInvalidDeviceId cudaInvalidDeviceId
+
+typedef cudaMemoryAdvise hipMemoryAdvise;
+#define hipMemAdviseSetReadMostly cudaMemAdviseSetReadMostly
+#define hipMemAdviseUnsetReadMostly cudaMemAdviseUnsetReadMostly
+#define hipMemAdviseSetPreferredLocation cudaMemAdviseSetPreferredLocation
+#define hipMemAdviseUnsetPreferredLocation cudaMemAdviseUnsetPreferredLocation
+#define hipMemAdviseSetAccessedBy cudaMemAdviseSetAccessedBy
+#define hipMemAdviseUnsetAccessedBy cudaMemAdviseUnsetAccessedBy
+
+typedef cudaMemRangeAttribute hipMemRangeAttribute;
+#define hipMemRangeAttributeReadMostly cudaMemRangeAttributeReadMostly
+#define hipMemRangeAttributePreferredLocation cudaMemRangeAttributePreferredLocation
+#define hipMemRangeAttributeAccessedBy cudaMemRangeAttributeAccessedBy
+#define hipMemRangeAttributeLastPrefetchLocation cudaMemRangeAttributeLastPrefetchLocation
 
 #define hipHostRegisterPortable cudaHostRegisterPortable
 #define hipHostRegisterMapped cudaHostRegisterMapped
@@ -85,6 +122,14 @@ typedef CUdevice hipDevice_t;
 typedef CUmodule hipModule_t;
 typedef CUfunction hipFunction_t;
 typedef CUdeviceptr hipDeviceptr_t;
+typedef cudaTextureObject_t hipTextureObject_t;
+typedef cudaResourceDesc hipResourceDesc;
+typedef cudaTextureDesc hipTextureDesc;
+typedef cudaResourceViewDesc hipResourceViewDesc;
+typedef cudaArray hipArray;
+typedef cudaExtent hipExtent;
+typedef cudaPos hipPos;
+typedef cudaPitchedPtr hipPitchedPtr;
 
 // Flags that can be used with hipStreamCreateWithFlags
 #define hipStreamDefault            cudaStreamDefault
@@ -112,6 +157,7 @@ switch(cuError) {
     case cudaErrorHostMemoryAlreadyRegistered    : return hipErrorHostMemoryAlreadyRegistered ;
     case cudaErrorHostMemoryNotRegistered        : return hipErrorHostMemoryNotRegistered     ;
     case cudaErrorUnsupportedLimit               : return hipErrorUnsupportedLimit            ;
+    case cudaErrorNotSupported                   : return hipErrorNotSupported                ;
     default                                      : return hipErrorUnknown;  // Note - translated error.
 }
 }
@@ -197,6 +243,68 @@ inline static hipError_t hipMalloc(void** ptr, size_t size) {
     return hipCUDAErrorTohipError(cudaMalloc(ptr, size));
 }
 
+inline static hipError_t hipMallocManaged(void** devPtr, size_t size, unsigned int flags = hipMemAttachGlobal) {
+    return hipCUDAErrorTohipError(cudaMallocManaged(devPtr, size, flags));
+}
+
+inline static hipError_t hipMemPrefetchAsync(const void* devPtr, size_t count, int device, hipStream_t stream = 0) {
+    return hipCUDAErrorTohipError(cudaMemPrefetchAsync(devPtr, count, device, stream));
+}
+
+inline static hipError_t hipMemAdvise(const void* devPtr, size_t count, hipMemoryAdvise advice, int device) {
+    return hipCUDAErrorTohipError(cudaMemAdvise(devPtr, count, advice, device));
+}
+
+inline static hipError_t hipMemRangeGetAttribute(void* data, size_t dataSize, hipMemRangeAttribute attribute, const void* devPtr, size_t count) {
+    return hipCUDAErrorTohipError(cudaMemRangeGetAttribute(data, dataSize, attribute, devPtr, count));
+}
+
+#if CUDA_VERSION >= 10020
+typedef CUmemGenericAllocationHandle hipMemGenericAllocationHandle_t;
+typedef CUmemAllocationProp hipMemAllocationProp;
+typedef CUmemAccessDesc hipMemAccessDesc;
+typedef CUmemAllocationGranularity_flags hipMemAllocationGranularity_flags;
+#define hipMemAllocationTypePinned CU_MEM_ALLOCATION_TYPE_PINNED
+#define hipMemLocationTypeDevice CU_MEM_LOCATION_TYPE_DEVICE
+#define hipMemAccessFlagsProtNone CU_MEM_ACCESS_FLAGS_PROT_NONE
+#define hipMemAccessFlagsProtRead CU_MEM_ACCESS_FLAGS_PROT_READ
+#define hipMemAccessFlagsProtReadWrite CU_MEM_ACCESS_FLAGS_PROT_READWRITE
+#define hipMemAllocationGranularityMinimum CU_MEM_ALLOC_GRANULARITY_MINIMUM
+#define hipMemAllocationGranularityRecommended CU_MEM_ALLOC_GRANULARITY_RECOMMENDED
+
+inline static hipError_t hipMemGetAllocationGranularity(size_t* granularity, const hipMemAllocationProp* prop, hipMemAllocationGranularity_flags option) {
+    return hipCUResultTohipError(cuMemGetAllocationGranularity(granularity, prop, option));
+}
+
+inline static hipError_t hipMemAddressReserve(void** ptr, size_t size, size_t alignment, void* addr, unsigned long long flags) {
+    return hipCUResultTohipError(cuMemAddressReserve((CUdeviceptr*)ptr, size, alignment, (CUdeviceptr)addr, flags));
+}
+
+inline static hipError_t hipMemAddressFree(void* ptr, size_t size) {
+    return hipCUResultTohipError(cuMemAddressFree((CUdeviceptr)ptr, size));
+}
+
+inline static hipError_t hipMemCreate(hipMemGenericAllocationHandle_t* handle, size_t size, const hipMemAllocationProp* prop, unsigned long long flags) {
+    return hipCUResultTohipError(cuMemCreate(handle, size, prop, flags));
+}
+
+inline static hipError_t hipMemRelease(hipMemGenericAllocationHandle_t handle) {
+    return hipCUResultTohipError(cuMemRelease(handle));
+}
+
+inline static hipError_t hipMemMap(void* ptr, size_t size, size_t offset, hipMemGenericAllocationHandle_t handle, unsigned long long flags) {
+    return hipCUResultTohipError(cuMemMap((CUdeviceptr)ptr, size, offset, handle, flags));
+}
+
+inline static hipError_t hipMemUnmap(void* ptr, size_t size) {
+    return hipCUResultTohipError(cuMemUnmap((CUdeviceptr)ptr, size));
+}
+
+inline static hipError_t hipMemSetAccess(void* ptr, size_t size, const hipMemAccessDesc* desc, size_t count) {
+    return hipCUResultTohipError(cuMemSetAccess((CUdeviceptr)ptr, size, desc, count));
+}
+#endif
+
 inline static hipError_t hipFree(void* ptr) {
     return hipCUDAErrorTohipError(cudaFree(ptr));
 }
@@ -312,13 +420,142 @@ inline static hipError_t hipMemcpyAsync(void* dst, const void* src, size_t sizeB
   return hipCUDAErrorTohipError(cudaMemcpyAsync(dst, src, sizeBytes, hipMemcpyKindToCudaMemcpyKind(copyKind), stream));
 }
 
+// No batched copy before CUDA 12.8 - issue one cudaMemcpyAsync per range.
+inline static hipError_t hipMemcpyBatchAsync(void* const* dsts, const void* const* srcs, const size_t* sizes, size_t count,
+                                             hipMemcpyKind copyKind, hipStream_t stream=0) {
+  for (size_t i=0; i<count; i++) {
+    cudaError_t e = cudaMemcpyAsync(dsts[i], srcs[i], sizes[i], hipMemcpyKindToCudaMemcpyKind(copyKind), stream);
+    if (e != cudaSuccess) {
+      return hipCUDAErrorTohipError(e);
+    }
+  }
+  return hipSuccess;
+}
+
+inline static hipError_t hipMemcpyGatherScatterAsync(void* dst, const size_t* dstIndices, const void* src, const size_t* srcIndices,
+                                                     size_t elementSize, size_t count, hipMemcpyKind copyKind, hipStream_t stream=0) {
+  for (size_t i=0; i<count; i++) {
+    size_t d = dstIndices ? dstIndices[i] : i;
+    size_t s = srcIndices ? srcIndices[i] : i;
+    cudaError_t e = cudaMemcpyAsync((char*)dst + d*elementSize, (const char*)src + s*elementSize, elementSize,
+                                    hipMemcpyKindToCudaMemcpyKind(copyKind), stream);
+    if (e != cudaSuccess) {
+      return hipCUDAErrorTohipError(e);
+    }
+  }
+  return hipSuccess;
+}
+
+// No stream-ordered file I/O in CUDA - read/write through a temporary host buffer, synchronously.
+inline static hipError_t hipMemcpyFromFileAsync(void* dst, int fd, int64_t offset, size_t sizeBytes, hipStream_t stream=0) {
+  void *tmp = malloc(sizeBytes);
+  if (tmp == NULL) {
+    return hipErrorMemoryAllocation;
+  }
+  hipError_t e = (pread(fd, tmp, sizeBytes, offset) == (ssize_t)sizeBytes) ? hipSuccess : hipErrorInvalidValue;
+  if (e == hipSuccess) {
+    e = hipCUDAErrorTohipError(cudaMemcpy(dst, tmp, sizeBytes, cudaMemcpyHostToDevice));
+  }
+  free(tmp);
+  return e;
+}
+
+inline static hipError_t hipMemcpyToFileAsync(int fd, int64_t offset, const void* src, size_t sizeBytes, hipStream_t stream=0) {
+  void *tmp = malloc(sizeBytes);
+  if (tmp == NULL) {
+    return hipErrorMemoryAllocation;
+  }
+  hipError_t e = hipCUDAErrorTohipError(cudaMemcpy(tmp, src, sizeBytes, cudaMemcpyDeviceToHost));
+  if ((e == hipSuccess) && (pwrite(fd, tmp, sizeBytes, offset) != (ssize_t)sizeBytes)) {
+    e = hipErrorInvalidValue;
+  }
+  free(tmp);
+  return e;
+}
+
 
 inline static hipError_t hipMemcpyToSymbol(const void* symbol, const void* src, size_t sizeBytes, size_t offset = 0, hipMemcpyKind copyType = hipMemcpyHostToDevice) {
 	return hipCUDAErrorTohipError(cudaMemcpyToSymbol(symbol, src, sizeBytes, offset, hipMemcpyKindToCudaMemcpyKind(copyType)));
 }
 
 inline static hipError_t hipMemcpyToSymbolAsync(const void* symbol, const void* src, size_t sizeBytes, size_t offset, hipMemcpyKind copyType, hipStream_t stream) {
-    return hipCUDAErrorTohipError(cudaMemcpyToSymbolAsync(symbol, src, sizeBytes, offset, hipMemcpyKindToCudaMemcpyKind(copyType)));
+    return hipCUDAErrorTohipError(cudaMemcpyToSymbolAsync(symbol, src, sizeBytes, offset, hipMemcpyKindToCudaMemcpyKind(copyType), stream));
+}
+
+inline static hipError_t hipMemcpyFromSymbol(void* dst, const void* symbol, size_t sizeBytes, size_t offset, hipMemcpyKind copyType) {
+    return hipCUDAErrorTohipError(cudaMemcpyFromSymbol(dst, symbol, sizeBytes, offset, hipMemcpyKindToCudaMemcpyKind(copyType)));
+}
+
+inline static hipError_t hipMemcpyFromSymbolAsync(void* dst, const void* symbol, size_t sizeBytes, size_t offset, hipMemcpyKind copyType, hipStream_t stream) {
+    return hipCUDAErrorTohipError(cudaMemcpyFromSymbolAsync(dst, symbol, sizeBytes, offset, hipMemcpyKindToCudaMemcpyKind(copyType), stream));
+}
+
+inline static hipError_t hipGetSymbolAddress(void** devPtr, const void* symbol) {
+    return hipCUDAErrorTohipError(cudaGetSymbolAddress(devPtr, symbol));
+}
+
+inline static hipError_t hipGetSymbolSize(size_t* size, const void* symbol) {
+    return hipCUDAErrorTohipError(cudaGetSymbolSize(size, symbol));
+}
+
+inline static hipExtent make_hipExtent(size_t w, size_t h, size_t d) {
+    return make_cudaExtent(w, h, d);
+}
+
+inline static hipPos make_hipPos(size_t x, size_t y, size_t z) {
+    return make_cudaPos(x, y, z);
+}
+
+inline static hipPitchedPtr make_hipPitchedPtr(void* d, size_t p, size_t xsz, size_t ysz) {
+    return make_cudaPitchedPtr(d, p, xsz, ysz);
+}
+
+inline static hipError_t hipMalloc3DArray(hipArray** array, const hipChannelFormatDesc* desc, hipExtent extent, unsigned int flags = 0) {
+    return hipCUDAErrorTohipError(cudaMalloc3DArray(array, desc, extent, flags));
+}
+
+inline static hipError_t hipMalloc3D(hipPitchedPtr* pitchedDevPtr, hipExtent extent) {
+    return hipCUDAErrorTohipError(cudaMalloc3D(pitchedDevPtr, extent));
+}
+
+typedef struct hipMemcpy3DParms {
+    hipArray*     srcArray;
+    hipPos        srcPos;
+    hipPitchedPtr srcPtr;
+    hipArray*     dstArray;
+    hipPos        dstPos;
+    hipPitchedPtr dstPtr;
+    hipExtent     extent;
+    hipMemcpyKind kind;
+} hipMemcpy3DParms;
+
+inline static hipError_t hipMemcpy3D(const hipMemcpy3DParms* p) {
+    cudaMemcpy3DParms c = {0};
+    c.srcArray = p->srcArray;
+    c.srcPos = p->srcPos;
+    c.srcPtr = p->srcPtr;
+    c.dstArray = p->dstArray;
+    c.dstPos = p->dstPos;
+    c.dstPtr = p->dstPtr;
+    c.extent = p->extent;
+    c.kind = hipMemcpyKindToCudaMemcpyKind(p->kind);
+    return hipCUDAErrorTohipError(cudaMemcpy3D(&c));
+}
+
+inline static hipError_t hipCreateTextureObject(hipTextureObject_t* pTexObject, const hipResourceDesc* pResDesc, const hipTextureDesc* pTexDesc, const hipResourceViewDesc* pResViewDesc) {
+    return hipCUDAErrorTohipError(cudaCreateTextureObject(pTexObject, pResDesc, pTexDesc, pResViewDesc));
+}
+
+inline static hipError_t hipDestroyTextureObject(hipTextureObject_t texObject) {
+    return hipCUDAErrorTohipError(cudaDestroyTextureObject(texObject));
+}
+
+inline static hipError_t hipGetTextureObjectResourceDesc(hipResourceDesc* pResDesc, hipTextureObject_t texObject) {
+    return hipCUDAErrorTohipError(cudaGetTextureObjectResourceDesc(pResDesc, texObject));
+}
+
+inline static hipError_t hipGetTextureObjectTextureDesc(hipTextureDesc* pTexDesc, hipTextureObject_t texObject) {
+    return hipCUDAErrorTohipError(cudaGetTextureObjectTextureDesc(pTexDesc, texObject));
 }
 
 inline static hipError_t hipDeviceSynchronize() {
@@ -524,7 +761,7 @@ inline static hipError_t hipPointerGetAttributes(hipPointerAttribute_t *attribut
 		attributes->device = cPA.device;
 		attributes->devicePointer = cPA.devicePointer;
 		attributes->hostPointer = cPA.hostPointer;
-		attributes->isManaged = 0;
+		attributes->isManaged = cPA.isManaged;
 		attributes->allocationFlags = 0;
 	}
 	return err;
@@ -822,6 +1059,18 @@ inline static hipError_t hipModuleLoadData(hipModule_t *module, const void *imag
     return hipCUResultTohipError(cuModuleLoadData(module, image));
 }
 
+inline static hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, hipFunction_t f,
+                                                                           int blockSize, size_t dynSharedMemPerBlk)
+{
+    return hipCUResultTohipError(cuOccupancyMaxActiveBlocksPerMultiprocessor(numBlocks, f, blockSize, dynSharedMemPerBlk));
+}
+
+inline static hipError_t hipModuleOccupancyMaxPotentialBlockSize(int *gridSize, int *blockSize, hipFunction_t f,
+                                                                size_t dynSharedMemPerBlk, int blockSizeLimit)
+{
+    return hipCUResultTohipError(cuOccupancyMaxPotentialBlockSize(gridSize, blockSize, f, NULL, dynSharedMemPerBlk, blockSizeLimit));
+}
+
 inline static hipError_t hipModuleLaunchKernel(hipFunction_t f,
       unsigned int gridDimX, unsigned int gridDimY, unsigned int gridDimZ,
       unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
@@ -2,6 +2,9 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
+#include <stdlib.h>
+#include <sys/mman.h>
 #include "hip/hip_runtime.h"
 
 #include "ResultDatabase.h"
@@ -17,6 +20,9 @@ bool          p_async = 0;
 int           p_alignedhost = 0;  // align host allocs to this granularity, in bytes. 64 or 4096 are good values to try.
 int           p_onesize = 0;  
 
+unsigned      p_hostMallocFlags = hipHostMallocDefault; // --hugepages adds hipHostMallocHugePages.
+bool          p_pinning = false;  // run the pinning (registration time) benchmark.
+
 bool          p_h2d   = true;
 bool          p_d2h   = true;
 bool          p_bidir = true;
@@ -69,6 +75,18 @@ hipError_t memcopy(void * dst, const void *src, size_t sizeBytes, enum hipMemcpy
 }
 
 
+// ****************************************************************************
+// Result name suffix which identifies the host memory type and copy path.
+std::string resultSuffix()
+{
+    std::string s = p_pinned ? "_Pinned" : "_Unpinned";
+    if (p_pinned && (p_hostMallocFlags & hipHostMallocHugePages)) {
+        s += "_HugePages";
+    }
+    return s;
+}
+
+
 
 // ****************************************************************************
 // -sizes are in bytes, +sizes are in kb, last size must be largest
@@ -108,7 +126,7 @@ void RunBenchmark_H2D(ResultDatabase &resultDB)
     float *hostMem = NULL;
     if (p_pinned)
     {
-        hipHostMalloc((void**)&hostMem, sizeof(float) * numMaxFloats);
+        hipHostMalloc((void**)&hostMem, sizeof(float) * numMaxFloats, p_hostMallocFlags);
         while (hipGetLastError() != hipSuccess)
         {
             // drop the size and try again
@@ -120,7 +138,7 @@ void RunBenchmark_H2D(ResultDatabase &resultDB)
             return;
             }
             numMaxFloats = 1024 * (sizes[nSizes-1]) / 4;
-            hipHostMalloc((void**)&hostMem, sizeof(float) * numMaxFloats);
+            hipHostMalloc((void**)&hostMem, sizeof(float) * numMaxFloats, p_hostMallocFlags);
         }
     }
     else
@@ -199,8 +217,8 @@ void RunBenchmark_H2D(ResultDatabase &resultDB)
             } else {
                 sprintf(sizeStr, "%9s", sizeToString(thisSize).c_str());
             }
-            resultDB.AddResult(std::string("H2D_Bandwidth") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "GB/sec", speed);
-            resultDB.AddResult(std::string("H2D_Time") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "ms", t);
+            resultDB.AddResult(std::string("H2D_Bandwidth") + resultSuffix(), sizeStr, "GB/sec", speed);
+            resultDB.AddResult(std::string("H2D_Time") + resultSuffix(), sizeStr, "ms", t);
 
             if (p_onesize) {
                 break;
@@ -259,9 +277,9 @@ void RunBenchmark_D2H(ResultDatabase &resultDB)
     float *hostMem2;
     if (p_pinned)
     {
-        hipHostMalloc((void**)&hostMem1, sizeof(float)*numMaxFloats);
+        hipHostMalloc((void**)&hostMem1, sizeof(float)*numMaxFloats, p_hostMallocFlags);
         hipError_t err1 = hipGetLastError();
-        hipHostMalloc((void**)&hostMem2, sizeof(float)*numMaxFloats);
+        hipHostMalloc((void**)&hostMem2, sizeof(float)*numMaxFloats, p_hostMallocFlags);
         hipError_t err2 = hipGetLastError();
 	while (err1 != hipSuccess || err2 != hipSuccess)
 	{
@@ -278,9 +296,9 @@ void RunBenchmark_D2H(ResultDatabase &resultDB)
 		return;
 	    }
 	    numMaxFloats = 1024 * (sizes[nSizes-1]) / 4;
-            hipHostMalloc((void**)&hostMem1, sizeof(float)*numMaxFloats);
+            hipHostMalloc((void**)&hostMem1, sizeof(float)*numMaxFloats, p_hostMallocFlags);
             err1 = hipGetLastError();
-            hipHostMalloc((void**)&hostMem2, sizeof(float)*numMaxFloats);
+            hipHostMalloc((void**)&hostMem2, sizeof(float)*numMaxFloats, p_hostMallocFlags);
             err2 = hipGetLastError();
 	}
    }
@@ -358,8 +376,8 @@ void RunBenchmark_D2H(ResultDatabase &resultDB)
             } else {
                 sprintf(sizeStr, "%9s", sizeToString(thisSize).c_str());
             }
-            resultDB.AddResult(std::string("D2H_Bandwidth") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "GB/sec", speed);
-            resultDB.AddResult(std::string("D2H_Time") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "ms", t);
+            resultDB.AddResult(std::string("D2H_Bandwidth") + resultSuffix(), sizeStr, "GB/sec", speed);
+            resultDB.AddResult(std::string("D2H_Time") + resultSuffix(), sizeStr, "ms", t);
             if (p_onesize) {
                 break;
             }
@@ -413,8 +431,8 @@ void RunBenchmark_Bidir(ResultDatabase &resultDB)
     {
         while (1) 
         {
-            hipError_t e1 = hipHostMalloc((void**)&hostMem[0], sizeof(float) * numMaxFloats);
-            hipError_t e2 = hipHostMalloc((void**)&hostMem[1], sizeof(float) * numMaxFloats);
+            hipError_t e1 = hipHostMalloc((void**)&hostMem[0], sizeof(float) * numMaxFloats, p_hostMallocFlags);
+            hipError_t e2 = hipHostMalloc((void**)&hostMem[1], sizeof(float) * numMaxFloats, p_hostMallocFlags);
 
             if ((e1 == hipSuccess) && (e2 == hipSuccess)) {
                 break;
@@ -512,8 +530,8 @@ void RunBenchmark_Bidir(ResultDatabase &resultDB)
             double speed = (double(sizeToBytes(thisSize)) / (1000*1000)) / t;
             char sizeStr[256];
             sprintf(sizeStr, "%9s", sizeToString(thisSize).c_str());
-            resultDB.AddResult(std::string("Bidir_Bandwidth") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "GB/sec", speed);
-            resultDB.AddResult(std::string("Bidir_Time") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "ms", t);
+            resultDB.AddResult(std::string("Bidir_Bandwidth") + resultSuffix(), sizeStr, "GB/sec", speed);
+            resultDB.AddResult(std::string("Bidir_Time") + resultSuffix(), sizeStr, "ms", t);
         }
     }
 
@@ -539,6 +557,115 @@ void RunBenchmark_Bidir(ResultDatabase &resultDB)
 }
 
 
+// ****************************************************************************
+// Function: RunBenchmark_Pinning
+//
+// Purpose:
+//   Measures the time to pin large host buffers, and the H2D bandwidth from them, for 4KB-page and huge-page
+//   backed memory.  Allocated with hipHostMalloc (with and without hipHostMallocHugePages) and registered with
+//   hipHostRegister (plain malloc, and 2MB-aligned memory advised for transparent huge pages).
+//
+// ****************************************************************************
+enum PinMode {PinHostMalloc, PinHostMallocHuge, PinRegister, PinRegisterHuge, PinModeCount};
+const char *pinModeNames[PinModeCount] = {"HostMalloc_4K", "HostMalloc_HugePages", "HostRegister_4K", "HostRegister_THP"};
+
+void *pinHostBuffer(PinMode mode, size_t sizeBytes)
+{
+    void *p = NULL;
+    switch (mode) {
+        case PinHostMalloc:
+            hipHostMalloc(&p, sizeBytes, hipHostMallocDefault);
+            break;
+        case PinHostMallocHuge:
+            hipHostMalloc(&p, sizeBytes, hipHostMallocHugePages);
+            break;
+        case PinRegister:
+            p = aligned_alloc(4096, sizeBytes);
+            hipHostRegister(p, sizeBytes, hipHostRegisterDefault);
+            break;
+        case PinRegisterHuge:
+            p = aligned_alloc(2*1024*1024, sizeBytes);
+#if defined(MADV_HUGEPAGE)
+            madvise(p, sizeBytes, MADV_HUGEPAGE);
+#endif
+            hipHostRegister(p, sizeBytes, hipHostRegisterDefault);
+            break;
+        default:
+            break;
+    }
+    CHECK_HIP_ERROR();
+    return p;
+}
+
+void unpinHostBuffer(PinMode mode, void *p)
+{
+    if ((mode == PinHostMalloc) || (mode == PinHostMallocHuge)) {
+        hipHostFree(p);
+    } else {
+        hipHostUnregister(p);
+        free(p);
+    }
+    CHECK_HIP_ERROR();
+}
+
+void RunBenchmark_Pinning(ResultDatabase &resultDB)
+{
+    // Sizes in MB:
+    const int pinSizes[] = {16, 64, 256, 1024};
+
+    hipSetDevice(p_device);
+
+    hipEvent_t start, stop;
+    hipEventCreate(&start);
+    hipEventCreate(&stop);
+
+    for (int sizeMB : pinSizes) {
+        const size_t sizeBytes = size_t(sizeMB) * 1024 * 1024;
+        void *device;
+        if (hipMalloc(&device, sizeBytes) != hipSuccess) {
+            if (p_verbose) std::cout << " - skipping " << sizeMB << "MB, can't allocate device mem\n";
+            continue;
+        }
+
+        char sizeStr[256];
+        sprintf(sizeStr, "%7dMB", sizeMB);
+
+        for (int mode = 0; mode < PinModeCount; mode++) {
+            for (int pass = 0; pass < p_iterations; pass++) {
+                auto t0 = std::chrono::high_resolution_clock::now();
+                void *host = pinHostBuffer(PinMode(mode), sizeBytes);
+                auto t1 = std::chrono::high_resolution_clock::now();
+                double pinMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+                memset(host, pass, sizeBytes);
+
+                hipEventRecord(start, 0);
+                hipMemcpy(device, host, sizeBytes, hipMemcpyHostToDevice);
+                hipEventRecord(stop, 0);
+                hipEventSynchronize(stop);
+                float t = 0;
+                hipEventElapsedTime(&t, start, stop);
+                double speed = (double(sizeBytes) / (1000*1000)) / t;
+
+                if (p_verbose) {
+                    std::cerr << pinModeNames[mode] << " size " << sizeMB << "MB pin " << pinMs << " ms, H2D " << t << " ms\n";
+                }
+
+                resultDB.AddResult(std::string("Pin_Time_") + pinModeNames[mode], sizeStr, "ms", pinMs);
+                resultDB.AddResult(std::string("Pin_H2D_Bandwidth_") + pinModeNames[mode], sizeStr, "GB/sec", speed);
+
+                unpinHostBuffer(PinMode(mode), host);
+            }
+        }
+
+        hipFree(device);
+    }
+
+    hipEventDestroy(start);
+    hipEventDestroy(stop);
+}
+
+
 #define failed(...) \
     printf ("error: ");\
     printf (__VA_ARGS__);\
@@ -557,7 +684,8 @@ void printConfig() {
     hipDeviceProp_t props;
     hipGetDeviceProperties(&props, p_device);
 
-    printf ("Device:%s Mem=%.1fGB #CUs=%d Freq=%.0fMhz  Pinned=%s\n", props.name, props.totalGlobalMem/1024.0/1024.0/1024.0, props.multiProcessorCount, props.clockRate/1000.0, p_pinned ? "YES" : "NO");
+    printf ("Device:%s Mem=%.1fGB #CUs=%d Freq=%.0fMhz  Pinned=%s%s\n", props.name, props.totalGlobalMem/1024.0/1024.0/1024.0, props.multiProcessorCount, props.clockRate/1000.0, p_pinned ? "YES" : "NO",
+            (p_pinned && (p_hostMallocFlags & hipHostMallocHugePages)) ? " (huge pages)" : "");
 }
 
 void help() {
@@ -566,6 +694,8 @@ void help() {
     printf ("  --beatsperiterations, -b : Number of beats (back-to-back copies of same size) per iteration to run.\n");
     printf ("  --device, -d             : Device ID to use (0..numDevices).\n");
     printf ("  --unpinned               : Use unpinned host memory.\n");
+    printf ("  --hugepages              : Allocate pinned host memory with hipHostMallocHugePages.\n");
+    printf ("  --pinning                : Run only the pinning test: pin time and H2D bandwidth for 4KB vs huge pages.\n");
     printf ("  --d2h                    : Run only device-to-host test.\n");
     printf ("  --h2d                    : Run only host-to-device test.\n");
     printf ("  --bidir                  : Run only bidir copy test.\n");
@@ -602,6 +732,13 @@ int parseStandardArguments(int argc, char *argv[])
             }
         } else if (!strcmp(arg, "--unpinned")) {
             p_pinned = 0;
+        } else if (!strcmp(arg, "--hugepages")) {
+            p_hostMallocFlags |= hipHostMallocHugePages;
+        } else if (!strcmp(arg, "--pinning")) {
+            p_pinning = true;
+            p_h2d   = false;
+            p_d2h   = false;
+            p_bidir = false;
         } else if (!strcmp(arg, "--h2d")) {
             p_h2d   = true;
             p_d2h   = false;
@@ -677,4 +814,15 @@ int main(int argc, char *argv[])
             resultDB.DumpDetailed(std::cout);
         }
     }
+
+    if (p_pinning) {
+        ResultDatabase resultDB;
+        RunBenchmark_Pinning(resultDB);
+
+        resultDB.DumpSummary(std::cout);
+
+        if (p_detailed) {
+            resultDB.DumpDetailed(std::cout);
+        }
+    }
 }
@@ -0,0 +1,277 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+/**
+ * @file hip_api_latency.cpp
+ *
+ * Per-API latency histograms, enabled with HIP_API_LATENCY.
+ *
+ * HIP_INIT_API pushes the API name and start time on a small per-thread stack, and ihipLogStatus pops it and adds
+ * the duration to a log-linear histogram for the API.  Each thread records into its own shard, so threads do
+ * not contend with each other on this path.  Readers (hipApiGetLatency and the dump at exit) merge all shards.
+ * When a thread exits its shard is merged into a retired shard, so its calls are still counted.
+ *
+ * Each frame records the API's __func__ pointer and its stack frame address, and an exit only matches a frame with
+ * both.  So an ihipLogStatus in a function which did not call HIP_INIT_API is ignored, and nested APIs are timed
+ * separately.  Some APIs return without ihipLogStatus and leave their frame behind.  A frame deeper on the stack
+ * than the API being entered or exited belongs to a call which has already returned, and so does a frame of the
+ * same API at the same depth; both are discarded.  When the stack is full the oldest frame is dropped.
+ *
+ * With COMPILE_HIP_API_LATENCY set but HIP_API_LATENCY=0, each API pays one load and branch at entry and exit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "hip_histogram.h"
+#include "trace_helper.h"
+
+#define HIP_API_LATENCY_MAX_DEPTH 16
+
+
+bool g_apiLatency = false;
+
+
+// Histograms for one thread, indexed by the API id from ihipTraceApiId.  The owning thread holds the mutex
+// only while adding one value, so readers rarely contend with it.
+struct ihipApiLatencyShard_t {
+    ~ihipApiLatencyShard_t() {
+        for (auto h : _apis) {
+            delete h;
+        }
+    };
+
+    ihipHistogram_t *get(uint16_t apiId) {
+        if (apiId >= _apis.size()) {
+            _apis.resize(apiId + 1, nullptr);
+        }
+        if (_apis[apiId] == nullptr) {
+            _apis[apiId] = new ihipHistogram_t;
+        }
+        return _apis[apiId];
+    };
+
+    void merge(const ihipApiLatencyShard_t &other) {
+        for (size_t i = 0; i < other._apis.size(); i++) {
+            if (other._apis[i]) {
+                get(i)->merge(*other._apis[i]);
+            }
+        }
+    };
+
+    std::mutex                      _mutex;
+    std::vector<ihipHistogram_t*>   _apis;
+};
+
+
+static std::mutex                           g_apiLatencyMutex;  // protects the fields below
+static std::list<ihipApiLatencyShard_t*>    g_apiLatencyShards;
+static ihipApiLatencyShard_t                g_apiLatencyRetired;
+
+
+struct ihipApiLatencyFrame_t {
+    const char *_apiName;
+    const void *_frame;     // __builtin_frame_address of the API.  The stack grows down.
+    std::chrono::steady_clock::time_point _start;
+};
+
+struct ihipApiLatencyTls_t {
+    ~ihipApiLatencyTls_t() {
+        if (_shard) {
+            std::lock_guard<std::mutex> l(g_apiLatencyMutex);
+            g_apiLatencyShards.remove(_shard);
+            g_apiLatencyRetired.merge(*_shard);
+            delete _shard;
+        }
+    };
+
+    ihipApiLatencyShard_t  *_shard = nullptr;
+    int                     _depth = 0;
+    ihipApiLatencyFrame_t   _stack[HIP_API_LATENCY_MAX_DEPTH];
+};
+
+static thread_local ihipApiLatencyTls_t tls_apiLatency;
+
+
+// Merge the histogram for one API from all shards.
+static void ihipApiLatencyMerge(uint16_t apiId, ihipHistogram_t *h)
+{
+    std::lock_guard<std::mutex> l(g_apiLatencyMutex);
+    if (apiId < g_apiLatencyRetired._apis.size() && g_apiLatencyRetired._apis[apiId]) {
+        h->merge(*g_apiLatencyRetired._apis[apiId]);
+    }
+    for (auto shard : g_apiLatencyShards) {
+        std::lock_guard<std::mutex> sl(shard->_mutex);
+        if (apiId < shard->_apis.size() && shard->_apis[apiId]) {
+            h->merge(*shard->_apis[apiId]);
+        }
+    }
+}
+
+
+static void ihipApiLatencyDump()
+{
+    ihipApiLatencyShard_t all;
+    {
+        std::lock_guard<std::mutex> l(g_apiLatencyMutex);
+        all.merge(g_apiLatencyRetired);
+        for (auto shard : g_apiLatencyShards) {
+            std::lock_guard<std::mutex> sl(shard->_mutex);
+            all.merge(*shard);
+        }
+    }
+
+    std::vector<uint16_t> sorted;
+    for (size_t i = 0; i < all._apis.size(); i++) {
+        if (all._apis[i] && all._apis[i]->_count) {
+            sorted.push_back(i);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [&all](uint16_t a, uint16_t b) {
+        return all._apis[a]->_total > all._apis[b]->_total;
+    });
+
+    fprintf(stderr, "HIP API latency: %zu APIs\n", sorted.size());
+    fprintf(stderr, "%12s %10s %10s %10s %10s %10s %10s %10s  %s\n",
+            "total(ms)", "count", "avg(us)", "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)", "api");
+    for (auto id : sorted) {
+        const ihipHistogram_t &h = *all._apis[id];
+        fprintf(stderr, "%12.3f %10lu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f  %s\n",
+                h._total / 1.0e6, h._count, h._total / 1.0e3 / h._count,
+                h.percentile(50) / 1.0e3, h.percentile(90) / 1.0e3, h.percentile(99) / 1.0e3,
+                h.percentile(99.9) / 1.0e3, h._max / 1.0e3, ihipTraceApiName(id).c_str());
+    }
+}
+
+
+//=================================================================================================
+// Called from HIP_INIT_API and ihipLogStatus:
+//=================================================================================================
+void ihipApiLatencyInit()
+{
+    if (HIP_API_LATENCY) {
+        g_apiLatency = true;
+        if (HIP_API_LATENCY == 2) {
+            atexit(ihipApiLatencyDump);
+        }
+    }
+}
+
+
+// Pop frames of calls below frame on the stack, which have returned without ihipLogStatus.
+static void ihipApiLatencyDiscardStale(ihipApiLatencyTls_t &t, const void *frame)
+{
+    while ((t._depth > 0) && (t._stack[t._depth - 1]._frame < frame)) {
+        t._depth--;
+    }
+}
+
+
+void ihipApiLatencyEnter(const char *apiName, const void *frame)
+{
+    ihipApiLatencyTls_t &t = tls_apiLatency;
+    ihipApiLatencyDiscardStale(t, frame);
+    if ((t._depth > 0) && (t._stack[t._depth - 1]._frame == frame) && (t._stack[t._depth - 1]._apiName == apiName)) {
+        t._depth--;     // an earlier call of this API from the same caller
+    }
+
+    if (t._depth == HIP_API_LATENCY_MAX_DEPTH) {
+        std::copy(t._stack + 1, t._stack + HIP_API_LATENCY_MAX_DEPTH, t._stack);
+        t._depth--;
+    }
+    t._stack[t._depth]._apiName = apiName;
+    t._stack[t._depth]._frame = frame;
+    t._stack[t._depth]._start = std::chrono::steady_clock::now();
+    t._depth++;
+}
+
+
+void ihipApiLatencyExit(uint16_t apiId, const char *apiName, const void *frame)
+{
+    auto end = std::chrono::steady_clock::now();
+
+    ihipApiLatencyTls_t &t = tls_apiLatency;
+    ihipApiLatencyDiscardStale(t, frame);
+
+    // An inlined API shares its caller's frame, so match the name too:
+    int i = t._depth - 1;
+    while ((i >= 0) && (t._stack[i]._frame == frame) && (t._stack[i]._apiName != apiName)) {
+        i--;
+    }
+    if ((i < 0) || (t._stack[i]._frame != frame)) {
+        return;
+    }
+    t._depth = i;
+
+    if (t._shard == nullptr) {
+        t._shard = new ihipApiLatencyShard_t;
+        std::lock_guard<std::mutex> l(g_apiLatencyMutex);
+        g_apiLatencyShards.push_back(t._shard);
+    }
+
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - t._stack[i]._start).count();
+    std::lock_guard<std::mutex> sl(t._shard->_mutex);
+    t._shard->get(apiId)->add(ns);
+}
+
+
+//=================================================================================================
+// Query API:
+//=================================================================================================
+hipError_t hipApiGetLatency(const char *apiName, hipApiLatency_t *latency)
+{
+    HIP_INIT_API(apiName, latency);
+
+    hipError_t e = hipSuccess;
+
+    if ((apiName == nullptr) || (latency == nullptr)) {
+        e = hipErrorInvalidValue;
+    } else if (!g_apiLatency) {
+        e = hipErrorProfilerDisabled;
+    } else {
+        ihipHistogram_t h;
+        int apiId = ihipTraceFindApiId(apiName);
+        if (apiId >= 0) {
+            ihipApiLatencyMerge(apiId, &h);
+        }
+
+        latency->count   = h._count;
+        latency->totalUs = h._total / 1.0e3;
+        latency->minUs   = h._min / 1.0e3;
+        latency->maxUs   = h._max / 1.0e3;
+        latency->p50Us   = h.percentile(50) / 1.0e3;
+        latency->p90Us   = h.percentile(90) / 1.0e3;
+        latency->p99Us   = h.percentile(99) / 1.0e3;
+        latency->p999Us  = h.percentile(99.9) / 1.0e3;
+    }
+
+    return ihipLogStatus(e);
+}
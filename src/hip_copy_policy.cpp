@@ -0,0 +1,404 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file hip_copy_policy.cpp
+ *
+ * Size-aware selection of the engine used for each copy:
+ *   - CPU:  plain loads/stores through the large BAR.  Only possible when device memory is CPU-visible (_isLargeBar).
+ *           Fastest for small H2D copies since there is no command submission at all.
+ *   - Blit: a shader copy kernel.  Lower launch latency than an SDMA job for small D2D copies.  Without a large
+ *           BAR it also takes the small H2D/D2H copies the CPU path would have taken, if the host side is pinned.
+ *   - SDMA: copy_ext / copy_async_ext.  Best for everything large.
+ *
+ * The built-in thresholds are used by default, and each can be overridden with an env var.  The crossover sizes
+ * depend on the platform, so HIP_COPY_CALIBRATE=1 opts in to measuring them by timing each path at a range of
+ * sizes the first time the device copies anything.  The result is cached in HIP_COPY_POLICY_FILE (one line per
+ * device).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <atomic>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+const char *ihipCopyPathStr(ihipCopyPath_t path)
+{
+    switch (path) {
+        case ihipCopyPathSdma: return "sdma";
+        case ihipCopyPathCpu:  return "cpu";
+        case ihipCopyPathBlit: return "blit";
+        default:               return "unknown";
+    };
+}
+
+
+//=================================================================================================
+// Blit kernel:
+//=================================================================================================
+template <typename T>
+static hc::completion_future ihipCopyKernelT(hc::accelerator_view &av, T *dst, const T *src, size_t numElements)
+{
+    const int threads_per_wg = 256;
+    const int max_wg = 16;
+
+    size_t threads = max_wg * threads_per_wg;
+    if (threads > numElements) {
+        threads = ((numElements + threads_per_wg - 1) / threads_per_wg) * threads_per_wg;
+    }
+
+    hc::extent<1> ext(threads);
+    auto ext_tile = ext.tile(threads_per_wg);
+
+    return hc::parallel_for_each(
+            av,
+            ext_tile,
+            [=] (hc::tiled_index<1> idx)
+            __attribute__((hc))
+    {
+        int offset = amp_get_global_id(0);
+        int stride = amp_get_local_size(0) * hc_get_num_groups(0) ;
+
+        for (size_t i=offset; i<numElements; i+=stride) {
+            dst[i] = src[i];
+        }
+    });
+}
+
+
+hc::completion_future ihipCopyKernel(hc::accelerator_view &av, void *dst, const void *src, size_t sizeBytes)
+{
+    if (((reinterpret_cast<uintptr_t>(dst) | reinterpret_cast<uintptr_t>(src) | sizeBytes) & 0x3) == 0) {
+        // Use a faster dword-per-workitem copy:
+        return ihipCopyKernelT<unsigned>(av, static_cast<unsigned*>(dst), static_cast<const unsigned*>(src), sizeBytes/sizeof(unsigned));
+    } else {
+        return ihipCopyKernelT<char>(av, static_cast<char*>(dst), static_cast<const char*>(src), sizeBytes);
+    }
+}
+
+
+// Each workgroup copies whole ranges, striding over the table.  Ranges are small (<= HIP_COPY_BATCH_BLIT_THRESHOLD)
+// so one workgroup per range keeps the loop simple and still fills the device for large batches.
+hc::completion_future ihipCopyBatchKernel(hc::accelerator_view &av, const ihipCopyRange_t *ranges, size_t numRanges)
+{
+    const int threads_per_wg = 256;
+    const size_t max_wg = 1024;
+
+    size_t wgs = std::min(numRanges, max_wg);
+
+    hc::extent<1> ext(wgs * threads_per_wg);
+    auto ext_tile = ext.tile(threads_per_wg);
+
+    return hc::parallel_for_each(
+            av,
+            ext_tile,
+            [=] (hc::tiled_index<1> idx)
+            __attribute__((hc))
+    {
+        int lid = idx.local[0];
+        int numGroups = hc_get_num_groups(0);
+
+        for (size_t r=idx.tile[0]; r<numRanges; r+=numGroups) {
+            char *dst = static_cast<char*>(ranges[r]._dst);
+            const char *src = static_cast<const char*>(ranges[r]._src);
+            size_t sizeBytes = ranges[r]._sizeBytes;
+
+            if (((reinterpret_cast<uintptr_t>(dst) | reinterpret_cast<uintptr_t>(src) | sizeBytes) & 0x3) == 0) {
+                unsigned *dst32 = reinterpret_cast<unsigned*>(dst);
+                const unsigned *src32 = reinterpret_cast<const unsigned*>(src);
+                for (size_t i=lid; i<sizeBytes/sizeof(unsigned); i+=threads_per_wg) {
+                    dst32[i] = src32[i];
+                }
+            } else {
+                for (size_t i=lid; i<sizeBytes; i+=threads_per_wg) {
+                    dst[i] = src[i];
+                }
+            }
+        }
+    });
+}
+
+
+
+//=================================================================================================
+// ihipCopyPolicy_t:
+//=================================================================================================
+ihipCopyPolicy_t::ihipCopyPolicy_t(ihipDevice_t *device) :
+    _device(device),
+    _h2dCpuMax(0),
+    _d2hCpuMax(0),
+    _blitMax(0)
+{
+}
+
+
+ihipCopyPath_t ihipCopyPolicy_t::choose(hc::hcCommandKind hcCopyDir, size_t sizeBytes,
+                                        const hc::AmPointerInfo &dstPtrInfo, const hc::AmPointerInfo &srcPtrInfo)
+{
+    std::call_once(_initOnce, &ihipCopyPolicy_t::init, this);
+
+    // Only memory local to this device is visible through its BAR or cheap to reach from its shaders.
+    const int deviceId = _device->_deviceId;
+    const bool dstLocal = dstPtrInfo._isInDeviceMem && (dstPtrInfo._appId == deviceId);
+    const bool srcLocal = srcPtrInfo._isInDeviceMem && (srcPtrInfo._appId == deviceId);
+
+    // Pinned host memory is reachable from the device's shaders:
+    const bool dstPinnedHost = !dstPtrInfo._isInDeviceMem && (dstPtrInfo._hostPointer != nullptr);
+    const bool srcPinnedHost = !srcPtrInfo._isInDeviceMem && (srcPtrInfo._hostPointer != nullptr);
+
+    switch (hcCopyDir) {
+        case hc::hcMemcpyHostToDevice:
+            if (dstLocal && (sizeBytes <= _h2dCpuMax)) {
+                return ihipCopyPathCpu;
+            }
+            if (!_device->_isLargeBar && dstLocal && srcPinnedHost && (sizeBytes <= _blitMax)) {
+                return ihipCopyPathBlit;
+            }
+            break;
+        case hc::hcMemcpyDeviceToHost:
+            if (srcLocal && (sizeBytes <= _d2hCpuMax)) {
+                return ihipCopyPathCpu;
+            }
+            if (!_device->_isLargeBar && srcLocal && dstPinnedHost && (sizeBytes <= _blitMax)) {
+                return ihipCopyPathBlit;
+            }
+            break;
+        case hc::hcMemcpyDeviceToDevice:
+            if (dstLocal && srcLocal && (sizeBytes <= _blitMax)) {
+                return ihipCopyPathBlit;
+            }
+            break;
+        default:
+            break;
+    };
+
+    return ihipCopyPathSdma;
+}
+
+
+void ihipCopyPolicy_t::init()
+{
+    // Defaults, used unless calibration is enabled:
+    _h2dCpuMax = 64*1024;
+    _d2hCpuMax = 0;          // uncached reads through the BAR are slow at all but the smallest sizes.
+    _blitMax   = 16*1024;
+
+    const char *source = "defaults";
+    if (HIP_COPY_CALIBRATE == 1 && loadFromFile()) {
+        source = "cached";
+    } else if (HIP_COPY_CALIBRATE) {
+        calibrate();
+        saveToFile();
+        source = "calibrated";
+    }
+
+    if (HIP_COPY_H2D_CPU_THRESHOLD >= 0) {
+        _h2dCpuMax = HIP_COPY_H2D_CPU_THRESHOLD;
+    }
+    if (HIP_COPY_D2H_CPU_THRESHOLD >= 0) {
+        _d2hCpuMax = HIP_COPY_D2H_CPU_THRESHOLD;
+    }
+    if (HIP_COPY_BLIT_THRESHOLD >= 0) {
+        _blitMax = HIP_COPY_BLIT_THRESHOLD;
+    }
+
+    // CPU path needs device memory to be mapped into the host address space.  choose() falls back to the blit
+    // kernel for small copies to/from pinned host memory instead.
+    if (!_device->_isLargeBar) {
+        _h2dCpuMax = 0;
+        _d2hCpuMax = 0;
+    }
+
+    tprintf(DB_COPY, "copy policy dev:%d large_bar=%d h2d_cpu<=%zu d2h_cpu<=%zu d2d_blit<=%zu (%s)\n",
+            _device->_deviceId, _device->_isLargeBar, _h2dCpuMax, _d2hCpuMax, _blitMax, source);
+}
+
+
+// Median time in microseconds of several runs of op, after a warm-up run.
+template <typename F>
+static double ihipTimeCopy(F op)
+{
+    const int reps = 7;
+    double t[reps];
+
+    op();
+    for (int i=0; i<reps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        op();
+        t[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::sort(t, t+reps);
+    return t[reps/2];
+}
+
+
+// Time each path at increasing sizes.  A path keeps winning until the first size where SDMA beats it.
+void ihipCopyPolicy_t::calibrate()
+{
+    const size_t maxBytes = 1024*1024;
+
+    hc::accelerator &acc = _device->_acc;
+    hc::accelerator_view av = acc.create_view();
+
+    void *dev0 = hc::am_alloc(maxBytes, acc, 0);
+    void *dev1 = hc::am_alloc(maxBytes, acc, 0);
+    char *host = new char[maxBytes];
+    memset(host, 0x5a, maxBytes);
+
+    hc::accelerator nullAcc;
+    hc::AmPointerInfo dev0Info(NULL, NULL, 0, nullAcc, 0, 0);
+    hc::AmPointerInfo dev1Info(NULL, NULL, 0, nullAcc, 0, 0);
+    hc::AmPointerInfo hostInfo(NULL, NULL, 0, nullAcc, 0, 0);
+
+    if (dev0 && dev1 &&
+        (hc::am_memtracker_getinfo(&dev0Info, dev0) == AM_SUCCESS) &&
+        (hc::am_memtracker_getinfo(&dev1Info, dev1) == AM_SUCCESS)) {
+
+        bool h2dCpuWins = _device->_isLargeBar;
+        bool d2hCpuWins = _device->_isLargeBar;
+        bool blitWins   = true;
+        size_t h2dCpuMax = 0, d2hCpuMax = 0, blitMax = 0;
+
+        for (size_t sz = 256; sz <= maxBytes; sz *= 4) {
+#if USE_COPY_EXT_V2
+            double tH2d = ihipTimeCopy([&] { av.copy_ext(host, dev0, sz, hc::hcMemcpyHostToDevice,   hostInfo, dev0Info, &acc, true); });
+            double tD2h = ihipTimeCopy([&] { av.copy_ext(dev0, host, sz, hc::hcMemcpyDeviceToHost,   dev0Info, hostInfo, &acc, true); });
+            double tD2d = ihipTimeCopy([&] { av.copy_ext(dev0, dev1, sz, hc::hcMemcpyDeviceToDevice, dev0Info, dev1Info, &acc, false); });
+#else
+            double tH2d = ihipTimeCopy([&] { av.copy_ext(host, dev0, sz, hc::hcMemcpyHostToDevice,   hostInfo, dev0Info, true); });
+            double tD2h = ihipTimeCopy([&] { av.copy_ext(dev0, host, sz, hc::hcMemcpyDeviceToHost,   dev0Info, hostInfo, true); });
+            double tD2d = ihipTimeCopy([&] { av.copy_ext(dev0, dev1, sz, hc::hcMemcpyDeviceToDevice, dev0Info, dev1Info, false); });
+#endif
+
+            if (h2dCpuWins) {
+                double t = ihipTimeCopy([&] { memcpy(dev0, host, sz); std::atomic_thread_fence(std::memory_order_seq_cst); });
+                h2dCpuWins = (t < tH2d);
+                if (h2dCpuWins) h2dCpuMax = sz;
+            }
+            if (d2hCpuWins) {
+                double t = ihipTimeCopy([&] { memcpy(host, dev0, sz); });
+                d2hCpuWins = (t < tD2h);
+                if (d2hCpuWins) d2hCpuMax = sz;
+            }
+            if (blitWins) {
+                double t = ihipTimeCopy([&] { ihipCopyKernel(av, dev1, dev0, sz).wait(); });
+                blitWins = (t < tD2d);
+                if (blitWins) blitMax = sz;
+            }
+
+            tprintf(DB_COPY, "calibrate dev:%d sz=%zu sdma(h2d=%.1fus d2h=%.1fus d2d=%.1fus) cpu_h2d_wins=%d cpu_d2h_wins=%d blit_wins=%d\n",
+                    _device->_deviceId, sz, tH2d, tD2h, tD2d, h2dCpuWins, d2hCpuWins, blitWins);
+        }
+
+        _h2dCpuMax = h2dCpuMax;
+        _d2hCpuMax = d2hCpuMax;
+        _blitMax   = blitMax;
+    }
+
+    if (dev0) hc::am_free(dev0);
+    if (dev1) hc::am_free(dev1);
+    delete [] host;
+}
+
+
+static std::string ihipCopyPolicyFile()
+{
+    if (!HIP_COPY_POLICY_FILE.empty()) {
+        return HIP_COPY_POLICY_FILE;
+    }
+
+    char hostname[256] = "unknown";
+    gethostname(hostname, sizeof(hostname)-1);
+    const char *home = getenv("HOME");
+
+    return std::string(home ? home : "/tmp") + "/.hip_copy_policy." + hostname;
+}
+
+
+// Devices are identified by name and PCI location, so the file stays valid if HIP_VISIBLE_DEVICES changes.
+std::string ihipCopyPolicy_t::fileKey() const
+{
+    std::string name(_device->_props.name);
+    std::replace(name.begin(), name.end(), ' ', '_');
+
+    std::stringstream ss;
+    ss << name << "@" << std::hex << _device->_props.pciBusID << ":" << _device->_props.pciDeviceID;
+    return ss.str();
+}
+
+
+bool ihipCopyPolicy_t::loadFromFile()
+{
+    std::ifstream f(ihipCopyPolicyFile());
+    std::string key;
+    size_t h2dCpuMax, d2hCpuMax, blitMax;
+
+    while (f >> key >> h2dCpuMax >> d2hCpuMax >> blitMax) {
+        if (key == fileKey()) {
+            _h2dCpuMax = h2dCpuMax;
+            _d2hCpuMax = d2hCpuMax;
+            _blitMax   = blitMax;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ihipCopyPolicy_t::saveToFile() const
+{
+    const std::string fileName = ihipCopyPolicyFile();
+
+    // Keep the lines for other devices:
+    std::vector<std::string> lines;
+    {
+        std::ifstream f(fileName);
+        std::string line;
+        while (std::getline(f, line)) {
+            if (!line.empty() && (line.compare(0, fileKey().size() + 1, fileKey() + " ") != 0)) {
+                lines.push_back(line);
+            }
+        }
+    }
+
+    // Write a private copy and rename it into place, so concurrent processes never see a partial file.
+    const std::string tmpName = fileName + "." + std::to_string(getpid());
+    {
+        std::ofstream f(tmpName);
+        if (!f) {
+            return;
+        }
+        for (auto &line : lines) {
+            f << line << "\n";
+        }
+        f << fileKey() << " " << _h2dCpuMax << " " << _d2hCpuMax << " " << _blitMax << "\n";
+    }
+    rename(tmpName.c_str(), fileName.c_str());
+}
@@ -34,15 +34,26 @@ hipError_t ihipEventCreate(hipEvent_t* event, unsigned flags)
 {
     hipError_t e = hipSuccess;
 
-    // TODO-IPC - support hipEventInterprocess.
-    unsigned supportedFlags = hipEventDefault | hipEventBlockingSync | hipEventDisableTiming;
-    if ((flags & ~supportedFlags) == 0) {
+    unsigned supportedFlags = hipEventDefault | hipEventBlockingSync | hipEventDisableTiming | hipEventInterprocess;
+    bool timedIpc = (flags & hipEventInterprocess) && !(flags & hipEventDisableTiming);
+    if (((flags & ~supportedFlags) == 0) && !timedIpc) {
         ihipEvent_t *eh = new ihipEvent_t();
 
         eh->_state  = hipEventStatusCreated;
         eh->_stream = NULL;
         eh->_flags  = flags;
         eh->_timestamp  = 0;
+        eh->_ipcSignal.handle = 0;
+        eh->_ipcOwner = false;
+        eh->_ipcHandleValid = false;
+
+        if (flags & hipEventInterprocess) {
+            if (hsa_amd_signal_create(0, 0, NULL, HSA_AMD_SIGNAL_IPC, &eh->_ipcSignal) != HSA_STATUS_SUCCESS) {
+                delete eh;
+                return hipErrorOutOfResources;
+            }
+            eh->_ipcOwner = true;
+        }
         *event = eh; 
     } else {
         e = hipErrorInvalidValue;
@@ -51,6 +62,15 @@ hipError_t ihipEventCreate(hipEvent_t* event, unsigned flags)
     return e;
 }
 
+
+// Wait on the host until all records of an interprocess event have completed, in this process or another.
+static void ihipWaitIpcEvent(hipEvent_t event)
+{
+    hsa_wait_state_t waitState = (event->_flags & hipEventBlockingSync) ? HSA_WAIT_STATE_BLOCKED : HSA_WAIT_STATE_ACTIVE;
+    while (hsa_signal_wait_scacquire(event->_ipcSignal, HSA_SIGNAL_CONDITION_EQ, 0, UINT64_MAX, waitState) != 0) {
+    }
+}
+
 hipError_t hipEventCreateWithFlags(hipEvent_t* event, unsigned flags)
 {
     HIP_INIT_API(event, flags);
@@ -103,6 +123,14 @@ hipError_t hipEventDestroy(hipEvent_t event)
 
     event->_state  = hipEventStatusUnitialized;
 
+    if (event->_ipcSignal.handle) {
+        if (event->_ipcOwner) {
+            // Barrier packets from our records still reference the signal.
+            ihipWaitIpcEvent(event);
+        }
+        hsa_signal_destroy(event->_ipcSignal);
+    }
+
     delete event;
     event = NULL;
 
@@ -117,17 +145,22 @@ hipError_t hipEventSynchronize(hipEvent_t event)
     if (event) {
         if (event->_state == hipEventStatusUnitialized) {
             return ihipLogStatus(hipErrorInvalidResourceHandle);
+        } else if (event->_ipcSignal.handle) {
+            // May have been recorded by another process.
+            ihipWaitIpcEvent(event);
+            return ihipLogStatus(hipSuccess);
         } else if (event->_state == hipEventStatusCreated ) {
             // Created but not actually recorded on any device:
             return ihipLogStatus(hipSuccess);
         } else if (event->_stream == NULL) {
             auto *ctx = ihipGetTlsDefaultCtx();
             ctx->locked_syncDefaultStream(true);
-            return ihipLogStatus(hipSuccess);
+            return ihipLogStatus(ctx->_defaultStream->locked_takeFileIoError());
         } else {
             event->_marker.wait((event->_flags & hipEventBlockingSync) ? hc::hcWaitModeBlocked : hc::hcWaitModeActive);
 
-            return ihipLogStatus(hipSuccess);
+            // The marker follows any file writes in the stream (see locked_recordEvent), which may have failed:
+            return ihipLogStatus(event->_stream->locked_takeFileIoError());
         }
     } else {
         return ihipLogStatus(hipErrorInvalidResourceHandle);
@@ -180,8 +213,12 @@ hipError_t hipEventQuery(hipEvent_t event)
 {
     HIP_INIT_API(event);
 
-    if ((event->_state == hipEventStatusRecording) && (!event->_marker.is_ready())) {
+    if (event->_ipcSignal.handle) {
+        return ihipLogStatus((hsa_signal_load_scacquire(event->_ipcSignal) == 0) ? hipSuccess : hipErrorNotReady);
+    } else if ((event->_state == hipEventStatusRecording) && (!event->_marker.is_ready())) {
         return ihipLogStatus(hipErrorNotReady);
+    } else if ((event->_state != hipEventStatusCreated) && event->_stream) {
+        return ihipLogStatus(event->_stream->locked_takeFileIoError());
     } else {
         return ihipLogStatus(hipSuccess);
     }
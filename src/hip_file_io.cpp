@@ -0,0 +1,305 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file hip_file_io.cpp
+ *
+ * Stream-ordered copies between files and device memory (hipMemcpyFromFileAsync / hipMemcpyToFileAsync).
+ * Each device has a second ihipStagingEngine_t for file I/O: a ring of HIP_FILE_IO_BUFFERS pinned bounce buffers
+ * of HIP_FILE_IO_SIZE KB, and HIP_FILE_IO_THREADS I/O threads, so file traffic never waits behind pageable copies.
+ *
+ * Read:  each chunk is a stream-ordered host task (see enqueueHostTask) on an I/O thread which preads into a
+ *        bounce buffer, followed on the stream by the DMA of that buffer.  The reads wait for earlier host tasks in
+ *        the stream but overlap each other and the DMAs of earlier chunks.  The call returns once everything is
+ *        enqueued; it only blocks when all the bounce buffers are in use.  A read which fails is reported like a
+ *        failed write.
+ *
+ * Write: the DMA of each chunk is enqueued on the stream, and an I/O thread waits for it and pwrites the buffer,
+ *        exactly like a staged device-to-host copy.  The stream's _stagingFuture tracks the last write, so stream
+ *        and event synchronization cover the file writes.
+ *
+ * A read or write which fails after the call returned is reported, once, by the next file copy on the stream or by
+ * hipStreamSynchronize / hipStreamQuery on the stream or hipEventSynchronize / hipEventQuery on a completed event
+ * recorded in it.
+ *
+ * Files opened with O_DIRECT need 4KB-aligned offsets, lengths and buffers.  Reads are widened to 4KB boundaries
+ * inside the (page-aligned) bounce buffer and the DMA skips the extra bytes; writes must already be aligned.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+static const size_t DIRECT_IO_ALIGN = 4096;
+
+
+//=================================================================================================
+// Helpers:
+//=================================================================================================
+static bool ihipIsDirectIo(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return (flags != -1) && (flags & O_DIRECT);
+}
+
+
+// pread/pwrite the whole range, retrying on short transfers and EINTR.  Returns the number of bytes transferred,
+// which is less than sizeBytes only at end of file or on error.
+static size_t ihipPreadFull(int fd, void *buf, size_t sizeBytes, int64_t offset)
+{
+    size_t done = 0;
+    while (done < sizeBytes) {
+        ssize_t n = pread(fd, static_cast<char*>(buf) + done, sizeBytes - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+
+static size_t ihipPwriteFull(int fd, const void *buf, size_t sizeBytes, int64_t offset)
+{
+    size_t done = 0;
+    while (done < sizeBytes) {
+        ssize_t n = pwrite(fd, static_cast<const char*>(buf) + done, sizeBytes - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+
+static void ihipGetDevicePtrInfo(const void *ptr, hc::AmPointerInfo *ptrInfo)
+{
+    if ((hc::am_memtracker_getinfo(ptrInfo, ptr) != AM_SUCCESS) || !ptrInfo->_isInDeviceMem) {
+        throw ihipException(hipErrorInvalidValue);
+    }
+}
+
+
+// Report, and clear, an error left behind by an earlier file copy.
+static void ihipCheckFileIoError(ihipStream_t *stream, LockedAccessor_StreamCrit_t &crit)
+{
+    hipError_t e = stream->takeFileIoError(crit);
+    if (e != hipSuccess) {
+        throw ihipException(e);
+    }
+}
+
+
+
+//=================================================================================================
+// ihipStream_t file copies:
+//=================================================================================================
+hipError_t ihipStream_t::takeFileIoError(LockedAccessor_StreamCrit_t &crit)
+{
+    if (crit->_fileIoError) {
+        return static_cast<hipError_t>(crit->_fileIoError->exchange(hipSuccess));
+    }
+    return hipSuccess;
+}
+
+
+hipError_t ihipStream_t::locked_takeFileIoError()
+{
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+
+    return takeFileIoError(crit);
+}
+
+
+void ihipStream_t::locked_copyFromFileAsync(void* dst, int fd, int64_t offset, size_t sizeBytes)
+{
+    ihipDevice_t *device = getCtx()->getWriteableDevice();
+    ihipStagingEngine_t *engine = device->_fileIoEngine;
+
+    hc::accelerator acc;
+    hc::AmPointerInfo dstPtrInfo(NULL, NULL, 0, acc, 0, 0);
+    ihipGetDevicePtrInfo(dst, &dstPtrInfo);
+
+    const bool directIo = ihipIsDirectIo(fd);
+    const size_t numBuffers = engine->numBuffers();
+    if (numBuffers == 0) {
+        throw ihipException(hipErrorMemoryAllocation);
+    }
+    // With O_DIRECT each read may start up to one alignment unit early and is rounded up at the end:
+    const size_t alignedBufferSize = engine->bufferSize() & ~(DIRECT_IO_ALIGN - 1);
+    const size_t chunkSize = directIo ? ((alignedBufferSize > DIRECT_IO_ALIGN) ? (alignedBufferSize - DIRECT_IO_ALIGN) : 0)
+                                      : engine->bufferSize();
+    if (chunkSize == 0) {
+        throw ihipException(hipErrorInvalidValue);
+    }
+
+    tprintf(DB_COPY, "copyFromFile dst=%p fd=%d offset=%ld sz=%zu chunk=%zu direct=%d\n",
+            dst, fd, (long)offset, sizeBytes, chunkSize, directIo);
+
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+    ihipCheckFileIoError(this, crit);
+    if (!crit->_fileIoError) {
+        crit->_fileIoError = std::make_shared<std::atomic<int>>(hipSuccess);
+    }
+
+    // Fail a read past end of file now, unless file writes still pending on this stream may extend the file:
+    struct stat st;
+    const bool ioPending = crit->_stagingFuture.valid() &&
+                           (crit->_stagingFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+    if (!ioPending && (fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (offset + (int64_t)sizeBytes > st.st_size)) {
+        throw ihipException(hipErrorInvalidValue);
+    }
+
+    // Every read waits for the host tasks already in the stream (earlier file writes may cover the region),
+    // but not for each other, so up to one read per I/O thread is in flight.
+    const std::shared_future<void> priorIo = crit->_stagingFuture;
+    std::shared_ptr<std::atomic<int>> error = crit->_fileIoError;
+
+    unsigned queue = 0;
+    for (size_t pos = 0; pos < sizeBytes; pos += chunkSize) {
+        const size_t thisChunk = std::min(chunkSize, sizeBytes - pos);
+
+        // The buffer comes back once its DMA, which waits for the read, has completed.  Reads and DMAs don't
+        // depend on this thread, so waiting here with the stream locked can't deadlock.
+        ihipStagingBuffer_t *b = engine->acquire();
+
+        size_t  head       = 0;
+        int64_t readOffset = offset + pos;
+        size_t  readSize   = thisChunk;
+        if (directIo) {
+            head       = readOffset & (DIRECT_IO_ALIGN - 1);
+            readOffset -= head;
+            readSize   = (head + thisChunk + DIRECT_IO_ALIGN - 1) & ~(DIRECT_IO_ALIGN - 1);
+        }
+
+        void *buf = b->_ptr;
+        const size_t needed = head + thisChunk;
+        try {
+            enqueueHostTask(crit, [=] {
+                if (priorIo.valid()) {
+                    priorIo.wait();
+                }
+                // An O_DIRECT read may stop short at end of file, past the bytes we need.
+                if (ihipPreadFull(fd, buf, readSize, readOffset) < needed) {
+                    tprintf(DB_COPY, "copyFromFile fd=%d read of %zu bytes at offset %ld failed, errno=%d\n",
+                            fd, readSize, (long)readOffset, errno);
+                    error->store(hipErrorInvalidValue);
+                }
+            }, false/*waitForCommands*/, engine, queue++, true/*overlapPrior*/);
+
+            // Enqueued behind the host task's barrier, so it runs once the chunk has been read:
+            b->_dmaFuture = crit->_av.copy_async_ext(static_cast<char*>(buf) + head, static_cast<char*>(dst) + pos,
+                                                     thisChunk, hc::hcMemcpyHostToDevice, b->_ptrInfo, dstPtrInfo,
+                                                     &device->_acc);
+        } catch (Kalmar::runtime_exception) {
+            // The read may be queued: keep the buffer out of the ring until the stream has drained.
+            waitStaging(crit);
+            engine->release(b);
+            throw ihipException(hipErrorRuntimeOther);
+        } catch (...) {
+            waitStaging(crit);
+            engine->release(b);
+            throw;
+        }
+        engine->release(b);
+    }
+}
+
+
+void ihipStream_t::locked_copyToFileAsync(int fd, int64_t offset, const void* src, size_t sizeBytes)
+{
+    ihipDevice_t *device = getCtx()->getWriteableDevice();
+    ihipStagingEngine_t *engine = device->_fileIoEngine;
+
+    hc::accelerator acc;
+    hc::AmPointerInfo srcPtrInfo(NULL, NULL, 0, acc, 0, 0);
+    ihipGetDevicePtrInfo(src, &srcPtrInfo);
+
+    if (ihipIsDirectIo(fd) && ((offset & (DIRECT_IO_ALIGN - 1)) || (sizeBytes & (DIRECT_IO_ALIGN - 1)))) {
+        throw ihipException(hipErrorInvalidValue);
+    }
+
+    const size_t chunkSize = engine->bufferSize();
+
+    tprintf(DB_COPY, "copyToFile fd=%d offset=%ld src=%p sz=%zu chunk=%zu\n", fd, (long)offset, src, sizeBytes, chunkSize);
+
+    {
+        LockedAccessor_StreamCrit_t crit(_criticalData);
+        ihipCheckFileIoError(this, crit);
+        if (!crit->_fileIoError) {
+            crit->_fileIoError = std::make_shared<std::atomic<int>>(hipSuccess);
+        }
+    }
+
+    for (size_t pos = 0; pos < sizeBytes; pos += chunkSize) {
+        const size_t thisChunk = std::min(chunkSize, sizeBytes - pos);
+
+        // As for staged D2H copies, hold at most one buffer so acquire() always makes progress.
+        ihipStagingBuffer_t *b = engine->acquire();
+
+        LockedAccessor_StreamCrit_t crit(_criticalData);
+        try {
+            b->_dmaFuture = crit->_av.copy_async_ext(static_cast<const char*>(src) + pos, b->_ptr, thisChunk,
+                                                     hc::hcMemcpyDeviceToHost, srcPtrInfo, b->_ptrInfo,
+                                                     &device->_acc);
+        } catch (Kalmar::runtime_exception) {
+            engine->release(b);
+            throw ihipException(hipErrorRuntimeOther);
+        };
+
+        // The previous host task may be on the staging engine rather than this one - chain to it so the stream's
+        // _stagingFuture always covers every earlier task.
+        std::shared_future<void> priorTask = crit->_stagingFuture;
+        std::shared_ptr<std::atomic<int>> error = crit->_fileIoError;
+        const int64_t fileOffset = offset + pos;
+
+        crit->_stagingFuture = engine->submit(_id, [=] {
+            b->_dmaFuture.wait();
+            if (ihipPwriteFull(fd, b->_ptr, thisChunk, fileOffset) != thisChunk) {
+                tprintf(DB_COPY, "copyToFile fd=%d write of %zu bytes at offset %ld failed, errno=%d\n",
+                        fd, thisChunk, (long)fileOffset, errno);
+                error->store(hipErrorUnknown);
+            }
+            b->_dmaFuture = hc::completion_future();
+            engine->release(b);
+            if (priorTask.valid()) {
+                priorTask.wait();
+            }
+        });
+    }
+}
@@ -47,11 +47,6 @@ THE SOFTWARE.
 #include "hip_hcc.h"
 #include "trace_helper.h"
 
-
-#ifndef USE_COPY_EXT_V2
-#define USE_COPY_EXT_V2 1
-#endif
-
 //=================================================================================================
 //Global variables:
 //=================================================================================================
@@ -86,6 +81,50 @@ int HIP_FORCE_SYNC_COPY = 0;
 
 int HIP_COHERENT_HOST_ALLOC = 0;
 
+// Staging engine for async copies to/from pageable host memory:
+int HIP_STAGING_SIZE = 1024;  /* KB */
+int HIP_STAGING_BUFFERS = 4;
+int HIP_STAGING_THREADS = 1;
+int HIP_PARALLEL_COPY_THREADS = 4;
+int HIP_PARALLEL_COPY_THRESHOLD = 256; /* KB */
+
+// Pin-on-demand cache for hot pageable ranges:
+int HIP_PIN_CACHE = 0; /* MB */
+int HIP_PIN_CACHE_HITS = 2;
+
+// Copy path selection:
+int HIP_COPY_CALIBRATE = 0;
+int HIP_COPY_H2D_CPU_THRESHOLD = -1;
+int HIP_COPY_D2H_CPU_THRESHOLD = -1;
+int HIP_COPY_BLIT_THRESHOLD = -1;
+std::string HIP_COPY_POLICY_FILE;
+int HIP_COPY_BATCH_BLIT_THRESHOLD = 64;
+
+// Peer copies:
+int HIP_PEER_STAGING_SIZE = 4096;
+int HIP_PEER_SPLIT_THRESHOLD = 64;
+int HIP_HOST_NUMA_NODE = -1;
+int HIP_HOST_HUGE_PAGES = 0;
+int HIP_FILE_IO_SIZE = 4096;
+int HIP_FILE_IO_BUFFERS = 4;
+int HIP_FILE_IO_THREADS = 2;
+
+// Binary API trace:
+std::string HIP_TRACE_FILE;
+int HIP_TRACE_RING_SIZE = 4096;
+
+// Timeline:
+std::string HIP_TIMELINE_FILE;
+int HIP_TIMELINE_MAX_EVENTS = 1000000;
+int HIP_PROFILE_KERNELS = 0;
+int HIP_API_LATENCY = 0;
+
+// Runtime profiling control:
+int HIP_PROFILE_START_PAUSED = 0;
+int HIP_PROFILE_SIGNAL = 0;
+std::string HIP_PROFILE_CONTROL_FILE;
+int HIP_PROFILE_MAX_WINDOWS = 0;
+
 
 
 
@@ -131,11 +170,9 @@ thread_local ShortTid tls_shortTid;
 //=================================================================================================
 // Top-level "free" functions:
 //=================================================================================================
-void recordApiTrace(std::string *fullStr, const std::string &apiStr)
+// Start or stop profiling when this thread reaches one of the HIP_DB_START_API / HIP_DB_STOP_API triggers.
+void ihipProfTriggerCheck(int tid, uint64_t apiSeqNum)
 {
-    auto apiSeqNum = tls_shortTid.incApiSeqNum();
-    auto tid = tls_shortTid.tid();
-
     if ((tid < g_dbStartTriggers.size()) && (apiSeqNum >= g_dbStartTriggers[tid].nextTrigger())) {
         printf ("info: resume profiling at %lu\n", apiSeqNum);
         RESUME_PROFILING;
@@ -146,6 +183,15 @@ void recordApiTrace(std::string *fullStr, const std::string &apiStr)
         STOP_PROFILING;
         g_dbStopTriggers.pop_back();
     };
+}
+
+
+void recordApiTrace(std::string *fullStr, const std::string &apiStr)
+{
+    auto apiSeqNum = tls_shortTid.incApiSeqNum();
+    auto tid = tls_shortTid.tid();
+
+    ihipProfTriggerCheck(tid, apiSeqNum);
 
     fullStr->reserve(16 + apiStr.length());
     *fullStr = std::to_string(tid) + ".";
@@ -257,6 +303,19 @@ ihipStream_t::ihipStream_t(ihipCtx_t *ctx, hc::accelerator_view av, unsigned int
 //---
 ihipStream_t::~ihipStream_t()
 {
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+    for (auto &s : crit->_hostTaskSignals) {
+        s.second.wait();
+        hsa_signal_destroy(s.first);
+    }
+    for (auto &t : crit->_batchTables) {
+        if (t._cf.valid()) {
+            t._cf.wait();
+        }
+        if (t._ranges) {
+            hc::am_free(t._ranges);
+        }
+    }
 }
 
 
@@ -291,6 +350,9 @@ void ihipStream_t::wait(LockedAccessor_StreamCrit_t &crit, bool assertQueueEmpty
         crit->_av.wait(waitMode);
     }
 
+    waitStaging(crit);
+    reclaimHostTaskSignals(crit);
+
     crit->_kernelCnt = 0;
 }
 
@@ -309,7 +371,14 @@ void ihipStream_t::locked_waitEvent(hipEvent_t event)
 {
     LockedAccessor_StreamCrit_t crit(_criticalData);
 
-    crit->_av.create_blocking_marker(event->_marker);
+    if (event->_ipcSignal.handle) {
+        // The event may be recorded in another process - wait on the shared signal in the queue.
+        // Follow with a marker so later SDMA copies wait too.
+        ihipEnqueueBarrierPacket(crit->_av, event->_ipcSignal, hsa_signal_t{0});
+        crit->_av.create_marker();
+    } else {
+        crit->_av.create_blocking_marker(event->_marker);
+    }
 }
 
 // Create a marker in this stream.
@@ -319,7 +388,19 @@ void ihipStream_t::locked_recordEvent(hipEvent_t event)
     // Lock the stream to prevent simultaneous access
     LockedAccessor_StreamCrit_t crit(_criticalData);
 
+    // Staged D2H copies finish on the host, after their DMA - hold the marker back until they are done.
+    fenceStaging(crit);
+
     event->_marker = crit->_av.create_marker();
+    if (g_timeline) {
+        ihipTimelineAddOp(this, "event", "hipEventRecord", nullptr, 0, event->_marker);
+    }
+
+    if (event->_ipcSignal.handle) {
+        // Count this record in the shared signal.  The barrier retires after the marker and decrements it again.
+        hsa_signal_add_screlease(event->_ipcSignal, 1);
+        ihipEnqueueBarrierPacket(crit->_av, hsa_signal_t{0}, event->_ipcSignal);
+    }
 }
 
 //=============================================================================
@@ -349,6 +430,11 @@ ihipCtx_t * ihipStream_t::getCtx() const
 // Lock the stream to prevent other threads from intervening.
 LockedAccessor_StreamCrit_t ihipStream_t::lockopen_preKernelCommand()
 {
+    // Kernels may touch any allocation, so peer remaps still in progress must finish first:
+    if (g_peerMapPending.load(std::memory_order_acquire)) {
+        ihipWaitPeerMappers();
+    }
+
     LockedAccessor_StreamCrit_t crit(_criticalData, false/*no unlock at destruction*/);
 
     if(crit->_kernelCnt > HIP_NUM_KERNELS_INFLIGHT){
@@ -439,15 +525,19 @@ void ihipStream_t::launchModuleKernel(
 
 
 //=============================================================================
-// Recompute the peercnt and the packed _peerAgents whenever a peer is added or deleted.
-// The packed _peerAgents can efficiently be used on each memory allocation.
+// Publish a new peer snapshot whenever a peer is added or deleted.
+// The packed agent array in the snapshot can efficiently be used on each memory allocation, without the ctx lock.
 template<>
 void ihipCtxCriticalBase_t<CtxMutex>::recomputePeerAgents()
 {
-    _peerCnt = 0;
-    std::for_each (_peers.begin(), _peers.end(), [this](ihipCtx_t* ctx) {
-        _peerAgents[_peerCnt++] = ctx->getDevice()->_hsaAgent;
+    std::vector<hsa_agent_t> agents;
+    agents.reserve(_peers.size());
+    std::for_each (_peers.begin(), _peers.end(), [&agents](ihipCtx_t* ctx) {
+        agents.push_back(ctx->getDevice()->_hsaAgent);
     });
+
+    auto snapshot = std::make_shared<const ihipPeerSnapshot_t>(std::move(agents), _peerSnapshot->_generation + 1);
+    std::atomic_store(&_peerSnapshot, ihipPeerSnapshotPtr_t(snapshot));
 }
 
 
@@ -499,7 +589,6 @@ void ihipCtxCriticalBase_t<CtxMutex>::resetPeerWatchers(ihipCtx_t *thisCtx)
 {
     tprintf(DB_COPY, "resetPeerWatchers for context=%s\n", thisCtx->toString().c_str());
     _peers.clear();
-    _peerCnt = 0;
     addPeerWatcher(thisCtx, thisCtx); // peer-list always contains self agent.
 }
 
@@ -544,7 +633,14 @@ ihipDevice_t::ihipDevice_t(unsigned deviceId, unsigned deviceCnt, hc::accelerato
     }
 
     initProperties(&_props);
+    initNumaPlacement();
 
+    _stagingEngine = new ihipStagingEngine_t(this, HIP_STAGING_SIZE*1024, HIP_STAGING_BUFFERS, HIP_STAGING_THREADS);
+    _copyPolicy = new ihipCopyPolicy_t(this);
+    _peerCopyEngine = new ihipPeerCopyEngine_t(this, size_t(HIP_PEER_STAGING_SIZE)*1024);
+    _peerMapper = new ihipPeerMapper_t(this);
+    _fileIoEngine = new ihipStagingEngine_t(this, size_t(HIP_FILE_IO_SIZE)*1024, HIP_FILE_IO_BUFFERS, HIP_FILE_IO_THREADS);
+    _symbolCache = new ihipSymbolCache_t(this);
 
     _primaryCtx = new ihipCtx_t(this, deviceCnt, hipDeviceMapHost);
 }
@@ -554,6 +650,24 @@ ihipDevice_t::~ihipDevice_t()
 {
     delete _primaryCtx;
     _primaryCtx = NULL;
+
+    delete _stagingEngine;
+    _stagingEngine = NULL;
+
+    delete _copyPolicy;
+    _copyPolicy = NULL;
+
+    delete _peerCopyEngine;
+    _peerCopyEngine = NULL;
+
+    delete _peerMapper;
+    _peerMapper = NULL;
+
+    delete _fileIoEngine;
+    _fileIoEngine = NULL;
+
+    delete _symbolCache;
+    _symbolCache = NULL;
 }
 
 
@@ -761,6 +875,12 @@ hipError_t ihipDevice_t::initProperties(hipDeviceProp_t* prop)
     // prop->pciDomainID =  bdf_id & 0x7;
     prop->pciDeviceID =  (bdf_id>>3) & 0x1F;
     prop->pciBusID =  (bdf_id>>8) & 0xFF;
+    _pciBdfId = bdf_id;
+
+    _pciDomain = 0;
+#if HIP_HAS_HSA_AGENT_DOMAIN
+    hsa_agent_get_info(_hsaAgent, (hsa_agent_info_t)HSA_AMD_AGENT_INFO_DOMAIN, &_pciDomain);
+#endif
 
     // Masquerade as a 3.0-level device. This will change as more HW functions are properly supported.
     // Application code should use the arch.has* to do detailed feature detection.
@@ -1277,6 +1397,16 @@ void ihipInit()
     READ_ENV_I(release, HIP_PROFILE_API, 0,  "Add HIP API markers to ATP file generated with CodeXL. 0x1=short API name, 0x2=full API name including args.");
     READ_ENV_S(release, HIP_DB_START_API, 0,  "Comma-separated list of tid.api_seq_num for when to start debug and profiling.");
     READ_ENV_S(release, HIP_DB_STOP_API, 0,  "Comma-separated list of tid.api_seq_num for when to stop debug and profiling.");
+    READ_ENV_S(release, HIP_TRACE_FILE, 0,  "Trace each HIP API call in binary form to this file.  Much cheaper than HIP_TRACE_API.  Decode with bin/hiptracedecode.");
+    READ_ENV_I(release, HIP_TRACE_RING_SIZE, 0,  "Number of records in the binary trace buffer of each thread.  Records are dropped if the buffer fills before it is written.");
+    READ_ENV_S(release, HIP_TIMELINE_FILE, 0,  "Record a timeline of HIP APIs, kernels, copies and event records, and write it to this file at exit in Chrome trace (JSON) format.");
+    READ_ENV_I(release, HIP_TIMELINE_MAX_EVENTS, 0,  "Maximum number of timeline events kept in memory (about 56 bytes each).  Later events are dropped.");
+    READ_ENV_I(release, HIP_PROFILE_KERNELS, 0,  "Time every kernel on the device and print per-kernel statistics (count, total, min, max, p50, p99) at exit and at hipProfilerStop.");
+    READ_ENV_I(release, HIP_API_LATENCY, 0,  "Record a latency histogram for each HIP API, read with hipApiGetLatency.  1=record, 2=also print percentiles to stderr at exit.");
+    READ_ENV_I(release, HIP_PROFILE_START_PAUSED, 0,  "Set up HIP_TRACE_FILE, HIP_TIMELINE_FILE and HIP_PROFILE_KERNELS but do not record until hipProfilerStart, HIP_PROFILE_SIGNAL or HIP_PROFILE_CONTROL_FILE starts a capture window.");
+    READ_ENV_I(release, HIP_PROFILE_SIGNAL, 0,  "Signal number (for example 12 = SIGUSR2) which toggles recording on and off.  Each capture window is written to numbered files.");
+    READ_ENV_S(release, HIP_PROFILE_CONTROL_FILE, 0,  "File polled for \"start\" or \"stop\", which starts or stops a capture window when its contents change.");
+    READ_ENV_I(release, HIP_PROFILE_MAX_WINDOWS, 0,  "Keep only the files of the last N capture windows.  0 keeps all.");
 
     READ_ENV_C(release, HIP_VISIBLE_DEVICES, CUDA_VISIBLE_DEVICES, "Only devices whose index is present in the sequence are visible to HIP applications and they are enumerated in the order of sequence.", HIP_VISIBLE_DEVICES_callback );
 
@@ -1290,6 +1420,28 @@ void ihipInit()
 
     READ_ENV_I(release, HIP_COHERENT_HOST_ALLOC, 0, "If set, all host memory will be allocated as fine-grained system memory.  This allows threadfence_system to work but prevents host memory from being cached on GPU which may have performance impact.");
 
+    READ_ENV_I(release, HIP_STAGING_SIZE, 0, "Size of each pinned staging buffer used for async copies to/from pageable host memory, in KB.");
+    READ_ENV_I(release, HIP_STAGING_BUFFERS, 0, "Number of pinned staging buffers per device (pipeline depth) for async pageable copies.  0 disables the staging engine.");
+    READ_ENV_I(release, HIP_STAGING_THREADS, 0, "Number of worker threads per device which drain staged device-to-host copies.");
+    READ_ENV_I(release, HIP_PARALLEL_COPY_THREADS, 0, "Number of extra CPU threads per device used to split large host-side staging copies.  0 copies on a single thread.");
+    READ_ENV_I(release, HIP_PARALLEL_COPY_THRESHOLD, 0, "Host-side staging copies at least this large (in KB) are split across the HIP_PARALLEL_COPY_THREADS threads.");
+    READ_ENV_I(release, HIP_PIN_CACHE, 0, "If non-zero, copies transparently pin hot pageable host ranges, keeping at most this many MB pinned.");
+    READ_ENV_I(release, HIP_PIN_CACHE_HITS, 0, "Number of copies from the same pageable range before the pin cache pins it.");
+
+    READ_ENV_I(release, HIP_COPY_CALIBRATE, 0, "Copy path selection. 0=use built-in thresholds (default), 1=measure CPU/blit/SDMA crossovers once per host and cache them in HIP_COPY_POLICY_FILE, 2=always re-measure.");
+    READ_ENV_I(release, HIP_COPY_H2D_CPU_THRESHOLD, 0, "H2D copies up to this many bytes use CPU stores through the large BAR.  -1=use calibrated value.");
+    READ_ENV_I(release, HIP_COPY_D2H_CPU_THRESHOLD, 0, "D2H copies up to this many bytes use CPU loads through the large BAR.  -1=use calibrated value.");
+    READ_ENV_I(release, HIP_COPY_BLIT_THRESHOLD, 0, "D2D copies up to this many bytes use a blit kernel instead of SDMA.  -1=use calibrated value.");
+    READ_ENV_S(release, HIP_COPY_POLICY_FILE, 0, "File caching calibrated copy thresholds.  Default is $HOME/.hip_copy_policy.<hostname>.");
+    READ_ENV_I(release, HIP_PEER_STAGING_SIZE, 0, "Size of each of the two pinned bounce buffers, in KB, used for peer copies between devices which cannot see each other's memory.");
+    READ_ENV_I(release, HIP_PEER_SPLIT_THRESHOLD, 0, "Peer copies at least this large, in MB, are split across the DMA engines of both devices.  0=never split.");
+    READ_ENV_I(release, HIP_HOST_NUMA_NODE, 0, "NUMA node for pinned host memory, staging buffers and worker threads.  -1=node closest to each device, N=force OS node N (numbered as in /sys/devices/system/node), -2=no NUMA placement.");
+    READ_ENV_I(release, HIP_HOST_HUGE_PAGES, 0, "1=back all hipHostMalloc allocations with huge pages where available, as if hipHostMallocHugePages were set.");
+    READ_ENV_I(release, HIP_FILE_IO_SIZE, 0, "Size of each pinned bounce buffer, in KB, for hipMemcpyFromFileAsync and hipMemcpyToFileAsync.");
+    READ_ENV_I(release, HIP_FILE_IO_BUFFERS, 0, "Number of pinned bounce buffers per device for file I/O.  Reads of this many buffers are in flight at once.");
+    READ_ENV_I(release, HIP_FILE_IO_THREADS, 0, "Number of threads per device which read and write files for hipMemcpyFromFileAsync and hipMemcpyToFileAsync.");
+    READ_ENV_I(release, HIP_COPY_BATCH_BLIT_THRESHOLD, 0, "Ranges of a batched copy up to this size (KB) are copied together by one blit kernel.  Larger ranges use one DMA command each.");
+
     // Some flags have both compile-time and runtime flags - generate a warning if user enables the runtime flag but the compile-time flag is disabled.
     if (HIP_DB && !COMPILE_HIP_DB) {
         fprintf (stderr, "warning: env var HIP_DB=0x%x but COMPILE_HIP_DB=0.  (perhaps enable COMPILE_HIP_DB in src code before compiling?)\n", HIP_DB);
@@ -1337,6 +1489,12 @@ void ihipInit()
     parseTrigger(HIP_DB_START_API, g_dbStartTriggers);
     parseTrigger(HIP_DB_STOP_API,  g_dbStopTriggers);
 
+    ihipTraceInit();
+    ihipTimelineInit();
+    ihipKernelProfInit();
+    ihipApiLatencyInit();
+    ihipProfControlInit();
+
 
 
 
@@ -1465,7 +1623,7 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, dim3 grid, dim3 block, grid_
 
     auto crit = stream->lockopen_preKernelCommand();
     lp->av = &(crit->_av);
-    lp->cf = nullptr;
+    lp->cf = (g_timeline || g_kernelProf) ? new hc::completion_future : nullptr;  // filled in by the launch, see ihipPostLaunchKernel
     ihipPrintKernelLaunch(kernelNameStr, lp, stream);
 
     return (stream);
@@ -1487,7 +1645,7 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, size_t grid, dim3 block, gri
 
     auto crit = stream->lockopen_preKernelCommand();
     lp->av = &(crit->_av);
-    lp->cf = nullptr;
+    lp->cf = (g_timeline || g_kernelProf) ? new hc::completion_future : nullptr;  // filled in by the launch, see ihipPostLaunchKernel
     ihipPrintKernelLaunch(kernelNameStr, lp, stream);
     return (stream);
 }
@@ -1508,7 +1666,7 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, dim3 grid, size_t block, gri
 
     auto crit = stream->lockopen_preKernelCommand();
     lp->av = &(crit->_av);
-    lp->cf = nullptr;
+    lp->cf = (g_timeline || g_kernelProf) ? new hc::completion_future : nullptr;  // filled in by the launch, see ihipPostLaunchKernel
     ihipPrintKernelLaunch(kernelNameStr, lp, stream);
     return (stream);
 }
@@ -1529,7 +1687,7 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, size_t grid, size_t block, g
 
     auto crit = stream->lockopen_preKernelCommand();
     lp->av = &(crit->_av);
-    lp->cf = nullptr;
+    lp->cf = (g_timeline || g_kernelProf) ? new hc::completion_future : nullptr;  // filled in by the launch, see ihipPostLaunchKernel
 
 
     ihipPrintKernelLaunch(kernelNameStr, lp, stream);
@@ -1544,7 +1702,24 @@ void ihipPostLaunchKernel(const char *kernelName, hipStream_t stream, grid_launc
 {
     tprintf(DB_SYNC, "ihipPostLaunchKernel, unlocking stream\n");
 
+    hc::completion_future profCf;
+    if (lp.cf) {
+        if (g_timeline) {
+            ihipTimelineAddOp(stream, "kernel", ihipTimelineIntern(kernelName), nullptr, 0, *lp.cf);
+        }
+        if (g_kernelProf) {
+            profCf = *lp.cf;
+        }
+        delete lp.cf;
+        lp.cf = nullptr;
+    }
+
     stream->lockclose_postKernelCommand(kernelName, lp.av);
+
+    // Queued after the stream is released, since a thread with a full queue waits for its oldest launch:
+    if (profCf.valid()) {
+        ihipKernelProfAdd(kernelName, lp.grid_dim, lp.group_dim, profCf);
+    }
     MARKER_END();
 }
 
@@ -1602,6 +1777,8 @@ const char *ihipErrorString(hipError_t hip_error)
         case hipErrorInvalidHandle              : return "hipErrorInvalidHandle";
         case hipErrorNotFound                   : return "hipErrorNotFound";
         case hipErrorIllegalAddress             : return "hipErrorIllegalAddress";
+        case hipErrorInvalidSymbol              : return "hipErrorInvalidSymbol";
+        case hipErrorNotSupported               : return "hipErrorNotSupported";
 
         case hipErrorMissingConfiguration       : return "hipErrorMissingConfiguration";
         case hipErrorMemoryAllocation           : return "hipErrorMemoryAllocation";
@@ -1627,6 +1804,7 @@ const char *ihipErrorString(hipError_t hip_error)
         case hipErrorRuntimeOther               : return "hipErrorRuntimeOther";
         case hipErrorHostMemoryAlreadyRegistered : return "hipErrorHostMemoryAlreadyRegistered";
         case hipErrorHostMemoryNotRegistered    : return "hipErrorHostMemoryNotRegistered";
+        case hipErrorMapBufferObjectFailed      : return "hipErrorMapBufferObjectFailed";
         case hipErrorTbd                        : return "hipErrorTbd";
         default                                 : return "hipErrorUnknown";
     };
@@ -1780,6 +1958,7 @@ void ihipStream_t::resolveHcMemcpyDirection(unsigned hipMemKind,
         } else {
             tprintf (DB_COPY, "P2P.  Copy engine (dev:%d agent=0x%lx) can see src and dst.\n",
                     (*copyDevice)->getDeviceNum(), (*copyDevice)->getDevice()->_hsaAgent.handle);
+            ensurePeerMapped(dstPtrInfo, srcPtrInfo);
         }
     } else {
         *forceUnpinnedCopy = true;
@@ -1789,9 +1968,77 @@ void ihipStream_t::resolveHcMemcpyDirection(unsigned hipMemKind,
 }
 
 
+// Peer visibility is applied lazily after hipDeviceEnablePeerAccess - make sure both buffers of a copy are mapped.
+void ihipStream_t::ensurePeerMapped(const hc::AmPointerInfo *dstPtrInfo, const hc::AmPointerInfo *srcPtrInfo)
+{
+    const hc::AmPointerInfo *ptrInfos[2] = {dstPtrInfo, srcPtrInfo};
+    for (auto ptrInfo : ptrInfos) {
+        ihipDevice_t *device = ihipGetDevice(ptrInfo->_appId);
+        if (device) {
+            device->_peerMapper->ensureMapped(*ptrInfo);
+        }
+    }
+}
+
+
+// If the pin cache is enabled, look up host pointers in it.  A pageable range which has just become hot is pinned
+// here, so re-query the memtracker and let the caller take the DMA fast path.
+void ihipStream_t::pinCacheAcquire(const void *ptr, size_t sizeBytes, bool *tracked, hc::AmPointerInfo *ptrInfo,
+                                   ihipPinCache_t::Ref *ref)
+{
+    if (!g_pinCache.enabled() || (*tracked && ptrInfo->_isInDeviceMem)) {
+        return;
+    }
+
+    if (g_pinCache.acquire(ptr, sizeBytes, *tracked, ref) && !*tracked) {
+        *tracked = (hc::am_memtracker_getinfo(ptrInfo, ptr) == AM_SUCCESS);
+    }
+}
+
+
+// Returns true if the copy moves data between device memory and pageable (untracked) host memory, and the
+// staging engine of the copy device is enabled.
+bool ihipStream_t::canUseStaging(hc::hcCommandKind hcCopyDir, bool dstTracked, bool srcTracked, const ihipCtx_t *copyDevice)
+{
+    if ((copyDevice == nullptr) || !copyDevice->getDevice()->_stagingEngine->enabled()) {
+        return false;
+    }
+
+    return ((hcCopyDir == hc::hcMemcpyHostToDevice) && !srcTracked && dstTracked) ||
+           ((hcCopyDir == hc::hcMemcpyDeviceToHost) && srcTracked && !dstTracked);
+}
+
+
+//---
+// Puts a copy which completes before the API returns on the timeline, timed on the host.
+// Copies which stay asynchronous are timed by their completion signal instead and leave _name unset.
+struct ihipTimelineCopy_t {
+    ihipTimelineCopy_t(const ihipStream_t *stream, size_t sizeBytes) :
+        _stream(stream), _sizeBytes(sizeBytes), _name(nullptr), _detail(nullptr),
+        _begin(g_timeline ? hc::get_system_ticks() : 0)
+    {};
+
+    ~ihipTimelineCopy_t() {
+        if (g_timeline && _name) {
+            ihipTimelineAddOp(_stream, "copy", _name, _detail, _sizeBytes, _begin, hc::get_system_ticks());
+        }
+    };
+
+    void set(hc::hcCommandKind hcCopyDir, const char *detail) { _name = hcMemcpyStr(hcCopyDir); _detail = detail; };
+
+    const ihipStream_t *_stream;
+    size_t              _sizeBytes;
+    const char         *_name;
+    const char         *_detail;
+    uint64_t            _begin;
+};
+
+
 // TODO - remove kind parm from here or use it below?
 void ihipStream_t::locked_copySync(void* dst, const void* src, size_t sizeBytes, unsigned kind, bool resolveOn)
 {
+    ihipTimelineCopy_t timeline(this, sizeBytes);
+
     ihipCtx_t *ctx = this->getCtx();
     const ihipDevice_t *device = ctx->getDevice();
 
@@ -1805,19 +2052,58 @@ void ihipStream_t::locked_copySync(void* dst, const void* src, size_t sizeBytes,
     bool dstTracked = (hc::am_memtracker_getinfo(&dstPtrInfo, dst) == AM_SUCCESS);
     bool srcTracked = (hc::am_memtracker_getinfo(&srcPtrInfo, src) == AM_SUCCESS);
 
+    ihipPinCache_t::Ref dstPinRef, srcPinRef;
+    pinCacheAcquire(dst, sizeBytes, &dstTracked, &dstPtrInfo, &dstPinRef);
+    pinCacheAcquire(src, sizeBytes, &srcTracked, &srcPtrInfo, &srcPinRef);
+
 
     hc::hcCommandKind hcCopyDir;
     ihipCtx_t *copyDevice;
     bool forceUnpinnedCopy;
     resolveHcMemcpyDirection(kind, &dstPtrInfo, &srcPtrInfo, &hcCopyDir, &copyDevice, &forceUnpinnedCopy);
 
+    ihipCopyPath_t copyPath = copyDevice ? copyDevice->getDevice()->_copyPolicy->choose(hcCopyDir, sizeBytes, dstPtrInfo, srcPtrInfo)
+                                         : ihipCopyPathSdma;
+    timeline.set(hcCopyDir, ihipCopyPathStr(copyPath));
+
+    if (copyPath == ihipCopyPathCpu) {
+        LockedAccessor_StreamCrit_t crit (_criticalData);
+
+        // Commands already in the stream may access the same memory:
+        this->wait(crit);
+
+        tprintf (DB_COPY, "copySync dst=%p src=%p sz=%zu dir=%s path=cpu\n", dst, src, sizeBytes, hcMemcpyStr(hcCopyDir));
+        memcpy(dst, src, sizeBytes);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // drain write-combined stores to the BAR.
+        return;
+    }
+
+    if (canUseStaging(hcCopyDir, dstTracked, srcTracked, copyDevice)) {
+        // Pageable host memory - use the staging engine so the host-side copy is split across the copy pool,
+        // then wait for the DMA and any D2H drains to make the copy synchronous.  This replaces the unpinned
+        // copy_ext path below (HIP_STAGING_BUFFERS=0 disables the engine and restores it).
+        tprintf (DB_COPY, "copySync dst=%p src=%p sz=%zu dir=%s path=sdma(staged)\n", dst, src, sizeBytes, hcMemcpyStr(hcCopyDir));
+        timeline._detail = "staged";
+        if (hcCopyDir == hc::hcMemcpyHostToDevice) {
+            stagedCopyHostToDevice(dst, src, sizeBytes, dstPtrInfo, copyDevice);
+        } else {
+            stagedCopyDeviceToHost(dst, src, sizeBytes, srcPtrInfo, copyDevice);
+        }
+        locked_wait();
+        return;
+    }
+
     {
         LockedAccessor_StreamCrit_t crit (_criticalData);
-        tprintf (DB_COPY, "copySync copyDev:%d  dst=%p (phys_dev:%d, isDevMem:%d)  src=%p(phys_dev:%d, isDevMem:%d)   sz=%zu dir=%s forceUnpinnedCopy=%d\n",
+
+        // Sync copies may touch host memory still being written by staged D2H copies:
+        waitStaging(crit);
+
+        tprintf (DB_COPY, "copySync copyDev:%d  dst=%p (phys_dev:%d, isDevMem:%d)  src=%p(phys_dev:%d, isDevMem:%d)   sz=%zu dir=%s forceUnpinnedCopy=%d path=%s\n",
                  copyDevice ? copyDevice->getDeviceNum():-1,
                  dst, dstPtrInfo._appId, dstPtrInfo._isInDeviceMem,
                  src, srcPtrInfo._appId, srcPtrInfo._isInDeviceMem,
-                 sizeBytes, hcMemcpyStr(hcCopyDir), forceUnpinnedCopy);
+                 sizeBytes, hcMemcpyStr(hcCopyDir), forceUnpinnedCopy, ihipCopyPathStr(copyPath));
         tprintf (DB_COPY, "  dst=%p baseHost=%p baseDev=%p sz=%zu home_dev=%d tracked=%d isDevMem=%d\n",
                  dst, dstPtrInfo._hostPointer, dstPtrInfo._devicePointer, dstPtrInfo._sizeBytes,
                  dstPtrInfo._appId, dstTracked, dstPtrInfo._isInDeviceMem);
@@ -1825,18 +2111,22 @@ void ihipStream_t::locked_copySync(void* dst, const void* src, size_t sizeBytes,
                  src, srcPtrInfo._hostPointer, srcPtrInfo._devicePointer, srcPtrInfo._sizeBytes,
                  srcPtrInfo._appId, srcTracked, srcPtrInfo._isInDeviceMem);
 
-
+        if (copyPath == ihipCopyPathBlit) {
+            ihipCopyKernel(crit->_av, ihipAgentPtr(dst, dstPtrInfo), ihipAgentPtr(src, srcPtrInfo), sizeBytes).wait();
+        } else {
 #if USE_COPY_EXT_V2
-        crit->_av.copy_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, copyDevice ? &copyDevice->getDevice()->_acc : nullptr, forceUnpinnedCopy);
+            crit->_av.copy_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, copyDevice ? &copyDevice->getDevice()->_acc : nullptr, forceUnpinnedCopy);
 #else
-        crit->_av.copy_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, forceUnpinnedCopy);
+            crit->_av.copy_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, forceUnpinnedCopy);
 #endif
+        }
     }
 }
 
 
 void ihipStream_t::locked_copyAsync(void* dst, const void* src, size_t sizeBytes, unsigned kind)
 {
+    ihipTimelineCopy_t timeline(this, sizeBytes);
 
     const ihipCtx_t *ctx = this->getCtx();
 
@@ -1846,16 +2136,34 @@ void ihipStream_t::locked_copyAsync(void* dst, const void* src, size_t sizeBytes
     }
 
     if (kind == hipMemcpyHostToHost) {
-        tprintf (DB_COPY, "locked_copyAsync: H2H with memcpy");
-
-        // TODO - consider if we want to perhaps use the GPU SDMA engines anyway, to avoid the host-side sync here and keep everything flowing on the GPU.
-        /* As this is a CPU op, we need to wait until all
-        the commands in current stream are finished.
-        */
         LockedAccessor_StreamCrit_t crit(_criticalData);
-        this->wait(crit);
 
-        memcpy(dst, src, sizeBytes);
+        if (HIP_FORCE_SYNC_COPY || isIdle(crit)) {
+            tprintf (DB_COPY, "locked_copyAsync: H2H with memcpy\n");
+
+            /* As this is a CPU op, we need to wait until all
+            the commands in current stream are finished.
+            */
+            this->wait(crit);
+
+            timeline.set(hc::hcMemcpyHostToHost, "cpu");
+            memcpy(dst, src, sizeBytes);
+        } else {
+            // Stream is busy - copy on a staging worker so the caller and the device keep running.
+            // Large copies are split across the host copy pool.
+            tprintf (DB_COPY, "locked_copyAsync: H2H dst=%p src=%p sz=%zu as stream-ordered host task\n", dst, src, sizeBytes);
+
+            ihipStagingEngine_t *engine = ctx->getDevice()->_stagingEngine;
+            enqueueHostTask(crit, [=] {
+                engine->hostCopy(dst, src, sizeBytes);
+            });
+            recordHostWrite(crit, dst, sizeBytes);
+
+            if (HIP_API_BLOCKING) {
+                tprintf(DB_SYNC, "%s LAUNCH_BLOCKING for completion of hipMemcpyAsync(sz=%zu)\n", ToString(this).c_str(), sizeBytes);
+                this->wait(crit);
+            }
+        }
 
     } else {
 
@@ -1865,16 +2173,37 @@ void ihipStream_t::locked_copyAsync(void* dst, const void* src, size_t sizeBytes
         bool dstTracked = (hc::am_memtracker_getinfo(&dstPtrInfo, dst) == AM_SUCCESS);
         bool srcTracked = (hc::am_memtracker_getinfo(&srcPtrInfo, src) == AM_SUCCESS);
 
+        ihipPinCache_t::Ref dstPinRef, srcPinRef;
+        pinCacheAcquire(dst, sizeBytes, &dstTracked, &dstPtrInfo, &dstPinRef);
+        pinCacheAcquire(src, sizeBytes, &srcTracked, &srcPtrInfo, &srcPinRef);
+
 
         hc::hcCommandKind hcCopyDir;
         ihipCtx_t *copyDevice;
         bool forceUnpinnedCopy;
         resolveHcMemcpyDirection(kind, &dstPtrInfo, &srcPtrInfo, &hcCopyDir, &copyDevice, &forceUnpinnedCopy);
-        tprintf (DB_COPY, "copyASync copyDev:%d  dst=%p (phys_dev:%d, isDevMem:%d)  src=%p(phys_dev:%d, isDevMem:%d)   sz=%zu dir=%s forceUnpinnedCopy=%d\n",
+
+        ihipCopyPath_t copyPath = copyDevice ? copyDevice->getDevice()->_copyPolicy->choose(hcCopyDir, sizeBytes, dstPtrInfo, srcPtrInfo)
+                                             : ihipCopyPathSdma;
+        if (copyPath == ihipCopyPathCpu) {
+            LockedAccessor_StreamCrit_t crit(_criticalData);
+
+            // A CPU copy happens immediately, so it is only ordered correctly if the stream is idle:
+            if (isIdle(crit)) {
+                tprintf (DB_COPY, "copyASync dst=%p src=%p sz=%zu dir=%s path=cpu\n", dst, src, sizeBytes, hcMemcpyStr(hcCopyDir));
+                timeline.set(hcCopyDir, "cpu");
+                memcpy(dst, src, sizeBytes);
+                std::atomic_thread_fence(std::memory_order_seq_cst); // drain write-combined stores to the BAR.
+                return;
+            }
+            copyPath = ihipCopyPathSdma;
+        }
+
+        tprintf (DB_COPY, "copyASync copyDev:%d  dst=%p (phys_dev:%d, isDevMem:%d)  src=%p(phys_dev:%d, isDevMem:%d)   sz=%zu dir=%s forceUnpinnedCopy=%d path=%s\n",
                  copyDevice ? copyDevice->getDeviceNum():-1,
                  dst, dstPtrInfo._appId, dstPtrInfo._isInDeviceMem,
                  src, srcPtrInfo._appId, srcPtrInfo._isInDeviceMem,
-                 sizeBytes, hcMemcpyStr(hcCopyDir), forceUnpinnedCopy);
+                 sizeBytes, hcMemcpyStr(hcCopyDir), forceUnpinnedCopy, ihipCopyPathStr(copyPath));
         tprintf (DB_COPY, "  dst=%p baseHost=%p baseDev=%p sz=%zu home_dev=%d tracked=%d isDevMem=%d\n",
                  dst, dstPtrInfo._hostPointer, dstPtrInfo._devicePointer, dstPtrInfo._sizeBytes,
                  dstPtrInfo._appId, dstTracked, dstPtrInfo._isInDeviceMem);
@@ -1889,7 +2218,16 @@ void ihipStream_t::locked_copyAsync(void* dst, const void* src, size_t sizeBytes
 
             // Perform fast asynchronous copy - we know copyDevice != NULL based on check above
             try {
-                if (HIP_FORCE_SYNC_COPY) {
+                if (copyPath == ihipCopyPathBlit) {
+                    hc::completion_future cf = ihipCopyKernel(crit->_av, ihipAgentPtr(dst, dstPtrInfo), ihipAgentPtr(src, srcPtrInfo), sizeBytes);
+                    if (g_timeline) {
+                        ihipTimelineAddOp(this, "copy", hcMemcpyStr(hcCopyDir), "blit", sizeBytes, cf);
+                    }
+                    if (HIP_FORCE_SYNC_COPY) {
+                        cf.wait();
+                    }
+                } else if (HIP_FORCE_SYNC_COPY) {
+                    timeline.set(hcCopyDir, "sdma");
 #if USE_COPY_EXT_V2
                     crit->_av.copy_ext      (src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, &copyDevice->getDevice()->_acc, forceUnpinnedCopy);
 #else
@@ -1898,10 +2236,16 @@ void ihipStream_t::locked_copyAsync(void* dst, const void* src, size_t sizeBytes
 
                 } else {
 #if USE_COPY_EXT_V2
-                    crit->_av.copy_async_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, &copyDevice->getDevice()->_acc);
+                    hc::completion_future cf = crit->_av.copy_async_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, &copyDevice->getDevice()->_acc);
 #else
-                    crit->_av.copy_async(src, dst, sizeBytes);
+                    hc::completion_future cf = crit->_av.copy_async(src, dst, sizeBytes);
 #endif
+                    if (g_timeline) {
+                        ihipTimelineAddOp(this, "copy", hcMemcpyStr(hcCopyDir), "sdma", sizeBytes, cf);
+                    }
+                    // Pinned-on-demand ranges must stay pinned until the DMA completes:
+                    dstPinRef.setPending(cf);
+                    srcPinRef.setPending(cf);
                 }
             } catch (Kalmar::runtime_exception) {
                 throw ihipException(hipErrorRuntimeOther);
@@ -1913,8 +2257,22 @@ void ihipStream_t::locked_copyAsync(void* dst, const void* src, size_t sizeBytes
                 this->wait(crit);
             }
 
+        } else if (!HIP_FORCE_SYNC_COPY && canUseStaging(hcCopyDir, dstTracked, srcTracked, copyDevice)) {
+            // One side is pageable host memory - pipeline the copy through the pinned staging buffers.
+            if (hcCopyDir == hc::hcMemcpyHostToDevice) {
+                stagedCopyHostToDevice(dst, src, sizeBytes, dstPtrInfo, copyDevice);
+            } else {
+                stagedCopyDeviceToHost(dst, src, sizeBytes, srcPtrInfo, copyDevice);
+            }
+
+            if (HIP_API_BLOCKING) {
+                tprintf(DB_SYNC, "%s LAUNCH_BLOCKING for completion of hipMemcpyAsync(sz=%zu)\n", ToString(this).c_str(), sizeBytes);
+                this->locked_wait();
+            }
+
         } else {
             LockedAccessor_StreamCrit_t crit(_criticalData);
+            timeline.set(hcCopyDir, "sdma");
 #if USE_COPY_EXT_V2
             crit->_av.copy_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, copyDevice ? &copyDevice->getDevice()->_acc : nullptr, forceUnpinnedCopy);
 #else
@@ -1924,6 +2282,230 @@ void ihipStream_t::locked_copyAsync(void* dst, const void* src, size_t sizeBytes
     }
 }
 
+//---
+// Memtracker lookup which remembers the last allocation found.  Batched ranges are usually slices of a few large
+// allocations, so most ranges are classified without a memtracker query.
+struct ihipPointerCache_t {
+    hc::accelerator     _acc;
+    hc::AmPointerInfo   _info;
+    bool                _tracked;
+    const char         *_base;
+
+    ihipPointerCache_t() : _info(NULL, NULL, 0, _acc, 0, 0), _tracked(false), _base(nullptr) {};
+
+    bool lookup(const void *ptr) {
+        const char *p = static_cast<const char*>(ptr);
+        if (_tracked && (p >= _base) && (p < _base + _info._sizeBytes)) {
+            return true;
+        }
+        _tracked = (hc::am_memtracker_getinfo(&_info, ptr) == AM_SUCCESS);
+        if (_tracked) {
+            _base = static_cast<const char*>(_info._isInDeviceMem ? _info._devicePointer : _info._hostPointer);
+        }
+        return _tracked;
+    };
+
+    // Device memory of deviceId, or pinned host memory:
+    bool visibleTo(int deviceId) const { return !_info._isInDeviceMem || (_info._appId == deviceId); };
+
+    // Address of ptr as seen by the device.  Registered host memory may be mapped at a different address.
+    void *devicePtr(const void *ptr) const {
+        if (_info._isInDeviceMem) {
+            return const_cast<void*>(ptr);
+        }
+        return static_cast<char*>(_info._devicePointer) + (static_cast<const char*>(ptr) - _base);
+    };
+};
+
+
+// Return a range table which is no longer used by the device, with room for numRanges.
+ihipCopyBatchTable_t *ihipStream_t::acquireBatchTable(LockedAccessor_StreamCrit_t &crit, size_t numRanges)
+{
+    ihipCopyBatchTable_t *table = nullptr;
+    for (auto &t : crit->_batchTables) {
+        if (!t._cf.valid() || t._cf.is_ready()) {
+            table = &t;
+            if (t._capacity >= numRanges) {
+                return table;
+            }
+        }
+    }
+
+    if (table == nullptr) {
+        crit->_batchTables.push_back(ihipCopyBatchTable_t{nullptr, 0, hc::completion_future()});
+        table = &crit->_batchTables.back();
+    } else {
+        hc::am_free(table->_ranges);
+        table->_ranges = nullptr;
+        table->_capacity = 0;
+    }
+
+    size_t capacity = 64;
+    while (capacity < numRanges) {
+        capacity *= 2;
+    }
+
+    table->_ranges = static_cast<ihipCopyRange_t*> (hc::am_alloc(capacity * sizeof(ihipCopyRange_t), getCtx()->getWriteableDevice()->_acc, amHostPinned));
+    if (table->_ranges == nullptr) {
+        throw ihipException(hipErrorMemoryAllocation);
+    }
+    table->_capacity = capacity;
+    table->_cf = hc::completion_future();
+
+    return table;
+}
+
+
+void ihipStream_t::locked_copyBatchAsync(std::vector<ihipCopyRange_t> &ranges, unsigned kind)
+{
+    const ihipCtx_t *ctx = this->getCtx();
+
+    if ((ctx == nullptr) || (ctx->getDevice() == nullptr)) {
+        tprintf (DB_COPY, "locked_copyBatchAsync bad ctx or device\n");
+        throw ihipException(hipErrorInvalidDevice);
+    }
+    const int deviceId = ctx->getDevice()->_deviceId;
+
+    // Coalesce ranges which continue the previous range in both dst and src:
+    const size_t userRanges = ranges.size();
+    size_t numRanges = 0;
+    for (size_t i=0; i<userRanges; i++) {
+        const ihipCopyRange_t r = ranges[i];
+        if (r._sizeBytes == 0) {
+            continue;
+        }
+        if (numRanges) {
+            ihipCopyRange_t &prev = ranges[numRanges-1];
+            if ((static_cast<char*>(prev._dst) + prev._sizeBytes == r._dst) &&
+                (static_cast<const char*>(prev._src) + prev._sizeBytes == r._src)) {
+                prev._sizeBytes += r._sizeBytes;
+                continue;
+            }
+        }
+        ranges[numRanges++] = r;
+    }
+    ranges.resize(numRanges);
+
+    const size_t blitMax = HIP_COPY_BATCH_BLIT_THRESHOLD * 1024;
+
+    ihipPointerCache_t dstCache, srcCache;
+    std::vector<ihipCopyRange_t> blitRanges;
+    std::vector<size_t> otherRanges;   // pageable or not reachable by one engine - copied one at a time below.
+    size_t numDma = 0;
+
+    {
+        // The whole batch is submitted under one lock, so commands from other threads can't land inside it.
+        LockedAccessor_StreamCrit_t crit(_criticalData);
+
+        for (size_t i=0; i<numRanges; i++) {
+            const ihipCopyRange_t &r = ranges[i];
+            bool dstTracked = dstCache.lookup(r._dst);
+            bool srcTracked = srcCache.lookup(r._src);
+
+            if (!dstTracked || !srcTracked || (!dstCache._info._isInDeviceMem && !srcCache._info._isInDeviceMem)) {
+                otherRanges.push_back(i);
+                continue;
+            }
+
+            // Small ranges the stream's device can reach are gathered into one blit kernel:
+            if ((r._sizeBytes <= blitMax) && dstCache.visibleTo(deviceId) && srcCache.visibleTo(deviceId)) {
+                blitRanges.push_back(ihipCopyRange_t{dstCache.devicePtr(r._dst), srcCache.devicePtr(r._src), r._sizeBytes});
+                continue;
+            }
+
+            hc::hcCommandKind hcCopyDir;
+            ihipCtx_t *copyDevice;
+            bool forceUnpinnedCopy;
+            resolveHcMemcpyDirection(kind, &dstCache._info, &srcCache._info, &hcCopyDir, &copyDevice, &forceUnpinnedCopy);
+            if (forceUnpinnedCopy || (copyDevice == nullptr) || HIP_FORCE_SYNC_COPY) {
+                otherRanges.push_back(i);
+                continue;
+            }
+
+            try {
+#if USE_COPY_EXT_V2
+                crit->_av.copy_async_ext(r._src, r._dst, r._sizeBytes, hcCopyDir, srcCache._info, dstCache._info, &copyDevice->getDevice()->_acc);
+#else
+                crit->_av.copy_async(r._src, r._dst, r._sizeBytes);
+#endif
+            } catch (Kalmar::runtime_exception) {
+                throw ihipException(hipErrorRuntimeOther);
+            };
+            numDma++;
+        }
+
+        if (!blitRanges.empty()) {
+            ihipCopyBatchTable_t *table = acquireBatchTable(crit, blitRanges.size());
+            std::copy(blitRanges.begin(), blitRanges.end(), table->_ranges);
+            table->_cf = ihipCopyBatchKernel(crit->_av, table->_ranges, blitRanges.size());
+        }
+
+        for (auto i : otherRanges) {
+            copyBatchRangeLocked(crit, ranges[i], kind);
+        }
+
+        tprintf (DB_COPY, "copyBatchAsync ranges=%zu coalesced=%zu blit=%zu sdma=%zu other=%zu\n",
+                 userRanges, numRanges, blitRanges.size(), numDma, otherRanges.size());
+
+        if (HIP_API_BLOCKING || (HIP_FORCE_SYNC_COPY && !blitRanges.empty())) {
+            tprintf(DB_SYNC, "%s LAUNCH_BLOCKING for completion of hipMemcpyBatchAsync(ranges=%zu)\n", ToString(this).c_str(), userRanges);
+            this->wait(crit);
+        }
+    }
+}
+
+
+// Same paths as locked_copyAsync, minus the pin cache and the CPU path, but with the lock already held.
+void ihipStream_t::copyBatchRangeLocked(LockedAccessor_StreamCrit_t &crit, const ihipCopyRange_t &r, unsigned kind)
+{
+    void *dst = r._dst;
+    const void *src = r._src;
+    const size_t sizeBytes = r._sizeBytes;
+
+    hc::accelerator acc;
+    hc::AmPointerInfo dstPtrInfo(NULL, NULL, 0, acc, 0, 0);
+    hc::AmPointerInfo srcPtrInfo(NULL, NULL, 0, acc, 0, 0);
+    bool dstTracked = (hc::am_memtracker_getinfo(&dstPtrInfo, dst) == AM_SUCCESS);
+    bool srcTracked = (hc::am_memtracker_getinfo(&srcPtrInfo, src) == AM_SUCCESS);
+
+    if ((kind == hipMemcpyHostToHost) || (!dstPtrInfo._isInDeviceMem && !srcPtrInfo._isInDeviceMem)) {
+        if (HIP_FORCE_SYNC_COPY) {
+            this->wait(crit);
+            memcpy(dst, src, sizeBytes);
+        } else {
+            ihipStagingEngine_t *engine = getCtx()->getDevice()->_stagingEngine;
+            enqueueHostTask(crit, [=] {
+                engine->hostCopy(dst, src, sizeBytes);
+            });
+            recordHostWrite(crit, dst, sizeBytes);
+        }
+        return;
+    }
+
+    hc::hcCommandKind hcCopyDir;
+    ihipCtx_t *copyDevice;
+    bool forceUnpinnedCopy;
+    resolveHcMemcpyDirection(kind, &dstPtrInfo, &srcPtrInfo, &hcCopyDir, &copyDevice, &forceUnpinnedCopy);
+
+    tprintf (DB_COPY, "copyBatchRange dst=%p src=%p sz=%zu dir=%s dstTracked=%d srcTracked=%d\n",
+             dst, src, sizeBytes, hcMemcpyStr(hcCopyDir), dstTracked, srcTracked);
+
+    if (!HIP_FORCE_SYNC_COPY && canUseStaging(hcCopyDir, dstTracked, srcTracked, copyDevice)) {
+        if (hcCopyDir == hc::hcMemcpyHostToDevice) {
+            stagedCopyHostToDevice(dst, src, sizeBytes, dstPtrInfo, copyDevice, &crit);
+        } else {
+            stagedCopyDeviceToHost(dst, src, sizeBytes, srcPtrInfo, copyDevice, &crit);
+        }
+    } else {
+#if USE_COPY_EXT_V2
+        crit->_av.copy_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, copyDevice ? &copyDevice->getDevice()->_acc : nullptr, forceUnpinnedCopy);
+#else
+        crit->_av.copy_ext(src, dst, sizeBytes, hcCopyDir, srcPtrInfo, dstPtrInfo, forceUnpinnedCopy);
+#endif
+    }
+}
+
+
 
 //-------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------------------------------------
@@ -1934,6 +2516,7 @@ hipError_t hipProfilerStart()
 #if COMPILE_HIP_ATP_MARKER
     amdtResumeProfiling(AMDT_ALL_PROFILING);
 #endif
+    ihipProfControlStart();
 
     return ihipLogStatus(hipSuccess);
 };
@@ -1945,6 +2528,7 @@ hipError_t hipProfilerStop()
 #if COMPILE_HIP_ATP_MARKER
     amdtStopProfiling(AMDT_ALL_PROFILING);
 #endif
+    ihipProfControlStop();
 
     return ihipLogStatus(hipSuccess);
 };
@@ -24,16 +24,31 @@ THE SOFTWARE.
 #define HIP_HCC_H
 
 #include <hc.hpp>
+#include <hc_am.hpp>
 #include <hsa/hsa.h>
 #include "hsa/hsa_ext_amd.h"
 #include "hip_util.h"
 
+#include <map>
+#include <future>
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <memory>
+
 
 #if defined(__HCC__) && (__hcc_workweek__ < 16354)
 #error("This version of HIP requires a newer version of HCC.");
 #endif
 
 #define USE_DISPATCH_HSA_KERNEL 1
+
+#ifndef USE_COPY_EXT_V2
+#define USE_COPY_EXT_V2 1
+#endif
 //
 
 
@@ -54,6 +69,35 @@ extern int HIP_PROFILE_API;
 extern int HIP_ATP;
 extern int HIP_DB;
 extern int HIP_STAGING_SIZE;   /* size of staging buffers, in KB */
+extern int HIP_STAGING_BUFFERS; /* number of staging buffers per device, 0 disables the staging engine */
+extern int HIP_STAGING_THREADS; /* number of worker threads per device which drain staged D2H copies */
+extern int HIP_PARALLEL_COPY_THREADS;   /* number of CPU threads used to split large host-side memcpys, 0 disables */
+extern int HIP_PARALLEL_COPY_THRESHOLD; /* host-side memcpys at least this large (in KB) are split across threads */
+extern int HIP_PIN_CACHE;       /* budget in MB for pageable ranges pinned on demand by the copy path, 0 disables */
+extern int HIP_PIN_CACHE_HITS;  /* number of copies from the same pageable range before it is pinned */
+extern int HIP_COPY_CALIBRATE;  /* 0=use defaults (default), 1=calibrate copy paths once per host and cache, 2=force re-calibration */
+extern int HIP_COPY_H2D_CPU_THRESHOLD; /* H2D copies up to this size (bytes) use CPU stores through the large BAR.  -1=calibrated */
+extern int HIP_COPY_D2H_CPU_THRESHOLD; /* D2H copies up to this size (bytes) use CPU reads through the large BAR.  -1=calibrated */
+extern int HIP_COPY_BLIT_THRESHOLD;    /* D2D copies up to this size (bytes) use a blit kernel.  -1=calibrated */
+extern std::string HIP_COPY_POLICY_FILE; /* where calibrated thresholds are cached */
+extern int HIP_COPY_BATCH_BLIT_THRESHOLD; /* batched ranges up to this size (KB) are copied by one blit kernel */
+extern int HIP_PEER_STAGING_SIZE;       /* size (KB) of each bounce buffer for peer copies between unmapped devices */
+extern int HIP_PEER_SPLIT_THRESHOLD;    /* peer copies at least this large (MB) are split across both devices' DMA engines.  0=never */
+extern int HIP_HOST_NUMA_NODE;          /* NUMA node for pinned host memory and worker threads.  -1=closest to device, -2=no placement */
+extern int HIP_HOST_HUGE_PAGES;         /* back pinned host allocations with huge pages.  0=only with hipHostMallocHugePages, 1=always */
+extern int HIP_FILE_IO_SIZE;            /* size (KB) of each bounce buffer for hipMemcpyFromFileAsync/ToFileAsync */
+extern int HIP_FILE_IO_BUFFERS;         /* number of file I/O bounce buffers per device */
+extern int HIP_FILE_IO_THREADS;         /* number of file I/O threads per device */
+extern std::string HIP_TRACE_FILE;      /* if set, APIs are traced in binary form to this file.  See hip_trace.cpp */
+extern int HIP_TRACE_RING_SIZE;         /* number of records in the binary trace ring of each thread */
+extern std::string HIP_TIMELINE_FILE;   /* if set, a Chrome trace timeline is written to this file at exit.  See hip_timeline.cpp */
+extern int HIP_TIMELINE_MAX_EVENTS;     /* maximum number of timeline events kept in memory */
+extern int HIP_PROFILE_KERNELS;         /* collect per-kernel device execution times.  See hip_kernel_prof.cpp */
+extern int HIP_API_LATENCY;             /* record per-API latency histograms.  See hip_api_latency.cpp */
+extern int HIP_PROFILE_START_PAUSED;    /* set up the recorders but wait for a capture window to start.  See hip_prof_control.cpp */
+extern int HIP_PROFILE_SIGNAL;          /* signal which toggles recording */
+extern std::string HIP_PROFILE_CONTROL_FILE; /* file polled for start/stop commands */
+extern int HIP_PROFILE_MAX_WINDOWS;     /* number of capture windows whose files are kept */
 extern int HIP_STREAM_SIGNALS;  /* number of signals to allocate at stream creation */
 extern int HIP_VISIBLE_DEVICES; /* Contains a comma-separated sequence of GPU identifiers */
 extern int HIP_FORCE_P2P_HOST;
@@ -153,6 +197,21 @@ extern const char *API_COLOR_END;
 #define COMPILE_HIP_TRACE_API 0x3
 
 
+// Compile per-API latency histograms.  Must be enabled at runtime with HIP_API_LATENCY.
+// When compiled in but disabled, each API pays one load and branch at entry and at exit.
+#ifndef COMPILE_HIP_API_LATENCY
+#define COMPILE_HIP_API_LATENCY 1
+#endif
+
+
+// Compile lock contention statistics for LockedAccessor and LockedBase.  When set, the wait and hold time of
+// every stream and context lock is recorded per lock and per call site, and the most contended are printed to
+// stderr at exit.  See hip_lock_prof.cpp.  Off by default; when off the locks are plain mutexes.
+#ifndef COMPILE_HIP_LOCK_PROF
+#define COMPILE_HIP_LOCK_PROF 0
+#endif
+
+
 // Compile code that generates trace markers for CodeXL ATP at HIP function begin/end.
 // ATP is standard CodeXL format that includes timestamps for kernels, HSA RT APIs, and HIP APIs.
 #ifndef COMPILE_HIP_ATP_MARKER
@@ -181,11 +240,82 @@ extern const char *API_COLOR_END;
 
 
 extern void recordApiTrace(std::string *fullStr, const std::string &apiStr);
+extern void ihipProfTriggerCheck(int tid, uint64_t apiSeqNum);
+extern void ihipTraceInit();
+extern void ihipTraceStart();
+extern void ihipTraceStop(const std::string &closedName);
+
+#include "hip_trace.h"
+
+// Timeline recorder, see hip_timeline.cpp:
+extern bool g_timeline;
+extern void ihipTimelineInit();
+extern void ihipTimelineStart();
+extern void ihipTimelineStop(const std::string &fileName);
+extern const char *ihipTimelineIntern(const char *name);
+extern void ihipTimelineApiEnter(const char *apiName);
+extern void ihipTimelineApiExit(const char *apiName);
+// Command on a stream timed on the host, or by its completion signal:
+extern void ihipTimelineAddOp(const ihipStream_t *stream, const char *cat, const char *name, const char *detail,
+                              uint64_t bytes, uint64_t begin, uint64_t end);
+extern void ihipTimelineAddOp(const ihipStream_t *stream, const char *cat, const char *name, const char *detail,
+                              uint64_t bytes, const hc::completion_future &cf);
+// Command bracketed by two markers, for dispatches which don't return a completion_future:
+extern void ihipTimelineAddOp(const ihipStream_t *stream, const char *cat, const char *name, const char *detail,
+                              uint64_t bytes, const hc::completion_future &beginCf, const hc::completion_future &cf);
+
+// Per-kernel execution time statistics, see hip_kernel_prof.cpp:
+extern bool g_kernelProf;
+extern void ihipKernelProfInit();
+extern void ihipKernelProfStart();
+extern void ihipKernelProfStop();
+extern void ihipKernelProfAdd(const char *kernelName, const gl_dim3 &grid, const gl_dim3 &group, const hc::completion_future &cf);
+extern void ihipKernelProfAdd(const char *kernelName, const gl_dim3 &grid, const gl_dim3 &group,
+                              const hc::completion_future &beginCf, const hc::completion_future &cf);
+extern void ihipKernelProfAdd(const char *kernelName, const gl_dim3 &grid, const gl_dim3 &group, uint64_t begin, uint64_t end);
+
+// Runtime start/stop of the recorders above, see hip_prof_control.cpp:
+extern void ihipProfControlInit();
+extern void ihipProfControlStart();
+extern void ihipProfControlStop();
+
+// Per-API latency histograms, see hip_api_latency.cpp:
+extern bool g_apiLatency;
+extern void ihipApiLatencyInit();
+extern void ihipApiLatencyEnter(const char *apiName, const void *frame);
+extern void ihipApiLatencyExit(uint16_t apiId, const char *apiName, const void *frame);
+
+#if COMPILE_HIP_API_LATENCY
+#define API_LATENCY_ENTER()\
+{\
+    if (g_apiLatency) {\
+        ihipApiLatencyEnter(__func__, __builtin_frame_address(0));\
+    }\
+}
+#define API_LATENCY_EXIT()\
+{\
+    if (g_apiLatency) {\
+        static uint16_t latencyApiId = ihipTraceApiId(__func__);\
+        ihipApiLatencyExit(latencyApiId, __func__, __builtin_frame_address(0));\
+    }\
+}
+#else
+#define API_LATENCY_ENTER()
+#define API_LATENCY_EXIT()
+#endif
 
+// With HIP_TRACE_FILE set, the binary trace replaces the string trace: the arguments are copied into a
+// per-thread ring as raw words and no string is built.
 #if COMPILE_HIP_ATP_MARKER || (COMPILE_HIP_TRACE_API & 0x1)
 #define API_TRACE(...)\
 {\
-    if (HIP_PROFILE_API || (COMPILE_HIP_DB && HIP_TRACE_API)) {\
+    if (g_timeline) {\
+        ihipTimelineApiEnter(__func__);\
+    }\
+    if (g_traceBinary) {\
+        static uint16_t traceApiId = ihipTraceApiId(__func__);\
+        ihipTraceEnter(traceApiId, ##__VA_ARGS__);\
+    } else if (HIP_PROFILE_API || (COMPILE_HIP_DB && HIP_TRACE_API)) {\
         std::string apiStr = std::string(__func__) + " (" + ToString(__VA_ARGS__) + ')';\
         std::string fullStr;\
         recordApiTrace(&fullStr, apiStr);\
@@ -210,17 +340,23 @@ extern void recordApiTrace(std::string *fullStr, const std::string &apiStr);
 // generate trace string that can be output to stderr or to ATP file.
 #define HIP_INIT_API(...) \
     HIP_INIT()\
-    API_TRACE(__VA_ARGS__);
+    API_TRACE(__VA_ARGS__);\
+    API_LATENCY_ENTER();
 
 #define ihipLogStatus(hipStatus) \
     ({\
         hipError_t localHipStatus = hipStatus; /*local copy so hipStatus only evaluated once*/ \
         tls_lastHipError = localHipStatus;\
+        API_LATENCY_EXIT();\
         \
-        if ((COMPILE_HIP_TRACE_API & 0x2) && HIP_TRACE_API) {\
+        if ((COMPILE_HIP_TRACE_API & 0x2) && g_traceBinary) {\
+            static uint16_t traceApiId = ihipTraceApiId(__func__);\
+            ihipTraceExit(traceApiId, localHipStatus);\
+        } else if ((COMPILE_HIP_TRACE_API & 0x2) && HIP_TRACE_API) {\
             fprintf(stderr, "  %ship-api tid:%d.%lu %-30s ret=%2d (%s)>>%s\n", (localHipStatus == 0) ? API_COLOR:KRED, tls_shortTid.tid(),tls_shortTid.apiSeqNum(),  __func__, localHipStatus, ihipErrorString(localHipStatus), API_COLOR_END);\
         }\
         if (HIP_PROFILE_API) { MARKER_END(); }\
+        if (g_timeline) { ihipTimelineApiExit(__func__); }\
         localHipStatus;\
     })
 
@@ -317,6 +453,53 @@ typedef FakeMutex CtxMutex;
 #warning "Device thread-safe disabled"
 #endif
 
+#if COMPILE_HIP_LOCK_PROF
+//---
+// Contention statistics for one lock, or for all locks taken at one call site.
+struct ihipLockStats_t {
+    std::atomic<uint64_t>   _acquires;
+    std::atomic<uint64_t>   _contended;     // acquires which had to wait
+    std::atomic<uint64_t>   _waitNs;
+    std::atomic<uint64_t>   _maxWaitNs;
+    std::atomic<uint64_t>   _holdNs;
+};
+
+// Per-lock state, embedded in LockedBase.  Registered for the report while the lock exists.
+// _acquireNs and _siteStats describe the current holder, and are only touched with the lock held.
+struct ihipLockProf_t {
+    ihipLockProf_t();
+    ~ihipLockProf_t();
+
+    const char          *_name;         // type of the critical data, set by the first LockedAccessor
+    ihipLockStats_t     _stats;
+    uint64_t            _acquireNs;
+    ihipLockStats_t     *_siteStats;
+};
+
+extern uint64_t ihipLockProfNow();
+extern void ihipLockProfAcquired(ihipLockProf_t *prof, const char *name, const void *site, bool contended, uint64_t waitNs);
+extern void ihipLockProfReleased(ihipLockProf_t *prof);
+
+// Lock, timing the wait only if the lock is already held.
+template <typename MUTEX_TYPE>
+inline void ihipLockProfLock(MUTEX_TYPE &mutex, ihipLockProf_t *prof, const char *name, const void *site)
+{
+    if (mutex.try_lock()) {
+        ihipLockProfAcquired(prof, name, site, false, 0);
+    } else {
+        uint64_t start = ihipLockProfNow();
+        mutex.lock();
+        ihipLockProfAcquired(prof, name, site, true, ihipLockProfNow() - start);
+    }
+}
+
+// The call site is the return address of the locking function, so it must not be inlined.
+#define LOCK_PROF_NOINLINE __attribute__((noinline))
+#else
+#define LOCK_PROF_NOINLINE
+#endif
+
+
 //
 //---
 // Protects access to the member _data with a lock acquired on contruction/destruction.
@@ -325,19 +508,26 @@ template<typename T>
 class LockedAccessor
 {
 public:
-    LockedAccessor(T &criticalData, bool autoUnlock=true) :
+    LOCK_PROF_NOINLINE LockedAccessor(T &criticalData, bool autoUnlock=true) :
         _criticalData(&criticalData),
         _autoUnlock(autoUnlock)
 
     {
         tprintf(DB_SYNC, "lock critical data %s.%p\n", typeid(T).name(), _criticalData);
+#if COMPILE_HIP_LOCK_PROF
+        ihipLockProfLock(_criticalData->_mutex, &_criticalData->_lockProf, typeid(T).name(), __builtin_return_address(0));
+#else
         _criticalData->_mutex.lock();
+#endif
     };
 
     ~LockedAccessor()
     {
         if (_autoUnlock) {
         tprintf(DB_SYNC, "auto-unlock critical data %s.%p\n",typeid(T).name(),  _criticalData);
+#if COMPILE_HIP_LOCK_PROF
+            ihipLockProfReleased(&_criticalData->_lockProf);
+#endif
             _criticalData->_mutex.unlock();
         }
     }
@@ -345,6 +535,9 @@ public:
     void unlock()
     {
         tprintf(DB_SYNC, "unlock critical data %s.%p\n", typeid(T).name(), _criticalData);
+#if COMPILE_HIP_LOCK_PROF
+       ihipLockProfReleased(&_criticalData->_lockProf);
+#endif
        _criticalData->_mutex.unlock();
     }
 
@@ -362,27 +555,41 @@ struct LockedBase {
 
     // Experts-only interface for explicit locking.
     // Most uses should use the lock-accessor.
+#if COMPILE_HIP_LOCK_PROF
+    LOCK_PROF_NOINLINE void lock() { ihipLockProfLock(_mutex, &_lockProf, nullptr, __builtin_return_address(0)); }
+    void unlock() { ihipLockProfReleased(&_lockProf); _mutex.unlock(); }
+
+    ihipLockProf_t  _lockProf;
+#else
     void lock() { _mutex.lock(); }
     void unlock() { _mutex.unlock(); }
+#endif
 
     MUTEX_TYPE  _mutex;
 };
 
 /**
- * HIP IPC Handle Size
+ * Layout of the bytes in hipIpcMemHandle_t.
  */
-#define HIP_IPC_HANDLE_SIZE 64
-class ihipIpcMemHandle_t
+struct ihipIpcMemHandle_t
 {
-public:
     hsa_amd_ipc_memory_t ipc_handle; ///< ipc memory handle on ROCr
-    char reserved[HIP_IPC_HANDLE_SIZE];
     size_t psize;
 };
+static_assert(sizeof(ihipIpcMemHandle_t) <= HIP_IPC_HANDLE_SIZE, "ihipIpcMemHandle_t does not fit in hipIpcMemHandle_t");
+
+/**
+ * Layout of the bytes in hipIpcEventHandle_t.
+ */
+struct ihipIpcEventHandle_t
+{
+    hsa_amd_ipc_signal_t ipc_handle; ///< ipc signal handle on ROCr
+};
+static_assert(sizeof(ihipIpcEventHandle_t) <= HIP_IPC_HANDLE_SIZE, "ihipIpcEventHandle_t does not fit in hipIpcEventHandle_t");
 
 class ihipFunction_t{
 public:
-    ihipFunction_t(const char *name) {
+    ihipFunction_t(const char *name) : _kernelCode(nullptr) {
         size_t nameSz = strlen(name);
         char *kernelName = (char*)malloc(nameSz);
         strncpy(kernelName, name, nameSz);
@@ -399,6 +606,7 @@ public:
     const char             *_kernelName;
     hsa_executable_symbol_t _kernelSymbol;
     uint64_t _kernel;
+    const void             *_kernelCode;  // amd_kernel_code_t in the module's host copy of the code object, or nullptr.
 };
 
 class ihipModule_t {
@@ -425,6 +633,384 @@ private:
   std::vector<ihipFunction_t*> hipFunctionTable;
 };
 
+//---
+// Pinned bounce buffer used to stage copies to and from pageable host memory.
+struct ihipStagingBuffer_t {
+    ihipStagingBuffer_t(void *ptr, const hc::AmPointerInfo &ptrInfo) :
+        _ptr(ptr), _ptrInfo(ptrInfo) {};
+
+    void                   *_ptr;
+    hc::AmPointerInfo       _ptrInfo;
+
+    // Last DMA which reads or writes this buffer.  Must complete before the buffer is refilled.
+    hc::completion_future   _dmaFuture;
+};
+
+
+//---
+// Pool of CPU threads which split large host-side memcpys (pageable <-> pinned staging buffer).
+// Threads are pinned to the CPUs closest to the device so the copies stay on the device's NUMA node.
+class ihipHostCopyPool_t
+{
+public:
+    ihipHostCopyPool_t(const ihipDevice_t *device, int numThreads, size_t threshold);
+    ~ihipHostCopyPool_t();
+
+    // Copy on the calling thread plus the pool.  Returns when the whole copy is complete.
+    void copy(void *dst, const void *src, size_t sizeBytes);
+
+private:
+    struct Job;
+    struct Piece {
+        void       *_dst;
+        const void *_src;
+        size_t      _sizeBytes;
+        Job        *_job;
+    };
+
+    void start();
+    void workerLoop(int workerId);
+
+private:
+    const ihipDevice_t         *_device;
+    int                         _numThreads;
+    size_t                      _threshold;
+
+    std::once_flag              _startOnce;
+    std::mutex                  _mutex;
+    std::condition_variable     _pieceReady;
+    std::condition_variable     _pieceDone;
+    std::deque<Piece>           _pieces;
+    std::vector<std::thread>    _workers;
+    bool                        _shutdown;
+};
+
+
+//---
+// Per-device engine for asynchronous copies to/from pageable (untracked) host memory.
+// The engine owns a ring of pinned staging buffers plus a small pool of CPU worker threads.
+// Buffers and threads are created on first use so apps which never copy pageable memory do not pay for them.
+// The engine only manages resources - ihipStream_t orders the chunked copies against the rest of the stream.
+class ihipStagingEngine_t
+{
+public:
+    ihipStagingEngine_t(ihipDevice_t *device, size_t bufferSize, int numBuffers, int numThreads);
+    ~ihipStagingEngine_t();
+
+    bool   enabled()    const { return _numBuffers > 0; };
+    size_t bufferSize() const { return _bufferSize; };
+    size_t numBuffers();   // buffers actually allocated - may be fewer than requested.
+    int    numThreads() const { return _numThreads; };
+
+    // Blocks until a staging buffer is free and any DMA still using it has completed.
+    ihipStagingBuffer_t *acquire();
+    void                 release(ihipStagingBuffer_t *buffer);
+
+    // Run task on worker thread 'queue % numThreads'.  Tasks submitted to the same queue execute in FIFO order.
+    std::shared_future<void> submit(unsigned queue, std::function<void()> task);
+
+    // Host-side copy into or out of a staging buffer, split across the host copy pool if large enough.
+    void hostCopy(void *dst, const void *src, size_t sizeBytes) { _hostCopyPool.copy(dst, src, sizeBytes); };
+
+private:
+    void allocBuffers();
+    void workerLoop(int workerId);
+
+private:
+    ihipDevice_t                        *_device;
+    size_t                               _bufferSize;
+    int                                  _numBuffers;
+    int                                  _numThreads;
+
+    std::once_flag                       _initOnce;
+    std::mutex                           _mutex;
+    std::condition_variable              _bufferFreed;
+    std::vector<ihipStagingBuffer_t*>    _allBuffers;
+    std::deque<ihipStagingBuffer_t*>     _freeBuffers;
+
+    std::condition_variable              _taskReady;
+    std::vector<std::deque<std::packaged_task<void()>>> _tasks;  // one FIFO per worker.
+    std::vector<std::thread>             _workers;
+    bool                                 _shutdown;
+
+    ihipHostCopyPool_t                   _hostCopyPool;
+};
+
+
+//---
+// Per-device engine for peer copies into this device.
+// Owns a second view on the device, so the halves of a large copy can run on both devices' DMA engines at once,
+// and a pair of pinned bounce buffers used when the devices cannot see each other's memory.
+// View and buffers are created on first use.  Callers hold the stream lock; the engine lock nests inside it.
+// See hip_peer_copy.cpp.
+class ihipPeerCopyEngine_t
+{
+public:
+    ihipPeerCopyEngine_t(ihipDevice_t *device, size_t bufferSize);
+    ~ihipPeerCopyEngine_t();
+
+    // Copy from srcDevice through the bounce buffers: D2H chunks are enqueued on av, H2D chunks on this engine's
+    // queue for streamId.
+    void stagedCopy(hc::accelerator_view &av, uint64_t streamId, void *dst, const hc::AmPointerInfo &dstPtrInfo,
+                    const void *src, const hc::AmPointerInfo &srcPtrInfo, ihipDevice_t *srcDevice, size_t sizeBytes);
+
+    // Copy the first half on av with srcDevice's DMA engine and the second half on this engine's queue for
+    // streamId with this device's DMA engine.  Later commands in av wait for both halves.
+    void splitCopy(hc::accelerator_view &av, uint64_t streamId, void *dst, const hc::AmPointerInfo &dstPtrInfo,
+                   const void *src, const hc::AmPointerInfo &srcPtrInfo, ihipDevice_t *srcDevice, size_t sizeBytes);
+
+private:
+    struct Queue;
+    Queue *queueFor(uint64_t streamId);
+    void initQueue(Queue *q);
+
+private:
+    ihipDevice_t                        *_device;
+    size_t                               _bufferSize;
+    std::vector<Queue*>                  _queues;      // extra views of _device, created on first use.
+};
+
+
+//---
+// A __device__ or __constant__ variable in the loaded code objects.
+struct ihipSymbol_t {
+    void               *_address;
+    size_t              _sizeBytes;     // 0 if the runtime can't report it.
+};
+
+// Per-device cache of symbol lookups, so hipMemcpyToSymbol etc. resolve each name through HCC once.
+// Keyed by the name pointer (usually a string literal from HIP_SYMBOL), checked against the stored name, with a
+// fallback keyed by the name string.  See hip_symbol.cpp.
+class ihipSymbolCache_t
+{
+public:
+    ihipSymbolCache_t(ihipDevice_t *device);
+
+    // Returns false if no symbol has this name.
+    bool lookup(const char *symbolName, ihipSymbol_t *symbol);
+
+    // Forget every entry.  Called when a module is unloaded, since its symbols' addresses go away with it.
+    void clear();
+
+private:
+    // _byPointer holds one entry per distinct name pointer, which apps building names at runtime can churn;
+    // it is emptied when it reaches this size.
+    static const size_t MAX_POINTER_ENTRIES = 1024;
+
+    struct Entry {
+        std::string     _name;
+        ihipSymbol_t    _symbol;
+    };
+
+    ihipDevice_t                                            *_device;
+    std::mutex                                               _mutex;
+    std::unordered_map<const char*, const Entry*>            _byPointer;
+    std::unordered_map<std::string, std::unique_ptr<Entry>>  _byName;
+};
+
+
+//---
+// Tracks the allocations owned by one device and the peer set each one is mapped to.
+// A peer change only publishes the new agent set and a new generation, so hipDeviceEnablePeerAccess takes constant
+// time.  Stale allocations are remapped by a worker thread, or on demand when a copy touches them first.
+// Kernel launches wait for pending remaps, since device code may touch any allocation.  See hip_peer_map.cpp.
+class ihipPeerMapper_t
+{
+public:
+    ihipPeerMapper_t(ihipDevice_t *device);
+    ~ihipPeerMapper_t();
+
+    // Track an allocation which the caller has already mapped to the peer set of 'generation'.
+    void add(void *ptr, size_t sizeBytes, uint64_t generation);
+    void remove(void *ptr);
+
+    // Publish a new peer set and wake the worker.
+    void update(uint32_t peerCnt, const hsa_agent_t *peerAgents, uint64_t generation);
+
+    // Map the allocation described by ptrInfo to the current peer set now, if it is stale.
+    void ensureMapped(const hc::AmPointerInfo &ptrInfo);
+
+    // True once the worker has caught up with the last published peer set.  Does not take the lock.
+    bool idle() const { return _mappedGeneration.load(std::memory_order_acquire) >= _publishedGeneration.load(std::memory_order_acquire); }
+
+    // Wait until all allocations are mapped to the current peer set.
+    void waitIdle();
+
+private:
+    struct Alloc {
+        size_t      _sizeBytes;
+        uint64_t    _generation;   // generation of the peer set this allocation is mapped to.
+    };
+
+    void workerLoop();
+    void mapUnlocked(std::unique_lock<std::mutex> &l, void *ptr);
+
+private:
+    ihipDevice_t                        *_device;
+
+    std::mutex                           _mutex;
+    std::condition_variable              _workReady;
+    std::condition_variable              _stateChanged;
+    std::unordered_map<void*, Alloc>     _allocs;
+    std::vector<hsa_agent_t>             _agents;      // current peer set, including self.
+    uint64_t                             _generation;
+    bool                                 _pending;     // worker has not yet caught up with _generation.
+    std::unordered_set<void*>            _busy;        // allocations being mapped without the lock.
+
+    std::atomic<uint64_t>                _publishedGeneration;  // _generation, readable without the lock.
+    std::atomic<uint64_t>                _mappedGeneration;     // last generation the worker finished.
+
+    std::once_flag                       _startOnce;
+    std::thread                          _worker;
+    bool                                 _shutdown;
+};
+
+// Number of peer mappers with pending work.  Checked on every kernel launch; when it is non-zero only the mappers
+// which are not idle() are waited for.
+extern std::atomic<int> g_peerMapPending;
+extern void ihipWaitPeerMappers();
+
+
+//---
+// Opt-in cache of pageable host ranges which the copy path pins on demand (HIP_PIN_CACHE).
+// Ranges are pinned with am_memory_host_lock once they have been copied HIP_PIN_CACHE_HITS times; later copies
+// find them in the memtracker and take the DMA fast path.  Entries are refcounted by the copies using them and
+// evicted in LRU order when the budget is exceeded.  Entries are dropped when the application frees or unmaps
+// their pages.  See hip_pin_cache.cpp.
+class ihipPinCache_t
+{
+public:
+    struct Entry;
+
+    // Reference held by a copy for the duration of the command.  Releases the entry on destruction, so it is
+    // safe on the exception paths.  Async copies record their completion_future so eviction can wait for them.
+    class Ref {
+    public:
+        Ref() : _entry(nullptr) {};
+        Ref(const Ref &) = delete;
+        ~Ref();
+        void                 setPending(const hc::completion_future &cf) { _pending = cf; };
+    private:
+        Entry               *_entry;
+        hc::completion_future _pending;
+        friend class ihipPinCache_t;
+    };
+
+    ihipPinCache_t();
+    ~ihipPinCache_t();
+
+    bool enabled() const { return HIP_PIN_CACHE > 0; };
+
+    // Look up host range [ptr, ptr+sizeBytes) and pin it if it has become hot.  Returns true if the range is
+    // now covered by a cache entry, in which case ref holds the entry until it is destroyed.
+    // tracked indicates the memtracker already knows ptr - such ranges are never pinned by the cache.
+    bool acquire(const void *ptr, size_t sizeBytes, bool tracked, Ref *ref);
+
+    // Unpin and remove the entry which contains ptr.  Returns false if ptr is not in the cache.
+    bool remove(const void *ptr);
+
+    // Unpin and remove every entry overlapping [start, end).  Called before the application releases the pages.
+    void invalidate(uintptr_t start, uintptr_t end);
+
+    // Lock-free filter used by the hooks - false if no entry can overlap [start, end).
+    bool mayOverlap(uintptr_t start, uintptr_t end) const {
+        return (start < _maxEnd.load(std::memory_order_relaxed)) && (end > _minBase.load(std::memory_order_relaxed));
+    };
+
+private:
+    bool acquireLocked(uintptr_t start, size_t sizeBytes, bool tracked, Ref *ref, std::vector<Entry*> *victims);
+    void release(Entry *entry, const hc::completion_future &pending);
+    bool makeRoom(size_t sizeBytes, std::vector<Entry*> *victims);
+    Entry *detachLocked(std::map<uintptr_t, Entry*>::iterator i);
+    void updateBounds();
+    void unpin(Entry *entry);
+
+private:
+    std::mutex                      _mutex;
+    std::condition_variable         _released;    // signalled when an entry's refcount drops to zero.
+    std::map<uintptr_t, Entry*>     _entries;     // pinned ranges, keyed by start address.
+    std::map<uintptr_t, std::pair<size_t, int>> _candidates;  // start -> (size, hits) for ranges not yet pinned.
+    size_t                          _pinnedBytes;
+    uint64_t                        _clock;       // LRU clock, incremented on each acquire.
+    std::atomic<uintptr_t>          _minBase;     // span of _entries, read by the hooks without _mutex.
+    std::atomic<uintptr_t>          _maxEnd;
+};
+
+extern ihipPinCache_t g_pinCache;
+
+
+//---
+// Engine used to perform one copy command.
+enum ihipCopyPath_t {
+    ihipCopyPathSdma = 0,  // copy_ext / copy_async_ext (DMA engine, or staging for pageable memory).
+    ihipCopyPathCpu  = 1,  // CPU loads/stores through the large BAR.
+    ihipCopyPathBlit = 2,  // shader copy kernel.
+};
+
+extern const char *ihipCopyPathStr(ihipCopyPath_t path);
+
+
+//---
+// Per-device policy which picks the copy path for each copy from its size and direction.
+// Uses built-in crossover sizes unless HIP_COPY_CALIBRATE is set, in which case they are measured the first time
+// the device copies anything, then cached in HIP_COPY_POLICY_FILE so later processes on the same host skip the
+// measurement.  See hip_copy_policy.cpp.
+class ihipCopyPolicy_t
+{
+public:
+    ihipCopyPolicy_t(ihipDevice_t *device);
+
+    ihipCopyPath_t choose(hc::hcCommandKind hcCopyDir, size_t sizeBytes,
+                          const hc::AmPointerInfo &dstPtrInfo, const hc::AmPointerInfo &srcPtrInfo);
+
+private:
+    void init();
+    void calibrate();
+    bool loadFromFile();
+    void saveToFile() const;
+    std::string fileKey() const;
+
+private:
+    ihipDevice_t   *_device;
+    std::once_flag  _initOnce;
+
+    size_t          _h2dCpuMax;   // largest H2D copy which uses CPU stores.
+    size_t          _d2hCpuMax;   // largest D2H copy which uses CPU loads.
+    size_t          _blitMax;     // largest D2D copy which uses a blit kernel.
+};
+
+// Enqueue a shader copy of sizeBytes from src to dst on av.  Both pointers must be accessible from the device.
+extern hc::completion_future ihipCopyKernel(hc::accelerator_view &av, void *dst, const void *src, size_t sizeBytes);
+
+// Address the device uses for ptr.  Differs from ptr for host memory locked with am_memory_host_lock.
+inline void *ihipAgentPtr(const void *ptr, const hc::AmPointerInfo &ptrInfo)
+{
+    if (ptrInfo._isInDeviceMem || (ptrInfo._hostPointer == nullptr) || (ptrInfo._devicePointer == nullptr)) {
+        return const_cast<void*>(ptr);
+    }
+    return static_cast<char*>(ptrInfo._devicePointer) + (static_cast<const char*>(ptr) - static_cast<const char*>(ptrInfo._hostPointer));
+}
+
+
+//---
+// One (dst, src, size) entry of a batched copy.
+struct ihipCopyRange_t {
+    void       *_dst;
+    const void *_src;
+    size_t      _sizeBytes;
+};
+
+// Pinned host table of ranges read by the batch blit kernel.  Reused once _cf completes.
+struct ihipCopyBatchTable_t {
+    ihipCopyRange_t        *_ranges;
+    size_t                  _capacity;
+    hc::completion_future   _cf;
+};
+
+// Enqueue one shader copy of all numRanges ranges on av.  ranges and the pointers it holds must be accessible from the device.
+extern hc::completion_future ihipCopyBatchKernel(hc::accelerator_view &av, const ihipCopyRange_t *ranges, size_t numRanges);
+
+
 template <typename MUTEX_TYPE>
 class ihipStreamCriticalBase_t : public LockedBase<MUTEX_TYPE>
 {
@@ -444,6 +1030,30 @@ public:
     // TODO - remove _kernelCnt mechanism:
     uint32_t                    _kernelCnt;    // Count of inflight kernels in this stream.  Reset at ::wait().
     hc::accelerator_view        _av;
+
+    // Most recent host-side task submitted to the staging engine for this stream.  Reset at ::wait().
+    std::shared_future<void>    _stagingFuture;
+
+    // Host ranges written by pending host tasks, each with the task that writes it.  Staged H2D copies read their
+    // source on the calling thread and only wait for the tasks writing it.  Pruned as tasks complete.
+    struct HostWrite {
+        uintptr_t                _start;
+        uintptr_t                _end;
+        std::shared_future<void> _task;
+    };
+    std::vector<HostWrite>      _hostWrites;
+
+    // Range tables of batched copies.  Freed when the stream is destroyed.
+    std::vector<ihipCopyBatchTable_t> _batchTables;
+
+    // Signals released by host tasks, each with a marker enqueued after the barrier packet waiting on it.
+    // A signal is destroyed once its marker completes, since the barrier can no longer read it.
+    std::deque<std::pair<hsa_signal_t, hc::completion_future>> _hostTaskSignals;
+
+    // Error from a file write which failed after hipMemcpyToFileAsync returned.  Shared with the I/O threads,
+    // which must not take the stream lock.  Reported and cleared by the next file copy on the stream, or by
+    // synchronizing or querying the stream or an event recorded in it.
+    std::shared_ptr<std::atomic<int>> _fileIoError;
 };
 
 
@@ -474,6 +1084,20 @@ public:
 
     void locked_copyAsync(void* dst, const void* src, size_t sizeBytes, unsigned kind);
 
+    // Copy between device memory on srcCtx and dstCtx, choosing direct, split or host-staged peer copies.
+    void locked_copyPeerAsync(void* dst, ihipCtx_t *dstCtx, const void* src, ihipCtx_t *srcCtx, size_t sizeBytes);
+
+    // Copy many ranges with one pointer classification pass and as few commands as possible.
+    // Ranges are coalesced in place, and may complete in any order relative to each other.
+    void locked_copyBatchAsync(std::vector<ihipCopyRange_t> &ranges, unsigned kind);
+
+    // Copies between a file region and device memory through the device's file I/O engine.  See hip_file_io.cpp.
+    void locked_copyFromFileAsync(void* dst, int fd, int64_t offset, size_t sizeBytes);
+    void locked_copyToFileAsync(int fd, int64_t offset, const void* src, size_t sizeBytes);
+    // Return, and clear, an error left behind by a file copy which failed after it was enqueued.
+    hipError_t takeFileIoError(LockedAccessor_StreamCrit_t &crit);
+    hipError_t locked_takeFileIoError();
+
 
     //---
     // Member functions that begin with locked_ are thread-safe accessors - these acquire / release the critical mutex.
@@ -528,6 +1152,50 @@ private:
 
     bool canSeeMemory(const ihipCtx_t *thisCtx, const hc::AmPointerInfo *dstInfo, const hc::AmPointerInfo *srcInfo);
 
+    bool canUseStaging(hc::hcCommandKind hcCopyDir, bool dstTracked, bool srcTracked, const ihipCtx_t *copyDevice);
+
+    void ensurePeerMapped(const hc::AmPointerInfo *dstPtrInfo, const hc::AmPointerInfo *srcPtrInfo);
+
+    // Route host pointers through the pin cache, refreshing ptrInfo/tracked if the range was just pinned.
+    void pinCacheAcquire(const void *ptr, size_t sizeBytes, bool *tracked, hc::AmPointerInfo *ptrInfo, ihipPinCache_t::Ref *ref);
+
+    ihipCopyBatchTable_t *acquireBatchTable(LockedAccessor_StreamCrit_t &crit, size_t numRanges);
+
+    // Chunked copies through the pinned staging buffers of copyDevice.  See hip_staging.cpp.
+    // The stream lock is taken for each chunk, unless the caller already holds it and passes heldCrit.
+    void stagedCopyHostToDevice(void *dst, const void *src, size_t sizeBytes,
+                                const hc::AmPointerInfo &dstPtrInfo, ihipCtx_t *copyDevice,
+                                LockedAccessor_StreamCrit_t *heldCrit=nullptr);
+    void stagedCopyDeviceToHost(void *dst, const void *src, size_t sizeBytes,
+                                const hc::AmPointerInfo &srcPtrInfo, ihipCtx_t *copyDevice,
+                                LockedAccessor_StreamCrit_t *heldCrit=nullptr);
+
+    // Copy one batch range which no engine can take asynchronously as-is.  Caller holds the stream lock.
+    void copyBatchRangeLocked(LockedAccessor_StreamCrit_t &crit, const ihipCopyRange_t &range, unsigned kind);
+
+    // Wait for host-side staging tasks for this stream.  Caller must hold the stream lock.
+    void waitStaging(LockedAccessor_StreamCrit_t &crit);
+
+    // Note that the task in crit->_stagingFuture writes host range [dst, dst+sizeBytes).
+    void recordHostWrite(LockedAccessor_StreamCrit_t &crit, const void *dst, size_t sizeBytes);
+
+    // Pending host tasks which write any part of [ptr, ptr+sizeBytes).
+    std::vector<std::shared_future<void>> pendingHostWrites(LockedAccessor_StreamCrit_t &crit, const void *ptr, size_t sizeBytes);
+
+    // True if no device command or host task is pending in the stream.
+    bool isIdle(LockedAccessor_StreamCrit_t &crit);
+
+    // Run task on a staging worker once prior commands in the stream complete.  Later device commands wait for it.
+    // With waitForCommands false the task only waits for earlier host tasks.  By default the task runs on this
+    // stream's worker of the device staging engine; engine/queue pick another worker.  With overlapPrior the task
+    // starts without waiting for earlier host tasks, and only its completion is ordered after theirs.
+    void enqueueHostTask(LockedAccessor_StreamCrit_t &crit, std::function<void()> task, bool waitForCommands=true,
+                         ihipStagingEngine_t *engine=nullptr, unsigned queue=0, bool overlapPrior=false);
+
+    // Make later device commands wait for the pending host tasks, without blocking the caller.
+    void fenceStaging(LockedAccessor_StreamCrit_t &crit);
+    void reclaimHostTaskSignals(LockedAccessor_StreamCrit_t &crit);
+
 
 private: // Data
     // Critical Data - MUST be accessed through LockedAccessor_StreamCrit_t
@@ -563,6 +1231,13 @@ struct ihipEvent_t {
 
     hc::completion_future _marker;
     uint64_t              _timestamp;  // store timestamp, may be set on host or by marker.
+
+    // hipEventInterprocess only.  The signal counts records which have not completed yet, so 0 means the event is done.
+    // It is shared with other processes through hipIpcGetEventHandle.
+    hsa_signal_t          _ipcSignal;       // handle==0 if this is not an interprocess event.
+    bool                  _ipcOwner;        // true if created in this process, false if opened from a handle.
+    bool                  _ipcHandleValid;  // _ipcHandle has been created.
+    hsa_amd_ipc_signal_t  _ipcHandle;
 } ;
 
 
@@ -594,15 +1269,50 @@ public:
     // TODO - report this through device properties, base on HCC API call.
     int                     _isLargeBar;
 
+    uint32_t                _pciDomain;    // PCI domain, 0 if the ROCr does not report it.
+    uint16_t                _pciBdfId;     // PCI bus [15:8], device [7:3] and function [2:0].
+
     ihipCtx_t               *_primaryCtx;
 
+    ihipStagingEngine_t     *_stagingEngine;  // staging for async copies to/from pageable host memory.
+    ihipCopyPolicy_t        *_copyPolicy;     // chooses CPU/blit/SDMA for copies to/from this device.
+    ihipPeerCopyEngine_t    *_peerCopyEngine; // peer copies into this device.
+    ihipPeerMapper_t        *_peerMapper;     // peer visibility of allocations on this device.
+    ihipStagingEngine_t     *_fileIoEngine;   // bounce buffers and I/O threads for copies between files and this device.
+    ihipSymbolCache_t       *_symbolCache;    // resolved __device__/__constant__ symbols.
+
+    // NUMA placement of pinned host memory, see hip_numa.cpp:
+    int                     _numaNode;        // OS NUMA node of the CPU agent closest to the device, -1 if placement is off.
+    hsa_agent_t             _cpuAgent;        // CPU agent for _numaNode.
+    hsa_amd_memory_pool_t   _hostPool;        // pool on _numaNode used for pinned host allocations.
+
 private:
     hipError_t initProperties(hipDeviceProp_t* prop);
+    void initNumaPlacement();
 };
 //=============================================================================
 
 
 
+//=============================================================================
+// Immutable copy of the enabled peer set of a context.  A new snapshot is published whenever the set changes;
+// readers hold a reference to the snapshot they loaded, so allocation paths can use it without the ctx lock.
+struct ihipPeerSnapshot_t
+{
+    ihipPeerSnapshot_t(std::vector<hsa_agent_t> &&agents, uint64_t generation) :
+        _agents(std::move(agents)),
+        _generation(generation)
+    {};
+
+    uint32_t           peerCnt() const { return _agents.size(); };
+    const hsa_agent_t *peerAgents() const { return _agents.data(); };
+
+    const std::vector<hsa_agent_t>  _agents;        // packed array of enabled agents, always including self.
+    const uint64_t                  _generation;    // incremented whenever the peer set changes.
+};
+typedef std::shared_ptr<const ihipPeerSnapshot_t> ihipPeerSnapshotPtr_t;
+
+
 //=============================================================================
 //class ihipCtxCriticalBase_t
 template <typename MUTEX_TYPE>
@@ -610,19 +1320,10 @@ class ihipCtxCriticalBase_t : LockedBase<MUTEX_TYPE>
 {
 public:
     ihipCtxCriticalBase_t(unsigned deviceCnt) :
-         _peerCnt(0)
+         _peerSnapshot(std::make_shared<const ihipPeerSnapshot_t>(std::vector<hsa_agent_t>(), 0))
     {
-        _peerAgents = new hsa_agent_t[deviceCnt];
     };
 
-    ~ihipCtxCriticalBase_t()  {
-        if (_peerAgents != nullptr) {
-            delete _peerAgents;
-            _peerAgents = nullptr;
-        }
-        _peerCnt = 0;
-    }
-
     // Streams:
     void addStream(ihipStream_t *stream);
     std::list<ihipStream_t*> &streams() { return _streams; };
@@ -636,8 +1337,12 @@ public:
     void resetPeerWatchers(ihipCtx_t *thisDevice);
     void printPeerWatchers(FILE *f) const;
 
-    uint32_t peerCnt() const { return _peerCnt; };
-    hsa_agent_t *peerAgents() const { return _peerAgents; };
+    uint32_t peerCnt() const { return _peerSnapshot->peerCnt(); };
+    const hsa_agent_t *peerAgents() const { return _peerSnapshot->peerAgents(); };
+    uint64_t peerGeneration() const { return _peerSnapshot->_generation; };
+
+    // Lock-free: may be called without holding the LockedAccessor.  See ihipCtx_t::peerSnapshot.
+    ihipPeerSnapshotPtr_t peerSnapshot() const { return std::atomic_load(&_peerSnapshot); };
 
 
     // TODO - move private
@@ -653,8 +1358,8 @@ private:
     // These reflect the currently Enabled set of peers for this GPU:
     // Enabled peers have permissions to access the memory physically allocated on this device.
     // Note the peers always contain the self agent for easy interfacing with HSA APIs.
-    uint32_t                  _peerCnt;     // number of enabled peers
-    hsa_agent_t              *_peerAgents;  // efficient packed array of enabled agents (to use for allocations.)
+    // Written only with the lock held, and always with std::atomic_store since readers may not hold the lock.
+    ihipPeerSnapshotPtr_t     _peerSnapshot;
 private:
     void recomputePeerAgents();
 };
@@ -690,6 +1395,9 @@ public: // Functions:
 
     ihipCtxCritical_t  &criticalData() { return _criticalData; }; // TODO, move private.  Fix P2P.
 
+    // Current enabled peer set, read without taking the ctx lock.  Used on every allocation.
+    ihipPeerSnapshotPtr_t peerSnapshot() const { return _criticalData.peerSnapshot(); };
+
     const ihipDevice_t *getDevice() const { return _device; };
     int                 getDeviceNum() const { return _device->_deviceId; };
 
@@ -735,6 +1443,20 @@ extern hipError_t    ihipSynchronize(void);
 extern void          ihipCtxStackUpdate();
 
 extern ihipDevice_t *ihipGetDevice(int);
+
+// Pinned host memory on the device's NUMA node, visible to all devices.  Free with ihipHostFreePinned.
+// hugePages backs the allocation with 2MB or 1GB pages when the host has them, else it silently uses 4KB pages;
+// *usedHugePages says which.  Either way the devices see the memory at its host address.
+extern void         *ihipHostAllocPinned(ihipDevice_t *device, size_t sizeBytes, bool hugePages=false, bool *usedHugePages=nullptr);
+extern void          ihipHostFreePinned(void *ptr);
+// Enqueue an AQL barrier-AND packet which waits for depSignal to reach 0 and then decrements completionSignal.
+// Either signal may have a 0 handle.
+extern void          ihipEnqueueBarrierPacket(hc::accelerator_view &av, hsa_signal_t depSignal, hsa_signal_t completionSignal);
+// Drop the cached IPC handle for an allocation which is being freed.
+extern void          ihipIpcForgetMemHandle(void *ptr);
+// Managed memory from hipMallocManaged.  ihipFreeManaged returns false if ptr is not a managed allocation.
+extern bool          ihipIsManaged(const void *ptr);
+extern bool          ihipFreeManaged(void *ptr);
 ihipCtx_t * ihipGetPrimaryCtx(unsigned deviceIndex);
 
 extern void ihipSetTs(hipEvent_t e);
@@ -794,6 +1516,7 @@ inline std::ostream& operator<<(std::ostream& os, const ihipCtx_t* c)
 // Helper functions that are used across src files:
 namespace hip_internal {
     hipError_t memcpyAsync (void* dst, const void* src, size_t sizeBytes, hipMemcpyKind kind, hipStream_t stream);
+    hipError_t memcpyBatchAsync (std::vector<ihipCopyRange_t> &ranges, hipMemcpyKind kind, hipStream_t stream);
 };
 
 
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+//#pragma once
+
+#ifndef HIP_HISTOGRAM_H
+#define HIP_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+//---
+// Log-linear histogram of durations (or any non-negative value).  Each power of two is split into
+// 2^HIP_HISTOGRAM_SUB_BITS linear buckets, so any percentile is accurate to 1/2^HIP_HISTOGRAM_SUB_BITS of
+// its value, and the histogram is a fixed-size array which two threads can merge by adding counts.
+// Values below 2^HIP_HISTOGRAM_SUB_BITS get a bucket each.
+
+#define HIP_HISTOGRAM_SUB_BITS  3
+#define HIP_HISTOGRAM_SUB_COUNT (1 << HIP_HISTOGRAM_SUB_BITS)
+#define HIP_HISTOGRAM_BUCKETS   ((64 - HIP_HISTOGRAM_SUB_BITS + 1) * HIP_HISTOGRAM_SUB_COUNT)
+
+struct ihipHistogram_t {
+    ihipHistogram_t() { clear(); };
+
+    void clear() { memset(this, 0, sizeof(*this)); };
+
+    static unsigned bucket(uint64_t v) {
+        if (v < HIP_HISTOGRAM_SUB_COUNT) {
+            return v;
+        }
+        unsigned msb = 63 - __builtin_clzll(v);
+        return ((msb - HIP_HISTOGRAM_SUB_BITS + 1) << HIP_HISTOGRAM_SUB_BITS) +
+               ((v >> (msb - HIP_HISTOGRAM_SUB_BITS)) & (HIP_HISTOGRAM_SUB_COUNT - 1));
+    };
+
+    // Smallest value which falls in bucket b.
+    static uint64_t bucketLow(unsigned b) {
+        if (b < HIP_HISTOGRAM_SUB_COUNT) {
+            return b;
+        }
+        unsigned msb = (b >> HIP_HISTOGRAM_SUB_BITS) + HIP_HISTOGRAM_SUB_BITS - 1;
+        uint64_t sub = b & (HIP_HISTOGRAM_SUB_COUNT - 1);
+        return (1ull << msb) | (sub << (msb - HIP_HISTOGRAM_SUB_BITS));
+    };
+
+    void add(uint64_t v) {
+        _counts[bucket(v)]++;
+        _count++;
+        _total += v;
+        _min = (_count == 1 || v < _min) ? v : _min;
+        _max = (v > _max) ? v : _max;
+    };
+
+    void merge(const ihipHistogram_t &other) {
+        if (other._count == 0) {
+            return;
+        }
+        for (unsigned b = 0; b < HIP_HISTOGRAM_BUCKETS; b++) {
+            _counts[b] += other._counts[b];
+        }
+        _min = (_count == 0 || other._min < _min) ? other._min : _min;
+        _max = (other._max > _max) ? other._max : _max;
+        _count += other._count;
+        _total += other._total;
+    };
+
+    // Value at percentile p (0..100), interpolated to the middle of its bucket and clamped to [min, max].
+    uint64_t percentile(double p) const {
+        if (_count == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p / 100.0 * (_count - 1)) + 1;
+        uint64_t seen = 0;
+        for (unsigned b = 0; b < HIP_HISTOGRAM_BUCKETS; b++) {
+            seen += _counts[b];
+            if (seen >= rank) {
+                uint64_t low = bucketLow(b);
+                uint64_t high = (b + 1 < HIP_HISTOGRAM_BUCKETS) ? bucketLow(b + 1) - 1 : UINT64_MAX;
+                uint64_t v = low + (high - low) / 2;
+                return (v < _min) ? _min : ((v > _max) ? _max : v);
+            }
+        }
+        return _max;
+    };
+
+    uint64_t    _count;
+    uint64_t    _total;
+    uint64_t    _min;
+    uint64_t    _max;
+    uint64_t    _counts[HIP_HISTOGRAM_BUCKETS];
+};
+
+#endif
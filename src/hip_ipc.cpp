@@ -0,0 +1,274 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file hip_ipc.cpp
+ *
+ * Interprocess memory and event handles.
+ *
+ * Memory: hipIpcGetMemHandle creates the ROCr IPC handle once per allocation and caches it, keyed by the base
+ * pointer, until hipFree.  hipIpcOpenMemHandle caches the mapping of each handle on each device with a reference
+ * count, so a process which opens the same buffer for every request attaches it once.  hipIpcCloseMemHandle drops
+ * a reference and detaches the memory when the last one goes.
+ *
+ * Events: a hipEventInterprocess event owns an IPC-capable HSA signal which counts records that have not completed.
+ * A record adds 1 on the host and enqueues a barrier packet which decrements it when prior work in the stream is
+ * done.  Another process attaches the same signal with hipIpcOpenEventHandle, and hipStreamWaitEvent there enqueues
+ * a barrier packet which waits for it to reach 0 - the two processes synchronize through the device queues without a
+ * host round trip.
+ */
+
+#include <string.h>
+#include <mutex>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+//=================================================================================================
+// Caches:
+//=================================================================================================
+struct ihipIpcExport_t {
+    hsa_amd_ipc_memory_t    _handle;
+    size_t                  _sizeBytes;
+};
+
+struct ihipIpcImport_t {
+    void                   *_ptr;
+    int                     _refCnt;
+};
+
+// Protects the caches below and the _ipcHandle of interprocess events.
+static std::mutex                                       g_ipcMutex;
+
+// Handles created in this process, keyed by allocation base pointer.
+static std::unordered_map<void*, ihipIpcExport_t>       g_ipcExports;
+
+// Handles opened in this process, keyed by handle bytes + mapping agent, and the reverse map used by close.
+static std::map<std::string, ihipIpcImport_t>           g_ipcImports;
+static std::unordered_map<void*, std::string>           g_ipcImportKeys;
+
+
+static std::string ihipIpcImportKey(const hsa_amd_ipc_memory_t &handle, hsa_agent_t agent)
+{
+    std::string key(reinterpret_cast<const char*>(&handle), sizeof(handle));
+    key.append(reinterpret_cast<const char*>(&agent.handle), sizeof(agent.handle));
+    return key;
+}
+
+
+void ihipIpcForgetMemHandle(void *ptr)
+{
+    std::lock_guard<std::mutex> lock(g_ipcMutex);
+    g_ipcExports.erase(ptr);
+}
+
+
+//=================================================================================================
+// Memory handles:
+//=================================================================================================
+hipError_t hipIpcGetMemHandle(hipIpcMemHandle_t* handle, void* devPtr)
+{
+    HIP_INIT_API(handle, devPtr);
+
+    if ((handle == nullptr) || (devPtr == nullptr)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    hc::accelerator acc;
+    hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
+    if (hc::am_memtracker_getinfo(&amPointerInfo, devPtr) != AM_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidResourceHandle);
+    }
+
+    // Export the whole allocation, so every pointer into it shares one handle.
+    void *base = amPointerInfo._devicePointer;
+
+    ihipIpcMemHandle_t ih;
+    {
+        std::lock_guard<std::mutex> lock(g_ipcMutex);
+
+        auto it = g_ipcExports.find(base);
+        if (it == g_ipcExports.end()) {
+            ihipIpcExport_t e;
+            e._sizeBytes = amPointerInfo._sizeBytes;
+            if (hsa_amd_ipc_memory_create(base, e._sizeBytes, &e._handle) != HSA_STATUS_SUCCESS) {
+                return ihipLogStatus(hipErrorMemoryAllocation);
+            }
+            tprintf(DB_MEM, "ipc: created handle for %p size=%zu\n", base, e._sizeBytes);
+            it = g_ipcExports.emplace(base, e).first;
+        }
+
+        ih.ipc_handle = it->second._handle;
+        ih.psize      = it->second._sizeBytes;
+    }
+
+    memset(handle, 0, sizeof(*handle));
+    memcpy(handle->reserved, &ih, sizeof(ih));
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipIpcOpenMemHandle(void** devPtr, hipIpcMemHandle_t handle, unsigned int flags)
+{
+    HIP_INIT_API(devPtr, &handle, flags);
+
+    if (devPtr == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    ihipCtx_t *ctx = ihipGetTlsDefaultCtx();
+    if (ctx == nullptr) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+    hsa_agent_t agent = ctx->getDevice()->_hsaAgent;
+
+    ihipIpcMemHandle_t ih;
+    memcpy(&ih, handle.reserved, sizeof(ih));
+
+    std::string key = ihipIpcImportKey(ih.ipc_handle, agent);
+
+    std::lock_guard<std::mutex> lock(g_ipcMutex);
+
+    auto it = g_ipcImports.find(key);
+    if (it != g_ipcImports.end()) {
+        it->second._refCnt++;
+        *devPtr = it->second._ptr;
+        tprintf(DB_MEM, "ipc: reopened %p refCnt=%d\n", *devPtr, it->second._refCnt);
+        return ihipLogStatus(hipSuccess);
+    }
+
+    void *ptr = nullptr;
+    if (hsa_amd_ipc_memory_attach(&ih.ipc_handle, ih.psize, 1, &agent, &ptr) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorMapBufferObjectFailed);
+    }
+    tprintf(DB_MEM, "ipc: attached %p size=%zu\n", ptr, ih.psize);
+
+    g_ipcImports[key] = ihipIpcImport_t{ptr, 1};
+    g_ipcImportKeys[ptr] = key;
+    *devPtr = ptr;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipIpcCloseMemHandle(void *devPtr)
+{
+    HIP_INIT_API(devPtr);
+
+    std::lock_guard<std::mutex> lock(g_ipcMutex);
+
+    auto keyIt = g_ipcImportKeys.find(devPtr);
+    if (keyIt == g_ipcImportKeys.end()) {
+        return ihipLogStatus(hipErrorInvalidResourceHandle);
+    }
+
+    auto it = g_ipcImports.find(keyIt->second);
+    if (--it->second._refCnt > 0) {
+        tprintf(DB_MEM, "ipc: released %p refCnt=%d\n", devPtr, it->second._refCnt);
+        return ihipLogStatus(hipSuccess);
+    }
+
+    g_ipcImports.erase(it);
+    g_ipcImportKeys.erase(keyIt);
+
+    if (hsa_amd_ipc_memory_detach(devPtr) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidResourceHandle);
+    }
+    tprintf(DB_MEM, "ipc: detached %p\n", devPtr);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//=================================================================================================
+// Event handles:
+//=================================================================================================
+hipError_t hipIpcGetEventHandle(hipIpcEventHandle_t* handle, hipEvent_t event)
+{
+    HIP_INIT_API(handle, event);
+
+    if (handle == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    if ((event == nullptr) || (event->_ipcSignal.handle == 0)) {
+        return ihipLogStatus(hipErrorInvalidResourceHandle);
+    }
+
+    ihipIpcEventHandle_t ih;
+    {
+        std::lock_guard<std::mutex> lock(g_ipcMutex);
+
+        if (!event->_ipcHandleValid) {
+            if (hsa_amd_ipc_signal_create(event->_ipcSignal, &event->_ipcHandle) != HSA_STATUS_SUCCESS) {
+                return ihipLogStatus(hipErrorMemoryAllocation);
+            }
+            event->_ipcHandleValid = true;
+        }
+        ih.ipc_handle = event->_ipcHandle;
+    }
+
+    memset(handle, 0, sizeof(*handle));
+    memcpy(handle->reserved, &ih, sizeof(ih));
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipIpcOpenEventHandle(hipEvent_t* event, hipIpcEventHandle_t handle)
+{
+    HIP_INIT_API(event, &handle);
+
+    if (event == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    ihipIpcEventHandle_t ih;
+    memcpy(&ih, handle.reserved, sizeof(ih));
+
+    hsa_signal_t signal;
+    if (hsa_amd_ipc_signal_attach(&ih.ipc_handle, &signal) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorMapBufferObjectFailed);
+    }
+
+    ihipEvent_t *eh = new ihipEvent_t();
+    eh->_state          = hipEventStatusCreated;
+    eh->_stream         = NULL;
+    eh->_flags          = hipEventInterprocess | hipEventDisableTiming;
+    eh->_timestamp      = 0;
+    eh->_ipcSignal      = signal;
+    eh->_ipcOwner       = false;
+    eh->_ipcHandleValid = true;
+    eh->_ipcHandle      = ih.ipc_handle;
+    *event = eh;
+
+    return ihipLogStatus(hipSuccess);
+}
@@ -0,0 +1,342 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+/**
+ * @file hip_kernel_prof.cpp
+ *
+ * Per-kernel device execution time statistics, enabled with HIP_PROFILE_KERNELS=1.
+ *
+ * ihipPreLaunchKernel asks the launch for its completion_future, whose signal HCC takes from its signal pool
+ * and stamps with the dispatch start and end times.  ihipPostLaunchKernel queues the future here once the stream
+ * is unlocked.  Module launches are timed by markers around the dispatch, or from their own signal.
+ *
+ * Each thread queues its launches and keeps its statistics in its own buffer, registered once, so launching
+ * threads never share a lock; a buffer's lock is only contended while the summary is printed.  Completed futures
+ * are harvested without blocking on each later launch from the thread, and the rest are waited for when the
+ * summary is printed.  The statistics of a launch site - the kernel name pointer and geometry it passes - are
+ * found with one hash lookup in a per-thread cache, so the name string is built only on a site's first launch.
+ *
+ * Launches on several streams can complete out of order, so each thread queues at most
+ * HIP_KERNEL_PROF_MAX_PENDING futures.  A launch which finds its queue full harvests all completed futures, and
+ * if none has completed, waits for the oldest - so a thread only waits for the GPU when it has thousands of
+ * launches in flight.
+ *
+ * Durations are aggregated per kernel name and launch geometry into a count, total and log-linear histogram
+ * (min, max, p50, p99).  The summary merges the threads, is sorted by total time, and is printed to stderr at
+ * exit, and at the end of each capture window (hipProfilerStop, see hip_prof_control.cpp).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <hc.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "hip_histogram.h"
+#include "trace_helper.h"
+
+
+bool g_kernelProf = false;
+
+#define HIP_KERNEL_PROF_MAX_PENDING 4096
+
+
+struct ihipKernelKey_t {
+    std::string     _name;
+    gl_dim3         _grid;
+    gl_dim3         _group;
+
+    bool operator<(const ihipKernelKey_t &o) const {
+        return std::tie(_name, _grid.x, _grid.y, _grid.z, _group.x, _group.y, _group.z) <
+               std::tie(o._name, o._grid.x, o._grid.y, o._grid.z, o._group.x, o._group.y, o._group.z);
+    };
+};
+
+typedef std::map<ihipKernelKey_t, ihipHistogram_t> ihipKernelStatsMap_t;
+
+struct ihipKernelPending_t {
+    ihipHistogram_t         *_stats;
+    hc::completion_future   _beginCf;   // if valid, the kernel began when this completed
+    hc::completion_future   _cf;
+};
+
+// Launches and statistics recorded by one thread.  The lock is only contended while the summary is printed.
+// Entries of _stats are cleared rather than erased, since the thread's site cache points at them.
+struct ihipKernelProfBuffer_t {
+    std::mutex                          _mutex;
+    ihipKernelStatsMap_t                _stats;
+    std::deque<ihipKernelPending_t>     _pending;
+};
+
+// A launch site: the kernel name pointer and geometry passed by the launch.
+struct ihipKernelSite_t {
+    const char     *_name;
+    gl_dim3         _grid;
+    gl_dim3         _group;
+
+    bool operator==(const ihipKernelSite_t &o) const {
+        return (_name == o._name) && (_grid.x == o._grid.x) && (_grid.y == o._grid.y) && (_grid.z == o._grid.z) &&
+               (_group.x == o._group.x) && (_group.y == o._group.y) && (_group.z == o._group.z);
+    };
+};
+
+struct ihipKernelSiteHash_t {
+    size_t operator()(const ihipKernelSite_t &s) const {
+        size_t h = std::hash<const void*>()(s._name);
+        for (size_t v : {s._grid.x, s._grid.y, s._grid.z, s._group.x, s._group.y, s._group.z}) {
+            h = h * 31 + v;
+        }
+        return h;
+    };
+};
+
+struct ihipKernelSiteStats_t {
+    const std::string   *_name;     // key of _stats in the thread's buffer
+    ihipHistogram_t     *_stats;
+};
+
+struct ihipKernelProfThread_t {
+    ihipKernelProfBuffer_t *_buffer = nullptr;
+    std::unordered_map<ihipKernelSite_t, ihipKernelSiteStats_t, ihipKernelSiteHash_t> _sites;
+};
+
+static thread_local ihipKernelProfThread_t tls_kernelProf;
+
+static std::mutex                           g_kernelProfMutex;  // protects g_kernelProfBuffers
+static std::vector<ihipKernelProfBuffer_t*> g_kernelProfBuffers;
+static double                               g_nsPerTick;
+
+
+static ihipKernelProfBuffer_t *ihipKernelProfThreadBuffer()
+{
+    ihipKernelProfBuffer_t *buffer = tls_kernelProf._buffer;
+    if (buffer == nullptr) {
+        buffer = new ihipKernelProfBuffer_t;
+        tls_kernelProf._buffer = buffer;
+        std::lock_guard<std::mutex> l(g_kernelProfMutex);
+        g_kernelProfBuffers.push_back(buffer);
+    }
+    return buffer;
+}
+
+
+// Statistics of a launch site in this thread's buffer.  Caller holds buffer->_mutex.
+static ihipHistogram_t *ihipKernelStats(ihipKernelProfBuffer_t *buffer, const char *kernelName,
+                                        const gl_dim3 &grid, const gl_dim3 &group)
+{
+    if (kernelName == nullptr) {
+        kernelName = "<unknown>";
+    }
+
+    // Module kernel names are freed with their module, so a recycled pointer must also match the name:
+    const ihipKernelSite_t site{kernelName, grid, group};
+    auto iter = tls_kernelProf._sites.find(site);
+    if ((iter != tls_kernelProf._sites.end()) && (strcmp(iter->second._name->c_str(), kernelName) == 0)) {
+        return iter->second._stats;
+    }
+
+    auto entry = buffer->_stats.insert(std::make_pair(ihipKernelKey_t{kernelName, grid, group}, ihipHistogram_t())).first;
+    tls_kernelProf._sites[site] = ihipKernelSiteStats_t{&entry->first._name, &entry->second};
+    return &entry->second;
+}
+
+
+static void ihipKernelProfAddTicks(ihipHistogram_t *stats, uint64_t begin, uint64_t end)
+{
+    stats->add((uint64_t)((end - begin) * g_nsPerTick));
+}
+
+
+static void ihipKernelProfAddPending(ihipKernelPending_t &p)
+{
+    ihipKernelProfAddTicks(p._stats, p._beginCf.valid() ? p._beginCf.get_end_tick() : p._cf.get_begin_tick(),
+                           p._cf.get_end_tick());
+}
+
+
+// Harvest completed launches.  With wait=true, waits for all of them.  Caller holds buffer->_mutex.
+static void ihipKernelProfHarvest(ihipKernelProfBuffer_t *buffer, bool wait)
+{
+    while (!buffer->_pending.empty()) {
+        ihipKernelPending_t &p = buffer->_pending.front();
+        if (!p._cf.is_ready()) {
+            if (!wait) {
+                break;
+            }
+            p._cf.wait();
+        }
+        ihipKernelProfAddPending(p);
+        buffer->_pending.pop_front();
+    }
+}
+
+
+// Make room for one more launch.  Caller holds buffer->_mutex.
+static void ihipKernelProfReserve(ihipKernelProfBuffer_t *buffer)
+{
+    ihipKernelProfHarvest(buffer, false);
+    std::deque<ihipKernelPending_t> &pending = buffer->_pending;
+    if (pending.size() < HIP_KERNEL_PROF_MAX_PENDING) {
+        return;
+    }
+
+    // The oldest is still running - harvest whatever has completed behind it:
+    auto out = pending.begin();
+    for (auto iter = pending.begin(); iter != pending.end(); iter++) {
+        if (iter->_cf.is_ready()) {
+            ihipKernelProfAddPending(*iter);
+        } else {
+            if (out != iter) {
+                *out = std::move(*iter);
+            }
+            out++;
+        }
+    }
+    pending.erase(out, pending.end());
+
+    if (pending.size() >= HIP_KERNEL_PROF_MAX_PENDING) {
+        pending.front()._cf.wait();
+        ihipKernelProfHarvest(buffer, false);
+    }
+}
+
+
+static void ihipKernelProfDump()
+{
+    ihipKernelStatsMap_t merged;
+    {
+        std::lock_guard<std::mutex> l(g_kernelProfMutex);
+        for (auto buffer : g_kernelProfBuffers) {
+            std::lock_guard<std::mutex> bl(buffer->_mutex);
+            ihipKernelProfHarvest(buffer, true);
+            for (auto &s : buffer->_stats) {
+                if (s.second._count) {
+                    merged[s.first].merge(s.second);
+                    s.second.clear();
+                }
+            }
+        }
+    }
+
+    std::vector<ihipKernelStatsMap_t::const_iterator> sorted;
+    uint64_t launches = 0;
+    for (auto iter = merged.cbegin(); iter != merged.cend(); iter++) {
+        sorted.push_back(iter);
+        launches += iter->second._count;
+    }
+    std::sort(sorted.begin(), sorted.end(), [](ihipKernelStatsMap_t::const_iterator a, ihipKernelStatsMap_t::const_iterator b) {
+        return a->second._total > b->second._total;
+    });
+
+    fprintf(stderr, "HIP kernel profile: %lu launches of %zu kernel configurations\n", launches, sorted.size());
+    fprintf(stderr, "%12s %8s %10s %10s %10s %10s %10s  %-18s %-18s %s\n",
+            "total(ms)", "count", "avg(us)", "min(us)", "p50(us)", "p99(us)", "max(us)", "grid", "block", "kernel");
+    for (auto iter : sorted) {
+        const ihipKernelKey_t &k = iter->first;
+        const ihipHistogram_t &h = iter->second;
+        char grid[32], group[32];
+        snprintf(grid, sizeof(grid), "{%u,%u,%u}", (unsigned)k._grid.x, (unsigned)k._grid.y, (unsigned)k._grid.z);
+        snprintf(group, sizeof(group), "{%u,%u,%u}", (unsigned)k._group.x, (unsigned)k._group.y, (unsigned)k._group.z);
+        fprintf(stderr, "%12.3f %8lu %10.2f %10.2f %10.2f %10.2f %10.2f  %-18s %-18s %s\n",
+                h._total / 1.0e6, h._count, h._total / 1.0e3 / h._count,
+                h._min / 1.0e3, h.percentile(50) / 1.0e3, h.percentile(99) / 1.0e3, h._max / 1.0e3,
+                grid, group, k._name.c_str());
+    }
+}
+
+
+//=================================================================================================
+// Called from the launch path:
+//=================================================================================================
+static void ihipKernelProfAtExit()
+{
+    if (g_kernelProf) {
+        ihipKernelProfDump();
+    }
+}
+
+
+void ihipKernelProfInit()
+{
+    if (HIP_PROFILE_KERNELS) {
+        uint64_t freqHz = 0;
+        hsa_system_get_info(HSA_SYSTEM_INFO_TIMESTAMP_FREQUENCY, &freqHz);
+        g_nsPerTick = freqHz ? 1.0e9 / freqHz : 0.0;
+        g_kernelProf = !HIP_PROFILE_START_PAUSED;
+        atexit(ihipKernelProfAtExit);
+    }
+}
+
+
+void ihipKernelProfAdd(const char *kernelName, const gl_dim3 &grid, const gl_dim3 &group, const hc::completion_future &cf)
+{
+    ihipKernelProfAdd(kernelName, grid, group, hc::completion_future(), cf);
+}
+
+
+void ihipKernelProfAdd(const char *kernelName, const gl_dim3 &grid, const gl_dim3 &group,
+                       const hc::completion_future &beginCf, const hc::completion_future &cf)
+{
+    if (cf.valid()) {
+        ihipKernelProfBuffer_t *buffer = ihipKernelProfThreadBuffer();
+        std::lock_guard<std::mutex> l(buffer->_mutex);
+        ihipKernelProfReserve(buffer);
+        buffer->_pending.push_back(ihipKernelPending_t{ihipKernelStats(buffer, kernelName, grid, group), beginCf, cf});
+    }
+}
+
+
+void ihipKernelProfAdd(const char *kernelName, const gl_dim3 &grid, const gl_dim3 &group, uint64_t begin, uint64_t end)
+{
+    ihipKernelProfBuffer_t *buffer = ihipKernelProfThreadBuffer();
+    std::lock_guard<std::mutex> l(buffer->_mutex);
+    ihipKernelProfAddTicks(ihipKernelStats(buffer, kernelName, grid, group), begin, end);
+}
+
+
+// Start a new capture window, see hip_prof_control.cpp.
+void ihipKernelProfStart()
+{
+    if (HIP_PROFILE_KERNELS) {
+        g_kernelProf = true;
+    }
+}
+
+
+// End the capture window and print its summary.
+void ihipKernelProfStop()
+{
+    if (g_kernelProf) {
+        g_kernelProf = false;
+        ihipKernelProfDump();
+    }
+}
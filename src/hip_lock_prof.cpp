@@ -0,0 +1,293 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+/**
+ * @file hip_lock_prof.cpp
+ *
+ * Lock contention statistics, compiled in with COMPILE_HIP_LOCK_PROF=1 (cmake -DCOMPILE_HIP_LOCK_PROF=1).
+ *
+ * Each LockedBase (the stream and context critical data) carries an ihipLockProf_t.  Locks are taken with
+ * try_lock first, so an uncontended acquire reads the clock only once to start the hold time.  Each acquire
+ * and release updates the statistics of the lock and of the call site which took it.  The call site is the
+ * return address of the (non-inlined) LockedAccessor constructor or LockedBase::lock, and is named with
+ * backtrace_symbols when the report is printed.
+ *
+ * Call sites are kept in a fixed open-addressing table so the lock path never allocates or takes another lock.
+ * Stats of locks which are destroyed (for example with their stream) are kept for the report if they were
+ * ever contended.
+ *
+ * At exit the locks and call sites with the most total wait time are printed to stderr.
+ */
+
+#include "hip_hcc.h"
+
+#if COMPILE_HIP_LOCK_PROF
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#define HIP_LOCK_PROF_SITES 4096    // the last entry collects sites which do not fit
+#define HIP_LOCK_PROF_TOP   10
+
+
+struct ihipLockSite_t {
+    std::atomic<const void*>    _site;
+    const char                  *_name;
+    ihipLockStats_t             _stats;
+};
+
+// Snapshot of one lock or call site, for the report.
+struct ihipLockReport_t {
+    std::string     _name;
+    uint64_t        _acquires;
+    uint64_t        _contended;
+    uint64_t        _waitNs;
+    uint64_t        _maxWaitNs;
+    uint64_t        _holdNs;
+};
+
+struct ihipLockRegistry_t {
+    std::mutex                  _mutex;     // protects the fields below
+    std::set<ihipLockProf_t*>   _locks;
+    std::vector<ihipLockReport_t> _retired;
+};
+
+// Zero-initialized, and never destroyed: locks may be created and destroyed during static init and exit.
+static ihipLockSite_t g_lockSites[HIP_LOCK_PROF_SITES];
+static ihipLockRegistry_t *ihipLockRegistry()
+{
+    static ihipLockRegistry_t *registry = new ihipLockRegistry_t;
+    return registry;
+}
+
+
+static void ihipLockStatsAdd(ihipLockStats_t *stats, bool contended, uint64_t waitNs)
+{
+    stats->_acquires.fetch_add(1, std::memory_order_relaxed);
+    if (contended) {
+        stats->_contended.fetch_add(1, std::memory_order_relaxed);
+        stats->_waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+        uint64_t maxWait = stats->_maxWaitNs.load(std::memory_order_relaxed);
+        while (waitNs > maxWait && !stats->_maxWaitNs.compare_exchange_weak(maxWait, waitNs, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+
+static ihipLockReport_t ihipLockReport(const std::string &name, const ihipLockStats_t &stats)
+{
+    return ihipLockReport_t{name,
+                            stats._acquires.load(std::memory_order_relaxed),
+                            stats._contended.load(std::memory_order_relaxed),
+                            stats._waitNs.load(std::memory_order_relaxed),
+                            stats._maxWaitNs.load(std::memory_order_relaxed),
+                            stats._holdNs.load(std::memory_order_relaxed)};
+}
+
+
+static std::string ihipLockName(const ihipLockProf_t *prof)
+{
+    char buf[256];
+    const char *name = prof->_name;
+    char *demangled = name ? abi::__cxa_demangle(name, nullptr, nullptr, nullptr) : nullptr;
+    snprintf(buf, sizeof(buf), "%s.%p", demangled ? demangled : (name ? name : "LockedBase"), prof);
+    free(demangled);
+    return buf;
+}
+
+
+// backtrace_symbols gives "object(mangled+0xoff) [addr]".  Demangle the function name if there is one.
+static std::string ihipLockSiteName(const void *site)
+{
+    void *addr = const_cast<void*>(site);
+    char **syms = backtrace_symbols(&addr, 1);
+    std::string name = syms ? syms[0] : "?";
+    free(syms);
+
+    size_t open = name.find('(');
+    size_t plus = name.find('+', open);
+    if (open != std::string::npos && plus != std::string::npos && plus > open + 1) {
+        std::string mangled = name.substr(open + 1, plus - open - 1);
+        char *demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, nullptr);
+        if (demangled) {
+            size_t close = name.find(')', plus);
+            name = std::string(demangled) + name.substr(plus, close - plus);
+            free(demangled);
+        }
+    }
+    return name;
+}
+
+
+static void ihipLockPrint(const char *title, std::vector<ihipLockReport_t> &reports)
+{
+    std::sort(reports.begin(), reports.end(), [](const ihipLockReport_t &a, const ihipLockReport_t &b) {
+        return a._waitNs > b._waitNs;
+    });
+
+    fprintf(stderr, "%s\n", title);
+    fprintf(stderr, "%12s %12s %10s %12s %12s %12s  %s\n",
+            "wait(ms)", "acquires", "contended", "avgWait(us)", "maxWait(us)", "hold(ms)", "name");
+    for (size_t i = 0; i < reports.size() && i < HIP_LOCK_PROF_TOP; i++) {
+        const ihipLockReport_t &r = reports[i];
+        fprintf(stderr, "%12.3f %12lu %9.1f%% %12.2f %12.2f %12.3f  %s\n",
+                r._waitNs / 1.0e6, r._acquires, r._acquires ? 100.0 * r._contended / r._acquires : 0.0,
+                r._contended ? r._waitNs / 1.0e3 / r._contended : 0.0, r._maxWaitNs / 1.0e3,
+                r._holdNs / 1.0e6, r._name.c_str());
+    }
+}
+
+
+static void ihipLockProfDump()
+{
+    std::vector<ihipLockReport_t> locks;
+    {
+        ihipLockRegistry_t *registry = ihipLockRegistry();
+        std::lock_guard<std::mutex> l(registry->_mutex);
+        locks = registry->_retired;
+        for (auto prof : registry->_locks) {
+            if (prof->_stats._acquires.load(std::memory_order_relaxed)) {
+                locks.push_back(ihipLockReport(ihipLockName(prof), prof->_stats));
+            }
+        }
+    }
+
+    std::vector<ihipLockReport_t> sites;
+    for (size_t i = 0; i < HIP_LOCK_PROF_SITES - 1; i++) {
+        const void *site = g_lockSites[i]._site.load(std::memory_order_acquire);
+        if (site) {
+            std::string name = ihipLockSiteName(site);
+            if (g_lockSites[i]._name) {
+                char *demangled = abi::__cxa_demangle(g_lockSites[i]._name, nullptr, nullptr, nullptr);
+                name += std::string(" [") + (demangled ? demangled : g_lockSites[i]._name) + "]";
+                free(demangled);
+            }
+            sites.push_back(ihipLockReport(name, g_lockSites[i]._stats));
+        }
+    }
+    const ihipLockStats_t &other = g_lockSites[HIP_LOCK_PROF_SITES - 1]._stats;
+    if (other._acquires.load(std::memory_order_relaxed)) {
+        sites.push_back(ihipLockReport("(other call sites)", other));
+    }
+
+    fprintf(stderr, "HIP lock profile: %zu locks, %zu call sites\n", locks.size(), sites.size());
+    ihipLockPrint("Most contended locks:", locks);
+    ihipLockPrint("Most contended call sites:", sites);
+}
+
+
+//=================================================================================================
+// Called from LockedAccessor and LockedBase:
+//=================================================================================================
+ihipLockProf_t::ihipLockProf_t() :
+    _name(nullptr),
+    _acquireNs(0),
+    _siteStats(nullptr)
+{
+    _stats._acquires = 0;
+    _stats._contended = 0;
+    _stats._waitNs = 0;
+    _stats._maxWaitNs = 0;
+    _stats._holdNs = 0;
+
+    static std::once_flag dumpOnce;
+    std::call_once(dumpOnce, []() { atexit(ihipLockProfDump); });
+
+    ihipLockRegistry_t *registry = ihipLockRegistry();
+    std::lock_guard<std::mutex> l(registry->_mutex);
+    registry->_locks.insert(this);
+}
+
+
+ihipLockProf_t::~ihipLockProf_t()
+{
+    ihipLockRegistry_t *registry = ihipLockRegistry();
+    std::lock_guard<std::mutex> l(registry->_mutex);
+    registry->_locks.erase(this);
+    if (_stats._contended.load(std::memory_order_relaxed)) {
+        registry->_retired.push_back(ihipLockReport(ihipLockName(this) + " (destroyed)", _stats));
+    }
+}
+
+
+uint64_t ihipLockProfNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Find or claim the table entry for a call site.  Sites which do not fit share the last entry.
+static ihipLockStats_t *ihipLockSiteStats(const void *site, const char *name)
+{
+    size_t h = (reinterpret_cast<uintptr_t>(site) >> 2) * 0x9E3779B97F4A7C15ull;
+    for (size_t probe = 0; probe < HIP_LOCK_PROF_SITES - 1; probe++) {
+        ihipLockSite_t &s = g_lockSites[(h + probe) % (HIP_LOCK_PROF_SITES - 1)];
+        const void *cur = s._site.load(std::memory_order_acquire);
+        if (cur == site) {
+            return &s._stats;
+        }
+        if (cur == nullptr) {
+            if (s._site.compare_exchange_strong(cur, site, std::memory_order_acq_rel)) {
+                s._name = name;
+                return &s._stats;
+            } else if (cur == site) {
+                return &s._stats;
+            }
+        }
+    }
+    return &g_lockSites[HIP_LOCK_PROF_SITES - 1]._stats;
+}
+
+
+void ihipLockProfAcquired(ihipLockProf_t *prof, const char *name, const void *site, bool contended, uint64_t waitNs)
+{
+    if (name && !prof->_name) {
+        prof->_name = name;
+    }
+    prof->_siteStats = ihipLockSiteStats(site, name);
+    ihipLockStatsAdd(&prof->_stats, contended, waitNs);
+    ihipLockStatsAdd(prof->_siteStats, contended, waitNs);
+    prof->_acquireNs = ihipLockProfNow();
+}
+
+
+void ihipLockProfReleased(ihipLockProf_t *prof)
+{
+    uint64_t holdNs = ihipLockProfNow() - prof->_acquireNs;
+    prof->_stats._holdNs.fetch_add(holdNs, std::memory_order_relaxed);
+    if (prof->_siteStats) {
+        prof->_siteStats->_holdNs.fetch_add(holdNs, std::memory_order_relaxed);
+    }
+}
+
+#endif
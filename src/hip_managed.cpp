@@ -0,0 +1,280 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file hip_managed.cpp
+ *
+ * Managed memory (hipMallocManaged, hipMemPrefetchAsync, hipMemAdvise, hipMemRangeGetAttribute).
+ *
+ * The devices and the ROCr of this release cannot fault and migrate pages, so managed memory is pinned
+ * system memory from the NUMA pool of the current device (see ihipHostAllocPinned).  It is mapped into
+ * every device when it is allocated, so the host and all devices use the same address and nobody ever takes a
+ * page fault.  Sporadic host and device accesses go straight to system memory instead of migrating pages back
+ * and forth.
+ *
+ * Each allocation is recorded here with its advice.  Advice and prefetch locations apply to the whole
+ * allocation containing the range.  As with CUDA on devices without concurrentManagedAccess they do not move
+ * data: advice is a hint, and a prefetch is a marker in its stream.  hipMemRangeGetAttribute reports them.
+ * hipMemAttachHost (memory which streams attach to later) is rejected.
+ */
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+struct ihipManagedAlloc_t {
+    size_t              _sizeBytes;
+    bool                _readMostly;
+    int                 _preferredLocation;
+    int                 _lastPrefetchLocation;
+    std::vector<int>    _accessedBy;
+};
+
+static std::mutex                               g_managedMutex;
+// Keyed by base pointer, ordered so a range can be found from any pointer inside it.
+static std::map<char*, ihipManagedAlloc_t>      g_managedAllocs;
+
+
+// Returns the allocation containing [ptr, ptr+count), or nullptr.  Caller holds g_managedMutex.
+static ihipManagedAlloc_t *findManaged(const void *ptr, size_t count)
+{
+    const char *p = static_cast<const char*>(ptr);
+    auto it = g_managedAllocs.upper_bound(const_cast<char*>(p));
+    if (it == g_managedAllocs.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (p + count > it->first + it->second._sizeBytes) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+
+static bool isValidLocation(int device)
+{
+    return (device == hipCpuDeviceId) || ((device >= 0) && ((unsigned)device < g_deviceCnt));
+}
+
+
+bool ihipIsManaged(const void *ptr)
+{
+    std::lock_guard<std::mutex> lock(g_managedMutex);
+    return findManaged(ptr, 0) != nullptr;
+}
+
+
+bool ihipFreeManaged(void *ptr)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_managedMutex);
+        auto it = g_managedAllocs.find(static_cast<char*>(ptr));
+        if (it == g_managedAllocs.end()) {
+            return false;
+        }
+        g_managedAllocs.erase(it);
+    }
+
+    ihipHostFreePinned(ptr);
+    tprintf(DB_MEM, "freed managed ptr:%p\n", ptr);
+    return true;
+}
+
+
+hipError_t hipMallocManaged(void** devPtr, size_t size, unsigned int flags)
+{
+    HIP_INIT_API(devPtr, size, flags);
+
+    auto ctx = ihipGetTlsDefaultCtx();
+
+    if ((devPtr == nullptr) || (size == 0) || (ctx == nullptr) ||
+        ((flags != hipMemAttachGlobal) && (flags != hipMemAttachHost))) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    if (flags == hipMemAttachHost) {
+        // Would need per-stream attach (hipStreamAttachMemAsync) to make the memory visible to devices later.
+        return ihipLogStatus(hipErrorNotSupported);
+    }
+
+    auto device = ctx->getWriteableDevice();
+
+    void *p = ihipHostAllocPinned(device, size);
+    if (p == nullptr) {
+        return ihipLogStatus(hipErrorMemoryAllocation);
+    }
+
+    // ihipHostAllocPinned may fall back to an allocation which only the current device can see.
+    std::vector<hsa_agent_t> agents;
+    for (unsigned i=0; i<g_deviceCnt; i++) {
+        agents.push_back(ihipGetDevice(i)->_hsaAgent);
+    }
+    if (hsa_amd_agents_allow_access(agents.size(), agents.data(), NULL, p) != HSA_STATUS_SUCCESS) {
+        ihipHostFreePinned(p);
+        return ihipLogStatus(hipErrorMemoryAllocation);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_managedMutex);
+        ihipManagedAlloc_t &m = g_managedAllocs[static_cast<char*>(p)];
+        m._sizeBytes            = size;
+        m._readMostly           = false;
+        m._preferredLocation    = hipInvalidDeviceId;
+        m._lastPrefetchLocation = hipInvalidDeviceId;
+    }
+
+    tprintf(DB_MEM, "allocated managed ptr:%p size:%zu on dev:%d\n", p, size, device->_deviceId);
+    *devPtr = p;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipMemPrefetchAsync(const void* devPtr, size_t count, int device, hipStream_t stream)
+{
+    HIP_INIT_API(devPtr, count, device, stream);
+
+    if (!isValidLocation(device)) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_managedMutex);
+
+        ihipManagedAlloc_t *m = findManaged(devPtr, count);
+        if ((m == nullptr) || (count == 0)) {
+            return ihipLogStatus(hipErrorInvalidValue);
+        }
+        m->_lastPrefetchLocation = device;
+    }
+
+    stream = ihipSyncAndResolveStream(stream);
+
+    // Already resident and mapped everywhere, so there is no data to move - just order the prefetch in the stream.
+    {
+        LockedAccessor_StreamCrit_t crit(stream->_criticalData);
+        crit->_av.create_marker();
+    }
+    tprintf(DB_MEM, "prefetch managed ptr:%p size:%zu to %d on stream:%p\n", devPtr, count, device, stream);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipMemAdvise(const void* devPtr, size_t count, hipMemoryAdvise advice, int device)
+{
+    HIP_INIT_API(devPtr, count, advice, device);
+
+    bool needsDevice = (advice != hipMemAdviseSetReadMostly) && (advice != hipMemAdviseUnsetReadMostly);
+    if (needsDevice && !isValidLocation(device)) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+
+    std::lock_guard<std::mutex> lock(g_managedMutex);
+
+    ihipManagedAlloc_t *m = findManaged(devPtr, count);
+    if ((m == nullptr) || (count == 0)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    auto accessor = std::find(m->_accessedBy.begin(), m->_accessedBy.end(), device);
+
+    switch (advice) {
+    case hipMemAdviseSetReadMostly:
+        m->_readMostly = true;
+        break;
+    case hipMemAdviseUnsetReadMostly:
+        m->_readMostly = false;
+        break;
+    case hipMemAdviseSetPreferredLocation:
+        m->_preferredLocation = device;
+        break;
+    case hipMemAdviseUnsetPreferredLocation:
+        m->_preferredLocation = hipInvalidDeviceId;
+        break;
+    case hipMemAdviseSetAccessedBy:
+        if (accessor == m->_accessedBy.end()) {
+            m->_accessedBy.push_back(device);
+        }
+        break;
+    case hipMemAdviseUnsetAccessedBy:
+        if (accessor != m->_accessedBy.end()) {
+            m->_accessedBy.erase(accessor);
+        }
+        break;
+    default:
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipMemRangeGetAttribute(void* data, size_t dataSize, hipMemRangeAttribute attribute, const void* devPtr, size_t count)
+{
+    HIP_INIT_API(data, dataSize, attribute, devPtr, count);
+
+    if ((data == nullptr) || (dataSize == 0) || (dataSize % sizeof(int))) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    if ((attribute != hipMemRangeAttributeAccessedBy) && (dataSize != sizeof(int))) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    std::lock_guard<std::mutex> lock(g_managedMutex);
+
+    ihipManagedAlloc_t *m = findManaged(devPtr, count);
+    if ((m == nullptr) || (count == 0)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    int *out = static_cast<int*>(data);
+    switch (attribute) {
+    case hipMemRangeAttributeReadMostly:
+        *out = m->_readMostly ? 1 : 0;
+        break;
+    case hipMemRangeAttributePreferredLocation:
+        *out = m->_preferredLocation;
+        break;
+    case hipMemRangeAttributeLastPrefetchLocation:
+        *out = m->_lastPrefetchLocation;
+        break;
+    case hipMemRangeAttributeAccessedBy:
+        for (size_t i=0; i<dataSize/sizeof(int); i++) {
+            out[i] = (i < m->_accessedBy.size()) ? m->_accessedBy[i] : hipInvalidDeviceId;
+        }
+        break;
+    default:
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    return ihipLogStatus(hipSuccess);
+}
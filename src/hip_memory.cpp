@@ -20,6 +20,11 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include <hc_am.hpp>
 #include "hsa/hsa.h"
 #include "hsa/hsa_ext_amd.h"
@@ -49,7 +54,7 @@ hipError_t hipPointerGetAttributes(hipPointerAttribute_t *attributes, void* ptr)
         attributes->memoryType    = amPointerInfo._isInDeviceMem ? hipMemoryTypeDevice: hipMemoryTypeHost;
         attributes->hostPointer   = amPointerInfo._hostPointer;
         attributes->devicePointer = amPointerInfo._devicePointer;
-        attributes->isManaged     = 0;
+        attributes->isManaged     = ihipIsManaged(ptr);
         if(attributes->memoryType == hipMemoryTypeHost){
             attributes->hostPointer = ptr;
         }
@@ -126,28 +131,18 @@ hipError_t hipMalloc(void** ptr, size_t sizeBytes)
             hip_status = hipErrorMemoryAllocation;
         } else {
             hc::am_memtracker_update(*ptr, device->_deviceId, 0);
-            int peerCnt=0;
-            {
-                LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-                // the peerCnt always stores self so make sure the trace actually
-                peerCnt = crit->peerCnt();
-                tprintf(DB_MEM, " allocated device_mem ptr:%p size:%zu on dev:%d and allowed %d other peer(s) access\n",
-                        *ptr, sizeBytes, device->_deviceId, peerCnt-1);
-                if (peerCnt > 1) {
-
-                    //printf ("peer self access\n");
-
-                    // TODOD - remove me:
-                    for (auto iter = crit->_peers.begin(); iter!=crit->_peers.end(); iter++) {
-                        tprintf (DB_MEM, "   allow access to peer: %s%s\n", (*iter)->toString().c_str(), (iter == crit->_peers.begin()) ? " (self)":"");
-                    };
-
-                    hsa_status_t e = hsa_amd_agents_allow_access(crit->peerCnt(), crit->peerAgents(), NULL, *ptr);
-                    if (e != HSA_STATUS_SUCCESS) {
-                        hip_status = hipErrorMemoryAllocation;
-                    }
+            // Lock-free read of the peer set.  The peerCnt always stores self so make sure the trace actually
+            // reports other peers:
+            ihipPeerSnapshotPtr_t peers = ctx->peerSnapshot();
+            tprintf(DB_MEM, " allocated device_mem ptr:%p size:%zu on dev:%d and allowed %d other peer(s) access\n",
+                    *ptr, sizeBytes, device->_deviceId, peers->peerCnt()-1);
+            if (peers->peerCnt() > 1) {
+                hsa_status_t e = hsa_amd_agents_allow_access(peers->peerCnt(), peers->peerAgents(), NULL, *ptr);
+                if (e != HSA_STATUS_SUCCESS) {
+                    hip_status = hipErrorMemoryAllocation;
                 }
             }
+            device->_peerMapper->add(*ptr, sizeBytes, peers->_generation);
         }
     } else {
         hip_status = hipErrorMemoryAllocation;
@@ -177,7 +172,7 @@ hipError_t hipHostMalloc(void** ptr, size_t sizeBytes, unsigned int flags)
             trueFlags = hipHostMallocMapped | hipHostMallocWriteCombined;
         }
 
-        const unsigned supportedFlags = hipHostMallocPortable | hipHostMallocMapped | hipHostMallocWriteCombined;
+        const unsigned supportedFlags = hipHostMallocPortable | hipHostMallocMapped | hipHostMallocWriteCombined | hipHostMallocHugePages;
 
         if (flags & ~supportedFlags) {
             hip_status = hipErrorInvalidValue;
@@ -197,21 +192,26 @@ hipError_t hipHostMalloc(void** ptr, size_t sizeBytes, unsigned int flags)
             else{
                 // TODO - am_alloc requires writeable __acc, perhaps could be refactored?
                 // TODO - hipHostMallocMapped is be ignored on ROCM - all memory is mapped to host address space as WC.
-                *ptr = hc::am_alloc(sizeBytes, device->_acc, amHostPinned);
+                bool usedHugePages = false;
+                *ptr = ihipHostAllocPinned(device, sizeBytes, (flags & hipHostMallocHugePages) || HIP_HOST_HUGE_PAGES, &usedHugePages);
                 if (*ptr == NULL) {
                     hip_status = hipErrorMemoryAllocation;
                 } else {
+                    // Report hipHostMallocHugePages only if the request was honored:
+                    if (!usedHugePages && (flags & hipHostMallocHugePages)) {
+                        flags &= ~hipHostMallocHugePages;
+                        if (flags == 0) {
+                            flags = hipHostMallocMapped | hipHostMallocWriteCombined;  // as for hipHostMallocDefault.
+                        }
+                    }
                     hc::am_memtracker_update(*ptr, device->_deviceId, flags);
                     // TODO-hipHostMallocPortable should map the host memory into all contexts, regardless of peer status.
-                    int peerCnt=0;
-                    {
-                        LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-                        peerCnt = crit->peerCnt();
-                        if (peerCnt > 1) {
-                            hsa_amd_agents_allow_access(crit->peerCnt(), crit->peerAgents(), NULL, *ptr);
-                        }
+                    ihipPeerSnapshotPtr_t peers = ctx->peerSnapshot();
+                    if (peers->peerCnt() > 1) {
+                        hsa_amd_agents_allow_access(peers->peerCnt(), peers->peerAgents(), NULL, *ptr);
                     }
-                    tprintf(DB_MEM, "allocated pinned_host ptr:%p size:%zu on dev:%d and allow access to %d other peer(s)\n", *ptr, sizeBytes, device->_deviceId, peerCnt-1);
+                    device->_peerMapper->add(*ptr, sizeBytes, peers->_generation);
+                    tprintf(DB_MEM, "allocated pinned_host ptr:%p size:%zu on dev:%d and allow access to %d other peer(s)\n", *ptr, sizeBytes, device->_deviceId, peers->peerCnt()-1);
                 }
             }
         }
@@ -256,15 +256,14 @@ hipError_t hipMallocPitch(void** ptr, size_t* pitch, size_t width, size_t height
             hip_status = hipErrorMemoryAllocation;
         } else {
             hc::am_memtracker_update(*ptr, device->_deviceId, 0);
-            {
-                LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-                if (crit->peerCnt() > 1) { // peerCnt includes self so only call allow_access if other peers involved:
-                    hsa_status_t hsa_status = hsa_amd_agents_allow_access(crit->peerCnt(), crit->peerAgents(), NULL, *ptr);
-                    if (hsa_status != HSA_STATUS_SUCCESS) {
-                        hip_status = hipErrorMemoryAllocation;
-                    }
+            ihipPeerSnapshotPtr_t peers = ctx->peerSnapshot();
+            if (peers->peerCnt() > 1) { // peerCnt includes self so only call allow_access if other peers involved:
+                hsa_status_t hsa_status = hsa_amd_agents_allow_access(peers->peerCnt(), peers->peerAgents(), NULL, *ptr);
+                if (hsa_status != HSA_STATUS_SUCCESS) {
+                    hip_status = hipErrorMemoryAllocation;
                 }
             }
+            device->_peerMapper->add(*ptr, sizeBytes, peers->_generation);
         }
     } else {
         hip_status = hipErrorMemoryAllocation;
@@ -281,65 +280,144 @@ hipChannelFormatDesc hipCreateChannelDesc(int x, int y, int z, int w, hipChannel
     return cd;
 }
 
-hipError_t hipMallocArray(hipArray** array, const hipChannelFormatDesc* desc,
-        size_t width, size_t height, unsigned int flags)
+// Bytes per array element: the sum of the channel sizes, or the size of the kind for descriptors without sizes.
+static unsigned ihipArrayElementSize(const hipChannelFormatDesc *desc)
 {
-    HIP_INIT_API(array, desc, width, height, flags);
+    const int bits = desc->x + desc->y + desc->z + desc->w;
+    if (bits > 0) {
+        return bits / 8;
+    }
+    switch(desc->f) {
+        case hipChannelFormatKindSigned:
+            return sizeof(int);
+        case hipChannelFormatKindUnsigned:
+            return sizeof(unsigned int);
+        case hipChannelFormatKindFloat:
+            return sizeof(float);
+        case hipChannelFormatKindNone:
+            return sizeof(size_t);
+        default:
+            return 0;
+    }
+}
+
 
+// Bytes allocated for the array, including the padding of partial tiles and bricks.
+static size_t ihipArraySizeBytes(const hipArray *array)
+{
+    size_t slices = array->depth ? array->depth : 1;
+    if (array->layout == hipArrayLayoutBrick) {
+        slices = (slices + HIP_ARRAY_BRICK_DIM - 1) / HIP_ARRAY_BRICK_DIM * HIP_ARRAY_BRICK_DIM;
+    }
+    return __hipArraySliceElements(array->layout, array->stride, array->height) * slices * array->elementSize;
+}
+
+
+static hipError_t ihipMallocArray(hipArray** array, const hipChannelFormatDesc* desc,
+        size_t width, size_t height, size_t depth, unsigned int flags)
+{
     hipError_t  hip_status = hipSuccess;
 
+    if ((array == nullptr) || (desc == nullptr) || (ihipArrayElementSize(desc) == 0) ||
+        (flags & ~(hipArrayLayered | hipArrayTiled | hipArrayMorton)) ||
+        ((flags & (hipArrayTiled | hipArrayMorton)) == (hipArrayTiled | hipArrayMorton)) ||
+        ((flags & hipArrayLayered) && (depth == 0))) {
+        return hipErrorInvalidValue;
+    }
+
     auto ctx = ihipGetTlsDefaultCtx();
 
     *array = (hipArray*)malloc(sizeof(hipArray));
     array[0]->width = width;
     array[0]->height = height;
+    array[0]->depth = depth;
 
     array[0]->f = desc->f;
+    array[0]->desc = *desc;
+    array[0]->flags = flags;
+    array[0]->elementSize = ihipArrayElementSize(desc);
+    if (depth && !(flags & hipArrayLayered)) {
+        array[0]->layout = hipArrayLayoutBrick;
+        array[0]->stride = (width + HIP_ARRAY_BRICK_DIM - 1) / HIP_ARRAY_BRICK_DIM * HIP_ARRAY_BRICK_DIM;
+    } else if (flags & hipArrayTiled) {
+        array[0]->layout = hipArrayLayoutTiled;
+        array[0]->stride = (width + HIP_ARRAY_TILE_DIM - 1) / HIP_ARRAY_TILE_DIM * HIP_ARRAY_TILE_DIM;
+    } else if (flags & hipArrayMorton) {
+        array[0]->layout = hipArrayLayoutMorton;
+        array[0]->stride = (width + HIP_ARRAY_MORTON_DIM - 1) / HIP_ARRAY_MORTON_DIM * HIP_ARRAY_MORTON_DIM;
+    } else {
+        array[0]->layout = hipArrayLayoutLinear;
+        array[0]->stride = width;
+    }
 
     void ** ptr = &array[0]->data;
 
     if (ctx) {
         auto device = ctx->getWriteableDevice();
         const unsigned am_flags = 0;
-        const size_t size = width*height;
-
-        switch(desc->f) {
-            case hipChannelFormatKindSigned:
-                *ptr = hc::am_alloc(size*sizeof(int), device->_acc, am_flags);
-                break;
-            case hipChannelFormatKindUnsigned:
-                *ptr = hc::am_alloc(size*sizeof(unsigned int), device->_acc, am_flags);
-                break;
-            case hipChannelFormatKindFloat:
-                *ptr = hc::am_alloc(size*sizeof(float), device->_acc, am_flags);
-                break;
-            case hipChannelFormatKindNone:
-                *ptr = hc::am_alloc(size*sizeof(size_t), device->_acc, am_flags);
-                break;
-            default:
-                hip_status = hipErrorUnknown;
-                break;
-        }
-        if (size && (*ptr == NULL)) {
+        const size_t sizeBytes = ihipArraySizeBytes(array[0]);
+
+        *ptr = hc::am_alloc(sizeBytes, device->_acc, am_flags);
+        if (sizeBytes && (*ptr == NULL)) {
             hip_status = hipErrorMemoryAllocation;
         } else {
             hc::am_memtracker_update(*ptr, device->_deviceId, 0);
-            {
-                LockedAccessor_CtxCrit_t crit(ctx->criticalData());
-                if (crit->peerCnt() > 1) { // peerCnt includes self so only call allow_access if other peers involved:
-                    hsa_status_t hsa_status = hsa_amd_agents_allow_access(crit->peerCnt(), crit->peerAgents(), NULL, *ptr);
-                    if (hsa_status != HSA_STATUS_SUCCESS) {
-                        hip_status = hipErrorMemoryAllocation;
-                    }
+            ihipPeerSnapshotPtr_t peers = ctx->peerSnapshot();
+            if (peers->peerCnt() > 1) { // peerCnt includes self so only call allow_access if other peers involved:
+                hsa_status_t hsa_status = hsa_amd_agents_allow_access(peers->peerCnt(), peers->peerAgents(), NULL, *ptr);
+                if (hsa_status != HSA_STATUS_SUCCESS) {
+                    hip_status = hipErrorMemoryAllocation;
                 }
             }
+            device->_peerMapper->add(*ptr, sizeBytes, peers->_generation);
         }
 
     } else {
         hip_status = hipErrorMemoryAllocation;
     }
 
-    return ihipLogStatus(hip_status);
+    return hip_status;
+}
+
+
+hipError_t hipMallocArray(hipArray** array, const hipChannelFormatDesc* desc,
+        size_t width, size_t height, unsigned int flags)
+{
+    HIP_INIT_API(array, desc, width, height, flags);
+
+    if (flags & hipArrayLayered) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    return ihipLogStatus(ihipMallocArray(array, desc, width, height, 0, flags));
+}
+
+
+hipError_t hipMalloc3DArray(hipArray** array, const hipChannelFormatDesc* desc, hipExtent extent, unsigned int flags)
+{
+    HIP_INIT_API(array, desc, extent.width, extent.height, extent.depth, flags);
+
+    return ihipLogStatus(ihipMallocArray(array, desc, extent.width, extent.height, extent.depth, flags));
+}
+
+
+hipError_t hipMalloc3D(hipPitchedPtr* pitchedDevPtr, hipExtent extent)
+{
+    HIP_INIT_API(pitchedDevPtr, extent.width, extent.height, extent.depth);
+
+    if ((pitchedDevPtr == nullptr) || (extent.depth == 0)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    size_t pitch = 0;
+    hipError_t e = hipMallocPitch(&pitchedDevPtr->ptr, &pitch, extent.width, extent.height * extent.depth);
+    if (e == hipSuccess) {
+        pitchedDevPtr->pitch = pitch;
+        pitchedDevPtr->xsize = extent.width;
+        pitchedDevPtr->ysize = extent.height;
+    }
+
+    return ihipLogStatus(e);
 }
 
 hipError_t hipHostGetFlags(unsigned int* flagsPtr, void* hostPtr)
@@ -381,6 +459,11 @@ hipError_t hipHostRegister(void *hostPtr, size_t sizeBytes, unsigned int flags)
     hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
     am_status_t am_status = hc::am_memtracker_getinfo(&amPointerInfo, hostPtr);
 
+    // Ranges pinned behind the app's back by the pin cache are handed back and registered as requested:
+    if ((am_status == AM_SUCCESS) && g_pinCache.enabled() && g_pinCache.remove(hostPtr)) {
+        am_status = hc::am_memtracker_getinfo(&amPointerInfo, hostPtr);
+    }
+
     if(am_status == AM_SUCCESS){
         hip_status = hipErrorHostMemoryAlreadyRegistered;
     } else {
@@ -418,7 +501,10 @@ hipError_t hipHostUnregister(void *hostPtr)
     hipError_t hip_status = hipSuccess;
     if(hostPtr == NULL){
         hip_status = hipErrorInvalidValue;
-    }else{
+    } else if (g_pinCache.enabled() && g_pinCache.remove(hostPtr)) {
+        // Dropped a range the pin cache had pinned - lets apps release cached pins before freeing the buffer.
+        tprintf(DB_MEM, " %s released pin cache range containing ptr=%p\n", __func__, hostPtr);
+    } else {
         auto device = ctx->getWriteableDevice();
         am_status_t am_status = hc::am_memory_host_unlock(device->_acc, hostPtr);
         tprintf(DB_MEM, " %s unregistered ptr=%p\n", __func__, hostPtr);
@@ -429,71 +515,142 @@ hipError_t hipHostUnregister(void *hostPtr)
     return ihipLogStatus(hip_status);
 }
 
-hipError_t hipMemcpyToSymbol(const char* symbolName, const void *src, size_t count, size_t offset, hipMemcpyKind kind)
+// Resolve symbolName on the current device and check [offset, offset+count) lies inside it.  Without the loader
+// extension the symbol size is unknown (0), and only a range which wraps the address space can be rejected.
+static hipError_t ihipResolveSymbol(const char *symbolName, size_t count, size_t offset, char **ptr)
 {
-    HIP_INIT_API(symbolName, src, count, offset, kind);
+    auto ctx = ihipGetTlsDefaultCtx();
 
-    if(symbolName == nullptr)
-    {
-        return ihipLogStatus(hipErrorInvalidSymbol);
+    ihipSymbol_t symbol;
+    if ((symbolName == nullptr) || (ctx == nullptr) || !ctx->getDevice()->_symbolCache->lookup(symbolName, &symbol)) {
+        return hipErrorInvalidSymbol;
     }
 
-    auto ctx = ihipGetTlsDefaultCtx();
+    const size_t size = symbol._sizeBytes ? symbol._sizeBytes : SIZE_MAX - reinterpret_cast<uintptr_t>(symbol._address);
+    if ((offset > size) || (count > size - offset)) {
+        return hipErrorInvalidValue;
+    }
 
-    hc::accelerator acc = ctx->getDevice()->_acc;
+    *ptr = static_cast<char*>(symbol._address) + offset;
+    return hipSuccess;
+}
 
-    void *ptr = acc.get_symbol_address(symbolName);
-    tprintf(DB_MEM, " symbol '%s' resolved to address:%p\n", symbolName, ptr);
 
-    if(ptr == nullptr)
-    {
-        return ihipLogStatus(hipErrorInvalidSymbol);
-    }
+hipError_t hipGetSymbolAddress(void** devPtr, const char* symbolName)
+{
+    HIP_INIT_API(devPtr, symbolName);
 
-    hipStream_t stream = ihipSyncAndResolveStream(hipStreamNull);
+    if (devPtr == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
 
-    stream->locked_copySync(ptr, src, count + offset, kind);
+    char *ptr;
+    hipError_t e = ihipResolveSymbol(symbolName, 0, 0, &ptr);
+    if (e == hipSuccess) {
+        *devPtr = ptr;
+    }
 
-    return ihipLogStatus(hipSuccess);
+    return ihipLogStatus(e);
 }
 
-hipError_t hipMemcpyToSymbolAsync(const char* symbolName, const void *src, size_t count, size_t offset, hipMemcpyKind kind, hipStream_t stream)
+
+hipError_t hipGetSymbolSize(size_t* size, const char* symbolName)
 {
-    HIP_INIT_API(symbolName, src, count, offset, kind, stream);
+    HIP_INIT_API(size, symbolName);
 
-    if(symbolName == nullptr)
-    {
+    auto ctx = ihipGetTlsDefaultCtx();
+
+    ihipSymbol_t symbol;
+    if (size == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    } else if ((symbolName == nullptr) || (ctx == nullptr) || !ctx->getDevice()->_symbolCache->lookup(symbolName, &symbol)) {
         return ihipLogStatus(hipErrorInvalidSymbol);
+    } else if (symbol._sizeBytes == 0) {
+        return ihipLogStatus(hipErrorNotSupported);
     }
 
-    hipError_t e = hipSuccess;
+    *size = symbol._sizeBytes;
+    return ihipLogStatus(hipSuccess);
+}
 
-    auto ctx = ihipGetTlsDefaultCtx();
 
-    hc::accelerator acc = ctx->getDevice()->_acc;
+hipError_t hipMemcpyToSymbol(const char* symbolName, const void *src, size_t count, size_t offset, hipMemcpyKind kind)
+{
+    HIP_INIT_API(symbolName, src, count, offset, kind);
 
-    void *ptr = acc.get_symbol_address(symbolName);
-    tprintf(DB_MEM, " symbol '%s' resolved to address:%p\n", symbolName, ptr);
+    char *ptr;
+    hipError_t e = ihipResolveSymbol(symbolName, count, offset, &ptr);
+    if (e == hipSuccess) {
+        hipStream_t stream = ihipSyncAndResolveStream(hipStreamNull);
+        try {
+            stream->locked_copySync(ptr, src, count, kind);
+        }
+        catch (ihipException ex) {
+            e = ex._code;
+        }
+    }
 
-    if(ptr == nullptr)
-    {
-        return ihipLogStatus(hipErrorInvalidSymbol);
+    return ihipLogStatus(e);
+}
+
+
+hipError_t hipMemcpyToSymbolAsync(const char* symbolName, const void *src, size_t count, size_t offset, hipMemcpyKind kind, hipStream_t stream)
+{
+    HIP_INIT_API(symbolName, src, count, offset, kind, stream);
+
+    char *ptr;
+    hipError_t e = ihipResolveSymbol(symbolName, count, offset, &ptr);
+    if (e == hipSuccess) {
+        stream = ihipSyncAndResolveStream(stream);
+        try {
+            stream->locked_copyAsync(ptr, src, count, kind);
+        }
+        catch (ihipException ex) {
+            e = ex._code;
+        }
     }
 
-    if (stream) {
+    return ihipLogStatus(e);
+}
+
+
+hipError_t hipMemcpyFromSymbol(void *dst, const char* symbolName, size_t count, size_t offset, hipMemcpyKind kind)
+{
+    HIP_INIT_API(dst, symbolName, count, offset, kind);
+
+    char *ptr;
+    hipError_t e = ihipResolveSymbol(symbolName, count, offset, &ptr);
+    if (e == hipSuccess) {
+        hipStream_t stream = ihipSyncAndResolveStream(hipStreamNull);
         try {
-            stream->locked_copyAsync(ptr, src, count + offset, kind);
+            stream->locked_copySync(dst, ptr, count, kind);
         }
         catch (ihipException ex) {
             e = ex._code;
         }
-    } else {
-        e = hipErrorInvalidValue;
     }
 
     return ihipLogStatus(e);
+}
+
+
+hipError_t hipMemcpyFromSymbolAsync(void *dst, const char* symbolName, size_t count, size_t offset, hipMemcpyKind kind, hipStream_t stream)
+{
+    HIP_INIT_API(dst, symbolName, count, offset, kind, stream);
 
+    char *ptr;
+    hipError_t e = ihipResolveSymbol(symbolName, count, offset, &ptr);
+    if (e == hipSuccess) {
+        stream = ihipSyncAndResolveStream(stream);
+        try {
+            stream->locked_copyAsync(dst, ptr, count, kind);
+        }
+        catch (ihipException ex) {
+            e = ex._code;
+        }
+    }
 
+    return ihipLogStatus(e);
 }
 
 //---
@@ -629,6 +786,33 @@ hipError_t memcpyAsync (void* dst, const void* src, size_t sizeBytes, hipMemcpyK
 
     return e;
 }
+
+
+hipError_t memcpyBatchAsync (std::vector<ihipCopyRange_t> &ranges, hipMemcpyKind kind, hipStream_t stream)
+{
+    hipError_t e = hipSuccess;
+
+    stream = ihipSyncAndResolveStream(stream);
+
+    for (auto &r : ranges) {
+        if ((r._sizeBytes != 0) && ((r._dst == NULL) || (r._src == NULL))) {
+            return hipErrorInvalidValue;
+        }
+    }
+
+    if (stream) {
+        try {
+            stream->locked_copyBatchAsync(ranges, kind);
+        }
+        catch (ihipException ex) {
+            e = ex._code;
+        }
+    } else {
+        e = hipErrorInvalidValue;
+    }
+
+    return e;
+}
 } // end namespace hip_internal
 
 
@@ -662,6 +846,98 @@ hipError_t hipMemcpyDtoHAsync(void* dst, hipDeviceptr_t src, size_t sizeBytes, h
     return ihipLogStatus(hip_internal::memcpyAsync(dst, src, sizeBytes, hipMemcpyDeviceToHost, stream));
 }
 
+
+hipError_t hipMemcpyBatchAsync(void* const* dsts, const void* const* srcs, const size_t* sizes, size_t count,
+                               hipMemcpyKind kind, hipStream_t stream)
+{
+    HIP_INIT_API(dsts, srcs, sizes, count, kind, stream);
+
+    if ((count != 0) && ((dsts == NULL) || (srcs == NULL) || (sizes == NULL))) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    std::vector<ihipCopyRange_t> ranges(count);
+    for (size_t i=0; i<count; i++) {
+        ranges[i] = ihipCopyRange_t{dsts[i], srcs[i], sizes[i]};
+    }
+
+    return ihipLogStatus(hip_internal::memcpyBatchAsync(ranges, kind, stream));
+}
+
+
+hipError_t hipMemcpyGatherScatterAsync(void* dst, const size_t* dstIndices, const void* src, const size_t* srcIndices,
+                                       size_t elementSize, size_t count, hipMemcpyKind kind, hipStream_t stream)
+{
+    HIP_INIT_API(dst, dstIndices, src, srcIndices, elementSize, count, kind, stream);
+
+    if ((dst == NULL) || (src == NULL)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    // Largest index whose element still ends inside the address space:
+    const size_t maxIndex = elementSize ? (SIZE_MAX - elementSize) / elementSize : SIZE_MAX;
+
+    std::vector<ihipCopyRange_t> ranges(count);
+    for (size_t i=0; i<count; i++) {
+        size_t d = dstIndices ? dstIndices[i] : i;
+        size_t s = srcIndices ? srcIndices[i] : i;
+        if ((d > maxIndex) || (s > maxIndex) ||
+            (d*elementSize > UINTPTR_MAX - reinterpret_cast<uintptr_t>(dst) - elementSize) ||
+            (s*elementSize > UINTPTR_MAX - reinterpret_cast<uintptr_t>(src) - elementSize)) {
+            return ihipLogStatus(hipErrorInvalidValue);
+        }
+        ranges[i] = ihipCopyRange_t{static_cast<char*>(dst) + d*elementSize, static_cast<const char*>(src) + s*elementSize, elementSize};
+    }
+
+    return ihipLogStatus(hip_internal::memcpyBatchAsync(ranges, kind, stream));
+}
+
+
+hipError_t hipMemcpyFromFileAsync(void* dst, int fd, int64_t offset, size_t sizeBytes, hipStream_t stream)
+{
+    HIP_INIT_API(dst, fd, offset, sizeBytes, stream);
+
+    hipError_t e = hipSuccess;
+
+    stream = ihipSyncAndResolveStream(stream);
+
+    if ((dst == NULL) || (fd < 0) || (offset < 0) || (stream == NULL)) {
+        e = hipErrorInvalidValue;
+    } else if (sizeBytes) {
+        try {
+            stream->locked_copyFromFileAsync(dst, fd, offset, sizeBytes);
+        }
+        catch (ihipException ex) {
+            e = ex._code;
+        }
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+hipError_t hipMemcpyToFileAsync(int fd, int64_t offset, const void* src, size_t sizeBytes, hipStream_t stream)
+{
+    HIP_INIT_API(fd, offset, src, sizeBytes, stream);
+
+    hipError_t e = hipSuccess;
+
+    stream = ihipSyncAndResolveStream(stream);
+
+    if ((src == NULL) || (fd < 0) || (offset < 0) || (stream == NULL)) {
+        e = hipErrorInvalidValue;
+    } else if (sizeBytes) {
+        try {
+            stream->locked_copyToFileAsync(fd, offset, src, sizeBytes);
+        }
+        catch (ihipException ex) {
+            e = ex._code;
+        }
+    }
+
+    return ihipLogStatus(e);
+}
+
 // TODO - review and optimize
 hipError_t hipMemcpy2D(void* dst, size_t dpitch, const void* src, size_t spitch,
         size_t width, size_t height, hipMemcpyKind kind) {
@@ -689,6 +965,393 @@ hipError_t hipMemcpy2D(void* dst, size_t dpitch, const void* src, size_t spitch,
     return ihipLogStatus(e);
 }
 
+//---
+// 3D copies between arrays and pitched memory.
+
+// One side of a 3D copy: an array, or pitched memory.  The box origin is in elements for arrays and in bytes
+// for pitched memory.
+struct ihipCopy3DSide_t {
+    char*           _base;
+    bool            _isArray;
+    hipArrayLayout  _layout;
+    unsigned        _stride;
+    unsigned        _height;
+    size_t          _pitch;
+    size_t          _slicePitch;
+    size_t          _x, _y, _z;
+};
+
+
+// Byte offset of element (x,y,z) of the box, with es bytes per element.
+__host__ __device__ static inline size_t ihipCopy3DOffset(const ihipCopy3DSide_t &s, size_t x, size_t y, size_t z, size_t es)
+{
+    if (s._isArray) {
+        return __hipArrayOffset3D(s._layout, s._stride, s._height, s._x + x, s._y + y, s._z + z) * es;
+    }
+    return (s._z + z) * s._slicePitch + (s._y + y) * s._pitch + s._x + x * es;
+}
+
+
+static ihipCopy3DSide_t ihipArraySide(const hipArray *a, const hipPos &pos)
+{
+    ihipCopy3DSide_t s = {};
+    s._base = static_cast<char*>(a->data);
+    s._isArray = true;
+    s._layout = a->layout;
+    s._stride = a->stride;
+    s._height = a->height;
+    s._x = pos.x; s._y = pos.y; s._z = pos.z;
+    return s;
+}
+
+
+static ihipCopy3DSide_t ihipPitchedSide(void *ptr, size_t pitch, size_t slicePitch, const hipPos &pos)
+{
+    ihipCopy3DSide_t s = {};
+    s._base = static_cast<char*>(ptr);
+    s._layout = hipArrayLayoutLinear;
+    s._pitch = pitch;
+    s._slicePitch = slicePitch;
+    s._x = pos.x; s._y = pos.y; s._z = pos.z;
+    return s;
+}
+
+
+// Elements which are contiguous in memory starting at box column x, up to w - x.
+static size_t ihipCopy3DRun(const ihipCopy3DSide_t &s, size_t x, size_t w)
+{
+    if (!s._isArray || (s._layout == hipArrayLayoutLinear)) {
+        return w - x;
+    }
+    if (s._layout == hipArrayLayoutTiled) {
+        return std::min<size_t>(w - x, HIP_ARRAY_TILE_DIM - (s._x + x) % HIP_ARRAY_TILE_DIM);
+    }
+    return 1;
+}
+
+
+// Copies the box on the host; both sides must be host memory.  Each row is copied in runs which are contiguous on
+// both sides - whole rows for pitched memory and row-major arrays.
+static void ihipCopy3DHost(const ihipCopy3DSide_t &dst, const ihipCopy3DSide_t &src, size_t w, size_t h, size_t d, size_t es)
+{
+    for (size_t z = 0; z < d; z++) {
+        for (size_t y = 0; y < h; y++) {
+            for (size_t x = 0; x < w; ) {
+                const size_t run = std::min(ihipCopy3DRun(dst, x, w), ihipCopy3DRun(src, x, w));
+                memcpy(dst._base + ihipCopy3DOffset(dst, x, y, z, es), src._base + ihipCopy3DOffset(src, x, y, z, es), run * es);
+                x += run;
+            }
+        }
+    }
+}
+
+
+// Copies the box with one kernel; both sides must be device memory.  Waits for the kernel to finish, after
+// releasing the stream.
+static void ihipCopy3DKernel(hipStream_t stream, const ihipCopy3DSide_t &dst, const ihipCopy3DSide_t &src,
+                             size_t w, size_t h, size_t d, size_t es)
+{
+    const size_t n = w * h * d;
+    const int threads_per_wg = 256;
+    const size_t wg = std::min<size_t>((n + threads_per_wg - 1) / threads_per_wg, 8 * stream->getDevice()->_computeUnits);
+
+    hc::extent<1> ext(wg * threads_per_wg);
+    auto ext_tile = ext.tile(threads_per_wg);
+
+    auto crit = stream->lockopen_preKernelCommand();
+
+    hc::completion_future cf;
+    bool ok = true;
+    try {
+        cf =
+        hc::parallel_for_each(
+                crit->_av,
+                ext_tile,
+                [=] (hc::tiled_index<1> idx)
+                __attribute__((hc))
+        {
+            const size_t stride = amp_get_local_size(0) * hc_get_num_groups(0);
+
+            for (size_t i = amp_get_global_id(0); i < n; i += stride) {
+                const size_t x = i % w;
+                const size_t y = (i / w) % h;
+                const size_t z = i / (w * h);
+                const char *s = src._base + ihipCopy3DOffset(src, x, y, z, es);
+                char *t = dst._base + ihipCopy3DOffset(dst, x, y, z, es);
+                switch (es) {
+                    case 1: *t = *s; break;
+                    case 2: *(uint16_t*)t = *(const uint16_t*)s; break;
+                    case 4: *(uint32_t*)t = *(const uint32_t*)s; break;
+                    case 8: *(uint64_t*)t = *(const uint64_t*)s; break;
+                    default:
+                        for (size_t b = 0; b < es; b++) {
+                            t[b] = s[b];
+                        }
+                }
+            }
+        });
+    }
+    catch (std::exception &ex) {
+        ok = false;
+    }
+
+    stream->lockclose_postKernelCommand("hipMemcpy3D", &crit->_av);
+
+    if (!ok) {
+        throw ihipException(hipErrorInvalidValue);
+    }
+    cf.wait();
+}
+
+
+static bool ihipIsDeviceMemory(const void *ptr)
+{
+    hc::accelerator acc;
+    hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
+    return (hc::am_memtracker_getinfo(&amPointerInfo, ptr) == AM_SUCCESS) && amPointerInfo._isInDeviceMem;
+}
+
+
+// True if the box covers all of the array.
+static bool ihipCoversArray(const hipArray *a, const hipPos &pos, size_t w, size_t h, size_t d)
+{
+    return (pos.x == 0) && (pos.y == 0) && (pos.z == 0) && (w == a->width) &&
+           (h == (a->height ? a->height : 1)) && (d == (a->depth ? a->depth : 1));
+}
+
+
+// True if the box is one contiguous run of pitched memory.
+static bool ihipIsContiguous(const ihipCopy3DSide_t &s, size_t w, size_t h, size_t d, size_t es)
+{
+    return ((h == 1) && (d == 1)) || ((w * es == s._pitch) && ((d == 1) || (h * s._pitch == s._slicePitch)));
+}
+
+
+// Pitched memory, or a row-major array viewed as pitched memory.  Returns false for the other array layouts.
+static bool ihipAsPitched(const ihipCopy3DSide_t &s, size_t es, ihipCopy3DSide_t *pitched)
+{
+    if (!s._isArray) {
+        *pitched = s;
+        return true;
+    }
+    if (s._layout != hipArrayLayoutLinear) {
+        return false;
+    }
+    const size_t pitch = s._stride * es;
+    *pitched = ihipPitchedSide(s._base, pitch, pitch * (s._height ? s._height : 1), make_hipPos(s._x * es, s._y, s._z));
+    return true;
+}
+
+
+// Device scratch for boxes which aren't contiguous on the device, kept per device and grown as needed.  Held for
+// the whole copy.
+struct ihipCopy3DScratch_t {
+    std::mutex  _mutex;
+    void*       _ptr = nullptr;
+    size_t      _sizeBytes = 0;
+};
+
+static std::mutex g_copy3DScratchMutex;
+static std::map<int, ihipCopy3DScratch_t> g_copy3DScratch;
+
+
+// Copies a box between the host and the device:
+//   - An array covered by the box is rebuilt on the host and copied once.
+//   - A box which is contiguous on a pitched or row-major device side is copied directly, in one copy.
+//   - Otherwise the host side is packed into device scratch, moved in one copy, and the kernel copies it to or from
+//     the device side.  One DMA and one kernel beat a DMA per row for all but the widest rows.
+static void ihipCopy3DHostDevice(hipStream_t stream, const ihipCopy3DSide_t &host, const ihipCopy3DSide_t &dev,
+                                 const hipArray *devArray, const hipPos &devPos,
+                                 size_t w, size_t h, size_t d, size_t es, bool toDevice)
+{
+    if (devArray && ihipCoversArray(devArray, devPos, w, h, d)) {
+        std::vector<char> image(ihipArraySizeBytes(devArray));
+        ihipCopy3DSide_t imageSide = dev;
+        imageSide._base = image.data();
+        if (toDevice) {
+            ihipCopy3DHost(imageSide, host, w, h, d, es);
+            stream->locked_copySync(devArray->data, image.data(), image.size(), hipMemcpyHostToDevice);
+        } else {
+            stream->locked_copySync(image.data(), devArray->data, image.size(), hipMemcpyDeviceToHost);
+            ihipCopy3DHost(host, imageSide, w, h, d, es);
+        }
+        return;
+    }
+
+    const size_t bytes = w * h * d * es;
+    const hipMemcpyKind kind = toDevice ? hipMemcpyHostToDevice : hipMemcpyDeviceToHost;
+
+    std::vector<char> packed;
+    ihipCopy3DSide_t packedSide;
+
+    ihipCopy3DSide_t rows;
+    if (ihipAsPitched(dev, es, &rows) && ihipIsContiguous(rows, w, h, d, es)) {
+        char *devStart = rows._base + ihipCopy3DOffset(rows, 0, 0, 0, es);
+        if (ihipIsContiguous(host, w, h, d, es)) {
+            char *hostStart = host._base + ihipCopy3DOffset(host, 0, 0, 0, es);
+            stream->locked_copySync(toDevice ? devStart : hostStart, toDevice ? hostStart : devStart, bytes, kind);
+            return;
+        }
+        packed.resize(bytes);
+        packedSide = ihipPitchedSide(packed.data(), w * es, w * es * h, make_hipPos(0, 0, 0));
+        if (toDevice) {
+            ihipCopy3DHost(packedSide, host, w, h, d, es);
+            stream->locked_copySync(devStart, packed.data(), bytes, kind);
+        } else {
+            stream->locked_copySync(packed.data(), devStart, bytes, kind);
+            ihipCopy3DHost(host, packedSide, w, h, d, es);
+        }
+        return;
+    }
+
+    packed.resize(bytes);
+    packedSide = ihipPitchedSide(packed.data(), w * es, w * es * h, make_hipPos(0, 0, 0));
+
+    auto device = stream->getCtx()->getWriteableDevice();
+    ihipCopy3DScratch_t *scratch;
+    {
+        std::lock_guard<std::mutex> l(g_copy3DScratchMutex);
+        scratch = &g_copy3DScratch[device->_deviceId];
+    }
+    std::lock_guard<std::mutex> l(scratch->_mutex);
+    if (scratch->_sizeBytes < bytes) {
+        if (scratch->_ptr) {
+            hc::am_free(scratch->_ptr);
+            scratch->_sizeBytes = 0;
+        }
+        scratch->_ptr = hc::am_alloc(bytes, device->_acc, 0);
+        if (scratch->_ptr == nullptr) {
+            throw ihipException(hipErrorMemoryAllocation);
+        }
+        hc::am_memtracker_update(scratch->_ptr, device->_deviceId, 0);
+        scratch->_sizeBytes = bytes;
+    }
+    ihipCopy3DSide_t scratchSide = packedSide;
+    scratchSide._base = static_cast<char*>(scratch->_ptr);
+
+    if (toDevice) {
+        ihipCopy3DHost(packedSide, host, w, h, d, es);
+        stream->locked_copySync(scratch->_ptr, packed.data(), bytes, kind);
+        ihipCopy3DKernel(stream, dev, scratchSide, w, h, d, es);
+    } else {
+        ihipCopy3DKernel(stream, scratchSide, dev, w, h, d, es);
+        stream->locked_copySync(packed.data(), scratch->_ptr, bytes, kind);
+        ihipCopy3DHost(host, packedSide, w, h, d, es);
+    }
+}
+
+
+// Checks that the box fits in an array side.
+static bool ihipArrayBoxValid(const hipArray *a, const hipPos &pos, size_t w, size_t h, size_t d)
+{
+    return (a->data != nullptr) && (pos.x + w <= a->width) && (pos.y + h <= (a->height ? a->height : 1)) &&
+           (pos.z + d <= (a->depth ? a->depth : 1));
+}
+
+
+static void ihipMemcpy3D(hipStream_t stream, const hipMemcpy3DParms *p)
+{
+    if ((p == nullptr) || ((p->srcArray == nullptr) == (p->srcPtr.ptr == nullptr)) ||
+        ((p->dstArray == nullptr) == (p->dstPtr.ptr == nullptr))) {
+        throw ihipException(hipErrorInvalidValue);
+    }
+
+    const size_t w = p->extent.width;
+    const size_t h = p->extent.height;
+    const size_t d = p->extent.depth;
+    if ((w == 0) || (h == 0) || (d == 0)) {
+        return;
+    }
+
+    // Widths are in elements if either side is an array, else in bytes.  Pitched-to-pitched copies move the
+    // largest power-of-two chunk which divides the widths, positions and pitches.
+    size_t es;
+    if (p->srcArray && p->dstArray) {
+        if (p->srcArray->elementSize != p->dstArray->elementSize) {
+            throw ihipException(hipErrorInvalidValue);
+        }
+        es = p->srcArray->elementSize;
+    } else if (p->srcArray || p->dstArray) {
+        es = p->srcArray ? p->srcArray->elementSize : p->dstArray->elementSize;
+    } else {
+        es = 8;
+        while ((w | p->srcPos.x | p->dstPos.x | p->srcPtr.pitch | p->dstPtr.pitch) & (es - 1)) {
+            es /= 2;
+        }
+    }
+    const size_t cw = (p->srcArray || p->dstArray) ? w : w / es;
+
+    ihipCopy3DSide_t src, dst;
+    if (p->srcArray) {
+        if (!ihipArrayBoxValid(p->srcArray, p->srcPos, w, h, d)) {
+            throw ihipException(hipErrorInvalidValue);
+        }
+        src = ihipArraySide(p->srcArray, p->srcPos);
+    } else {
+        if ((p->srcPos.x + cw * es > p->srcPtr.pitch) || ((d > 1) && (p->srcPos.y + h > p->srcPtr.ysize))) {
+            throw ihipException(hipErrorInvalidValue);
+        }
+        src = ihipPitchedSide(p->srcPtr.ptr, p->srcPtr.pitch, p->srcPtr.pitch * p->srcPtr.ysize, p->srcPos);
+    }
+    if (p->dstArray) {
+        if (!ihipArrayBoxValid(p->dstArray, p->dstPos, w, h, d)) {
+            throw ihipException(hipErrorInvalidValue);
+        }
+        dst = ihipArraySide(p->dstArray, p->dstPos);
+    } else {
+        if ((p->dstPos.x + cw * es > p->dstPtr.pitch) || ((d > 1) && (p->dstPos.y + h > p->dstPtr.ysize))) {
+            throw ihipException(hipErrorInvalidValue);
+        }
+        dst = ihipPitchedSide(p->dstPtr.ptr, p->dstPtr.pitch, p->dstPtr.pitch * p->dstPtr.ysize, p->dstPos);
+    }
+
+    // Arrays always live on the device.
+    bool srcHost = false, dstHost = false;
+    switch (p->kind) {
+        case hipMemcpyHostToHost:     srcHost = true;  dstHost = true;  break;
+        case hipMemcpyHostToDevice:   srcHost = true;  break;
+        case hipMemcpyDeviceToHost:   dstHost = true;  break;
+        case hipMemcpyDeviceToDevice: break;
+        default:
+            srcHost = !p->srcArray && !ihipIsDeviceMemory(p->srcPtr.ptr);
+            dstHost = !p->dstArray && !ihipIsDeviceMemory(p->dstPtr.ptr);
+            break;
+    }
+    if ((srcHost && p->srcArray) || (dstHost && p->dstArray)) {
+        throw ihipException(hipErrorInvalidMemcpyDirection);
+    }
+
+    if (srcHost && dstHost) {
+        ihipCopy3DHost(dst, src, cw, h, d, es);
+    } else if (srcHost) {
+        ihipCopy3DHostDevice(stream, src, dst, p->dstArray, p->dstPos, cw, h, d, es, true);
+    } else if (dstHost) {
+        ihipCopy3DHostDevice(stream, dst, src, p->srcArray, p->srcPos, cw, h, d, es, false);
+    } else {
+        ihipCopy3DKernel(stream, dst, src, cw, h, d, es);
+    }
+}
+
+
+hipError_t hipMemcpy3D(const hipMemcpy3DParms* p)
+{
+    HIP_INIT_API(p);
+
+    hipStream_t stream = ihipSyncAndResolveStream(hipStreamNull);
+
+    hipError_t e = hipSuccess;
+
+    try {
+        ihipMemcpy3D(stream, p);
+    }
+    catch (ihipException ex) {
+        e = ex._code;
+    }
+
+    return ihipLogStatus(e);
+}
+
+
 hipError_t hipMemcpy2DToArray(hipArray* dst, size_t wOffset, size_t hOffset, const void* src,
         size_t spitch, size_t width, size_t height, hipMemcpyKind kind) {
 
@@ -696,44 +1359,28 @@ hipError_t hipMemcpy2DToArray(hipArray* dst, size_t wOffset, size_t hOffset, con
 
     hipStream_t stream = ihipSyncAndResolveStream(hipStreamNull);
 
-    hc::completion_future marker;
-
     hipError_t e = hipSuccess;
 
-    size_t byteSize;
-    if(dst) {
-        switch(dst[0].f) {
-            case hipChannelFormatKindSigned:
-                byteSize = sizeof(int);
-                break;
-            case hipChannelFormatKindUnsigned:
-                byteSize = sizeof(unsigned int);
-                break;
-            case hipChannelFormatKindFloat:
-                byteSize = sizeof(float);
-                break;
-            case hipChannelFormatKindNone:
-                byteSize = sizeof(size_t);
-                break;
-            default:
-                byteSize = 0;
-                break;
-        }
-    } else {
+    if(!dst) {
         return ihipLogStatus(hipErrorUnknown);
     }
 
-    if((wOffset + width > (dst->width * byteSize)) || width > spitch) {
+    size_t byteSize = dst->elementSize;
+
+    if((wOffset + width > (dst->width * byteSize)) || width > spitch ||
+       (wOffset % byteSize) || (width % byteSize)) {
         return ihipLogStatus(hipErrorUnknown);
     }
 
-    size_t src_w = spitch;
-    size_t dst_w = (dst->width)*byteSize;
+    hipMemcpy3DParms p = {};
+    p.srcPtr = make_hipPitchedPtr(const_cast<void*>(src), spitch, width, height);
+    p.dstArray = dst;
+    p.dstPos = make_hipPos(wOffset / byteSize, hOffset, 0);
+    p.extent = make_hipExtent(width / byteSize, height, 1);
+    p.kind = kind;
 
     try {
-        for(int i = 0; i < height; ++i) {
-            stream->locked_copySync((unsigned char*)dst->data + i*dst_w, (unsigned char*)src + i*src_w, width, kind);
-        }
+        ihipMemcpy3D(stream, &p);
     }
     catch (ihipException ex) {
         e = ex._code;
@@ -749,12 +1396,47 @@ hipError_t hipMemcpyToArray(hipArray* dst, size_t wOffset, size_t hOffset,
 
     hipStream_t stream = ihipSyncAndResolveStream(hipStreamNull);
 
-    hc::completion_future marker;
-
     hipError_t e = hipSuccess;
 
+    if (!dst) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    const size_t rowBytes = dst->width * dst->elementSize;
+
     try {
-        stream->locked_copySync((char *)dst->data + wOffset, src, count, kind);
+        if (dst->layout == hipArrayLayoutLinear) {
+            if (hOffset * rowBytes + wOffset + count > ihipArraySizeBytes(dst)) {
+                throw ihipException(hipErrorInvalidValue);
+            }
+            stream->locked_copySync((char *)dst->data + hOffset * rowBytes + wOffset, src, count, kind);
+        } else {
+            if ((wOffset % dst->elementSize) || (count % dst->elementSize)) {
+                throw ihipException(hipErrorInvalidValue);
+            }
+            // The bytes run on through the following rows: copy the partial first row, the whole rows,
+            // then the partial last row.
+            const char *s = static_cast<const char*>(src);
+            size_t x = wOffset;
+            size_t y = hOffset;
+            while (count) {
+                const size_t rows = (x == 0) ? count / rowBytes : 0;
+                const size_t bytes = rows ? rows * rowBytes : std::min(count, rowBytes - x);
+
+                hipMemcpy3DParms p = {};
+                p.srcPtr = make_hipPitchedPtr(const_cast<char*>(s), rows ? rowBytes : bytes, bytes, rows ? rows : 1);
+                p.dstArray = dst;
+                p.dstPos = make_hipPos(x / dst->elementSize, y, 0);
+                p.extent = make_hipExtent((rows ? rowBytes : bytes) / dst->elementSize, rows ? rows : 1, 1);
+                p.kind = kind;
+                ihipMemcpy3D(stream, &p);
+
+                s += bytes;
+                count -= bytes;
+                y += rows ? rows : (x + bytes == rowBytes);
+                x = (x + bytes) % rowBytes;
+            }
+        }
     }
     catch (ihipException ex) {
         e = ex._code;
@@ -946,12 +1628,19 @@ hipError_t hipFree(void* ptr)
     // Synchronize to ensure all work has finished.
     ihipGetTlsDefaultCtx()->locked_waitAllStreams(); // ignores non-blocking streams, this waits for all activity to finish.
 
-    if (ptr) {
+    if (ptr && ihipFreeManaged(ptr)) {
+        hipStatus = hipSuccess;
+    } else if (ptr) {
         hc::accelerator acc;
         hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
         am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, ptr);
         if(status == AM_SUCCESS){
             if(amPointerInfo._hostPointer == NULL){
+                ihipDevice_t *device = ihipGetDevice(amPointerInfo._appId);
+                if (device) {
+                    device->_peerMapper->remove(ptr);
+                }
+                ihipIpcForgetMemHandle(ptr);
                 hc::am_free(ptr);
                 hipStatus = hipSuccess;
             }
@@ -979,7 +1668,11 @@ hipError_t hipHostFree(void* ptr)
         am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, ptr);
         if(status == AM_SUCCESS){
             if(amPointerInfo._hostPointer == ptr){
-                hc::am_free(ptr);
+                ihipDevice_t *device = ihipGetDevice(amPointerInfo._appId);
+                if (device) {
+                    device->_peerMapper->remove(ptr);
+                }
+                ihipHostFreePinned(ptr);
                 hipStatus = hipSuccess;
             }
         }
@@ -1011,6 +1704,10 @@ hipError_t hipFreeArray(hipArray* array)
         am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, array->data);
         if(status == AM_SUCCESS){
             if(amPointerInfo._hostPointer == NULL){
+                ihipDevice_t *device = ihipGetDevice(amPointerInfo._appId);
+                if (device) {
+                    device->_peerMapper->remove(array->data);
+                }
                 hc::am_free(array->data);
                 hipStatus = hipSuccess;
             }
@@ -1037,64 +1734,3 @@ hipError_t hipMemGetAddressRange ( hipDeviceptr_t* pbase, size_t* psize, hipDevi
 }
 
 
-//TODO: IPC implementaiton:
-
-hipError_t hipIpcGetMemHandle(hipIpcMemHandle_t* handle, void* devPtr){
-    HIP_INIT_API ( handle, devPtr);
-    hipError_t hipStatus = hipSuccess;
-    // Get the size of allocated pointer
-    size_t psize;
-    hc::accelerator acc;
-    hc::AmPointerInfo amPointerInfo( NULL , NULL , 0 , acc , 0 , 0 );
-    am_status_t status = hc::am_memtracker_getinfo( &amPointerInfo , devPtr );
-    if (status == AM_SUCCESS) {
-        psize = (size_t)amPointerInfo._sizeBytes;
-    }
-    else
-        hipStatus = hipErrorInvalidResourceHandle;
-
-    // Save the size of the pointer to hipIpcMemHandle
-    (*handle)->psize = psize;
-
-    // Create HSA ipc memory
-    hsa_status_t hsa_status =
-        hsa_amd_ipc_memory_create(devPtr, psize, &(*handle)->ipc_handle);
-    if(hsa_status!= HSA_STATUS_SUCCESS)
-        hipStatus = hipErrorMemoryAllocation;
-
-    return hipStatus;
-}
-
-hipError_t hipIpcOpenMemHandle(void** devPtr, hipIpcMemHandle_t handle, unsigned int flags){
-// HIP_INIT_API ( devPtr, handle.handle , flags);
-    hipError_t hipStatus = hipSuccess;
-
-    // Get the current device agent.
-    hc::accelerator acc;
-    hsa_agent_t *agent = static_cast<hsa_agent_t*>(acc.get_hsa_agent());
-    if(!agent)
-        return hipErrorInvalidResourceHandle;
-
-    //Attach ipc memory
-    hsa_status_t hsa_status =
-        hsa_amd_ipc_memory_attach(&handle->ipc_handle, handle->psize, 1, agent, devPtr);
-    if(hsa_status != HSA_STATUS_SUCCESS)
-        hipStatus = hipErrorMapBufferObjectFailed;
-
-    return hipStatus;
-}
-
-hipError_t hipIpcCloseMemHandle(void *devPtr){
-    HIP_INIT_API ( devPtr );
-    hipError_t hipStatus = hipSuccess;
-
-    hsa_status_t hsa_status =
-        hsa_amd_ipc_memory_detach(devPtr);
-    if(hsa_status != HSA_STATUS_SUCCESS)
-        return hipErrorInvalidResourceHandle;
-    return hipStatus;
-}
-
-// hipError_t hipIpcOpenEventHandle(hipEvent_t* event, hipIpcEventHandle_t handle){
-//     return hipSuccess;
-// }
@@ -83,6 +83,32 @@ uint64_t PrintSymbolSizes(const void *emi, const char *name){
     return 0;
 }
 
+// Host address of the amd_kernel_code_t for kernel name in the code object at emi, or nullptr if not found.
+// The kernel symbol's value is the address of its code in the section it belongs to.
+const void *ElfKernelCode(const void *emi, const char *name){
+    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr*)emi;
+    const Elf64_Shdr *shdr = (const Elf64_Shdr*)((char*)emi + ehdr->e_shoff);
+    for(uint16_t i=0;i<ehdr->e_shnum;++i){
+        if(shdr[i].sh_type == SHT_SYMTAB){
+            const Elf64_Sym *syms = (const Elf64_Sym*)((char*)emi + shdr[i].sh_offset);
+            uint64_t numSyms = shdr[i].sh_size/shdr[i].sh_entsize;
+            const char* strtab = (const char*)((char*)emi + shdr[shdr[i].sh_link].sh_offset);
+            for(uint64_t j=0;j<numSyms;++j){
+                uint16_t sec = syms[j].st_shndx;
+                if((sec == SHN_UNDEF) || (sec >= ehdr->e_shnum) || (strcmp(name, strtab + syms[j].st_name) != 0)){
+                    continue;
+                }
+                uint64_t offset = shdr[sec].sh_offset + (syms[j].st_value - shdr[sec].sh_addr);
+                if(offset + sizeof(amd_kernel_code_t) > shdr[sec].sh_offset + shdr[sec].sh_size){
+                    return nullptr;
+                }
+                return (const char*)emi + offset;
+            }
+        }
+    }
+    return nullptr;
+}
+
 uint64_t ElfSize(const void *emi){
     const Elf64_Ehdr *ehdr = (const Elf64_Ehdr*)emi;
     const Elf64_Shdr *shdr = (const Elf64_Shdr*)((char*)emi + ehdr->e_shoff);
@@ -186,6 +212,11 @@ hipError_t hipModuleUnload(hipModule_t hmod)
 				ret = hipErrorInvalidValue;
 		}
     delete hmod;
+
+    // Cached symbol addresses may point into the module just destroyed:
+    for (unsigned i=0; i<g_deviceCnt; i++) {
+        ihipGetDevice(i)->_symbolCache->clear();
+    }
     return ihipLogStatus(ret);
 }
 
@@ -226,6 +257,8 @@ hipError_t ihipModuleGetFunction(hipFunction_t *func, hipModule_t hmod, const ch
         if(status != HSA_STATUS_SUCCESS){
             return ihipLogStatus(hipErrorNotFound);
         }
+
+        (*func)->_kernelCode = ElfKernelCode(hmod->ptr, name);
     }
     return ihipLogStatus(ret);
 }
@@ -297,6 +330,9 @@ hipError_t hipModuleLaunchKernel(hipFunction_t f,
         */
         grid_launch_parm lp;
         hStream = ihipPreLaunchKernel(hStream, 0, 0, &lp, f->_kernelName);
+        gl_dim3 grid(gridDimX, gridDimY, gridDimZ);
+        gl_dim3 group(blockDimX, blockDimY, blockDimZ);
+        hc::completion_future profBegin, profEnd;     // queued for HIP_PROFILE_KERNELS once the stream is released
 
 #if USE_DISPATCH_HSA_KERNEL
 
@@ -322,7 +358,24 @@ hipError_t hipModuleLaunchKernel(hipFunction_t f,
                                     (HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_ACQUIRE_FENCE_SCOPE) |
                                     (HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_RELEASE_FENCE_SCOPE);
 
+        // dispatch_hsa_kernel returns no completion_future, so time the kernel with markers on either side:
+        hc::completion_future beginMarker;
+        if (g_timeline || g_kernelProf) {
+            beginMarker = lp.av->create_marker();
+        }
+
         lp.av->dispatch_hsa_kernel(&aql, config[1] /* kernarg*/, kernArgSize);
+
+        if (g_timeline || g_kernelProf) {
+            hc::completion_future endMarker = lp.av->create_marker();
+            if (g_timeline) {
+                ihipTimelineAddOp(hStream, "kernel", ihipTimelineIntern(f->_kernelName), nullptr, 0, beginMarker, endMarker);
+            }
+            if (g_kernelProf) {
+                profBegin = beginMarker;
+                profEnd = endMarker;
+            }
+        }
 #else
 
         /*
@@ -365,6 +418,18 @@ hipError_t hipModuleLaunchKernel(hipFunction_t f,
 
         hsa_signal_value_t value = hsa_signal_wait_acquire(signal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_BLOCKED);
 
+        if (g_timeline || g_kernelProf) {
+            hsa_amd_profiling_dispatch_time_t time;
+            if (hsa_amd_profiling_get_dispatch_time(*static_cast<hsa_agent_t*>(lp.av->get_hsa_agent()), signal, &time) == HSA_STATUS_SUCCESS) {
+                if (g_timeline) {
+                    ihipTimelineAddOp(hStream, "kernel", ihipTimelineIntern(f->_kernelName), nullptr, 0, time.start, time.end);
+                }
+                if (g_kernelProf) {
+                    ihipKernelProfAdd(f->_kernelName, grid, group, time.start, time.end);
+                }
+            }
+        }
+
         /*
            Destroy kernarg
         */
@@ -386,6 +451,10 @@ hipError_t hipModuleLaunchKernel(hipFunction_t f,
 
         ihipPostLaunchKernel(f->_kernelName, hStream, lp);
 
+        if (profEnd.valid()) {
+            ihipKernelProfAdd(f->_kernelName, grid, group, profBegin, profEnd);
+        }
+
     }
 
     return ihipLogStatus(ret);
@@ -0,0 +1,486 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file hip_numa.cpp
+ *
+ * NUMA placement of pinned host memory.  ROCr exposes one CPU agent per NUMA node, each with its own global
+ * memory pools.  Each device picks the fine-grained CPU pool with the shortest link to it (sum of the numa_distance
+ * of the HSA_AMD_AGENT_MEMORY_POOL_INFO_LINK_INFO hops), and pinned host memory allocated for the device -
+ * hipHostMalloc, staging buffers and peer bounce buffers - comes from that pool.  The staging and host-copy worker
+ * threads are pinned to the CPUs of the same node (see hip_staging.cpp).
+ *
+ * Nodes are numbered as the OS numbers them (/sys/devices/system/node/nodeN): CPU agents are matched to the nodes
+ * with CPUs in ascending order.  HIP_HOST_NUMA_NODE overrides the choice: -1 (default) picks the closest node,
+ * N>=0 forces OS node N, and -2 disables placement so pinned memory comes from the HCC allocator.
+ *
+ * Huge pages (hipHostMallocHugePages or HIP_HOST_HUGE_PAGES=1): the allocation is an anonymous mapping backed by
+ * reserved hugetlb pages (1GB, then 2MB), or failing that a 2MB-aligned mapping advised for transparent huge pages,
+ * bound with mbind to the device's NUMA node and locked for all devices with am_memory_host_lock.  Far fewer pages
+ * to pin means much faster registration and fewer IOMMU/TLB misses on device access.
+ *
+ * hipHostMalloc memory must be usable by kernels at its host address, but the devices see locked memory at the
+ * agent address returned by the lock, which on dGPUs need not equal the host address.  The huge page mapping is
+ * only kept when the two match.  If the mapping or lock fails, or the addresses differ, the normal 4KB path is used
+ * instead.  The caller is told whether the pages really are huge (THP may not deliver them), so hipHostGetFlags only
+ * reports hipHostMallocHugePages when they are.
+ */
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// From numaif.h, which is part of libnuma rather than libc:
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+
+//=================================================================================================
+// Discovery:
+//=================================================================================================
+namespace {
+
+struct CpuPool {
+    hsa_agent_t             _agent;
+    hsa_amd_memory_pool_t   _pool;
+    bool                    _hasPool;    // agent has a fine-grained pool we can allocate from.
+    int                     _osNode;     // OS NUMA node id of the agent.
+};
+
+
+// Pick the pool used for pinned host allocations on a CPU agent.  Only fine-grained pools qualify: pinned host
+// memory must stay coherent with the host while kernels and DMA access it, as with amHostPinned.
+hsa_status_t findHostPool(hsa_amd_memory_pool_t pool, void *data)
+{
+    hsa_amd_segment_t segment;
+    uint32_t flags;
+    bool allocAllowed = false;
+
+    if ((hsa_amd_memory_pool_get_info(pool, HSA_AMD_MEMORY_POOL_INFO_SEGMENT, &segment) != HSA_STATUS_SUCCESS) ||
+        (segment != HSA_AMD_SEGMENT_GLOBAL)) {
+        return HSA_STATUS_SUCCESS;
+    }
+    hsa_amd_memory_pool_get_info(pool, HSA_AMD_MEMORY_POOL_INFO_RUNTIME_ALLOC_ALLOWED, &allocAllowed);
+    if (!allocAllowed || (hsa_amd_memory_pool_get_info(pool, HSA_AMD_MEMORY_POOL_INFO_GLOBAL_FLAGS, &flags) != HSA_STATUS_SUCCESS)) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    if (flags & HSA_AMD_MEMORY_POOL_GLOBAL_FLAG_FINE_GRAINED) {
+        *static_cast<std::pair<bool, hsa_amd_memory_pool_t>*>(data) = std::make_pair(true, pool);
+        return HSA_STATUS_INFO_BREAK;
+    }
+    return HSA_STATUS_SUCCESS;
+}
+
+
+// Collect the host pool of every CPU agent, in agent order.
+hsa_status_t collectCpuPools(hsa_agent_t agent, void *data)
+{
+    hsa_device_type_t deviceType;
+    if ((hsa_agent_get_info(agent, HSA_AGENT_INFO_DEVICE, &deviceType) != HSA_STATUS_SUCCESS) ||
+        (deviceType != HSA_DEVICE_TYPE_CPU)) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    std::pair<bool, hsa_amd_memory_pool_t> found(false, hsa_amd_memory_pool_t());
+    hsa_amd_agent_iterate_memory_pools(agent, findHostPool, &found);
+    static_cast<std::vector<CpuPool>*>(data)->push_back(CpuPool{agent, found.second, found.first, -1});
+    return HSA_STATUS_SUCCESS;
+}
+
+
+// OS NUMA node ids (as in /sys/devices/system/node) which have CPUs, in ascending order.  The kernel driver creates
+// one CPU agent per such node, in this order, so the i'th CPU agent is on the i'th node of this list.
+std::vector<int> cpuNumaNodes()
+{
+    std::vector<int> nodes;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir == nullptr) {
+        return nodes;
+    }
+    while (struct dirent *e = readdir(dir)) {
+        int node;
+        char tail;
+        if (sscanf(e->d_name, "node%d%c", &node, &tail) != 1) {
+            continue;
+        }
+        char path[256];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        std::ifstream f(path);
+        std::string cpuList;
+        if (f && std::getline(f, cpuList) && !cpuList.empty()) {
+            nodes.push_back(node);
+        }
+    }
+    closedir(dir);
+
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+}
+
+
+// Sum of the NUMA distances along the path from gpu to pool, or UINT32_MAX if the gpu can't reach the pool.
+uint32_t poolDistance(hsa_agent_t gpu, hsa_amd_memory_pool_t pool)
+{
+    hsa_amd_memory_pool_access_t access = HSA_AMD_MEMORY_POOL_ACCESS_NEVER_ALLOWED;
+    hsa_amd_agent_memory_pool_get_info(gpu, pool, HSA_AMD_AGENT_MEMORY_POOL_INFO_ACCESS, &access);
+    if (access == HSA_AMD_MEMORY_POOL_ACCESS_NEVER_ALLOWED) {
+        return UINT32_MAX;
+    }
+
+    uint32_t hops = 0;
+    if ((hsa_amd_agent_memory_pool_get_info(gpu, pool, HSA_AMD_AGENT_MEMORY_POOL_INFO_NUM_LINK_HOPS, &hops) != HSA_STATUS_SUCCESS) ||
+        (hops == 0)) {
+        return 0;  // no link info - treat as local.
+    }
+
+    std::vector<hsa_amd_memory_pool_link_info_t> links(hops);
+    if (hsa_amd_agent_memory_pool_get_info(gpu, pool, HSA_AMD_AGENT_MEMORY_POOL_INFO_LINK_INFO, links.data()) != HSA_STATUS_SUCCESS) {
+        return 0;
+    }
+
+    uint32_t distance = 0;
+    for (auto &l : links) {
+        distance += l.numa_distance;
+    }
+    return distance;
+}
+
+} // end anonymous namespace
+
+
+//---
+// Choose the NUMA node (CPU agent) for this device's pinned host memory.  Called once, from the device constructor.
+void ihipDevice_t::initNumaPlacement()
+{
+    _numaNode = -1;
+
+    if ((HIP_HOST_NUMA_NODE == -2) || (_hsaAgent.handle == static_cast<uint64_t>(-1))) {
+        return;
+    }
+
+    std::vector<CpuPool> cpuPools;
+    hsa_iterate_agents(collectCpuPools, &cpuPools);
+
+    // Number the agents with OS node ids, so HIP_HOST_NUMA_NODE and the worker thread placement in hip_staging.cpp
+    // use the same numbering as numactl and /sys:
+    std::vector<int> osNodes = cpuNumaNodes();
+    if (osNodes.size() == cpuPools.size()) {
+        for (size_t i=0; i<cpuPools.size(); i++) {
+            cpuPools[i]._osNode = osNodes[i];
+        }
+    } else {
+        tprintf(DB_MEM, "%zu CPU agents but %zu NUMA nodes with CPUs, NUMA placement disabled\n", cpuPools.size(), osNodes.size());
+        return;
+    }
+
+    int index = -1;
+    if (HIP_HOST_NUMA_NODE >= 0) {
+        for (int i=0; i<(int)cpuPools.size(); i++) {
+            if ((cpuPools[i]._osNode == HIP_HOST_NUMA_NODE) && cpuPools[i]._hasPool) {
+                index = i;
+            }
+        }
+        if (index == -1) {
+            fprintf (stderr, "warning: HIP_HOST_NUMA_NODE=%d is not a NUMA node with CPUs and pinned memory, using closest node\n",
+                     HIP_HOST_NUMA_NODE);
+        }
+    }
+
+    if (index == -1) {
+        uint32_t best = UINT32_MAX;
+        for (int i=0; i<(int)cpuPools.size(); i++) {
+            uint32_t d = cpuPools[i]._hasPool ? poolDistance(_hsaAgent, cpuPools[i]._pool) : UINT32_MAX;
+            if (d < best) {
+                best = d;
+                index = i;
+            }
+        }
+    }
+
+    if (index >= 0) {
+        _numaNode = cpuPools[index]._osNode;
+        _cpuAgent = cpuPools[index]._agent;
+        _hostPool = cpuPools[index]._pool;
+    }
+
+    tprintf(DB_MEM, "device %d pinned host memory on NUMA node %d (of %zu)\n", _deviceId, _numaNode, cpuPools.size());
+}
+
+
+
+//=================================================================================================
+// Pinned host allocation:
+//=================================================================================================
+namespace {
+
+const size_t HUGE_PAGE_2M = size_t(2) << 20;
+const size_t HUGE_PAGE_1G = size_t(1) << 30;
+
+inline size_t roundUp(size_t x, size_t align) { return (x + align - 1) & ~(align - 1); };
+
+
+// Allocations which must not be released with am_free.
+struct PinnedAlloc {
+    enum Kind {NumaPool, HugePages};
+
+    Kind            _kind;
+    ihipDevice_t   *_device;
+    size_t          _mapSize;   // HugePages: length of the mapping.
+};
+
+std::mutex                               g_pinnedAllocsMutex;
+std::unordered_map<void*, PinnedAlloc>   g_pinnedAllocs;
+
+
+void trackPinnedAlloc(void *p, const PinnedAlloc &alloc)
+{
+    std::lock_guard<std::mutex> l(g_pinnedAllocsMutex);
+    g_pinnedAllocs[p] = alloc;
+}
+
+
+// Ask the kernel to back the 2MB-aligned interior of [ptr, ptr+sizeBytes) with transparent huge pages.
+void adviseHugePages(void *ptr, size_t sizeBytes)
+{
+#if defined(MADV_HUGEPAGE)
+    const uintptr_t start = roundUp(reinterpret_cast<uintptr_t>(ptr), HUGE_PAGE_2M);
+    const uintptr_t end   = (reinterpret_cast<uintptr_t>(ptr) + sizeBytes) & ~(HUGE_PAGE_2M - 1);
+    if (end > start) {
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_HUGEPAGE);
+    }
+#endif
+}
+
+
+// Place the pages of [ptr, ptr+sizeBytes) on OS NUMA node 'node'.  Must be called before the pages are touched.
+void bindToNode(void *ptr, size_t sizeBytes, int node)
+{
+    const size_t bitsPerWord = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> nodeMask(node / bitsPerWord + 1, 0);
+    nodeMask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+    if (syscall(SYS_mbind, ptr, sizeBytes, MPOL_BIND, nodeMask.data(), nodeMask.size() * bitsPerWord + 1, 0) != 0) {
+        tprintf(DB_MEM, "mbind of ptr:%p size:%zu to NUMA node %d failed (errno %d)\n", ptr, sizeBytes, node, errno);
+    }
+}
+
+
+// Bytes of transparent huge pages backing the mapping which contains ptr, from /proc/self/smaps.
+size_t anonHugeBytes(void *ptr)
+{
+    std::ifstream f("/proc/self/smaps");
+    std::string line;
+    bool inMapping = false;
+    while (std::getline(f, line)) {
+        unsigned long start, end;
+        size_t kb;
+        if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2) {
+            inMapping = (start <= reinterpret_cast<uintptr_t>(ptr)) && (reinterpret_cast<uintptr_t>(ptr) < end);
+        } else if (inMapping && (sscanf(line.c_str(), "AnonHugePages: %zu kB", &kb) == 1)) {
+            return kb << 10;
+        }
+    }
+    return 0;
+}
+
+
+// Map anonymous memory backed by huge pages.  Tries reserved hugetlb pages first - 1GB pages for allocations of
+// at least 1GB, then 2MB pages - and falls back to a 2MB-aligned mapping marked for transparent huge pages.
+void *mapHugePages(size_t sizeBytes, size_t *mapSize, const char **pageKind)
+{
+#if defined(MAP_HUGETLB)
+    const struct { size_t _size; int _log2; const char *_name; } pages[] = {
+        {HUGE_PAGE_1G, 30, "1GB"},
+        {HUGE_PAGE_2M, 21, "2MB"},
+    };
+    for (auto &page : pages) {
+        if ((page._size == HUGE_PAGE_1G) && (sizeBytes < HUGE_PAGE_1G)) {
+            continue;
+        }
+        const size_t len = roundUp(sizeBytes, page._size);
+        void *p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|(page._log2 << MAP_HUGE_SHIFT), -1, 0);
+        if (p != MAP_FAILED) {
+            *mapSize = len;
+            *pageKind = page._name;
+            return p;
+        }
+    }
+#endif
+
+    // Over-allocate by one huge page so the mapping can be trimmed to a 2MB boundary:
+    const size_t len = roundUp(sizeBytes, HUGE_PAGE_2M);
+    char *p = static_cast<char*>(mmap(NULL, len + HUGE_PAGE_2M, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0));
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    char *aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(p), HUGE_PAGE_2M));
+    if (aligned > p) {
+        munmap(p, aligned - p);
+    }
+    munmap(aligned + len, (p + len + HUGE_PAGE_2M) - (aligned + len));
+
+    adviseHugePages(aligned, len);
+    *mapSize = len;
+    *pageKind = "THP";
+    return aligned;
+}
+
+
+// Pinned, huge-page backed memory locked for all devices on the device's NUMA node.  Returns nullptr if it can't be
+// mapped or locked, or if the devices would see it at a different address.  *isHuge is set if the locked pages are
+// huge pages.
+void *allocHugePages(ihipDevice_t *device, size_t sizeBytes, bool *isHuge)
+{
+    size_t mapSize = 0;
+    const char *pageKind = nullptr;
+    void *p = mapHugePages(sizeBytes, &mapSize, &pageKind);
+    if (p == nullptr) {
+        return nullptr;
+    }
+
+    if (device->_numaNode >= 0) {
+        bindToNode(p, mapSize, device->_numaNode);
+    }
+
+    std::vector<hc::accelerator> vecAcc;
+    for (unsigned i=0; i<g_deviceCnt; i++) {
+        vecAcc.push_back(ihipGetDevice(i)->_acc);
+    }
+    if (hc::am_memory_host_lock(device->_acc, p, mapSize, &vecAcc[0], vecAcc.size()) != AM_SUCCESS) {
+        munmap(p, mapSize);
+        return nullptr;
+    }
+
+    hc::AmPointerInfo ptrInfo(NULL, NULL, 0, device->_acc, 0, 0);
+    if ((hc::am_memtracker_getinfo(&ptrInfo, p) != AM_SUCCESS) || (ptrInfo._devicePointer != p)) {
+        tprintf(DB_MEM, "huge page ptr:%p is seen by the devices at %p\n", p, ptrInfo._devicePointer);
+        hc::am_memory_host_unlock(device->_acc, p);
+        munmap(p, mapSize);
+        return nullptr;
+    }
+
+    trackPinnedAlloc(p, PinnedAlloc{PinnedAlloc::HugePages, device, mapSize});
+
+    // Locking faulted the pages in, so it is now known whether THP delivered huge pages:
+    *isHuge = (strcmp(pageKind, "THP") != 0) || (anonHugeBytes(p) > 0);
+
+    tprintf(DB_MEM, "allocated pinned host ptr:%p size:%zu with %s pages (mapped %zu, huge:%d) on NUMA node %d for dev:%d\n",
+            p, sizeBytes, pageKind, mapSize, *isHuge, device->_numaNode, device->_deviceId);
+    return p;
+}
+
+} // end anonymous namespace
+
+
+void *ihipHostAllocPinned(ihipDevice_t *device, size_t sizeBytes, bool hugePages, bool *usedHugePages)
+{
+    if (usedHugePages) {
+        *usedHugePages = false;
+    }
+
+    if (hugePages && sizeBytes) {
+        bool isHuge = false;
+        void *p = allocHugePages(device, sizeBytes, &isHuge);
+        if (p) {
+            if (usedHugePages) {
+                *usedHugePages = isHuge;
+            }
+            return p;
+        }
+        tprintf(DB_MEM, "huge page allocation of %zu bytes not possible, falling back to 4KB pages\n", sizeBytes);
+    }
+
+    if ((device->_numaNode < 0) || (sizeBytes == 0)) {
+        return hc::am_alloc(sizeBytes, device->_acc, amHostPinned);
+    }
+
+    void *p = nullptr;
+    if (hsa_amd_memory_pool_allocate(device->_hostPool, sizeBytes, 0, &p) != HSA_STATUS_SUCCESS) {
+        tprintf(DB_MEM, "NUMA node %d pool allocation of %zu bytes failed, falling back to am_alloc\n", device->_numaNode, sizeBytes);
+        return hc::am_alloc(sizeBytes, device->_acc, amHostPinned);
+    }
+
+    // Visible to every device, matching amHostPinned:
+    std::vector<hsa_agent_t> agents;
+    for (unsigned i=0; i<g_deviceCnt; i++) {
+        agents.push_back(ihipGetDevice(i)->_hsaAgent);
+    }
+    if (hsa_amd_agents_allow_access(agents.size(), agents.data(), NULL, p) != HSA_STATUS_SUCCESS) {
+        hsa_amd_memory_pool_free(p);
+        return hc::am_alloc(sizeBytes, device->_acc, amHostPinned);
+    }
+
+    // Register with the tracker so the copy paths treat it like any other pinned host allocation:
+    hc::AmPointerInfo ptrInfo(p/*hostPointer*/, p/*devicePointer*/, sizeBytes, device->_acc, false/*isInDeviceMem*/, false/*isAmManaged*/);
+    hc::am_memtracker_add(p, ptrInfo);
+    hc::am_memtracker_update(p, device->_deviceId, 0);
+
+    trackPinnedAlloc(p, PinnedAlloc{PinnedAlloc::NumaPool, device, 0});
+
+    tprintf(DB_MEM, "allocated pinned host ptr:%p size:%zu on NUMA node %d for dev:%d\n", p, sizeBytes, device->_numaNode, device->_deviceId);
+    return p;
+}
+
+
+void ihipHostFreePinned(void *ptr)
+{
+    PinnedAlloc alloc;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> l(g_pinnedAllocsMutex);
+        auto it = g_pinnedAllocs.find(ptr);
+        if (it != g_pinnedAllocs.end()) {
+            alloc = it->second;
+            found = true;
+            g_pinnedAllocs.erase(it);
+        }
+    }
+
+    if (!found) {
+        hc::am_free(ptr);
+    } else if (alloc._kind == PinnedAlloc::NumaPool) {
+        hc::am_memtracker_remove(ptr);
+        hsa_amd_memory_pool_free(ptr);
+    } else {
+        hc::am_memory_host_unlock(alloc._device->_acc, ptr);
+        munmap(ptr, alloc._mapSize);
+    }
+}
@@ -0,0 +1,404 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file hip_occupancy.cpp
+ *
+ * Occupancy calculator.  Reports how many workgroups of a kernel fit on one compute unit, and the block size
+ * which gives the most resident threads.
+ *
+ * Register and LDS usage come from the kernel's amd_kernel_code_t.  Module kernels find it in the host copy of
+ * the code object when the function is loaded (see ihipModuleGetFunction).  hipLaunchKernel kernels are found by
+ * name in the executables HCC has loaded, through the AMD loader extension when the ROCr provides
+ * hsa_ven_amd_loader_iterate_executables (CMake defines HIP_HAS_HSA_LOADER_ITERATE).  Their results are cached
+ * per device and name.
+ *
+ * The limits are those of the GCN compute unit: 4 SIMDs, each with 256 VGPRs per lane and 800 SGPRs, and at
+ * most 16 multi-wave workgroups (one barrier each).  The wave and LDS budgets come from hipDeviceProp_t.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <hc.hpp>
+
+#include "hsa/amd_hsa_kernel_code.h"
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+#if HIP_HAS_HSA_LOADER_ITERATE
+#include <hsa/hsa_ven_amd_loader.h>
+#endif
+
+
+namespace {
+
+const int SIMDS_PER_CU              = 4;
+const int VGPRS_PER_SIMD            = 256;
+const int VGPR_GRANULE              = 4;
+const int SGPRS_PER_SIMD            = 800;
+const int SGPR_GRANULE              = 16;
+const size_t LDS_GRANULE            = 256;
+const int MAX_BARRIERS_PER_CU       = 16;
+const int DEFAULT_WAVES_PER_SIMD    = 10;
+
+struct KernelResources {
+    int     _vgprs;
+    int     _sgprs;
+    size_t  _ldsBytes;
+};
+
+
+int roundUp(int x, int granule)
+{
+    return (x + granule - 1) / granule * granule;
+}
+
+
+KernelResources readKernelCode(const void *kernelCode)
+{
+    const amd_kernel_code_t *akc = static_cast<const amd_kernel_code_t*>(kernelCode);
+    return KernelResources{akc->workitem_vgpr_count, akc->wavefront_sgpr_count, akc->workgroup_group_segment_byte_size};
+}
+
+
+// Workgroups of blockSize threads which fit on one CU of device.
+int activeBlocksPerCU(const hipDeviceProp_t &props, const KernelResources &res, int blockSize, size_t dynSharedMemBytes)
+{
+    if (blockSize > props.maxThreadsPerBlock) {
+        return 0;
+    }
+
+    int warpSize = props.warpSize;
+    int wavesPerSimd = props.maxThreadsPerMultiProcessor ? props.maxThreadsPerMultiProcessor / warpSize / SIMDS_PER_CU
+                                                          : DEFAULT_WAVES_PER_SIMD;
+    if (res._vgprs) {
+        wavesPerSimd = std::min(wavesPerSimd, VGPRS_PER_SIMD / roundUp(res._vgprs, VGPR_GRANULE));
+    }
+    if (res._sgprs) {
+        wavesPerSimd = std::min(wavesPerSimd, SGPRS_PER_SIMD / roundUp(res._sgprs, SGPR_GRANULE));
+    }
+
+    int wavesPerBlock = (blockSize + warpSize - 1) / warpSize;
+    int blocks = wavesPerSimd * SIMDS_PER_CU / wavesPerBlock;
+
+    if (wavesPerBlock > 1) {
+        blocks = std::min(blocks, MAX_BARRIERS_PER_CU);
+    }
+
+    size_t ldsBytes = res._ldsBytes + dynSharedMemBytes;
+    if (ldsBytes > props.sharedMemPerBlock) {
+        return 0;
+    } else if (ldsBytes) {
+        // LDS is allocated per CU, and one workgroup may use all of it.
+        ldsBytes = (ldsBytes + LDS_GRANULE - 1) / LDS_GRANULE * LDS_GRANULE;
+        blocks = std::min(blocks, static_cast<int>(props.sharedMemPerBlock / ldsBytes));
+    }
+
+    return blocks;
+}
+
+
+// Largest multiple of warpSize up to blockSizeLimit which keeps the most threads resident on a CU.
+void potentialBlockSize(const hipDeviceProp_t &props, const KernelResources &res, size_t dynSharedMemBytes,
+                        int blockSizeLimit, int *gridSize, int *blockSize)
+{
+    int limit = props.maxThreadsPerBlock;
+    if ((blockSizeLimit > 0) && (blockSizeLimit < limit)) {
+        limit = blockSizeLimit;
+    }
+
+    int bestBlockSize = 0;
+    int bestBlocks = 0;
+    for (int bs = limit / props.warpSize * props.warpSize; bs > 0; bs -= props.warpSize) {
+        int blocks = activeBlocksPerCU(props, res, bs, dynSharedMemBytes);
+        if (blocks * bs > bestBlocks * bestBlockSize) {
+            bestBlockSize = bs;
+            bestBlocks = blocks;
+        }
+    }
+
+    *blockSize = bestBlockSize;
+    *gridSize = bestBlocks * props.multiProcessorCount;
+}
+
+
+#if HIP_HAS_HSA_LOADER_ITERATE
+
+hsa_ven_amd_loader_1_01_pfn_t g_loader;
+
+
+// Mangled form of a kernel name as written at the hipLaunchKernel call site.  "HipTest::vectorADD<float>"
+// becomes "7HipTest9vectorADD".  Template arguments are dropped, so all instantiations match.
+std::string mangledFragment(const char *kernelName)
+{
+    std::string name(kernelName);
+    const std::string wrapper("HIP_KERNEL_NAME(");
+    if (name.compare(0, wrapper.size(), wrapper) == 0) {
+        name = name.substr(wrapper.size(), name.rfind(')') - wrapper.size());
+    }
+    name = name.substr(0, name.find('<'));
+    name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+    name.erase(0, name.find_first_not_of("&("));   // &kernel, (kernel)
+
+    std::string fragment;
+    size_t pos = 0;
+    while (pos <= name.size()) {
+        size_t end = std::min(name.find("::", pos), name.size());
+        if (end > pos) {
+            fragment += std::to_string(end - pos) + name.substr(pos, end - pos);
+        }
+        pos = end + 2;
+    }
+    return fragment;
+}
+
+
+struct KernelQuery {
+    hsa_agent_t         _agent;
+    std::string         _fragment;
+    bool                _found;
+    KernelResources     _res;
+};
+
+
+bool nameMatches(const std::string &symbolName, const std::string &fragment)
+{
+    for (size_t p = symbolName.find(fragment); p != std::string::npos; p = symbolName.find(fragment, p + 1)) {
+        if ((p == 0) || !isdigit(symbolName[p - 1])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+hsa_status_t findKernel(hsa_executable_t executable, hsa_executable_symbol_t symbol, void *data)
+{
+    KernelQuery *q = static_cast<KernelQuery*>(data);
+
+    hsa_symbol_kind_t kind;
+    if ((hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_TYPE, &kind) != HSA_STATUS_SUCCESS) ||
+        (kind != HSA_SYMBOL_KIND_KERNEL)) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    hsa_agent_t agent;
+    if ((hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_AGENT, &agent) != HSA_STATUS_SUCCESS) ||
+        (agent.handle != q->_agent.handle)) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    uint32_t nameLen = 0;
+    hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_NAME_LENGTH, &nameLen);
+    std::vector<char> name(nameLen + 1, '\0');
+    hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_NAME, name.data());
+    if (!nameMatches(name.data(), q->_fragment)) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    uint64_t kernelObject = 0;
+    const void *kernelCode = nullptr;
+    if ((hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_KERNEL_OBJECT, &kernelObject) != HSA_STATUS_SUCCESS) ||
+        (g_loader.hsa_ven_amd_loader_query_host_address(reinterpret_cast<const void*>(kernelObject), &kernelCode) != HSA_STATUS_SUCCESS)) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    // Several symbols can match (template instantiations, overloads) - report the most demanding one.
+    KernelResources r = readKernelCode(kernelCode);
+    tprintf(DB_API, "occupancy: kernel '%s' vgprs:%d sgprs:%d lds:%zu\n", name.data(), r._vgprs, r._sgprs, r._ldsBytes);
+    q->_res._vgprs    = std::max(q->_res._vgprs, r._vgprs);
+    q->_res._sgprs    = std::max(q->_res._sgprs, r._sgprs);
+    q->_res._ldsBytes = std::max(q->_res._ldsBytes, r._ldsBytes);
+    q->_found = true;
+
+    return HSA_STATUS_SUCCESS;
+}
+
+
+hsa_status_t searchExecutable(hsa_executable_t executable, void *data)
+{
+    return hsa_executable_iterate_symbols(executable, findKernel, data);
+}
+
+
+hipError_t namedKernelResources(const ihipDevice_t *device, const char *kernelName, KernelResources *res)
+{
+    static bool haveLoader =
+        (hsa_system_get_major_extension_table(HSA_EXTENSION_AMD_LOADER, 1, sizeof(g_loader), &g_loader) == HSA_STATUS_SUCCESS) &&
+        (g_loader.hsa_ven_amd_loader_iterate_executables != nullptr);
+    if (!haveLoader) {
+        return hipErrorNotSupported;
+    }
+
+    static std::mutex mutex;
+    static std::map<std::pair<int, std::string>, KernelResources> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto key = std::make_pair(device->_deviceId, std::string(kernelName));
+    auto c = cache.find(key);
+    if (c == cache.end()) {
+        KernelQuery q = {device->_hsaAgent, mangledFragment(kernelName), false, KernelResources{0, 0, 0}};
+        if (!q._fragment.empty()) {
+            g_loader.hsa_ven_amd_loader_iterate_executables(searchExecutable, &q);
+        }
+        if (!q._found) {
+            tprintf(DB_API, "occupancy: no kernel matching '%s' on dev:%d\n", kernelName, device->_deviceId);
+            return hipErrorInvalidDeviceFunction;
+        }
+        c = cache.emplace(key, q._res).first;
+    }
+
+    *res = c->second;
+    return hipSuccess;
+}
+
+#else
+
+hipError_t namedKernelResources(const ihipDevice_t *, const char *, KernelResources *)
+{
+    return hipErrorNotSupported;
+}
+
+#endif
+
+
+// Resources of module function f, and the current device.
+hipError_t functionResources(hipFunction_t f, const ihipDevice_t **device, KernelResources *res)
+{
+    auto ctx = ihipGetTlsDefaultCtx();
+    if (ctx == nullptr) {
+        return hipErrorInvalidContext;
+    } else if ((f == nullptr) || (f->_kernelCode == nullptr)) {
+        return hipErrorInvalidDeviceFunction;
+    }
+
+    *device = ctx->getDevice();
+    *res = readKernelCode(f->_kernelCode);
+    return hipSuccess;
+}
+
+
+// Resources of the hipLaunchKernel kernel kernelName on the current device.
+hipError_t namedResources(const char *kernelName, const ihipDevice_t **device, KernelResources *res)
+{
+    auto ctx = ihipGetTlsDefaultCtx();
+    if (ctx == nullptr) {
+        return hipErrorInvalidContext;
+    } else if (kernelName == nullptr) {
+        return hipErrorInvalidValue;
+    }
+
+    *device = ctx->getDevice();
+    return namedKernelResources(*device, kernelName, res);
+}
+
+} // end anonymous namespace
+
+
+//---
+hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, hipFunction_t f, int blockSize,
+                                                              size_t dynSharedMemPerBlk)
+{
+    HIP_INIT_API(numBlocks, f, blockSize, dynSharedMemPerBlk);
+
+    const ihipDevice_t *device = nullptr;
+    KernelResources res;
+    hipError_t e = hipSuccess;
+
+    if ((numBlocks == nullptr) || (blockSize <= 0)) {
+        e = hipErrorInvalidValue;
+    } else if ((e = functionResources(f, &device, &res)) == hipSuccess) {
+        *numBlocks = activeBlocksPerCU(device->_props, res, blockSize, dynSharedMemPerBlk);
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+hipError_t hipModuleOccupancyMaxPotentialBlockSize(int *gridSize, int *blockSize, hipFunction_t f,
+                                                   size_t dynSharedMemPerBlk, int blockSizeLimit)
+{
+    HIP_INIT_API(gridSize, blockSize, f, dynSharedMemPerBlk, blockSizeLimit);
+
+    const ihipDevice_t *device = nullptr;
+    KernelResources res;
+    hipError_t e = hipSuccess;
+
+    if ((gridSize == nullptr) || (blockSize == nullptr)) {
+        e = hipErrorInvalidValue;
+    } else if ((e = functionResources(f, &device, &res)) == hipSuccess) {
+        potentialBlockSize(device->_props, res, dynSharedMemPerBlk, blockSizeLimit, gridSize, blockSize);
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+hipError_t hipHccOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, const char *kernelName, int blockSize,
+                                                           size_t dynSharedMemPerBlk)
+{
+    HIP_INIT_API(numBlocks, kernelName, blockSize, dynSharedMemPerBlk);
+
+    const ihipDevice_t *device = nullptr;
+    KernelResources res;
+    hipError_t e = hipSuccess;
+
+    if ((numBlocks == nullptr) || (blockSize <= 0)) {
+        e = hipErrorInvalidValue;
+    } else if ((e = namedResources(kernelName, &device, &res)) == hipSuccess) {
+        *numBlocks = activeBlocksPerCU(device->_props, res, blockSize, dynSharedMemPerBlk);
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+hipError_t hipHccOccupancyMaxPotentialBlockSize(int *gridSize, int *blockSize, const char *kernelName,
+                                                size_t dynSharedMemPerBlk, int blockSizeLimit)
+{
+    HIP_INIT_API(gridSize, blockSize, kernelName, dynSharedMemPerBlk, blockSizeLimit);
+
+    const ihipDevice_t *device = nullptr;
+    KernelResources res;
+    hipError_t e = hipSuccess;
+
+    if ((gridSize == nullptr) || (blockSize == nullptr)) {
+        e = hipErrorInvalidValue;
+    } else if ((e = namedResources(kernelName, &device, &res)) == hipSuccess) {
+        potentialBlockSize(device->_props, res, dynSharedMemPerBlk, blockSizeLimit, gridSize, blockSize);
+    }
+
+    return ihipLogStatus(e);
+}
@@ -101,8 +101,8 @@ hipError_t ihipDisablePeerAccess (hipCtx_t peerCtx)
             if (changed) {
                 tprintf(DB_MEM, "device %s disable access to memory allocated on peer:%s\n", 
                                   thisCtx->toString().c_str(), peerCtx->toString().c_str()); 
-                // Update the peers for all memory already saved in the tracker:
-                am_memtracker_update_peers(peerCtx->getDevice()->_acc, peerCrit->peerCnt(), peerCrit->peerAgents());
+                // Existing allocations are remapped in the background:
+                peerCtx->getDevice()->_peerMapper->update(peerCrit->peerCnt(), peerCrit->peerAgents(), peerCrit->peerGeneration());
             } else {
                 err = hipErrorPeerAccessNotEnabled; // never enabled P2P access.
             }
@@ -135,7 +135,8 @@ hipError_t ihipEnablePeerAccess (hipCtx_t peerCtx, unsigned int flags)
             if (isNewPeer) {
                 tprintf(DB_MEM, "device=%s can now see all memory allocated on peer=%s\n", 
                                   thisCtx->toString().c_str(), peerCtx->toString().c_str()); 
-                am_memtracker_update_peers(peerCtx->getDevice()->_acc, peerCrit->peerCnt(), peerCrit->peerAgents());
+                // Existing allocations are remapped in the background, or on first use by a copy:
+                peerCtx->getDevice()->_peerMapper->update(peerCrit->peerCnt(), peerCrit->peerAgents(), peerCrit->peerGeneration());
             } else {
                 err = hipErrorPeerAccessAlreadyEnabled;
             }
@@ -148,14 +149,44 @@ hipError_t ihipEnablePeerAccess (hipCtx_t peerCtx, unsigned int flags)
 }
 
 
+//---
+// Peer copies use the peer copy engine of the destination device.  See hip_peer_copy.cpp.
+hipError_t ihipMemcpyPeer (void* dst, hipCtx_t dstCtx, const void* src, hipCtx_t srcCtx, size_t sizeBytes, hipStream_t stream, bool isAsync)
+{
+    hipError_t e = hipSuccess;
+
+    if ((dst == NULL) || (src == NULL)) {
+        return hipErrorInvalidValue;
+    }
+    if ((dstCtx == NULL) || (srcCtx == NULL)) {
+        return hipErrorInvalidDevice;
+    }
+
+    stream = ihipSyncAndResolveStream(stream);
+    if (stream == nullptr) {
+        return hipErrorInvalidValue;
+    }
+
+    try {
+        stream->locked_copyPeerAsync(dst, dstCtx, src, srcCtx, sizeBytes);
+        if (!isAsync) {
+            stream->locked_wait();
+        }
+    }
+    catch (ihipException ex) {
+        e = ex._code;
+    }
+
+    return e;
+}
+
+
 //---
 hipError_t hipMemcpyPeer (void* dst, hipCtx_t dstCtx, const void* src, hipCtx_t srcCtx, size_t sizeBytes)
 {
     HIP_INIT_API(dst, dstCtx, src, srcCtx, sizeBytes);
 
-    // TODO - move to ihip memory copy implementaion.
-    // HCC has a unified memory architecture so device specifiers are not required.
-    return ihipLogStatus(hipMemcpy(dst, src, sizeBytes, hipMemcpyDefault));
+    return ihipLogStatus(ihipMemcpyPeer(dst, dstCtx, src, srcCtx, sizeBytes, hipStreamNull, false));
 };
 
 
@@ -164,9 +195,7 @@ hipError_t hipMemcpyPeerAsync (void* dst, hipCtx_t dstDevice, const void* src, h
 {
     HIP_INIT_API(dst, dstDevice, src, srcDevice, sizeBytes, stream);
 
-    // TODO - move to ihip memory copy implementaion.
-    // HCC has a unified memory architecture so device specifiers are not required.
-    return ihipLogStatus(hip_internal::memcpyAsync(dst, src, sizeBytes, hipMemcpyDefault, stream));
+    return ihipLogStatus(ihipMemcpyPeer(dst, dstDevice, src, srcDevice, sizeBytes, stream, true));
 };
 
 
@@ -202,14 +231,14 @@ hipError_t hipDeviceEnablePeerAccess (int peerDeviceId, unsigned int flags)
 hipError_t hipMemcpyPeer (void* dst, int  dstDevice, const void* src, int  srcDevice, size_t sizeBytes)
 {
     HIP_INIT_API(dst, dstDevice, src, srcDevice, sizeBytes);
-    return ihipLogStatus(hipMemcpyPeer(dst, ihipGetPrimaryCtx(dstDevice), src, ihipGetPrimaryCtx(srcDevice), sizeBytes));
+    return ihipLogStatus(ihipMemcpyPeer(dst, ihipGetPrimaryCtx(dstDevice), src, ihipGetPrimaryCtx(srcDevice), sizeBytes, hipStreamNull, false));
 }
 
 
 hipError_t hipMemcpyPeerAsync (void* dst, int  dstDevice, const void* src, int  srcDevice, size_t sizeBytes, hipStream_t stream)
 {
     HIP_INIT_API(dst, dstDevice, src, srcDevice, sizeBytes, stream);
-    return ihipLogStatus(hip_internal::memcpyAsync(dst, src, sizeBytes, hipMemcpyDefault, stream));
+    return ihipLogStatus(ihipMemcpyPeer(dst, ihipGetPrimaryCtx(dstDevice), src, ihipGetPrimaryCtx(srcDevice), sizeBytes, stream, true));
 }
 
 hipError_t hipCtxEnablePeerAccess (hipCtx_t peerCtx, unsigned int flags)
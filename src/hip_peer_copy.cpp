@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file hip_peer_copy.cpp
+ *
+ * Copies between device memory on two devices (hipMemcpyPeer / hipMemcpyPeerAsync):
+ *   - direct: one SDMA copy by a device which can see both buffers.  The source device is preferred.
+ *   - split:  copies of HIP_PEER_SPLIT_THRESHOLD MB or more, where both devices can see both buffers, are split in
+ *             two halves.  The halves run at the same time on the DMA engines of the two devices.
+ *   - staged: when neither device can see the other's memory (or HIP_FORCE_P2P_HOST&0x1), chunks go through two
+ *             pinned bounce buffers.  The source device copies chunk i+1 to the host while the destination device
+ *             copies chunk i from the host.
+ * All ordering is between device queues, so the calling thread only enqueues commands and never waits.
+ *
+ * The destination side of split and staged copies runs on one of PEER_COPY_QUEUES extra views of the destination
+ * device, picked by the id of the source stream.  Each view has its own lock and bounce buffers, so copies from
+ * different streams do not serialize behind one queue.
+ */
+
+#include <algorithm>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+//=================================================================================================
+// ihipPeerCopyEngine_t:
+//=================================================================================================
+// Extra views per destination device.  Streams beyond this share them round-robin.
+static const int PEER_COPY_QUEUES = 4;
+
+
+struct ihipPeerCopyEngine_t::Queue {
+    std::once_flag                      _initOnce;
+    std::mutex                          _mutex;
+    hc::accelerator_view               *_av;
+    std::vector<ihipStagingBuffer_t*>   _buffers;     // _dmaFuture is the last H2D out of the buffer.
+
+    Queue() : _av(nullptr) {};
+};
+
+
+ihipPeerCopyEngine_t::ihipPeerCopyEngine_t(ihipDevice_t *device, size_t bufferSize) :
+    _device(device),
+    _bufferSize(bufferSize)
+{
+    for (int i=0; i<PEER_COPY_QUEUES; i++) {
+        _queues.push_back(new Queue);
+    }
+}
+
+
+ihipPeerCopyEngine_t::~ihipPeerCopyEngine_t()
+{
+    for (auto q : _queues) {
+        for (auto b : q->_buffers) {
+            if (b->_dmaFuture.valid()) {
+                b->_dmaFuture.wait();
+            }
+            ihipHostFreePinned(b->_ptr);
+            delete b;
+        }
+        delete q->_av;
+        delete q;
+    }
+}
+
+
+// Create the queue's view and its bounce buffers.  Buffers are visible to all devices since any device may be the source.
+void ihipPeerCopyEngine_t::initQueue(Queue *q)
+{
+    q->_av = new hc::accelerator_view(_device->_acc.create_view());
+
+    std::vector<hsa_agent_t> agents;
+    for (unsigned i=0; i<g_deviceCnt; i++) {
+        agents.push_back(ihipGetDevice(i)->_hsaAgent);
+    }
+
+    for (int i=0; i<2 && _bufferSize; i++) {
+        void *p = ihipHostAllocPinned(_device, _bufferSize);
+        if (p == nullptr) {
+            break;
+        }
+        if (agents.size() > 1) {
+            hsa_status_t status = hsa_amd_agents_allow_access(agents.size(), agents.data(), NULL, p);
+            if (status != HSA_STATUS_SUCCESS) {
+                tprintf(DB_COPY, "peer copy engine dev:%d could not share bounce buffer with all devices, status=%d\n",
+                        _device->_deviceId, status);
+                ihipHostFreePinned(p);
+                break;
+            }
+        }
+
+        hc::accelerator acc;
+        hc::AmPointerInfo ptrInfo(NULL, NULL, 0, acc, 0, 0);
+        if (hc::am_memtracker_getinfo(&ptrInfo, p) != AM_SUCCESS) {
+            ihipHostFreePinned(p);
+            break;
+        }
+        q->_buffers.push_back(new ihipStagingBuffer_t(p, ptrInfo));
+    }
+
+    tprintf(DB_COPY, "peer copy engine dev:%d queue %p allocated %zu bounce buffers of %zu bytes\n",
+            _device->_deviceId, q, q->_buffers.size(), _bufferSize);
+}
+
+
+ihipPeerCopyEngine_t::Queue *ihipPeerCopyEngine_t::queueFor(uint64_t streamId)
+{
+    Queue *q = _queues[streamId % _queues.size()];
+    std::call_once(q->_initOnce, &ihipPeerCopyEngine_t::initQueue, this, q);
+    return q;
+}
+
+
+void ihipPeerCopyEngine_t::stagedCopy(hc::accelerator_view &av, uint64_t streamId, void *dst, const hc::AmPointerInfo &dstPtrInfo,
+                                      const void *src, const hc::AmPointerInfo &srcPtrInfo, ihipDevice_t *srcDevice, size_t sizeBytes)
+{
+    Queue *q = queueFor(streamId);
+
+    if (q->_buffers.empty()) {
+        throw ihipException(hipErrorMemoryAllocation);
+    }
+
+    std::lock_guard<std::mutex> l(q->_mutex);
+
+    tprintf(DB_COPY, "peer stagedCopy dev:%d->dev:%d dst=%p src=%p sz=%zu chunk=%zu buffers=%zu\n",
+            srcDevice->_deviceId, _device->_deviceId, dst, src, sizeBytes, _bufferSize, q->_buffers.size());
+
+    ihipStagingBuffer_t *last = nullptr;
+    size_t i = 0;
+    for (size_t offset = 0; offset < sizeBytes; offset += _bufferSize, i++) {
+        const size_t thisChunk = std::min(_bufferSize, sizeBytes - offset);
+        ihipStagingBuffer_t *b = q->_buffers[i % q->_buffers.size()];
+
+        try {
+            // The buffer is free once the previous H2D out of it (from this or an earlier copy) has completed:
+            if (b->_dmaFuture.valid()) {
+                av.create_blocking_marker(b->_dmaFuture);
+            }
+            hc::completion_future d2h = av.copy_async_ext(static_cast<const char*>(src) + offset, b->_ptr, thisChunk,
+                                                          hc::hcMemcpyDeviceToHost, srcPtrInfo, b->_ptrInfo, &srcDevice->_acc);
+
+            q->_av->create_blocking_marker(d2h);
+            b->_dmaFuture = q->_av->copy_async_ext(b->_ptr, static_cast<char*>(dst) + offset, thisChunk,
+                                                   hc::hcMemcpyHostToDevice, b->_ptrInfo, dstPtrInfo, &_device->_acc);
+        } catch (Kalmar::runtime_exception) {
+            throw ihipException(hipErrorRuntimeOther);
+        };
+        last = b;
+    }
+
+    // Later commands in the stream wait for the last H2D.  H2Ds complete in order on the queue, so this covers all of them.
+    if (last) {
+        av.create_blocking_marker(last->_dmaFuture);
+    }
+}
+
+
+void ihipPeerCopyEngine_t::splitCopy(hc::accelerator_view &av, uint64_t streamId, void *dst, const hc::AmPointerInfo &dstPtrInfo,
+                                     const void *src, const hc::AmPointerInfo &srcPtrInfo, ihipDevice_t *srcDevice, size_t sizeBytes)
+{
+    Queue *q = queueFor(streamId);
+
+    std::lock_guard<std::mutex> l(q->_mutex);
+
+    // Keep both halves page aligned:
+    const size_t firstHalf = ((sizeBytes / 2) + 4095) & ~size_t(4095);
+
+    tprintf(DB_COPY, "peer splitCopy dev:%d->dev:%d dst=%p src=%p sz=%zu first=%zu\n",
+            srcDevice->_deviceId, _device->_deviceId, dst, src, sizeBytes, firstHalf);
+
+    try {
+        // Second half starts after all prior work in the stream:
+        q->_av->create_blocking_marker(av.create_marker());
+        hc::completion_future second = q->_av->copy_async_ext(static_cast<const char*>(src) + firstHalf, static_cast<char*>(dst) + firstHalf,
+                                                              sizeBytes - firstHalf, hc::hcMemcpyDeviceToDevice,
+                                                              srcPtrInfo, dstPtrInfo, &_device->_acc);
+
+        av.copy_async_ext(src, dst, firstHalf, hc::hcMemcpyDeviceToDevice, srcPtrInfo, dstPtrInfo, &srcDevice->_acc);
+        av.create_blocking_marker(second);
+    } catch (Kalmar::runtime_exception) {
+        throw ihipException(hipErrorRuntimeOther);
+    };
+}
+
+
+
+//=================================================================================================
+// ihipStream_t peer copies:
+//=================================================================================================
+void ihipStream_t::locked_copyPeerAsync(void* dst, ihipCtx_t *dstCtx, const void* src, ihipCtx_t *srcCtx, size_t sizeBytes)
+{
+    if ((dstCtx == nullptr) || (srcCtx == nullptr)) {
+        throw ihipException(hipErrorInvalidDevice);
+    }
+
+    hc::accelerator acc;
+    hc::AmPointerInfo dstPtrInfo(NULL, NULL, 0, acc, 0, 0);
+    hc::AmPointerInfo srcPtrInfo(NULL, NULL, 0, acc, 0, 0);
+    bool dstTracked = (hc::am_memtracker_getinfo(&dstPtrInfo, dst) == AM_SUCCESS);
+    bool srcTracked = (hc::am_memtracker_getinfo(&srcPtrInfo, src) == AM_SUCCESS);
+
+    // Anything other than device memory on two different devices is an ordinary copy:
+    if ((dstCtx == srcCtx) || !dstTracked || !srcTracked || !dstPtrInfo._isInDeviceMem || !srcPtrInfo._isInDeviceMem) {
+        tprintf(DB_COPY, "copyPeerAsync dst=%p src=%p sz=%zu is not a peer copy, using copyAsync\n", dst, src, sizeBytes);
+        locked_copyAsync(dst, src, sizeBytes, hipMemcpyDefault);
+        return;
+    }
+
+    ihipDevice_t *dstDevice = dstCtx->getWriteableDevice();
+    ihipDevice_t *srcDevice = srcCtx->getWriteableDevice();
+
+    const bool srcSees = canSeeMemory(srcCtx, &dstPtrInfo, &srcPtrInfo);
+    const bool dstSees = canSeeMemory(dstCtx, &dstPtrInfo, &srcPtrInfo);
+    const bool forceStaged = (HIP_FORCE_P2P_HOST & 0x1);
+
+    if (srcSees || dstSees) {
+        ensurePeerMapped(&dstPtrInfo, &srcPtrInfo);
+    }
+
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+
+    if (forceStaged || (!srcSees && !dstSees)) {
+        dstDevice->_peerCopyEngine->stagedCopy(crit->_av, _id, dst, dstPtrInfo, src, srcPtrInfo, srcDevice, sizeBytes);
+
+    } else if (srcSees && dstSees && HIP_PEER_SPLIT_THRESHOLD && (sizeBytes >= size_t(HIP_PEER_SPLIT_THRESHOLD)*1024*1024)) {
+        dstDevice->_peerCopyEngine->splitCopy(crit->_av, _id, dst, dstPtrInfo, src, srcPtrInfo, srcDevice, sizeBytes);
+
+    } else {
+        ihipDevice_t *copyDevice = srcSees ? srcDevice : dstDevice;
+        tprintf(DB_COPY, "copyPeerAsync direct dev:%d->dev:%d on dev:%d engine dst=%p src=%p sz=%zu\n",
+                srcDevice->_deviceId, dstDevice->_deviceId, copyDevice->_deviceId, dst, src, sizeBytes);
+        try {
+            crit->_av.copy_async_ext(src, dst, sizeBytes, hc::hcMemcpyDeviceToDevice, srcPtrInfo, dstPtrInfo, &copyDevice->_acc);
+        } catch (Kalmar::runtime_exception) {
+            throw ihipException(hipErrorRuntimeOther);
+        };
+    }
+
+    if (HIP_API_BLOCKING) {
+        tprintf(DB_SYNC, "%s LAUNCH_BLOCKING for completion of hipMemcpyPeerAsync(sz=%zu)\n", ToString(this).c_str(), sizeBytes);
+        this->wait(crit);
+    }
+}
@@ -0,0 +1,226 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file hip_peer_map.cpp
+ *
+ * Incremental peer mapping.  Enabling or disabling peer access used to re-grant access to every live allocation on
+ * the peer device (am_memtracker_update_peers) while holding the peer context lock.  Now each device keeps a table
+ * of its allocations, each tagged with the generation of the peer set it was mapped to:
+ *   - hipDeviceEnablePeerAccess / hipDeviceDisablePeerAccess publish the new peer set and generation, and return.
+ *   - A worker thread walks the table and remaps stale allocations.  hsa_amd_agents_allow_access is always called
+ *     with the table lock dropped; the allocation is marked busy meanwhile so hipFree waits for it.
+ *   - Copies which use peer access call ensureMapped() and map their buffers on first touch.
+ *   - Kernel launches wait for pending remaps (ihipWaitPeerMappers), since kernel arguments are opaque.  The check is
+ *     a lock-free comparison of the published and mapped generations, so idle mappers cost nothing.
+ */
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+std::atomic<int> g_peerMapPending(0);
+
+
+void ihipWaitPeerMappers()
+{
+    for (unsigned i=0; i<g_deviceCnt; i++) {
+        ihipPeerMapper_t *mapper = ihipGetDevice(i)->_peerMapper;
+        if (!mapper->idle()) {
+            mapper->waitIdle();
+        }
+    }
+}
+
+
+//=================================================================================================
+// ihipPeerMapper_t:
+//=================================================================================================
+ihipPeerMapper_t::ihipPeerMapper_t(ihipDevice_t *device) :
+    _device(device),
+    _generation(0),
+    _pending(false),
+    _publishedGeneration(0),
+    _mappedGeneration(0),
+    _shutdown(false)
+{
+}
+
+
+ihipPeerMapper_t::~ihipPeerMapper_t()
+{
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _shutdown = true;
+    }
+    _workReady.notify_all();
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+
+void ihipPeerMapper_t::add(void *ptr, size_t sizeBytes, uint64_t generation)
+{
+    std::unique_lock<std::mutex> l(_mutex);
+    _allocs[ptr] = Alloc{sizeBytes, generation};
+
+    // Peer set changed after the caller mapped the allocation, and the worker may already have passed it:
+    if (generation < _generation) {
+        mapUnlocked(l, ptr);
+    }
+}
+
+
+void ihipPeerMapper_t::remove(void *ptr)
+{
+    std::unique_lock<std::mutex> l(_mutex);
+
+    // Access to this allocation may be being granted right now - don't let it be freed underneath.
+    _stateChanged.wait(l, [&]{ return _busy.count(ptr) == 0; });
+    _allocs.erase(ptr);
+}
+
+
+void ihipPeerMapper_t::update(uint32_t peerCnt, const hsa_agent_t *peerAgents, uint64_t generation)
+{
+    std::call_once(_startOnce, [this] { _worker = std::thread(&ihipPeerMapper_t::workerLoop, this); });
+
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _agents.assign(peerAgents, peerAgents + peerCnt);
+        _generation = generation;
+        _publishedGeneration.store(generation, std::memory_order_release);
+        if (!_pending) {
+            _pending = true;
+            g_peerMapPending++;
+        }
+    }
+    _workReady.notify_one();
+
+    tprintf(DB_MEM, "peer mapper dev:%d new peer set generation:%lu peers:%u\n", _device->_deviceId, generation, peerCnt);
+}
+
+
+// Grant the current peer set access to ptr.  Caller holds _mutex through l; it is dropped around
+// hsa_amd_agents_allow_access, which may take a while, and ptr is marked busy meanwhile so it can't be freed.
+void ihipPeerMapper_t::mapUnlocked(std::unique_lock<std::mutex> &l, void *ptr)
+{
+    std::vector<hsa_agent_t> agents = _agents;
+    const uint64_t generation = _generation;
+    _busy.insert(ptr);
+    l.unlock();
+
+    hsa_status_t e = hsa_amd_agents_allow_access(agents.size(), agents.data(), NULL, ptr);
+    if (e != HSA_STATUS_SUCCESS) {
+        tprintf(DB_MEM, "peer mapper dev:%d allow_access failed for ptr:%p\n", _device->_deviceId, ptr);
+    }
+
+    l.lock();
+    _busy.erase(ptr);
+    auto it = _allocs.find(ptr);
+    if ((it != _allocs.end()) && (it->second._generation < generation)) {
+        it->second._generation = generation;
+    }
+    _stateChanged.notify_all();
+}
+
+
+void ihipPeerMapper_t::ensureMapped(const hc::AmPointerInfo &ptrInfo)
+{
+    if ((g_peerMapPending.load(std::memory_order_acquire) == 0) || idle()) {
+        return;
+    }
+
+    void *base = ptrInfo._isInDeviceMem ? ptrInfo._devicePointer : ptrInfo._hostPointer;
+
+    std::unique_lock<std::mutex> l(_mutex);
+    _stateChanged.wait(l, [&]{ return _busy.count(base) == 0; });
+
+    auto it = _allocs.find(base);
+    if ((it != _allocs.end()) && (it->second._generation < _generation)) {
+        tprintf(DB_MEM, "peer mapper dev:%d map on first touch ptr:%p\n", _device->_deviceId, base);
+        mapUnlocked(l, base);
+    }
+}
+
+
+void ihipPeerMapper_t::waitIdle()
+{
+    if (idle()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> l(_mutex);
+    _stateChanged.wait(l, [this]{ return !_pending; });
+}
+
+
+void ihipPeerMapper_t::workerLoop()
+{
+    std::unique_lock<std::mutex> l(_mutex);
+
+    while (1) {
+        _workReady.wait(l, [this]{ return _shutdown || _pending; });
+        if (_shutdown) {
+            return;
+        }
+
+        const uint64_t targetGeneration = _generation;
+
+        // Snapshot the stale allocations, then remap them one at a time so allocations and frees can interleave.
+        std::vector<void*> stale;
+        for (auto &a : _allocs) {
+            if (a.second._generation < targetGeneration) {
+                stale.push_back(a.first);
+            }
+        }
+
+        for (auto ptr : stale) {
+            // Someone else may be mapping it on first touch - wait for them, then re-check.
+            _stateChanged.wait(l, [&]{ return _busy.count(ptr) == 0; });
+
+            auto it = _allocs.find(ptr);
+            if ((it == _allocs.end()) || (it->second._generation >= _generation)) {
+                continue;  // freed, or mapped on first touch meanwhile.
+            }
+
+            mapUnlocked(l, ptr);
+        }
+
+        tprintf(DB_MEM, "peer mapper dev:%d remapped %zu allocations to generation:%lu\n",
+                _device->_deviceId, stale.size(), targetGeneration);
+
+        // Another update may have arrived while the lock was dropped - go round again if so.
+        if (_generation == targetGeneration) {
+            _pending = false;
+            _mappedGeneration.store(targetGeneration, std::memory_order_release);
+            g_peerMapPending--;
+            _stateChanged.notify_all();
+        }
+    }
+}
@@ -0,0 +1,475 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file hip_pin_cache.cpp
+ *
+ * Pin-on-demand cache for pageable host ranges which are copied repeatedly (HIP_PIN_CACHE).
+ *
+ * Each copy from/to pageable memory is counted against its page-aligned range.  Once a range has been seen
+ * HIP_PIN_CACHE_HITS times it is pinned for all devices with am_memory_host_lock, exactly as hipHostRegister
+ * would do.  From then on the memtracker knows the range and copies take the DMA fast path.
+ *
+ * A pinned range keeps the physical pages it had when it was pinned.  If the application frees or unmaps it and
+ * the address is reused, the CPU would see new pages while DMAs still used the old ones.  The library therefore
+ * interposes the calls which can hand pages back to the OS (free, realloc, munmap, mremap and madvise) and drops
+ * any cache entry they touch before forwarding the call.  free has to be hooked because glibc releases its
+ * mmapped chunks with an internal munmap which cannot be interposed.  The hooks cost a relaxed load when the
+ * cache is empty.
+ *
+ * hipHostUnregister on a cached range drops the cache entry.  hipHostRegister on a cached range drops the cache
+ * entry and registers the range as the application asked, instead of failing with
+ * hipErrorHostMemoryAlreadyRegistered.
+ */
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+// Smaller ranges are cheaper to stage than to pin.
+static const size_t PIN_CACHE_MIN_BYTES = 64*1024;
+
+// Bound on the number of not-yet-hot ranges we remember.
+static const size_t PIN_CACHE_MAX_CANDIDATES = 256;
+
+static const uintptr_t PAGE_MASK = 4096-1;
+
+
+struct ihipPinCache_t::Entry {
+    uintptr_t                           _base;
+    size_t                              _sizeBytes;
+    int                                 _refCnt;   // copies currently holding a Ref to this entry.
+    uint64_t                            _lastUse;
+    std::vector<hc::completion_future>  _pending;  // async DMAs which may still access the range.
+};
+
+
+ihipPinCache_t g_pinCache;
+
+
+// Non-zero while this thread is inside the cache or holds a Ref.  The hooks do nothing then: the frees come from
+// HIP or the runtime below it, and taking _mutex or waiting for the Ref to be released would deadlock.
+static thread_local int t_pinCacheDepth = 0;
+
+struct PinCacheScope {
+    PinCacheScope()  { t_pinCacheDepth++; };
+    ~PinCacheScope() { t_pinCacheDepth--; };
+};
+
+
+//---
+ihipPinCache_t::Ref::~Ref()
+{
+    if (_entry) {
+        g_pinCache.release(_entry, _pending);
+    }
+}
+
+
+//---
+ihipPinCache_t::ihipPinCache_t() :
+    _pinnedBytes(0),
+    _clock(0),
+    _minBase(0),
+    _maxEnd(0)
+{
+}
+
+
+ihipPinCache_t::~ihipPinCache_t()
+{
+    // Hooks may still run during static destruction - make them skip the cache.
+    _maxEnd.store(0, std::memory_order_relaxed);
+}
+
+
+bool ihipPinCache_t::acquire(const void *ptr, size_t sizeBytes, bool tracked, Ref *ref)
+{
+    std::vector<Entry*> victims;
+    bool covered;
+    {
+        PinCacheScope scope;
+        std::lock_guard<std::mutex> l(_mutex);
+        covered = acquireLocked(reinterpret_cast<uintptr_t>(ptr), sizeBytes, tracked, ref, &victims);
+    }
+
+    // Evicted entries wait for their DMAs, so unpin them after dropping the lock.
+    for (Entry *e : victims) {
+        unpin(e);
+    }
+
+    return covered;
+}
+
+
+bool ihipPinCache_t::acquireLocked(uintptr_t start, size_t sizeBytes, bool tracked, Ref *ref, std::vector<Entry*> *victims)
+{
+    const uintptr_t end = start + sizeBytes;
+
+    _clock++;
+
+    // Find the last entry starting at or before ptr and check it covers the whole range:
+    auto i = _entries.upper_bound(start);
+    if (i != _entries.begin()) {
+        Entry *e = (--i)->second;
+        if ((start >= e->_base) && (end <= e->_base + e->_sizeBytes)) {
+            e->_refCnt++;
+            e->_lastUse = _clock;
+            ref->_entry = e;
+            t_pinCacheDepth++;
+            return true;
+        }
+    }
+
+    if (tracked || (sizeBytes < PIN_CACHE_MIN_BYTES)) {
+        // Registered by the app or allocated by HIP - not ours to pin.
+        return false;
+    }
+
+    // Count another hit on this range:
+    const uintptr_t alignedStart = start & ~PAGE_MASK;
+    const size_t    alignedSize  = ((end + PAGE_MASK) & ~PAGE_MASK) - alignedStart;
+    auto c = _candidates.find(alignedStart);
+    if (c == _candidates.end()) {
+        if (_candidates.size() >= PIN_CACHE_MAX_CANDIDATES) {
+            _candidates.erase(_candidates.begin());
+        }
+        c = _candidates.insert(std::make_pair(alignedStart, std::make_pair(alignedSize, 0))).first;
+    }
+    c->second.first = std::max(c->second.first, alignedSize);
+    if (++c->second.second < HIP_PIN_CACHE_HITS) {
+        return false;
+    }
+
+    // Hot - pin the largest range seen at this address, if it fits in the budget and does not overlap an entry.
+    const size_t pinSize = c->second.first;
+    _candidates.erase(c);
+
+    auto next = _entries.lower_bound(alignedStart);
+    if ((next != _entries.end()) && (next->first < alignedStart + pinSize)) {
+        return false;
+    }
+    if ((next != _entries.begin()) && ((--next)->first + next->second->_sizeBytes > alignedStart)) {
+        return false;
+    }
+    if (!makeRoom(pinSize, victims)) {
+        return false;
+    }
+
+    std::vector<hc::accelerator> vecAcc;
+    for (int d=0; d<g_deviceCnt; d++) {
+        vecAcc.push_back(ihipGetDevice(d)->_acc);
+    }
+    am_status_t am_status = hc::am_memory_host_lock(vecAcc[0], reinterpret_cast<void*>(alignedStart), pinSize, &vecAcc[0], vecAcc.size());
+    if (am_status != AM_SUCCESS) {
+        tprintf(DB_MEM, "pin cache: failed to pin %p+%zu\n", reinterpret_cast<void*>(alignedStart), pinSize);
+        return false;
+    }
+
+    Entry *e = new Entry;
+    e->_base      = alignedStart;
+    e->_sizeBytes = pinSize;
+    e->_refCnt    = 1;
+    e->_lastUse   = _clock;
+    _entries[alignedStart] = e;
+    _pinnedBytes += pinSize;
+    updateBounds();
+    ref->_entry = e;
+    t_pinCacheDepth++;
+
+    tprintf(DB_MEM, "pin cache: pinned hot range %p+%zu (cache now %zu bytes in %zu ranges)\n",
+            reinterpret_cast<void*>(alignedStart), pinSize, _pinnedBytes, _entries.size());
+
+    return true;
+}
+
+
+// Publish the span of the pinned ranges for the hooks.  Called with _mutex held.
+void ihipPinCache_t::updateBounds()
+{
+    if (_entries.empty()) {
+        _maxEnd.store(0, std::memory_order_relaxed);
+        _minBase.store(0, std::memory_order_relaxed);
+    } else {
+        auto last = _entries.rbegin();
+        _minBase.store(_entries.begin()->first, std::memory_order_relaxed);
+        _maxEnd.store(last->first + last->second->_sizeBytes, std::memory_order_relaxed);
+    }
+}
+
+
+// Remove entry i from the cache.  The caller unpins it once it is unreferenced and _mutex is released.
+ihipPinCache_t::Entry *ihipPinCache_t::detachLocked(std::map<uintptr_t, Entry*>::iterator i)
+{
+    Entry *e = i->second;
+    _entries.erase(i);
+    _pinnedBytes -= e->_sizeBytes;
+    updateBounds();
+    return e;
+}
+
+
+// Called without _mutex, on an entry which has been detached and is no longer referenced.
+void ihipPinCache_t::unpin(Entry *e)
+{
+    PinCacheScope scope;
+
+    for (auto &f : e->_pending) {
+        f.wait();
+    }
+    hc::am_memory_host_unlock(ihipGetDevice(0)->_acc, reinterpret_cast<void*>(e->_base));
+
+    tprintf(DB_MEM, "pin cache: unpinned %p+%zu\n", reinterpret_cast<void*>(e->_base), e->_sizeBytes);
+    delete e;
+}
+
+
+// Evict least-recently used, unreferenced entries until sizeBytes fits in the budget.  Called with _mutex held;
+// the evicted entries are returned in victims for the caller to unpin.
+bool ihipPinCache_t::makeRoom(size_t sizeBytes, std::vector<Entry*> *victims)
+{
+    const size_t budget = size_t(HIP_PIN_CACHE) * 1024 * 1024;
+    if (sizeBytes > budget) {
+        return false;
+    }
+
+    while (_pinnedBytes + sizeBytes > budget) {
+        auto victim = _entries.end();
+        for (auto i = _entries.begin(); i != _entries.end(); i++) {
+            if ((i->second->_refCnt == 0) &&
+                ((victim == _entries.end()) || (i->second->_lastUse < victim->second->_lastUse))) {
+                victim = i;
+            }
+        }
+        if (victim == _entries.end()) {
+            return false; // everything is in use.
+        }
+
+        victims->push_back(detachLocked(victim));
+    }
+
+    return true;
+}
+
+
+void ihipPinCache_t::release(Entry *e, const hc::completion_future &pending)
+{
+    PinCacheScope scope;
+    std::lock_guard<std::mutex> l(_mutex);
+
+    // Drop DMAs which have finished, then remember the new one:
+    e->_pending.erase(std::remove_if(e->_pending.begin(), e->_pending.end(),
+                                     [](const hc::completion_future &f) { return f.is_ready(); }),
+                      e->_pending.end());
+    if (pending.valid()) {
+        e->_pending.push_back(pending);
+    }
+
+    assert(e->_refCnt > 0);
+    if (--e->_refCnt == 0) {
+        _released.notify_all();
+    }
+    t_pinCacheDepth--;
+}
+
+
+bool ihipPinCache_t::remove(const void *ptr)
+{
+    PinCacheScope scope;
+    Entry *e;
+    {
+        std::unique_lock<std::mutex> l(_mutex);
+
+        // Entries are page-aligned, so find the one containing ptr:
+        const uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+        auto i = _entries.upper_bound(start);
+        if (i == _entries.begin()) {
+            return false;
+        }
+        if (start >= std::prev(i)->first + std::prev(i)->second->_sizeBytes) {
+            return false;
+        }
+        e = detachLocked(std::prev(i));
+
+        // Let copies which still hold a Ref release it before the entry is deleted.
+        // Refs are only held while a copy command is submitted, so the wait is short.
+        _released.wait(l, [e] { return e->_refCnt == 0; });
+    }
+
+    unpin(e);
+
+    return true;
+}
+
+
+void ihipPinCache_t::invalidate(uintptr_t start, uintptr_t end)
+{
+    if (t_pinCacheDepth || !mayOverlap(start, end)) {
+        return;
+    }
+
+    PinCacheScope scope;
+    std::vector<Entry*> dropped;
+    {
+        std::unique_lock<std::mutex> l(_mutex);
+
+        auto i = _entries.upper_bound(start);
+        if (i != _entries.begin() && (std::prev(i)->first + std::prev(i)->second->_sizeBytes > start)) {
+            i--;
+        }
+        while ((i != _entries.end()) && (i->first < end)) {
+            auto next = std::next(i);
+            dropped.push_back(detachLocked(i));
+            i = next;
+        }
+        for (Entry *e : dropped) {
+            _released.wait(l, [e] { return e->_refCnt == 0; });
+        }
+    }
+
+    for (Entry *e : dropped) {
+        tprintf(DB_MEM, "pin cache: %p+%zu is being released by the application\n",
+                reinterpret_cast<void*>(e->_base), e->_sizeBytes);
+        unpin(e);
+    }
+}
+
+
+//=================================================================================================
+// Hooks on the calls which release pages.
+//=================================================================================================
+extern "C" void __libc_free(void *ptr);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+typedef void  (*ihipFreeFn_t)(void *);
+typedef void *(*ihipReallocFn_t)(void *, size_t);
+
+static std::atomic<ihipFreeFn_t>    s_nextFree(nullptr);
+static std::atomic<ihipReallocFn_t> s_nextRealloc(nullptr);
+static thread_local bool            t_resolving = false;
+
+
+// Look up the allocator's definition of name.  dlsym may itself free memory, so recursive calls get the glibc
+// entry point instead.
+template <typename T>
+static T nextAllocFn(std::atomic<T> &slot, const char *name, T fallback)
+{
+    T fn = slot.load(std::memory_order_acquire);
+    if (fn == nullptr) {
+        if (t_resolving) {
+            return fallback;
+        }
+        t_resolving = true;
+        fn = reinterpret_cast<T>(dlsym(RTLD_NEXT, name));
+        t_resolving = false;
+        if (fn == nullptr) {
+            fn = fallback;
+        }
+        slot.store(fn, std::memory_order_release);
+    }
+    return fn;
+}
+
+
+// Only whole pages of a freed block can go back to the OS.
+static void invalidateHeapBlock(void *ptr)
+{
+    if (ptr && g_pinCache.mayOverlap(reinterpret_cast<uintptr_t>(ptr), UINTPTR_MAX)) {
+        const uintptr_t start = (reinterpret_cast<uintptr_t>(ptr) + PAGE_MASK) & ~PAGE_MASK;
+        const uintptr_t end   = (reinterpret_cast<uintptr_t>(ptr) + malloc_usable_size(ptr)) & ~PAGE_MASK;
+        if (start < end) {
+            g_pinCache.invalidate(start, end);
+        }
+    }
+}
+
+
+static bool releasesPages(int advice)
+{
+    switch (advice) {
+        case MADV_DONTNEED:
+        case MADV_REMOVE:
+#ifdef MADV_FREE
+        case MADV_FREE:
+#endif
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+extern "C" void free(void *ptr) __THROW
+{
+    invalidateHeapBlock(ptr);
+    nextAllocFn(s_nextFree, "free", &__libc_free)(ptr);
+}
+
+
+extern "C" void *realloc(void *ptr, size_t size) __THROW
+{
+    // The block may move or shrink.
+    invalidateHeapBlock(ptr);
+    return nextAllocFn(s_nextRealloc, "realloc", &__libc_realloc)(ptr, size);
+}
+
+
+extern "C" int munmap(void *addr, size_t length) __THROW
+{
+    g_pinCache.invalidate(reinterpret_cast<uintptr_t>(addr), reinterpret_cast<uintptr_t>(addr) + length);
+    return syscall(SYS_munmap, addr, length);
+}
+
+
+extern "C" void *mremap(void *oldAddr, size_t oldSize, size_t newSize, int flags, ...) __THROW
+{
+    void *newAddr = nullptr;
+    if (flags & MREMAP_FIXED) {
+        va_list ap;
+        va_start(ap, flags);
+        newAddr = va_arg(ap, void *);
+        va_end(ap);
+        g_pinCache.invalidate(reinterpret_cast<uintptr_t>(newAddr), reinterpret_cast<uintptr_t>(newAddr) + newSize);
+    }
+    g_pinCache.invalidate(reinterpret_cast<uintptr_t>(oldAddr), reinterpret_cast<uintptr_t>(oldAddr) + oldSize);
+    return reinterpret_cast<void *>(syscall(SYS_mremap, oldAddr, oldSize, newSize, flags, newAddr));
+}
+
+
+extern "C" int madvise(void *addr, size_t length, int advice) __THROW
+{
+    if (releasesPages(advice)) {
+        g_pinCache.invalidate(reinterpret_cast<uintptr_t>(addr), reinterpret_cast<uintptr_t>(addr) + length);
+    }
+    return syscall(SYS_madvise, addr, length, advice);
+}
@@ -0,0 +1,291 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+/**
+ * @file hip_prof_control.cpp
+ *
+ * Runtime start and stop of the built-in recorders: the binary trace (HIP_TRACE_FILE), the timeline
+ * (HIP_TIMELINE_FILE) and kernel statistics (HIP_PROFILE_KERNELS).  The env vars choose which recorders are
+ * set up; this file decides when they record.
+ *
+ * A capture window is started or stopped by:
+ *   - hipProfilerStart / hipProfilerStop.
+ *   - The signal HIP_PROFILE_SIGNAL, which toggles recording.  The handler only counts the signal.  It is
+ *     installed by a library constructor, so a signal which arrives before the first HIP call doesn't kill the
+ *     process; it takes effect once the runtime is initialized.
+ *   - HIP_PROFILE_CONTROL_FILE, whose first word ("start" or "stop") is acted on when it changes.
+ * The signal and the control file are handled by a thread which polls every HIP_PROF_CONTROL_POLL_MS, so the
+ * API path never checks them.
+ *
+ * Recording starts at init unless HIP_PROFILE_START_PAUSED is set.  Once a window has been stopped, each window
+ * is written to numbered files - <HIP_TRACE_FILE>.N and <HIP_TIMELINE_FILE>.N - and kernel statistics are
+ * printed to stderr.  With HIP_PROFILE_MAX_WINDOWS set, the files of older windows are deleted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+#define HIP_PROF_CONTROL_POLL_MS 100
+
+
+static std::mutex   g_profControlMutex;     // protects the fields below
+static bool         g_profRecording = false;
+static bool         g_profWindowed = false; // files are numbered once any window has been stopped
+static int          g_profWindow = 0;       // number of the current (or next) window
+
+static std::atomic<int> g_profSignalCount(0);
+static int              g_profSignalInstalled = 0;  // signal whose handler is installed, or 0
+
+
+static bool ihipProfAnyRecorder()
+{
+    return !HIP_TRACE_FILE.empty() || !HIP_TIMELINE_FILE.empty() || HIP_PROFILE_KERNELS;
+}
+
+
+static std::string ihipProfWindowFile(const std::string &fileName, int window)
+{
+    return fileName + "." + std::to_string(window);
+}
+
+
+static void ihipProfStartLocked()
+{
+    if (!g_profRecording) {
+        g_profRecording = true;
+        ihipTraceStart();
+        ihipTimelineStart();
+        ihipKernelProfStart();
+        if (g_profWindowed && ihipProfAnyRecorder()) {
+            fprintf(stderr, "info: HIP profiling started, window %d\n", g_profWindow);
+        }
+    }
+}
+
+
+static void ihipProfStopLocked()
+{
+    if (g_profRecording) {
+        g_profRecording = false;
+        g_profWindowed = true;
+
+        if (!HIP_TRACE_FILE.empty()) {
+            ihipTraceStop(ihipProfWindowFile(HIP_TRACE_FILE, g_profWindow));
+        }
+        if (!HIP_TIMELINE_FILE.empty()) {
+            ihipTimelineStop(ihipProfWindowFile(HIP_TIMELINE_FILE, g_profWindow));
+        }
+        ihipKernelProfStop();
+        if (ihipProfAnyRecorder()) {
+            fprintf(stderr, "info: HIP profiling stopped, window %d\n", g_profWindow);
+        }
+
+        // Rotate:
+        if ((HIP_PROFILE_MAX_WINDOWS > 0) && (g_profWindow >= HIP_PROFILE_MAX_WINDOWS)) {
+            int oldWindow = g_profWindow - HIP_PROFILE_MAX_WINDOWS;
+            if (!HIP_TRACE_FILE.empty()) {
+                unlink(ihipProfWindowFile(HIP_TRACE_FILE, oldWindow).c_str());
+            }
+            if (!HIP_TIMELINE_FILE.empty()) {
+                unlink(ihipProfWindowFile(HIP_TIMELINE_FILE, oldWindow).c_str());
+            }
+        }
+        g_profWindow++;
+    }
+}
+
+
+//=================================================================================================
+// Signal and control file:
+//=================================================================================================
+static void ihipProfSignalHandler(int)
+{
+    g_profSignalCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+static void ihipProfInstallSignalHandler(int signum)
+{
+    if (g_profSignalInstalled == signum) {
+        return;
+    }
+
+    struct sigaction sa = {}, old = {};
+    sa.sa_handler = ihipProfSignalHandler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(signum, &sa, &old) != 0) {
+        fprintf(stderr, "warning: could not install handler for HIP_PROFILE_SIGNAL=%d\n", signum);
+        return;
+    }
+    g_profSignalInstalled = signum;
+
+    if ((old.sa_flags & SA_SIGINFO) || (old.sa_handler != SIG_DFL)) {
+        fprintf(stderr, "warning: HIP_PROFILE_SIGNAL=%d replaced the application's handler for that signal\n", signum);
+    }
+}
+
+
+// Install the handler when the library is loaded, before the application's first HIP call initializes the
+// runtime.  Env vars set with setenv before the first HIP call are picked up by ihipProfControlInit instead.
+__attribute__((constructor)) static void ihipProfSignalConstructor()
+{
+    const char *env = getenv("HIP_PROFILE_SIGNAL");
+    int signum = env ? atoi(env) : 0;
+    if (signum > 0) {
+        ihipProfInstallSignalHandler(signum);
+    }
+}
+
+
+class ihipProfControlThread_t {
+public:
+    ihipProfControlThread_t() : _stop(false) {};
+    ~ihipProfControlThread_t() { stop(); };
+
+    void start() { _thread = std::thread(&ihipProfControlThread_t::loop, this); };
+    void stop() {
+        if (_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> l(_mutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            _thread.join();
+        }
+    };
+
+private:
+    void loop();
+
+    std::thread                 _thread;
+    std::mutex                  _mutex;
+    std::condition_variable     _wake;
+    bool                        _stop;
+};
+
+static ihipProfControlThread_t g_profControlThread;
+
+
+void ihipProfControlThread_t::loop()
+{
+    int signalsSeen = 0;
+    std::string lastCommand;
+
+    std::unique_lock<std::mutex> l(_mutex);
+    while (!_stop) {
+        _wake.wait_for(l, std::chrono::milliseconds(HIP_PROF_CONTROL_POLL_MS));
+        if (_stop) {
+            break;
+        }
+
+        // Each signal toggles; an even number since the last poll cancels out.
+        int signals = g_profSignalCount.load(std::memory_order_relaxed);
+        if ((signals - signalsSeen) & 1) {
+            std::lock_guard<std::mutex> cl(g_profControlMutex);
+            if (g_profRecording) {
+                ihipProfStopLocked();
+            } else {
+                ihipProfStartLocked();
+            }
+        }
+        signalsSeen = signals;
+
+        if (!HIP_PROFILE_CONTROL_FILE.empty()) {
+            std::ifstream f(HIP_PROFILE_CONTROL_FILE);
+            std::string command;
+            if (f >> command) {
+                if (command != lastCommand) {
+                    std::lock_guard<std::mutex> cl(g_profControlMutex);
+                    if (command == "start") {
+                        ihipProfStartLocked();
+                    } else if (command == "stop") {
+                        ihipProfStopLocked();
+                    } else {
+                        fprintf(stderr, "warning: unknown command '%s' in HIP_PROFILE_CONTROL_FILE=%s, expected start or stop\n",
+                                command.c_str(), HIP_PROFILE_CONTROL_FILE.c_str());
+                    }
+                }
+                lastCommand = command;
+            }
+        }
+    }
+}
+
+
+// Registered after the recorders' own atexit handlers, so it runs first and the last window is numbered like the
+// others.  The recorders then find themselves stopped and write nothing more.
+static void ihipProfControlAtExit()
+{
+    g_profControlThread.stop();
+
+    std::lock_guard<std::mutex> l(g_profControlMutex);
+    if (g_profWindowed) {
+        ihipProfStopLocked();
+    }
+}
+
+
+//=================================================================================================
+// Called from ihipInit and hipProfilerStart/Stop:
+//=================================================================================================
+void ihipProfControlInit()
+{
+    g_profRecording = !HIP_PROFILE_START_PAUSED;
+    g_profWindowed = HIP_PROFILE_START_PAUSED;
+    atexit(ihipProfControlAtExit);
+
+    if (HIP_PROFILE_SIGNAL) {
+        ihipProfInstallSignalHandler(HIP_PROFILE_SIGNAL);
+    }
+    if (HIP_PROFILE_SIGNAL || !HIP_PROFILE_CONTROL_FILE.empty()) {
+        g_profControlThread.start();
+    }
+}
+
+
+void ihipProfControlStart()
+{
+    std::lock_guard<std::mutex> l(g_profControlMutex);
+    ihipProfStartLocked();
+}
+
+
+void ihipProfControlStop()
+{
+    std::lock_guard<std::mutex> l(g_profControlMutex);
+    ihipProfStopLocked();
+}
@@ -0,0 +1,622 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file hip_staging.cpp
+ *
+ * Staging engine for asynchronous copies between device memory and pageable (untracked) host memory.
+ *
+ * H2D: the calling thread copies each chunk of the pageable source into a free pinned buffer and enqueues
+ *      the DMA for that chunk on the stream.  The call returns as soon as the source has been consumed,
+ *      matching the CUDA semantics for pageable hipMemcpyAsync.  The CPU copy of chunk N overlaps the DMA
+ *      of chunks N-1, N-2, ... so the pipeline depth is HIP_STAGING_BUFFERS.
+ *
+ * D2H: the DMA for each chunk is enqueued on the stream by the calling thread, and a worker thread waits
+ *      for the DMA and drains the staging buffer into the pageable destination.  The call returns once all
+ *      DMAs are enqueued.  The stream remembers the last host task and waits for it in ihipStream_t::wait,
+ *      so stream/device synchronization observes the completed copy.  hipEventRecord does not wait: it
+ *      enqueues a barrier which the worker releases after the drain (fenceStaging).
+ *
+ * The stream also remembers which host ranges pending tasks will write.  An H2D copy only waits for the tasks
+ * writing its source, and it waits without holding the stream lock.
+ *
+ * The DMA commands are always enqueued from the calling thread, in order, so the copy is ordered against
+ * earlier and later commands in the same stream.
+ *
+ * The host-side memcpy for each chunk is split across a small pool of CPU threads once it reaches
+ * HIP_PARALLEL_COPY_THRESHOLD, since a single core cannot saturate DRAM bandwidth on multi-socket hosts.
+ * Pool and worker threads are pinned to the CPUs local to the device (from sysfs).
+ */
+
+#include <sched.h>
+#include <pthread.h>
+#include <algorithm>
+#include <fstream>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+//=================================================================================================
+// Helpers:
+//=================================================================================================
+// Read the set of CPUs of the NUMA node the device's pinned memory is placed on (see hip_numa.cpp), or failing that
+// the CPUs closest to the device from the PCI sysfs node.  Returns false if the set can't be determined or placement
+// is disabled, in which case threads are left unpinned.
+static bool ihipGetDeviceLocalCpus(const ihipDevice_t *device, cpu_set_t *cpus)
+{
+    char path[256];
+    if (HIP_HOST_NUMA_NODE == -2) {
+        return false;
+    } else if (device->_numaNode >= 0) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", device->_numaNode);
+    } else {
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%04x:%02x:%02x.%x/local_cpulist", device->_pciDomain,
+                 device->_pciBdfId >> 8, (device->_pciBdfId >> 3) & 0x1f, device->_pciBdfId & 0x7);
+    }
+
+    std::ifstream f(path);
+    std::string cpuList;
+    if (!f || !std::getline(f, cpuList)) {
+        return false;
+    }
+
+    // Format is a comma-separated list of ranges, ie "0-7,16-23".
+    CPU_ZERO(cpus);
+    std::stringstream ss(cpuList);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        int first, last;
+        int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (n == 1) {
+            last = first;
+        } else if (n != 2) {
+            continue;
+        }
+        for (int c=first; (c<=last) && (c<CPU_SETSIZE); c++) {
+            CPU_SET(c, cpus);
+        }
+    }
+
+    return CPU_COUNT(cpus) > 0;
+}
+
+
+static void ihipPinThreadToDevice(std::thread &t, const ihipDevice_t *device)
+{
+    cpu_set_t cpus;
+    if (ihipGetDeviceLocalCpus(device, &cpus)) {
+        pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &cpus);
+    }
+}
+
+
+//=================================================================================================
+// ihipHostCopyPool_t:
+//=================================================================================================
+struct ihipHostCopyPool_t::Job {
+    int _remaining; // pieces not yet copied by the pool, protected by the pool mutex.
+};
+
+
+ihipHostCopyPool_t::ihipHostCopyPool_t(const ihipDevice_t *device, int numThreads, size_t threshold) :
+    _device(device),
+    _numThreads(numThreads > 0 ? numThreads : 0),
+    _threshold(threshold),
+    _shutdown(false)
+{
+}
+
+
+ihipHostCopyPool_t::~ihipHostCopyPool_t()
+{
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _shutdown = true;
+    }
+    _pieceReady.notify_all();
+    for (auto &t : _workers) {
+        t.join();
+    }
+}
+
+
+void ihipHostCopyPool_t::start()
+{
+    for (int i=0; i<_numThreads; i++) {
+        _workers.push_back(std::thread(&ihipHostCopyPool_t::workerLoop, this, i));
+        ihipPinThreadToDevice(_workers.back(), _device);
+    }
+    tprintf(DB_COPY, "host copy pool dev:%d started %d thread(s), threshold=%zu\n", _device->_deviceId, _numThreads, _threshold);
+}
+
+
+void ihipHostCopyPool_t::copy(void *dst, const void *src, size_t sizeBytes)
+{
+    if ((_numThreads == 0) || (sizeBytes < _threshold)) {
+        memcpy(dst, src, sizeBytes);
+        return;
+    }
+
+    std::call_once(_startOnce, &ihipHostCopyPool_t::start, this);
+
+    // One piece per pool thread plus one for the caller.  Round to whole pages so pieces never share a line.
+    const size_t numPieces = _workers.size() + 1;
+    size_t pieceSize = (sizeBytes + numPieces - 1) / numPieces;
+    pieceSize = (pieceSize + 4095) & ~size_t(4095);
+
+    Job job;
+    job._remaining = 0;
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        for (size_t offset = pieceSize; offset < sizeBytes; offset += pieceSize) {
+            _pieces.push_back(Piece{static_cast<char*>(dst) + offset, static_cast<const char*>(src) + offset,
+                                    std::min(pieceSize, sizeBytes - offset), &job});
+            job._remaining++;
+        }
+    }
+    _pieceReady.notify_all();
+
+    memcpy(dst, src, std::min(pieceSize, sizeBytes));
+
+    std::unique_lock<std::mutex> l(_mutex);
+    _pieceDone.wait(l, [&]{ return job._remaining == 0; });
+}
+
+
+void ihipHostCopyPool_t::workerLoop(int workerId)
+{
+    std::unique_lock<std::mutex> l(_mutex);
+    while (1) {
+        _pieceReady.wait(l, [this]{ return _shutdown || !_pieces.empty(); });
+        if (_pieces.empty()) {
+            return; // shutdown and drained.
+        }
+        Piece piece = _pieces.front();
+        _pieces.pop_front();
+
+        l.unlock();
+        memcpy(piece._dst, piece._src, piece._sizeBytes);
+        l.lock();
+
+        if (--piece._job->_remaining == 0) {
+            _pieceDone.notify_all();
+        }
+    }
+}
+
+
+
+//=================================================================================================
+// ihipStagingEngine_t:
+//=================================================================================================
+ihipStagingEngine_t::ihipStagingEngine_t(ihipDevice_t *device, size_t bufferSize, int numBuffers, int numThreads) :
+    _device(device),
+    _bufferSize(bufferSize),
+    _numBuffers(numBuffers),
+    _numThreads(numThreads > 0 ? numThreads : 1),
+    _shutdown(false),
+    _hostCopyPool(device, HIP_PARALLEL_COPY_THREADS, size_t(HIP_PARALLEL_COPY_THRESHOLD)*1024)
+{
+    if (_bufferSize == 0) {
+        _numBuffers = 0;
+    }
+}
+
+
+ihipStagingEngine_t::~ihipStagingEngine_t()
+{
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _shutdown = true;
+    }
+    _taskReady.notify_all();
+    for (auto &t : _workers) {
+        t.join();
+    }
+
+    for (auto b : _allBuffers) {
+        if (b->_dmaFuture.valid()) {
+            b->_dmaFuture.wait();
+        }
+        ihipHostFreePinned(b->_ptr);
+        delete b;
+    }
+}
+
+
+// Allocate the pinned buffers and start the worker threads.  Called once, on first use.
+void ihipStagingEngine_t::allocBuffers()
+{
+    for (int i=0; i<_numBuffers; i++) {
+        void *p = ihipHostAllocPinned(_device, _bufferSize);
+        if (p == nullptr) {
+            break;
+        }
+
+        hc::accelerator acc;
+        hc::AmPointerInfo ptrInfo(NULL, NULL, 0, acc, 0, 0);
+        if (hc::am_memtracker_getinfo(&ptrInfo, p) != AM_SUCCESS) {
+            ihipHostFreePinned(p);
+            break;
+        }
+
+        auto b = new ihipStagingBuffer_t(p, ptrInfo);
+        _allBuffers.push_back(b);
+        _freeBuffers.push_back(b);
+    }
+
+    if (_allBuffers.size() != _numBuffers) {
+        fprintf (stderr, "warning: could only allocate %zu of %d pinned staging buffers (HIP_STAGING_SIZE=%zuKB) on device %d\n",
+                 _allBuffers.size(), _numBuffers, _bufferSize/1024, _device->_deviceId);
+    }
+
+    _tasks.resize(_numThreads);
+    for (int i=0; i<_numThreads; i++) {
+        _workers.push_back(std::thread(&ihipStagingEngine_t::workerLoop, this, i));
+        ihipPinThreadToDevice(_workers.back(), _device);
+    }
+
+    tprintf(DB_COPY, "staging engine dev:%d allocated %zu buffers of %zu bytes, %d worker thread(s)\n",
+            _device->_deviceId, _allBuffers.size(), _bufferSize, _numThreads);
+}
+
+
+size_t ihipStagingEngine_t::numBuffers()
+{
+    std::call_once(_initOnce, &ihipStagingEngine_t::allocBuffers, this);
+    return _allBuffers.size();
+}
+
+
+ihipStagingBuffer_t *ihipStagingEngine_t::acquire()
+{
+    std::call_once(_initOnce, &ihipStagingEngine_t::allocBuffers, this);
+
+    if (_allBuffers.empty()) {
+        throw ihipException(hipErrorMemoryAllocation);
+    }
+
+    ihipStagingBuffer_t *b;
+    {
+        std::unique_lock<std::mutex> l(_mutex);
+        _bufferFreed.wait(l, [this]{ return !_freeBuffers.empty(); });
+        b = _freeBuffers.front();
+        _freeBuffers.pop_front();
+    }
+
+    // Buffer may still be the source of an in-flight H2D DMA - wait outside the lock.
+    if (b->_dmaFuture.valid()) {
+        b->_dmaFuture.wait();
+    }
+
+    return b;
+}
+
+
+void ihipStagingEngine_t::release(ihipStagingBuffer_t *buffer)
+{
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _freeBuffers.push_back(buffer);
+    }
+    _bufferFreed.notify_one();
+}
+
+
+std::shared_future<void> ihipStagingEngine_t::submit(unsigned queue, std::function<void()> task)
+{
+    std::call_once(_initOnce, &ihipStagingEngine_t::allocBuffers, this);
+
+    std::packaged_task<void()> pt(std::move(task));
+    std::shared_future<void> f = pt.get_future().share();
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _tasks[queue % _numThreads].push_back(std::move(pt));
+    }
+    _taskReady.notify_all();
+
+    return f;
+}
+
+
+void ihipStagingEngine_t::workerLoop(int workerId)
+{
+    while (1) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> l(_mutex);
+            _taskReady.wait(l, [&]{ return _shutdown || !_tasks[workerId].empty(); });
+            if (_tasks[workerId].empty()) {
+                return; // shutdown and drained.
+            }
+            task = std::move(_tasks[workerId].front());
+            _tasks[workerId].pop_front();
+        }
+
+        task();
+    }
+}
+
+
+
+//=================================================================================================
+// ihipStream_t staged copies:
+//=================================================================================================
+void ihipStream_t::waitStaging(LockedAccessor_StreamCrit_t &crit)
+{
+    if (crit->_stagingFuture.valid()) {
+        tprintf(DB_SYNC, "stream %p wait for staged host copies..\n", this);
+        crit->_stagingFuture.wait();
+        crit->_stagingFuture = std::shared_future<void>();
+    }
+    crit->_hostWrites.clear();
+}
+
+
+static bool ihipIsReady(const std::shared_future<void> &f)
+{
+    return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+
+void ihipStream_t::recordHostWrite(LockedAccessor_StreamCrit_t &crit, const void *dst, size_t sizeBytes)
+{
+    auto &writes = crit->_hostWrites;
+    writes.erase(std::remove_if(writes.begin(), writes.end(),
+                                [](const ihipStreamCritical_t::HostWrite &w) { return ihipIsReady(w._task); }),
+                 writes.end());
+
+    const uintptr_t start = reinterpret_cast<uintptr_t>(dst);
+    writes.push_back(ihipStreamCritical_t::HostWrite{start, start + sizeBytes, crit->_stagingFuture});
+}
+
+
+std::vector<std::shared_future<void>> ihipStream_t::pendingHostWrites(LockedAccessor_StreamCrit_t &crit, const void *ptr, size_t sizeBytes)
+{
+    const uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+    const uintptr_t end   = start + sizeBytes;
+
+    std::vector<std::shared_future<void>> tasks;
+    for (auto &w : crit->_hostWrites) {
+        if ((w._start < end) && (start < w._end) && !ihipIsReady(w._task)) {
+            tasks.push_back(w._task);
+        }
+    }
+    return tasks;
+}
+
+
+bool ihipStream_t::isIdle(LockedAccessor_StreamCrit_t &crit)
+{
+    bool stagingIdle = !crit->_stagingFuture.valid() ||
+                       (crit->_stagingFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+
+    return stagingIdle && (crit->_av.get_pending_async_ops() == 0);
+}
+
+
+// Enqueue an AQL barrier-AND packet which holds back later packets in av until depSignal reaches 0.
+// The packet decrements completionSignal when it retires.
+//
+// HCC has no command which waits on a signal set by the host, so the packet is written directly.  HCC does not
+// track it: callers must follow it with an HCC marker (see enqueueHostTask).  The marker has the barrier bit set
+// so it retires after this packet, and HCC's own commands, get_pending_async_ops and wait all depend on it.
+void ihipEnqueueBarrierPacket(hc::accelerator_view &av, hsa_signal_t depSignal, hsa_signal_t completionSignal)
+{
+    hsa_queue_t *queue = (hsa_queue_t*)av.get_hsa_queue();
+    const uint32_t queueMask = queue->size - 1;
+
+    uint64_t index = hsa_queue_add_write_index_relaxed(queue, 1);
+    while ((index - hsa_queue_load_read_index_acquire(queue)) >= queue->size) {
+        std::this_thread::yield(); // queue full.
+    }
+
+    hsa_barrier_and_packet_t *packet = &(((hsa_barrier_and_packet_t*)(queue->base_address))[index & queueMask]);
+    memset(reinterpret_cast<char*>(packet) + sizeof(uint16_t), 0, sizeof(*packet) - sizeof(uint16_t));
+    packet->dep_signal[0] = depSignal;
+    packet->completion_signal = completionSignal;
+
+    uint16_t header = (HSA_PACKET_TYPE_BARRIER_AND << HSA_PACKET_HEADER_TYPE) |
+                      (1 << HSA_PACKET_HEADER_BARRIER) |
+                      (HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_ACQUIRE_FENCE_SCOPE) |
+                      (HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_RELEASE_FENCE_SCOPE);
+
+    __atomic_store_n(reinterpret_cast<uint16_t*>(packet), header, __ATOMIC_RELEASE);
+
+    // Release ordering publishes the header before the packet processor sees the new write index.
+    hsa_signal_store_screlease(queue->doorbell_signal, index);
+}
+
+
+void ihipStream_t::enqueueHostTask(LockedAccessor_StreamCrit_t &crit, std::function<void()> task, bool waitForCommands,
+                                   ihipStagingEngine_t *engine, unsigned queue, bool overlapPrior)
+{
+    if (engine == nullptr) {
+        engine = getCtx()->getDevice()->_stagingEngine;
+        queue  = _id;
+    }
+
+    reclaimHostTaskSignals(crit);
+
+    hsa_signal_t signal;
+    if (hsa_signal_create(1, 0, NULL, &signal) != HSA_STATUS_SUCCESS) {
+        throw ihipException(hipErrorOutOfResources);
+    }
+
+    // Gate on prior device commands, and on prior host tasks which may have run on another device's engine.
+    hc::completion_future priorCommands;
+    if (waitForCommands && (crit->_av.get_pending_async_ops() != 0)) {
+        priorCommands = crit->_av.create_marker();
+    }
+    std::shared_future<void> priorTask = crit->_stagingFuture;
+
+    crit->_stagingFuture = engine->submit(queue, [=] () mutable {
+        if (priorCommands.valid()) {
+            priorCommands.wait();
+        }
+        if (priorTask.valid() && !overlapPrior) {
+            priorTask.wait();
+        }
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // Overlapped tasks still complete in order, so _stagingFuture covers every earlier task.
+        if (priorTask.valid() && overlapPrior) {
+            priorTask.wait();
+        }
+        hsa_signal_store_release(signal, 0);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    });
+
+    // The barrier holds back later kernels.  HCC chains its own copies to the previous HCC command only, so follow
+    // the barrier with a marker - this makes later SDMA copies wait too, and tells us when the signal is free.
+    ihipEnqueueBarrierPacket(crit->_av, signal, hsa_signal_t{0});
+    crit->_hostTaskSignals.push_back(std::make_pair(signal, crit->_av.create_marker()));
+}
+
+
+void ihipStream_t::fenceStaging(LockedAccessor_StreamCrit_t &crit)
+{
+    if (crit->_stagingFuture.valid() &&
+        (crit->_stagingFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+        tprintf(DB_SYNC, "stream %p fence staged host copies\n", this);
+        enqueueHostTask(crit, [] {}, false/*waitForCommands*/);
+    }
+}
+
+
+void ihipStream_t::reclaimHostTaskSignals(LockedAccessor_StreamCrit_t &crit)
+{
+    while (!crit->_hostTaskSignals.empty() && crit->_hostTaskSignals.front().second.is_ready()) {
+        hsa_signal_destroy(crit->_hostTaskSignals.front().first);
+        crit->_hostTaskSignals.pop_front();
+    }
+}
+
+
+void ihipStream_t::stagedCopyHostToDevice(void *dst, const void *src, size_t sizeBytes,
+                                          const hc::AmPointerInfo &dstPtrInfo, ihipCtx_t *copyDevice,
+                                          LockedAccessor_StreamCrit_t *heldCrit)
+{
+    ihipStagingEngine_t *engine = copyDevice->getDevice()->_stagingEngine;
+    const size_t chunkSize = engine->bufferSize();
+
+    tprintf(DB_COPY, "stagedCopyHostToDevice dst=%p src=%p sz=%zu chunk=%zu\n", dst, src, sizeBytes, chunkSize);
+
+    // src is read on this thread - wait for host tasks still pending in the stream which write it.  Unless the
+    // caller holds the lock, the wait happens after it is released.
+    std::vector<std::shared_future<void>> writers;
+    if (heldCrit) {
+        writers = pendingHostWrites(*heldCrit, src, sizeBytes);
+    } else {
+        LockedAccessor_StreamCrit_t crit(_criticalData);
+        writers = pendingHostWrites(crit, src, sizeBytes);
+    }
+    for (auto &w : writers) {
+        tprintf(DB_SYNC, "stream %p H2D source %p is written by a pending host task, wait..\n", this, src);
+        w.wait();
+    }
+
+    for (size_t offset = 0; offset < sizeBytes; offset += chunkSize) {
+        const size_t thisChunk = std::min(chunkSize, sizeBytes - offset);
+
+        // Unless the caller holds it, the buffer is acquired and filled without the stream lock - other threads can
+        // submit to the stream meanwhile.
+        ihipStagingBuffer_t *b = engine->acquire();
+        engine->hostCopy(b->_ptr, static_cast<const char*>(src) + offset, thisChunk);
+
+        auto submit = [&] (LockedAccessor_StreamCrit_t &crit) {
+            b->_dmaFuture = crit->_av.copy_async_ext(b->_ptr, static_cast<char*>(dst) + offset, thisChunk,
+                                                     hc::hcMemcpyHostToDevice, b->_ptrInfo, dstPtrInfo,
+                                                     &copyDevice->getDevice()->_acc);
+        };
+        try {
+            if (heldCrit) {
+                submit(*heldCrit);
+            } else {
+                LockedAccessor_StreamCrit_t crit(_criticalData);
+                submit(crit);
+            }
+        } catch (Kalmar::runtime_exception) {
+            engine->release(b);
+            throw ihipException(hipErrorRuntimeOther);
+        };
+
+        // Return to the ring with the DMA still in flight; the next acquirer waits on _dmaFuture.
+        engine->release(b);
+    }
+}
+
+
+void ihipStream_t::stagedCopyDeviceToHost(void *dst, const void *src, size_t sizeBytes,
+                                          const hc::AmPointerInfo &srcPtrInfo, ihipCtx_t *copyDevice,
+                                          LockedAccessor_StreamCrit_t *heldCrit)
+{
+    ihipStagingEngine_t *engine = copyDevice->getDevice()->_stagingEngine;
+    const size_t chunkSize = engine->bufferSize();
+
+    tprintf(DB_COPY, "stagedCopyDeviceToHost dst=%p src=%p sz=%zu chunk=%zu\n", dst, src, sizeBytes, chunkSize);
+
+    for (size_t offset = 0; offset < sizeBytes; offset += chunkSize) {
+        const size_t thisChunk = std::min(chunkSize, sizeBytes - offset);
+
+        // Never hold more than one buffer here: the worker releases buffers independently of this thread (and
+        // without the stream lock), so a blocking acquire can always make progress.
+        ihipStagingBuffer_t *b = engine->acquire();
+        char *hostDst = static_cast<char*>(dst) + offset;
+
+        auto submit = [&] (LockedAccessor_StreamCrit_t &crit) {
+            try {
+                b->_dmaFuture = crit->_av.copy_async_ext(static_cast<const char*>(src) + offset, b->_ptr, thisChunk,
+                                                         hc::hcMemcpyDeviceToHost, srcPtrInfo, b->_ptrInfo,
+                                                         &copyDevice->getDevice()->_acc);
+            } catch (Kalmar::runtime_exception) {
+                engine->release(b);
+                throw ihipException(hipErrorRuntimeOther);
+            };
+
+            crit->_stagingFuture = engine->submit(_id, [=] {
+                b->_dmaFuture.wait();
+                engine->hostCopy(hostDst, b->_ptr, thisChunk);
+                b->_dmaFuture = hc::completion_future();
+                engine->release(b);
+            });
+            recordHostWrite(crit, hostDst, thisChunk);
+        };
+        if (heldCrit) {
+            submit(*heldCrit);
+        } else {
+            LockedAccessor_StreamCrit_t crit(_criticalData);
+            submit(crit);
+        }
+    }
+}
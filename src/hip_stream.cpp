@@ -123,8 +123,13 @@ hipError_t hipStreamQuery(hipStream_t stream)
     LockedAccessor_StreamCrit_t crit(stream->_criticalData);
     int pendingOps = crit->_av.get_pending_async_ops();
 
+    // Staged D2H copies complete on the host after their DMA:
+    if (crit->_stagingFuture.valid() &&
+        (crit->_stagingFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+        pendingOps++;
+    }
 
-    hipError_t e = (pendingOps > 0) ? hipErrorNotReady : hipSuccess;
+    hipError_t e = (pendingOps > 0) ? hipErrorNotReady : stream->takeFileIoError(crit);
 
     return ihipLogStatus(e);
 }
@@ -140,11 +145,13 @@ hipError_t hipStreamSynchronize(hipStream_t stream)
     if (stream == NULL) {
         ihipCtx_t *ctx = ihipGetTlsDefaultCtx();
         ctx->locked_syncDefaultStream(true/*waitOnSelf*/);
+        stream = ctx->_defaultStream;
     } else {
         stream->locked_wait();
-        e = hipSuccess;
     }
 
+    // File copies can fail on an I/O thread after they were enqueued:
+    e = stream->locked_takeFileIoError();
 
     return ihipLogStatus(e);
 };
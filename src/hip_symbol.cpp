@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file hip_symbol.cpp
+ *
+ * Per-device cache of __device__ and __constant__ symbol lookups.
+ *
+ * HCC resolves a symbol name with a string lookup through its loaded programs, which is too slow to repeat
+ * before every hipMemcpyToSymbolAsync.  Each device caches the result the first time a name is used.  The fast
+ * path finds the entry by the name pointer - HIP_SYMBOL produces a string literal, so the pointer is stable - and
+ * confirms it with a string compare, since a caller may reuse a buffer for different names.  The pointer table is
+ * capped, and both tables are emptied when a module is unloaded.
+ *
+ * Symbol sizes come from the HSA executables, found through the AMD loader extension when the ROCr provides
+ * hsa_ven_amd_loader_iterate_executables (CMake defines HIP_HAS_HSA_LOADER_ITERATE).  Otherwise sizes are
+ * reported as 0 (unknown).
+ */
+
+#include <string.h>
+
+#include <hc.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+#if HIP_HAS_HSA_LOADER_ITERATE
+#include <hsa/hsa_ven_amd_loader.h>
+#endif
+
+
+//=================================================================================================
+// Symbol sizes:
+//=================================================================================================
+#if HIP_HAS_HSA_LOADER_ITERATE
+
+namespace {
+
+struct SizeQuery {
+    uint64_t    _address;
+    size_t      _sizeBytes;
+};
+
+
+hsa_status_t findVariableSize(hsa_executable_t executable, hsa_executable_symbol_t symbol, void *data)
+{
+    hsa_symbol_kind_t kind;
+    if ((hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_TYPE, &kind) != HSA_STATUS_SUCCESS) ||
+        (kind != HSA_SYMBOL_KIND_VARIABLE)) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    SizeQuery *q = static_cast<SizeQuery*>(data);
+    uint64_t address = 0;
+    hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_VARIABLE_ADDRESS, &address);
+    if (address != q->_address) {
+        return HSA_STATUS_SUCCESS;
+    }
+
+    uint32_t sizeBytes = 0;
+    hsa_executable_symbol_get_info(symbol, HSA_EXECUTABLE_SYMBOL_INFO_VARIABLE_SIZE, &sizeBytes);
+    q->_sizeBytes = sizeBytes;
+    return HSA_STATUS_INFO_BREAK;
+}
+
+
+hsa_status_t searchExecutable(hsa_executable_t executable, void *data)
+{
+    hsa_status_t s = hsa_executable_iterate_symbols(executable, findVariableSize, data);
+    return (s == HSA_STATUS_INFO_BREAK) ? HSA_STATUS_INFO_BREAK : HSA_STATUS_SUCCESS;
+}
+
+} // end anonymous namespace
+
+
+// Size of the variable at address, matched by address so it does not depend on how HCC names symbols.
+static size_t ihipSymbolSize(void *address)
+{
+    static hsa_ven_amd_loader_1_01_pfn_t loader;
+    static bool haveLoader =
+        (hsa_system_get_major_extension_table(HSA_EXTENSION_AMD_LOADER, 1, sizeof(loader), &loader) == HSA_STATUS_SUCCESS) &&
+        (loader.hsa_ven_amd_loader_iterate_executables != nullptr);
+
+    SizeQuery q = {reinterpret_cast<uint64_t>(address), 0};
+    if (haveLoader) {
+        loader.hsa_ven_amd_loader_iterate_executables(searchExecutable, &q);
+    }
+    return q._sizeBytes;
+}
+
+#else
+
+static size_t ihipSymbolSize(void *)
+{
+    return 0;
+}
+
+#endif
+
+
+//=================================================================================================
+// ihipSymbolCache_t:
+//=================================================================================================
+ihipSymbolCache_t::ihipSymbolCache_t(ihipDevice_t *device) :
+    _device(device)
+{
+}
+
+
+bool ihipSymbolCache_t::lookup(const char *symbolName, ihipSymbol_t *symbol)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto p = _byPointer.find(symbolName);
+    if ((p != _byPointer.end()) && (strcmp(p->second->_name.c_str(), symbolName) == 0)) {
+        *symbol = p->second->_symbol;
+        return true;
+    }
+
+    auto n = _byName.find(symbolName);
+    if (n == _byName.end()) {
+        void *address = _device->_acc.get_symbol_address(symbolName);
+        if (address == nullptr) {
+            tprintf(DB_MEM, "symbol '%s' not found on dev:%d\n", symbolName, _device->_deviceId);
+            return false;
+        }
+
+        std::unique_ptr<Entry> e(new Entry{symbolName, ihipSymbol_t{address, ihipSymbolSize(address)}});
+        tprintf(DB_MEM, "symbol '%s' resolved to address:%p size:%zu on dev:%d\n",
+                symbolName, address, e->_symbol._sizeBytes, _device->_deviceId);
+        n = _byName.emplace(symbolName, std::move(e)).first;
+    }
+
+    if (_byPointer.size() >= MAX_POINTER_ENTRIES) {
+        _byPointer.clear();
+    }
+    _byPointer[symbolName] = n->second.get();
+    *symbol = n->second->_symbol;
+    return true;
+}
+
+
+void ihipSymbolCache_t::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _byPointer.clear();
+    _byName.clear();
+}
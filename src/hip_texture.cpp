@@ -0,0 +1,280 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+/**
+ * @file hip_texture.cpp
+ *
+ * Texture objects (hipCreateTextureObject, hipDestroyTextureObject, hipGetTextureObject*Desc).
+ *
+ * A texture object is a __hip_texture descriptor in device memory.  Kernels sample it with tex1Dfetch, tex1D,
+ * tex2D, tex2DLayered and tex3D from hip_texture.h, which handle the array layout, address modes, linear
+ * filtering and normalized reads.  HCC does not expose the image instructions, so the sampling runs in the
+ * shader; tiled, Morton and brick layouts give local access patterns most of the cache locality the texture
+ * unit would.
+ *
+ * The runtime keeps a host copy of each descriptor and the descriptors it was created from, for the getters.
+ */
+
+#include <map>
+#include <mutex>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip/hcc_detail/hip_texture.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+struct ihipTexture_t {
+    hipResourceDesc _resDesc;
+    hipTextureDesc  _texDesc;
+    __hip_texture   _tex;
+};
+
+static std::mutex                                   g_textureMutex;
+static std::map<hipTextureObject_t, ihipTexture_t>  g_textures;
+
+
+static bool isValidAddressMode(hipTextureAddressMode mode)
+{
+    return (mode == hipAddressModeWrap) || (mode == hipAddressModeClamp) ||
+           (mode == hipAddressModeMirror) || (mode == hipAddressModeBorder);
+}
+
+
+// Fills the format fields of t from a channel descriptor and returns the element size in bytes, or 0.
+static size_t setFormat(__hip_texture *t, const hipChannelFormatDesc &desc)
+{
+    t->elementBits = desc.x;
+    t->kind = desc.f;
+    if (desc.y || desc.z || desc.w) {
+        return 0;
+    }
+    if ((desc.x != 8) && (desc.x != 16) && (desc.x != 32)) {
+        return 0;
+    }
+    if ((desc.f == hipChannelFormatKindFloat) && (desc.x != 32)) {
+        return 0;
+    }
+    if ((desc.f != hipChannelFormatKindSigned) && (desc.f != hipChannelFormatKindUnsigned) &&
+        (desc.f != hipChannelFormatKindFloat)) {
+        return 0;
+    }
+    return desc.x / 8;
+}
+
+
+static hipError_t ihipBuildTexture(__hip_texture *t, const hipResourceDesc *res, const hipTextureDesc *tex)
+{
+    size_t es = 0;
+
+    switch (res->resType) {
+        case hipResourceTypeArray: {
+            const hipArray *a = res->res.array.array;
+            if ((a == nullptr) || (a->data == nullptr)) {
+                return hipErrorInvalidValue;
+            }
+            es = setFormat(t, a->desc);
+            if (es != a->elementSize) {
+                return hipErrorNotSupported;
+            }
+            t->data = a->data;
+            t->width = a->width;
+            t->height = a->height ? a->height : 1;
+            t->depth = a->depth ? a->depth : 1;
+            t->stride = a->stride;
+            t->layout = a->layout;
+            break;
+        }
+        case hipResourceTypeLinear:
+            es = setFormat(t, res->res.linear.desc);
+            if (es == 0) {
+                return hipErrorNotSupported;
+            }
+            if (res->res.linear.devPtr == nullptr) {
+                return hipErrorInvalidValue;
+            }
+            t->data = res->res.linear.devPtr;
+            t->width = res->res.linear.sizeInBytes / es;
+            t->height = 1;
+            t->depth = 1;
+            t->stride = t->width;
+            t->layout = hipArrayLayoutLinear;
+            break;
+        case hipResourceTypePitch2D:
+            es = setFormat(t, res->res.pitch2D.desc);
+            if (es == 0) {
+                return hipErrorNotSupported;
+            }
+            if ((res->res.pitch2D.devPtr == nullptr) || (res->res.pitch2D.pitchInBytes % es) ||
+                (res->res.pitch2D.pitchInBytes < res->res.pitch2D.width * es)) {
+                return hipErrorInvalidValue;
+            }
+            t->data = res->res.pitch2D.devPtr;
+            t->width = res->res.pitch2D.width;
+            t->height = res->res.pitch2D.height;
+            t->depth = 1;
+            t->stride = res->res.pitch2D.pitchInBytes / es;
+            t->layout = hipArrayLayoutLinear;
+            break;
+        default:
+            return hipErrorNotSupported;
+    }
+
+    if ((t->width == 0) || (t->height == 0)) {
+        return hipErrorInvalidValue;
+    }
+
+    if (!isValidAddressMode(tex->addressMode[0]) || !isValidAddressMode(tex->addressMode[1]) ||
+        !isValidAddressMode(tex->addressMode[2]) || tex->sRGB) {
+        return hipErrorInvalidValue;
+    }
+    const bool intFormat = (t->kind != hipChannelFormatKindFloat);
+    if ((tex->readMode == hipReadModeNormalizedFloat) && !(intFormat && (t->elementBits < 32))) {
+        return hipErrorInvalidValue;
+    }
+    if ((tex->filterMode == hipFilterModeLinear) && intFormat && (tex->readMode != hipReadModeNormalizedFloat)) {
+        return hipErrorInvalidValue;
+    }
+    if ((tex->filterMode != hipFilterModePoint) && (tex->filterMode != hipFilterModeLinear)) {
+        return hipErrorInvalidValue;
+    }
+
+    t->addressMode[0] = tex->addressMode[0];
+    t->addressMode[1] = tex->addressMode[1];
+    t->addressMode[2] = tex->addressMode[2];
+    t->filterMode = tex->filterMode;
+    t->readMode = tex->readMode;
+    t->normalizedCoords = tex->normalizedCoords;
+    t->borderColor = tex->borderColor[0];
+
+    return hipSuccess;
+}
+
+
+hipError_t hipCreateTextureObject(hipTextureObject_t* pTexObject, const hipResourceDesc* pResDesc,
+                                  const hipTextureDesc* pTexDesc, const hipResourceViewDesc* pResViewDesc)
+{
+    HIP_INIT_API(pTexObject, pResDesc, pTexDesc, pResViewDesc);
+
+    if ((pTexObject == nullptr) || (pResDesc == nullptr) || (pTexDesc == nullptr)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    if (pResViewDesc != nullptr) {
+        return ihipLogStatus(hipErrorNotSupported);
+    }
+
+    auto ctx = ihipGetTlsDefaultCtx();
+    if (ctx == nullptr) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+
+    ihipTexture_t texture;
+    texture._resDesc = *pResDesc;
+    texture._texDesc = *pTexDesc;
+    hipError_t e = ihipBuildTexture(&texture._tex, pResDesc, pTexDesc);
+    if (e != hipSuccess) {
+        return ihipLogStatus(e);
+    }
+
+    auto device = ctx->getWriteableDevice();
+    void *p = hc::am_alloc(sizeof(__hip_texture), device->_acc, 0);
+    if (p == nullptr) {
+        return ihipLogStatus(hipErrorMemoryAllocation);
+    }
+    hc::am_memtracker_update(p, device->_deviceId, 0);
+
+    try {
+        hipStream_t stream = ihipSyncAndResolveStream(hipStreamNull);
+        stream->locked_copySync(p, &texture._tex, sizeof(__hip_texture), hipMemcpyHostToDevice);
+    }
+    catch (ihipException ex) {
+        hc::am_free(p);
+        return ihipLogStatus(ex._code);
+    }
+
+    *pTexObject = static_cast<hipTextureObject_t>(p);
+    {
+        std::lock_guard<std::mutex> lock(g_textureMutex);
+        g_textures[*pTexObject] = texture;
+    }
+
+    tprintf(DB_MEM, "created texture object:%p data:%p %ux%u layout:%d\n", p, texture._tex.data,
+            texture._tex.width, texture._tex.height, texture._tex.layout);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipDestroyTextureObject(hipTextureObject_t texObject)
+{
+    HIP_INIT_API(texObject);
+
+    {
+        std::lock_guard<std::mutex> lock(g_textureMutex);
+        auto it = g_textures.find(texObject);
+        if (it == g_textures.end()) {
+            return ihipLogStatus(hipErrorInvalidValue);
+        }
+        g_textures.erase(it);
+    }
+
+    // Kernels may still be reading the descriptor.
+    ihipGetTlsDefaultCtx()->locked_waitAllStreams();
+    hc::am_free(texObject);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipGetTextureObjectResourceDesc(hipResourceDesc* pResDesc, hipTextureObject_t texObject)
+{
+    HIP_INIT_API(pResDesc, texObject);
+
+    std::lock_guard<std::mutex> lock(g_textureMutex);
+    auto it = g_textures.find(texObject);
+    if ((pResDesc == nullptr) || (it == g_textures.end())) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    *pResDesc = it->second._resDesc;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+hipError_t hipGetTextureObjectTextureDesc(hipTextureDesc* pTexDesc, hipTextureObject_t texObject)
+{
+    HIP_INIT_API(pTexDesc, texObject);
+
+    std::lock_guard<std::mutex> lock(g_textureMutex);
+    auto it = g_textures.find(texObject);
+    if ((pTexDesc == nullptr) || (it == g_textures.end())) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    *pTexDesc = it->second._texDesc;
+
+    return ihipLogStatus(hipSuccess);
+}
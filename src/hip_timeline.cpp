@@ -0,0 +1,382 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+/**
+ * @file hip_timeline.cpp
+ *
+ * Timeline recorder, enabled by setting HIP_TIMELINE_FILE.  At exit the timeline is written in the Chrome trace
+ * event JSON format, which chrome://tracing and the Perfetto UI both load.
+ *
+ * Host tracks (one per thread) show each HIP API from entry to exit.  Device tracks (one per stream, grouped by
+ * device) show kernels, copies and event records.  Device times come from the completion signals of the
+ * commands - hc::completion_future ticks, or markers around the dispatch for module launches - and host
+ * times from hc::get_system_ticks, so all tracks share the HSA system clock.  Copies which block the host
+ * are timed on the host.
+ *
+ * Everything goes into a buffer owned by the recording thread, so the launch and copy paths, which run under the
+ * stream lock, never take a global lock.  Commands timed by their signal wait in the buffer's pending queue until
+ * the signal completes.  At most HIP_TIMELINE_MAX_EVENTS are kept; later events are dropped and counted.
+ *
+ * When profiling is stopped at runtime (see hip_prof_control.cpp) the window recorded so far is written to its
+ * own file and the buffers are cleared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <set>
+#include <unordered_map>
+
+#include <hc.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+bool g_timeline = false;
+
+#define HIP_TIMELINE_HOST_PID 0
+
+
+struct ihipTimelineEvent_t {
+    const char *_cat;       // "api", "kernel", "copy" or "event".  All names are literals or interned.
+    const char *_name;
+    const char *_detail;    // copy path, may be null
+    uint64_t    _bytes;
+    uint64_t    _begin;     // system ticks
+    uint64_t    _end;
+    uint32_t    _pid;       // HIP_TIMELINE_HOST_PID, or 1 + deviceId
+    uint32_t    _tid;       // short tid, or stream id
+};
+
+struct ihipTimelinePending_t {
+    ihipTimelineEvent_t     _event;
+    hc::completion_future   _beginCf;   // if valid, the command began when this completed
+    hc::completion_future   _cf;
+};
+
+// Events recorded by one thread.  The lock is only contended while the timeline is written.
+struct ihipTimelineBuffer_t {
+    std::mutex                          _mutex;
+    std::vector<ihipTimelineEvent_t>    _events;
+    std::deque<ihipTimelinePending_t>   _pending;   // signal-timed commands still running
+};
+
+struct ihipTimelineThread_t {
+    ihipTimelineBuffer_t                *_buffer = nullptr;
+    std::vector<std::pair<const char*, uint64_t>> _apiStack;    // open APIs and their entry ticks
+    std::unordered_map<std::string, const char*> _names;        // interned names seen by this thread
+};
+
+static thread_local ihipTimelineThread_t tls_timeline;
+
+static std::mutex                           g_timelineMutex;    // protects the fields below
+static std::vector<ihipTimelineBuffer_t*>   g_timelineBuffers;
+static std::set<std::string>                g_timelineNames;
+
+static std::atomic<uint64_t>                g_timelineCount(0);
+static std::atomic<uint64_t>                g_timelineDropped(0);
+static uint64_t                             g_timelineStart;
+
+
+// Reserve space for one more event, or count it as dropped.
+static bool ihipTimelineReserve()
+{
+    if (g_timelineCount.fetch_add(1, std::memory_order_relaxed) >= (uint64_t)HIP_TIMELINE_MAX_EVENTS) {
+        g_timelineDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+
+static ihipTimelineBuffer_t *ihipTimelineThreadBuffer()
+{
+    ihipTimelineBuffer_t *buffer = tls_timeline._buffer;
+    if (buffer == nullptr) {
+        buffer = new ihipTimelineBuffer_t;
+        tls_timeline._buffer = buffer;
+        std::lock_guard<std::mutex> l(g_timelineMutex);
+        g_timelineBuffers.push_back(buffer);
+    }
+    return buffer;
+}
+
+
+static void ihipTimelineAddHost(const ihipTimelineEvent_t &e)
+{
+    ihipTimelineBuffer_t *buffer = ihipTimelineThreadBuffer();
+    std::lock_guard<std::mutex> l(buffer->_mutex);
+    buffer->_events.push_back(e);
+}
+
+
+// Move the buffer's completed signal-timed commands to its events.  Caller holds the buffer's lock.
+static void ihipTimelineResolve(ihipTimelineBuffer_t *buffer)
+{
+    while (!buffer->_pending.empty() && buffer->_pending.front()._cf.is_ready()) {
+        ihipTimelinePending_t &p = buffer->_pending.front();
+        p._event._end = p._cf.get_end_tick();
+        if (strcmp(p._event._cat, "event") == 0) {
+            p._event._begin = p._event._end;
+        } else {
+            p._event._begin = p._beginCf.valid() ? p._beginCf.get_end_tick() : p._cf.get_begin_tick();
+        }
+        buffer->_events.push_back(p._event);
+        buffer->_pending.pop_front();
+    }
+}
+
+
+static ihipTimelineEvent_t ihipTimelineStreamEvent(const ihipStream_t *stream, const char *cat, const char *name,
+                                                   const char *detail, uint64_t bytes)
+{
+    return ihipTimelineEvent_t{cat, name, detail, bytes, 0, 0,
+                               (uint32_t)(1 + stream->getDevice()->_deviceId), (uint32_t)stream->_id};
+}
+
+
+//=================================================================================================
+// Chrome trace output:
+//=================================================================================================
+static void ihipTimelinePrintString(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if ((*s == '"') || (*s == '\\')) {
+            fputc('\\', f);
+        }
+        if ((unsigned char)*s >= 0x20) {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+
+static void ihipTimelinePrintEvent(FILE *f, const ihipTimelineEvent_t &e, double usPerTick)
+{
+    double ts = (double)(int64_t)(e._begin - g_timelineStart) * usPerTick;
+
+    fprintf(f, ",\n{\"name\":");
+    ihipTimelinePrintString(f, e._name);
+    fprintf(f, ",\"cat\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f", e._cat, e._pid, e._tid, ts);
+    if (strcmp(e._cat, "event") == 0) {
+        fprintf(f, ",\"ph\":\"i\",\"s\":\"t\"");
+    } else {
+        fprintf(f, ",\"ph\":\"X\",\"dur\":%.3f", (double)(e._end - e._begin) * usPerTick);
+    }
+    if (e._detail) {
+        fprintf(f, ",\"args\":{\"path\":\"%s\",\"bytes\":%lu}", e._detail, e._bytes);
+    }
+    fprintf(f, "}");
+}
+
+
+// Write the events recorded so far and clear them.  Commands still running stay pending, and go into the next
+// window or are counted as dropped at exit.
+static void ihipTimelineWrite(const std::string &fileName, bool atExit)
+{
+    FILE *f = fopen(fileName.c_str(), "w");
+    if (f == nullptr) {
+        fprintf(stderr, "warning: could not open HIP_TIMELINE_FILE=%s\n", fileName.c_str());
+        return;
+    }
+
+    uint64_t freqHz = 0;
+    hsa_system_get_info(HSA_SYSTEM_INFO_TIMESTAMP_FREQUENCY, &freqHz);
+    double usPerTick = freqHz ? 1.0e6 / freqHz : 0.0;
+
+    std::lock_guard<std::mutex> l(g_timelineMutex);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"HIP host (pid %d)\"}}",
+            HIP_TIMELINE_HOST_PID, getpid());
+
+    std::set<std::pair<uint32_t, uint32_t>> tracks;
+    auto printTracks = [&](const ihipTimelineEvent_t &e) {
+        if (tracks.insert(std::make_pair(e._pid, e._tid)).second) {
+            if (e._pid == HIP_TIMELINE_HOST_PID) {
+                fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                        e._pid, e._tid, e._tid);
+            } else {
+                if (tracks.insert(std::make_pair(e._pid, ~0u)).second) {
+                    fprintf(f, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"GPU %u\"}}",
+                            e._pid, e._pid - 1);
+                }
+                fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"stream#%u.%u\"}}",
+                        e._pid, e._tid, e._pid - 1, e._tid);
+            }
+        }
+        ihipTimelinePrintEvent(f, e, usPerTick);
+    };
+
+    uint64_t pending = 0;
+    for (auto buffer : g_timelineBuffers) {
+        std::lock_guard<std::mutex> bl(buffer->_mutex);
+        ihipTimelineResolve(buffer);
+        for (auto &e : buffer->_events) {
+            printTracks(e);
+        }
+        buffer->_events.clear();
+        pending += buffer->_pending.size();
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    uint64_t dropped = g_timelineDropped.exchange(0) + (atExit ? pending : 0);
+    g_timelineCount = pending;
+    if (dropped) {
+        fprintf(stderr, "warning: HIP timeline dropped %lu events (HIP_TIMELINE_MAX_EVENTS=%d, or commands still running at exit)\n",
+                dropped, HIP_TIMELINE_MAX_EVENTS);
+    }
+}
+
+
+// Registered with atexit, so it runs before the HCC runtime is torn down.
+static void ihipTimelineAtExit()
+{
+    if (g_timeline) {
+        g_timeline = false;
+        ihipTimelineWrite(HIP_TIMELINE_FILE, true);
+    }
+}
+
+
+//=================================================================================================
+// Recording:
+//=================================================================================================
+void ihipTimelineInit()
+{
+    if (!HIP_TIMELINE_FILE.empty()) {
+        g_timelineStart = hc::get_system_ticks();
+        g_timeline = !HIP_PROFILE_START_PAUSED;
+        atexit(ihipTimelineAtExit);
+    }
+}
+
+
+// Start a new capture window, see hip_prof_control.cpp.
+void ihipTimelineStart()
+{
+    if (!HIP_TIMELINE_FILE.empty() && !g_timeline) {
+        {
+            std::lock_guard<std::mutex> l(g_timelineMutex);
+            g_timelineStart = hc::get_system_ticks();
+        }
+        g_timeline = true;
+    }
+}
+
+
+// End the capture window and write its timeline to fileName.
+void ihipTimelineStop(const std::string &fileName)
+{
+    if (g_timeline) {
+        g_timeline = false;
+        ihipTimelineWrite(fileName, false);
+    }
+}
+
+
+// Names seen before by this thread are found without the global lock.
+const char *ihipTimelineIntern(const char *name)
+{
+    std::string key(name ? name : "<unknown>");
+    auto iter = tls_timeline._names.find(key);
+    if (iter != tls_timeline._names.end()) {
+        return iter->second;
+    }
+
+    const char *interned;
+    {
+        std::lock_guard<std::mutex> l(g_timelineMutex);
+        interned = g_timelineNames.insert(key).first->c_str();
+    }
+    tls_timeline._names[key] = interned;
+    return interned;
+}
+
+
+void ihipTimelineApiEnter(const char *apiName)
+{
+    tls_timeline._apiStack.push_back(std::make_pair(apiName, hc::get_system_ticks()));
+}
+
+
+void ihipTimelineApiExit(const char *apiName)
+{
+    uint64_t end = hc::get_system_ticks();
+    auto &stack = tls_timeline._apiStack;
+
+    // Entries above the match are APIs which returned without ihipLogStatus:
+    auto iter = stack.end();
+    while ((iter != stack.begin()) && ((iter - 1)->first != apiName)) {
+        iter--;
+    }
+    if (iter == stack.begin()) {
+        return;
+    }
+
+    uint64_t begin = (iter - 1)->second;
+    stack.erase(iter - 1, stack.end());
+    if (ihipTimelineReserve()) {
+        ihipTimelineAddHost(ihipTimelineEvent_t{"api", apiName, nullptr, 0, begin, end,
+                                                HIP_TIMELINE_HOST_PID, (uint32_t)tls_shortTid.tid()});
+    }
+}
+
+
+void ihipTimelineAddOp(const ihipStream_t *stream, const char *cat, const char *name, const char *detail,
+                       uint64_t bytes, uint64_t begin, uint64_t end)
+{
+    if (ihipTimelineReserve()) {
+        ihipTimelineEvent_t e = ihipTimelineStreamEvent(stream, cat, name, detail, bytes);
+        e._begin = begin;
+        e._end = end;
+        ihipTimelineAddHost(e);
+    }
+}
+
+
+void ihipTimelineAddOp(const ihipStream_t *stream, const char *cat, const char *name, const char *detail,
+                       uint64_t bytes, const hc::completion_future &cf)
+{
+    ihipTimelineAddOp(stream, cat, name, detail, bytes, hc::completion_future(), cf);
+}
+
+
+void ihipTimelineAddOp(const ihipStream_t *stream, const char *cat, const char *name, const char *detail,
+                       uint64_t bytes, const hc::completion_future &beginCf, const hc::completion_future &cf)
+{
+    if (cf.valid() && ihipTimelineReserve()) {
+        ihipTimelineBuffer_t *buffer = ihipTimelineThreadBuffer();
+        std::lock_guard<std::mutex> l(buffer->_mutex);
+        ihipTimelineResolve(buffer);
+        buffer->_pending.push_back(ihipTimelinePending_t{ihipTimelineStreamEvent(stream, cat, name, detail, bytes),
+                                                         beginCf, cf});
+    }
+}
@@ -0,0 +1,502 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+/**
+ * @file hip_trace.cpp
+ *
+ * Binary API trace, enabled by setting HIP_TRACE_FILE.
+ *
+ * Each thread owns a single-producer/single-consumer ring of ihipTraceRecord_t.  The API thread fills the slot at
+ * _head and publishes it with a release store; a writer thread drains [_tail, _head) to the file every few ms and
+ * then advances _tail.  If the writer falls behind the ring fills and further records are dropped and counted,
+ * so the API path never blocks.  When a thread exits its ring is retired and freed once drained.
+ *
+ * File layout (little-endian):
+ *   header : char magic[8] "HIPTRACE", uint32 version, uint32 record size, uint64 tick frequency (Hz), uint64 pid
+ *   chunks : uint32 type, uint32 count, then count entries:
+ *            1 = API names    : uint16 api id, uint16 length, name
+ *            2 = records      : ihipTraceRecord_t
+ *            3 = error names  : uint16 hipError_t, uint16 length, name
+ *            4 = drop counts  : uint32 tid, uint32 0, uint64 records dropped so far
+ *
+ * Names are written after the records which use them, so decoders read the whole file before printing.
+ * When profiling is stopped and restarted at runtime (see hip_prof_control.cpp) each capture window gets its own
+ * file, with its own header and names.
+ * bin/hiptracedecode prints the file in the HIP_TRACE_API format.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <set>
+
+#include <hc.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+bool g_traceBinary = false;
+
+#define HIP_TRACE_VERSION 1
+#define HIP_TRACE_FLUSH_MS 10
+
+enum ihipTraceChunk_t {
+    ihipTraceChunkApiNames   = 1,
+    ihipTraceChunkRecords    = 2,
+    ihipTraceChunkErrorNames = 3,
+    ihipTraceChunkDrops      = 4,
+};
+
+
+struct ihipTraceRing_t {
+    ihipTraceRing_t(uint32_t tid, size_t capacity) :
+        _tid(tid),
+        _mask(capacity - 1),
+        _records(capacity),
+        _head(0),
+        _tail(0),
+        _dropped(0),
+        _droppedWritten(0),
+        _retired(false)
+    {};
+
+    uint32_t                        _tid;
+    uint64_t                        _mask;
+    std::vector<ihipTraceRecord_t>  _records;
+    std::atomic<uint64_t>           _head;      // next slot written by the owning thread
+    std::atomic<uint64_t>           _tail;      // next slot read by the writer
+    std::atomic<uint64_t>           _dropped;   // records lost because the ring was full
+    uint64_t                        _droppedWritten;  // writer only
+    std::atomic<bool>               _retired;   // owning thread has exited
+};
+
+
+// Retires the ring of a thread when the thread exits.  The writer frees it.
+struct ihipTraceRingHandle_t {
+    ~ihipTraceRingHandle_t() {
+        if (_ring) {
+            _ring->_retired.store(true, std::memory_order_release);
+        }
+    };
+
+    ihipTraceRing_t *_ring = nullptr;
+};
+
+static thread_local ihipTraceRingHandle_t tls_traceRing;
+
+
+class ihipTraceWriter_t {
+public:
+    ihipTraceWriter_t() : _file(nullptr), _stop(false), _apiNamesWritten(0) {};
+    ~ihipTraceWriter_t();
+
+    bool open(const std::string &fileName, bool startPaused);
+    bool resume(const std::string &fileName);
+    void pause(const std::string &fileName, const std::string &closedName);
+
+    ihipTraceRing_t *newRing(uint32_t tid);
+    uint16_t apiId(const char *apiName);
+    int findApiId(const char *apiName);
+    std::string apiName(uint16_t id);
+
+private:
+    bool openFile(const std::string &fileName);
+    void writerLoop();
+    void drain();
+    void writeChunk(uint32_t type, uint32_t count);
+    void writeName(uint16_t id, const char *name);
+
+private:
+    std::mutex                  _fileMutex; // protects _file, and held while draining into it
+    FILE                        *_file;
+    std::thread                 _thread;
+
+    std::mutex                  _mutex;     // protects the fields below
+    std::condition_variable     _wake;
+    bool                        _stop;
+    std::vector<ihipTraceRing_t*> _rings;
+    std::vector<std::string>    _apiNames;
+    std::map<std::string, uint16_t> _apiIds;
+
+    // With _fileMutex held:
+    size_t                      _apiNamesWritten;
+    std::set<int>               _errorNamesWritten;
+};
+
+static ihipTraceWriter_t g_traceWriter;
+
+
+// Open the file and write its header.  Each file is complete on its own, so names are written again.
+// Caller holds _fileMutex.
+bool ihipTraceWriter_t::openFile(const std::string &fileName)
+{
+    _file = fopen(fileName.c_str(), "wb");
+    if (_file == nullptr) {
+        return false;
+    }
+    _apiNamesWritten = 0;
+    _errorNamesWritten.clear();
+
+    uint64_t freqHz = 0;
+    hsa_system_get_info(HSA_SYSTEM_INFO_TIMESTAMP_FREQUENCY, &freqHz);
+
+    char magic[8] = {'H', 'I', 'P', 'T', 'R', 'A', 'C', 'E'};
+    uint32_t version = HIP_TRACE_VERSION;
+    uint32_t recordSize = sizeof(ihipTraceRecord_t);
+    uint64_t pid = getpid();
+    fwrite(magic, sizeof(magic), 1, _file);
+    fwrite(&version, sizeof(version), 1, _file);
+    fwrite(&recordSize, sizeof(recordSize), 1, _file);
+    fwrite(&freqHz, sizeof(freqHz), 1, _file);
+    fwrite(&pid, sizeof(pid), 1, _file);
+    return true;
+}
+
+
+// With startPaused, the writer thread is started but no file is written until resume.
+bool ihipTraceWriter_t::open(const std::string &fileName, bool startPaused)
+{
+    if (!startPaused) {
+        std::lock_guard<std::mutex> fl(_fileMutex);
+        if (!openFile(fileName)) {
+            return false;
+        }
+    }
+
+    _thread = std::thread(&ihipTraceWriter_t::writerLoop, this);
+    return true;
+}
+
+
+bool ihipTraceWriter_t::resume(const std::string &fileName)
+{
+    std::lock_guard<std::mutex> fl(_fileMutex);
+    return _file || openFile(fileName);
+}
+
+
+// Write out everything recorded so far, close the file and rename it to closedName.  Records made after
+// g_traceBinary was cleared stay in the rings and go to the next file.
+void ihipTraceWriter_t::pause(const std::string &fileName, const std::string &closedName)
+{
+    std::lock_guard<std::mutex> fl(_fileMutex);
+    if (_file) {
+        drain();
+        fclose(_file);
+        _file = nullptr;
+        if (rename(fileName.c_str(), closedName.c_str()) != 0) {
+            fprintf(stderr, "warning: could not rename %s to %s\n", fileName.c_str(), closedName.c_str());
+        }
+    }
+}
+
+
+// Runs when the process exits.  Threads still running keep their rings; what they have recorded so far is written.
+ihipTraceWriter_t::~ihipTraceWriter_t()
+{
+    if (_thread.joinable()) {
+        g_traceBinary = false;
+        {
+            std::lock_guard<std::mutex> l(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        _thread.join();
+    }
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+
+ihipTraceRing_t *ihipTraceWriter_t::newRing(uint32_t tid)
+{
+    size_t capacity = 1;
+    while (capacity < (size_t)std::max(HIP_TRACE_RING_SIZE, 2)) {
+        capacity <<= 1;
+    }
+
+    ihipTraceRing_t *ring = new ihipTraceRing_t(tid, capacity);
+
+    std::lock_guard<std::mutex> l(_mutex);
+    _rings.push_back(ring);
+    return ring;
+}
+
+
+uint16_t ihipTraceWriter_t::apiId(const char *apiName)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    auto iter = _apiIds.find(apiName);
+    if (iter != _apiIds.end()) {
+        return iter->second;
+    }
+
+    uint16_t id = _apiNames.size();
+    _apiNames.push_back(apiName);
+    _apiIds[apiName] = id;
+    return id;
+}
+
+
+// Returns -1 if no API of this name has been called.
+int ihipTraceWriter_t::findApiId(const char *apiName)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    auto iter = _apiIds.find(apiName);
+    return (iter != _apiIds.end()) ? iter->second : -1;
+}
+
+
+std::string ihipTraceWriter_t::apiName(uint16_t id)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    return (id < _apiNames.size()) ? _apiNames[id] : std::string();
+}
+
+
+void ihipTraceWriter_t::writeChunk(uint32_t type, uint32_t count)
+{
+    fwrite(&type, sizeof(type), 1, _file);
+    fwrite(&count, sizeof(count), 1, _file);
+}
+
+
+void ihipTraceWriter_t::writeName(uint16_t id, const char *name)
+{
+    uint16_t len = strlen(name);
+    fwrite(&id, sizeof(id), 1, _file);
+    fwrite(&len, sizeof(len), 1, _file);
+    fwrite(name, len, 1, _file);
+}
+
+
+void ihipTraceWriter_t::drain()
+{
+    std::vector<ihipTraceRing_t*> rings;
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        rings = _rings;
+    }
+
+    std::vector<int> newErrors;
+    std::vector<ihipTraceRing_t*> newDrops;
+    for (auto ring : rings) {
+        uint64_t tail = ring->_tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->_head.load(std::memory_order_acquire);
+
+        if (head != tail) {
+            writeChunk(ihipTraceChunkRecords, head - tail);
+
+            // The live range may wrap around the end of the ring:
+            while (tail != head) {
+                uint64_t first = tail & ring->_mask;
+                uint64_t cnt = std::min(head - tail, ring->_mask + 1 - first);
+                fwrite(&ring->_records[first], sizeof(ihipTraceRecord_t), cnt, _file);
+
+                for (uint64_t i = first; i < first + cnt; i++) {
+                    const ihipTraceRecord_t &r = ring->_records[i];
+                    if ((r._kind == ihipTraceApiExit) && _errorNamesWritten.insert(r._arg[0]).second) {
+                        newErrors.push_back(r._arg[0]);
+                    }
+                }
+                tail += cnt;
+            }
+            ring->_tail.store(head, std::memory_order_release);
+        }
+
+        if (ring->_dropped.load(std::memory_order_relaxed) != ring->_droppedWritten) {
+            newDrops.push_back(ring);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        if (_apiNamesWritten < _apiNames.size()) {
+            writeChunk(ihipTraceChunkApiNames, _apiNames.size() - _apiNamesWritten);
+            for (; _apiNamesWritten < _apiNames.size(); _apiNamesWritten++) {
+                writeName(_apiNamesWritten, _apiNames[_apiNamesWritten].c_str());
+            }
+        }
+
+        // Free rings of exited threads once everything they recorded has been written.
+        for (auto iter = _rings.begin(); iter != _rings.end(); ) {
+            ihipTraceRing_t *ring = *iter;
+            if (ring->_retired.load(std::memory_order_acquire) &&
+                (ring->_head.load(std::memory_order_acquire) == ring->_tail.load(std::memory_order_relaxed)) &&
+                (std::find(newDrops.begin(), newDrops.end(), ring) == newDrops.end())) {
+                delete ring;
+                iter = _rings.erase(iter);
+            } else {
+                iter++;
+            }
+        }
+    }
+
+    if (!newErrors.empty()) {
+        writeChunk(ihipTraceChunkErrorNames, newErrors.size());
+        for (int e : newErrors) {
+            writeName(e, ihipErrorString(static_cast<hipError_t>(e)));
+        }
+    }
+
+    if (!newDrops.empty()) {
+        writeChunk(ihipTraceChunkDrops, newDrops.size());
+        for (auto ring : newDrops) {
+            uint32_t pad = 0;
+            ring->_droppedWritten = ring->_dropped.load(std::memory_order_relaxed);
+            fwrite(&ring->_tid, sizeof(ring->_tid), 1, _file);
+            fwrite(&pad, sizeof(pad), 1, _file);
+            fwrite(&ring->_droppedWritten, sizeof(ring->_droppedWritten), 1, _file);
+        }
+    }
+
+    fflush(_file);
+}
+
+
+void ihipTraceWriter_t::writerLoop()
+{
+    std::unique_lock<std::mutex> l(_mutex);
+    while (!_stop) {
+        _wake.wait_for(l, std::chrono::milliseconds(HIP_TRACE_FLUSH_MS));
+        l.unlock();
+        {
+            std::lock_guard<std::mutex> fl(_fileMutex);
+            if (_file) {
+                drain();
+            }
+        }
+        l.lock();
+    }
+}
+
+
+//=================================================================================================
+// Called from API_TRACE / ihipLogStatus:
+//=================================================================================================
+void ihipTraceInit()
+{
+    if (!HIP_TRACE_FILE.empty()) {
+        if (g_traceWriter.open(HIP_TRACE_FILE, HIP_PROFILE_START_PAUSED)) {
+            g_traceBinary = !HIP_PROFILE_START_PAUSED;
+        } else {
+            fprintf(stderr, "warning: could not open HIP_TRACE_FILE=%s, binary trace is disabled\n", HIP_TRACE_FILE.c_str());
+            HIP_TRACE_FILE.clear();
+        }
+    }
+}
+
+
+// Start a new capture window, see hip_prof_control.cpp.
+void ihipTraceStart()
+{
+    if (!HIP_TRACE_FILE.empty() && !g_traceBinary) {
+        if (g_traceWriter.resume(HIP_TRACE_FILE)) {
+            g_traceBinary = true;
+        } else {
+            fprintf(stderr, "warning: could not open HIP_TRACE_FILE=%s\n", HIP_TRACE_FILE.c_str());
+        }
+    }
+}
+
+
+// End the capture window, leaving its trace in closedName.
+void ihipTraceStop(const std::string &closedName)
+{
+    if (g_traceBinary) {
+        g_traceBinary = false;
+        g_traceWriter.pause(HIP_TRACE_FILE, closedName);
+    }
+}
+
+
+uint16_t ihipTraceApiId(const char *apiName)
+{
+    return g_traceWriter.apiId(apiName);
+}
+
+
+int ihipTraceFindApiId(const char *apiName)
+{
+    return g_traceWriter.findApiId(apiName);
+}
+
+
+std::string ihipTraceApiName(uint16_t apiId)
+{
+    return g_traceWriter.apiName(apiId);
+}
+
+
+ihipTraceRecord_t *ihipTraceReserve(uint16_t apiId, ihipTraceRecordKind_t kind)
+{
+    uint64_t apiSeqNum;
+    if (kind == ihipTraceApiEnter) {
+        apiSeqNum = tls_shortTid.incApiSeqNum();
+        ihipProfTriggerCheck(tls_shortTid.tid(), apiSeqNum);
+    } else {
+        apiSeqNum = tls_shortTid.apiSeqNum();
+    }
+
+    ihipTraceRing_t *ring = tls_traceRing._ring;
+    if (ring == nullptr) {
+        ring = g_traceWriter.newRing(tls_shortTid.tid());
+        tls_traceRing._ring = ring;
+    }
+
+    uint64_t head = ring->_head.load(std::memory_order_relaxed);
+    if (head - ring->_tail.load(std::memory_order_acquire) > ring->_mask) {
+        ring->_dropped.store(ring->_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    ihipTraceRecord_t *r = &ring->_records[head & ring->_mask];
+    r->_apiId     = apiId;
+    r->_kind      = kind;
+    r->_argCnt    = 0;
+    r->_tid       = ring->_tid;
+    r->_apiSeqNum = apiSeqNum;
+    r->_timestamp = hc::get_system_ticks();
+    return r;
+}
+
+
+void ihipTraceCommit()
+{
+    ihipTraceRing_t *ring = tls_traceRing._ring;
+    ring->_head.store(ring->_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+uint64_t ihipTraceStreamWord(hipStream_t stream)
+{
+    if (stream == nullptr) {
+        return ~0ull;
+    } else {
+        return ((uint64_t)stream->getDevice()->_deviceId << 32) | (stream->_id & 0xffffffff);
+    }
+}
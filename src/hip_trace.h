@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+//#pragma once
+
+#ifndef HIP_TRACE_H
+#define HIP_TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+//---
+// Binary API trace, enabled by HIP_TRACE_FILE.
+//
+// Each HIP API appends one fixed-size record at entry and one at exit to a ring owned by the calling thread.
+// No strings are built and no locks are taken on the API path - arguments are stored as raw 64-bit words plus
+// a type tag.  A background thread drains the rings to HIP_TRACE_FILE and bin/hiptracedecode turns the file
+// back into the HIP_TRACE_API text format.  See hip_trace.cpp for the file layout.
+
+#define HIP_TRACE_MAX_ARGS 8
+
+// Type tag for each argument word.  Tells the decoder how to print the word.
+enum ihipTraceArgType_t {
+    ihipTraceArgNone       = 0,
+    ihipTraceArgInt        = 1,  // signed integer
+    ihipTraceArgUInt       = 2,  // unsigned integer or enum
+    ihipTraceArgPtr        = 3,  // pointer, printed in hex
+    ihipTraceArgDouble     = 4,  // bits of a double
+    ihipTraceArgMemcpyKind = 5,
+    ihipTraceArgStream     = 6,  // (deviceId << 32) | stream id, or ~0 for the null stream
+    ihipTraceArgDim3       = 7,  // x, y, z packed in 21 bits each
+    ihipTraceArgError      = 8,  // hipError_t
+    ihipTraceArgOther      = 9,  // type which can not be stored in a word, printed as '?'
+};
+
+enum ihipTraceRecordKind_t {
+    ihipTraceApiEnter = 1,
+    ihipTraceApiExit  = 2,
+};
+
+// One API entry or exit.  Exit records store the return code as their only argument.
+struct ihipTraceRecord_t {
+    uint16_t    _apiId;
+    uint8_t     _kind;
+    uint8_t     _argCnt;
+    uint32_t    _tid;
+    uint64_t    _apiSeqNum;
+    uint64_t    _timestamp;     // hc::get_system_ticks
+    uint8_t     _argType[HIP_TRACE_MAX_ARGS];
+    uint64_t    _arg[HIP_TRACE_MAX_ARGS];
+};
+static_assert(sizeof(ihipTraceRecord_t) == 96, "ihipTraceRecord_t layout is part of the trace file format");
+
+
+extern bool g_traceBinary;
+
+// Return a small id for an API name.  Called once per call site, the result is cached in a function-local static.
+extern uint16_t ihipTraceApiId(const char *apiName);
+extern int ihipTraceFindApiId(const char *apiName);     // -1 if the API has not been seen
+extern std::string ihipTraceApiName(uint16_t apiId);
+
+// Claim the next slot in this thread's ring and fill in the header.  Returns NULL if the ring is full, in which
+// case the record is counted as dropped.  ihipTraceCommit publishes the slot to the flusher.
+extern ihipTraceRecord_t *ihipTraceReserve(uint16_t apiId, ihipTraceRecordKind_t kind);
+extern void ihipTraceCommit();
+
+extern uint64_t ihipTraceStreamWord(hipStream_t stream);
+
+
+//---
+// Convert one argument into a tagged word.  Overloads handle the HIP types which print specially;
+// the templates handle integers, enums, floats and pointers.
+inline void ihipTracePush(ihipTraceRecord_t *r, ihipTraceArgType_t type, uint64_t word)
+{
+    r->_argType[r->_argCnt] = type;
+    r->_arg[r->_argCnt] = word;
+    r->_argCnt++;
+}
+
+inline void ihipTraceArg(ihipTraceRecord_t *r, hipStream_t v)
+{
+    ihipTracePush(r, ihipTraceArgStream, ihipTraceStreamWord(v));
+}
+
+inline void ihipTraceArg(ihipTraceRecord_t *r, hipMemcpyKind v)
+{
+    ihipTracePush(r, ihipTraceArgMemcpyKind, static_cast<uint64_t>(v));
+}
+
+inline void ihipTraceArg(ihipTraceRecord_t *r, hipError_t v)
+{
+    ihipTracePush(r, ihipTraceArgError, static_cast<uint64_t>(v));
+}
+
+inline void ihipTraceArg(ihipTraceRecord_t *r, const dim3 &v)
+{
+    const uint64_t m = (1ull << 21) - 1;
+    ihipTracePush(r, ihipTraceArgDim3, (v.x & m) | ((v.y & m) << 21) | ((uint64_t)(v.z & m) << 42));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+ihipTraceArg(ihipTraceRecord_t *r, T v)
+{
+    ihipTracePush(r, std::is_signed<T>::value ? ihipTraceArgInt : ihipTraceArgUInt,
+                  static_cast<uint64_t>(static_cast<int64_t>(v)));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+ihipTraceArg(ihipTraceRecord_t *r, T v)
+{
+    double d = v;
+    uint64_t word;
+    memcpy(&word, &d, sizeof(word));
+    ihipTracePush(r, ihipTraceArgDouble, word);
+}
+
+template <typename T>
+inline void ihipTraceArg(ihipTraceRecord_t *r, T *v)
+{
+    ihipTracePush(r, ihipTraceArgPtr, reinterpret_cast<uintptr_t>(v));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_class<T>::value || std::is_union<T>::value>::type
+ihipTraceArg(ihipTraceRecord_t *r, const T &)
+{
+    ihipTracePush(r, ihipTraceArgOther, 0);
+}
+
+
+// Variadic peel, as in trace_helper.h.  Arguments past HIP_TRACE_MAX_ARGS are dropped.
+inline void ihipTraceArgs(ihipTraceRecord_t *r)
+{
+}
+
+template <typename T, typename... Args>
+inline void ihipTraceArgs(ihipTraceRecord_t *r, const T &first, const Args&... args)
+{
+    if (r->_argCnt < HIP_TRACE_MAX_ARGS) {
+        ihipTraceArg(r, first);
+        ihipTraceArgs(r, args...);
+    }
+}
+
+
+template <typename... Args>
+inline void ihipTraceEnter(uint16_t apiId, const Args&... args)
+{
+    ihipTraceRecord_t *r = ihipTraceReserve(apiId, ihipTraceApiEnter);
+    if (r) {
+        ihipTraceArgs(r, args...);
+        ihipTraceCommit();
+    }
+}
+
+inline void ihipTraceExit(uint16_t apiId, hipError_t status)
+{
+    ihipTraceRecord_t *r = ihipTraceReserve(apiId, ihipTraceApiExit);
+    if (r) {
+        ihipTraceArg(r, status);
+        ihipTraceCommit();
+    }
+}
+
+#endif
@@ -0,0 +1,417 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file hip_vmm.cpp
+ *
+ * Virtual memory management: reserve device virtual address ranges, create physical chunks in device memory,
+ * map chunks into the ranges and set per-device access.  A buffer can then grow in place by mapping more chunks
+ * after its end - no new allocation, no copy, and no hipFree (which drains every stream).
+ *
+ * Built on the hsa_amd_vmem API.  CMake defines HIP_HAS_HSA_VMEM when the ROCr headers provide it; without it
+ * every API returns hipErrorNotSupported.
+ *
+ * Mapped ranges are added to the HCC pointer tracker as device memory of the chunk's device, so hipMemcpy and
+ * the other copy paths accept them like hipMalloc memory.  Adjacent chunks of one device in a reservation are
+ * tracked as a single entry, so a copy may span chunks; map and unmap rebuild the entries of their reservation.
+ *
+ * ROCr aligns reservations to its own granularity only.  A larger alignment is honored by reserving alignment
+ * extra bytes and handing out the aligned part; hipMemAddressFree releases the whole reservation.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+#include <hc.hpp>
+#include <hc_am.hpp>
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc.h"
+#include "trace_helper.h"
+
+
+#if HIP_HAS_HSA_VMEM
+
+struct ihipMemGenericAllocationHandle {
+    hsa_amd_vmem_alloc_handle_t _handle;
+    size_t                      _sizeBytes;
+    ihipDevice_t               *_device;
+};
+
+struct ihipVmemReservation_t {
+    size_t                      _sizeBytes;
+    void                       *_rawBase;   // range actually reserved from ROCr, including alignment padding.
+    size_t                      _rawSize;
+    std::vector<char*>          _tracked;   // starts of the pointer tracker entries for the mapped chunks.
+};
+
+struct ihipVmemMapping_t {
+    size_t                      _sizeBytes;
+    ihipDevice_t               *_device;
+};
+
+static std::mutex                                   g_vmemMutex;
+// Reserved ranges and current mappings, keyed by (aligned) start address.
+static std::map<char*, ihipVmemReservation_t>       g_vmemReservations;
+static std::map<char*, ihipVmemMapping_t>           g_vmemMappings;
+
+
+// The reserved range containing all of [ptr, ptr+size), or end().  Caller holds g_vmemMutex.
+static std::map<char*, ihipVmemReservation_t>::iterator findReservation(const void *ptr, size_t size)
+{
+    const char *p = static_cast<const char*>(ptr);
+    auto it = g_vmemReservations.upper_bound(const_cast<char*>(p));
+    if (it == g_vmemReservations.begin()) {
+        return g_vmemReservations.end();
+    }
+    --it;
+    return (p + size <= it->first + it->second._sizeBytes) ? it : g_vmemReservations.end();
+}
+
+
+// Rebuild the pointer tracker entries of a reservation: one entry per run of adjacent chunks on the same device.
+// Copies racing with hipMemMap/hipMemUnmap on the same reservation may briefly not find their range.
+// Caller holds g_vmemMutex.
+static void retrackReservation(char *start, ihipVmemReservation_t &r)
+{
+    for (auto p : r._tracked) {
+        hc::am_memtracker_remove(p);
+    }
+    r._tracked.clear();
+
+    char *end = start + r._sizeBytes;
+    auto m = g_vmemMappings.lower_bound(start);
+    while ((m != g_vmemMappings.end()) && (m->first < end)) {
+        char *runStart = m->first;
+        ihipDevice_t *device = m->second._device;
+        size_t runSize = m->second._sizeBytes;
+
+        auto next = std::next(m);
+        while ((next != g_vmemMappings.end()) && (next->first == runStart + runSize) && (next->first < end) &&
+               (next->second._device == device)) {
+            runSize += next->second._sizeBytes;
+            ++next;
+        }
+
+        hc::AmPointerInfo ptrInfo(NULL/*hostPointer*/, runStart/*devicePointer*/, runSize, device->_acc, true/*isInDeviceMem*/, false/*isAmManaged*/);
+        hc::am_memtracker_add(runStart, ptrInfo);
+        hc::am_memtracker_update(runStart, device->_deviceId, 0);
+        r._tracked.push_back(runStart);
+
+        m = next;
+    }
+}
+
+
+static hsa_status_t findDevicePool(hsa_amd_memory_pool_t pool, void *data)
+{
+    hsa_amd_segment_t segment;
+    uint32_t flags;
+    bool allocAllowed = false;
+
+    if ((hsa_amd_memory_pool_get_info(pool, HSA_AMD_MEMORY_POOL_INFO_SEGMENT, &segment) != HSA_STATUS_SUCCESS) ||
+        (segment != HSA_AMD_SEGMENT_GLOBAL)) {
+        return HSA_STATUS_SUCCESS;
+    }
+    hsa_amd_memory_pool_get_info(pool, HSA_AMD_MEMORY_POOL_INFO_RUNTIME_ALLOC_ALLOWED, &allocAllowed);
+    if (allocAllowed && (hsa_amd_memory_pool_get_info(pool, HSA_AMD_MEMORY_POOL_INFO_GLOBAL_FLAGS, &flags) == HSA_STATUS_SUCCESS) &&
+        (flags & HSA_AMD_MEMORY_POOL_GLOBAL_FLAG_COARSE_GRAINED)) {
+        *static_cast<std::pair<bool, hsa_amd_memory_pool_t>*>(data) = std::make_pair(true, pool);
+        return HSA_STATUS_INFO_BREAK;
+    }
+    return HSA_STATUS_SUCCESS;
+}
+
+
+// Device and device memory pool named by prop, or nullptr if prop is invalid.
+static ihipDevice_t *propDevice(const hipMemAllocationProp *prop, hsa_amd_memory_pool_t *pool)
+{
+    if ((prop == nullptr) || (prop->type != hipMemAllocationTypePinned) || (prop->location.type != hipMemLocationTypeDevice) ||
+        (prop->location.id < 0) || ((unsigned)prop->location.id >= g_deviceCnt)) {
+        return nullptr;
+    }
+
+    ihipDevice_t *device = ihipGetDevice(prop->location.id);
+    std::pair<bool, hsa_amd_memory_pool_t> found(false, hsa_amd_memory_pool_t());
+    hsa_amd_agent_iterate_memory_pools(device->_hsaAgent, findDevicePool, &found);
+    if (!found.first) {
+        return nullptr;
+    }
+    *pool = found.second;
+    return device;
+}
+
+#endif
+
+
+hipError_t hipMemGetAllocationGranularity(size_t* granularity, const hipMemAllocationProp* prop, hipMemAllocationGranularity_flags option)
+{
+    HIP_INIT_API(granularity, prop, option);
+
+#if HIP_HAS_HSA_VMEM
+    hsa_amd_memory_pool_t pool;
+    if ((granularity == nullptr) || (propDevice(prop, &pool) == nullptr)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    size_t granule = 0;
+    if (hsa_amd_memory_pool_get_info(pool, HSA_AMD_MEMORY_POOL_INFO_RUNTIME_ALLOC_GRANULE, &granule) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorRuntimeMemory);
+    }
+
+    // 2MB chunks let the GPU use its large page size.
+    const size_t recommended = 2*1024*1024;
+    *granularity = (option == hipMemAllocationGranularityRecommended) ? std::max(granule, recommended) : granule;
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
+
+
+hipError_t hipMemAddressReserve(void** ptr, size_t size, size_t alignment, void* addr, unsigned long long flags)
+{
+    HIP_INIT_API(ptr, size, alignment, addr, flags);
+
+#if HIP_HAS_HSA_VMEM
+    if ((ptr == nullptr) || (size == 0) || (flags != 0) || (alignment & (alignment - 1)) ||
+        (size > SIZE_MAX - alignment)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    // The hint must already be aligned; ROCr aligns the returned range to the granularity.
+    uint64_t hint = reinterpret_cast<uint64_t>(addr);
+    if (alignment && (hint % alignment)) {
+        hint = 0;
+    }
+
+    void *raw = nullptr;
+    size_t rawSize = size;
+    if (hsa_amd_vmem_address_reserve(&raw, rawSize, hint, 0) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorMemoryAllocation);
+    }
+
+    // Not aligned enough - reserve again with room to align within the range:
+    if (alignment && (reinterpret_cast<uintptr_t>(raw) % alignment)) {
+        hsa_amd_vmem_address_free(raw, rawSize);
+        rawSize = size + alignment;
+        if (hsa_amd_vmem_address_reserve(&raw, rawSize, 0, 0) != HSA_STATUS_SUCCESS) {
+            return ihipLogStatus(hipErrorMemoryAllocation);
+        }
+    }
+
+    char *va = static_cast<char*>(raw);
+    if (alignment) {
+        va = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_vmemMutex);
+        g_vmemReservations[va] = ihipVmemReservation_t{size, raw, rawSize, {}};
+    }
+    tprintf(DB_MEM, "reserved va:%p size:%zu (raw:%p size:%zu)\n", va, size, raw, rawSize);
+    *ptr = va;
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
+
+
+hipError_t hipMemAddressFree(void* ptr, size_t size)
+{
+    HIP_INIT_API(ptr, size);
+
+#if HIP_HAS_HSA_VMEM
+    std::lock_guard<std::mutex> lock(g_vmemMutex);
+
+    auto it = g_vmemReservations.find(static_cast<char*>(ptr));
+    if ((it == g_vmemReservations.end()) || (it->second._sizeBytes != size)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    // Refuse while any chunk is still mapped in the range.
+    auto m = g_vmemMappings.lower_bound(it->first);
+    if ((m != g_vmemMappings.end()) && (m->first < it->first + size)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    if (hsa_amd_vmem_address_free(it->second._rawBase, it->second._rawSize) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    g_vmemReservations.erase(it);
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
+
+
+hipError_t hipMemCreate(hipMemGenericAllocationHandle_t* handle, size_t size, const hipMemAllocationProp* prop, unsigned long long flags)
+{
+    HIP_INIT_API(handle, size, prop, flags);
+
+#if HIP_HAS_HSA_VMEM
+    hsa_amd_memory_pool_t pool;
+    ihipDevice_t *device = propDevice(prop, &pool);
+    if ((handle == nullptr) || (size == 0) || (flags != 0) || (device == nullptr)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    hsa_amd_vmem_alloc_handle_t h;
+    if (hsa_amd_vmem_handle_create(pool, size, MEMORY_TYPE_NONE, 0, &h) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorMemoryAllocation);
+    }
+
+    *handle = new ihipMemGenericAllocationHandle{h, size, device};
+    tprintf(DB_MEM, "created vmem chunk size:%zu on dev:%d\n", size, device->_deviceId);
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
+
+
+hipError_t hipMemRelease(hipMemGenericAllocationHandle_t handle)
+{
+    HIP_INIT_API(handle);
+
+#if HIP_HAS_HSA_VMEM
+    if (handle == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    // ROCr keeps the memory until its last mapping goes away.
+    if (hsa_amd_vmem_handle_release(handle->_handle) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    delete handle;
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
+
+
+hipError_t hipMemMap(void* ptr, size_t size, size_t offset, hipMemGenericAllocationHandle_t handle, unsigned long long flags)
+{
+    HIP_INIT_API(ptr, size, offset, handle, flags);
+
+#if HIP_HAS_HSA_VMEM
+    if ((handle == nullptr) || (size == 0) || (flags != 0) || (offset + size > handle->_sizeBytes)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    std::lock_guard<std::mutex> lock(g_vmemMutex);
+
+    auto r = findReservation(ptr, size);
+    if (r == g_vmemReservations.end()) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    if (hsa_amd_vmem_map(ptr, size, offset, handle->_handle, 0) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    ihipDevice_t *device = handle->_device;
+    g_vmemMappings[static_cast<char*>(ptr)] = ihipVmemMapping_t{size, device};
+    retrackReservation(r->first, r->second);
+    tprintf(DB_MEM, "mapped vmem chunk at %p size:%zu offset:%zu on dev:%d\n", ptr, size, offset, device->_deviceId);
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
+
+
+hipError_t hipMemUnmap(void* ptr, size_t size)
+{
+    HIP_INIT_API(ptr, size);
+
+#if HIP_HAS_HSA_VMEM
+    std::lock_guard<std::mutex> lock(g_vmemMutex);
+
+    auto it = g_vmemMappings.find(static_cast<char*>(ptr));
+    if ((it == g_vmemMappings.end()) || (it->second._sizeBytes != size)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    if (hsa_amd_vmem_unmap(ptr, size) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    g_vmemMappings.erase(it);
+
+    auto r = findReservation(ptr, size);
+    if (r != g_vmemReservations.end()) {
+        retrackReservation(r->first, r->second);
+    }
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
+
+
+hipError_t hipMemSetAccess(void* ptr, size_t size, const hipMemAccessDesc* desc, size_t count)
+{
+    HIP_INIT_API(ptr, size, desc, count);
+
+#if HIP_HAS_HSA_VMEM
+    if ((desc == nullptr) || (count == 0) || (size == 0)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    std::vector<hsa_amd_memory_access_desc_t> hsaDesc(count);
+    for (size_t i=0; i<count; i++) {
+        const hipMemLocation &loc = desc[i].location;
+        if ((loc.type != hipMemLocationTypeDevice) || (loc.id < 0) || ((unsigned)loc.id >= g_deviceCnt)) {
+            return ihipLogStatus(hipErrorInvalidDevice);
+        }
+        hsaDesc[i].agent_handle = ihipGetDevice(loc.id)->_hsaAgent;
+        switch (desc[i].flags) {
+        case hipMemAccessFlagsProtNone:       hsaDesc[i].permissions = HSA_ACCESS_PERMISSION_NONE; break;
+        case hipMemAccessFlagsProtRead:       hsaDesc[i].permissions = HSA_ACCESS_PERMISSION_RO;   break;
+        case hipMemAccessFlagsProtReadWrite:  hsaDesc[i].permissions = HSA_ACCESS_PERMISSION_RW;   break;
+        default:
+            return ihipLogStatus(hipErrorInvalidValue);
+        }
+    }
+
+    if (hsa_amd_vmem_set_access(ptr, size, hsaDesc.data(), count) != HSA_STATUS_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    return ihipLogStatus(hipSuccess);
+#else
+    return ihipLogStatus(hipErrorNotSupported);
+#endif
+}
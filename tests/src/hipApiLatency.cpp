@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+// Per-API latency histograms (HIP_API_LATENCY).  A child process with HIP_API_LATENCY=2 calls a few APIs a known
+// number of times and checks the counts and percentiles returned by hipApiGetLatency.  The parent checks the
+// summary the child printed at exit, and that the query fails when recording is disabled.
+
+/* HIT_START
+ * BUILD: %t %s test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define LATENCY_FILE "/tmp/hipApiLatency.txt"
+
+
+void checkLatency(const char *apiName, uint64_t expectedCount)
+{
+    hipApiLatency_t l;
+    HIPCHECK(hipApiGetLatency(apiName, &l));
+    printf("%-24s count=%lu min=%.2f p50=%.2f p99=%.2f max=%.2f us\n", apiName, l.count, l.minUs, l.p50Us, l.p99Us, l.maxUs);
+    HIPASSERT(l.count == expectedCount);
+    if (expectedCount) {
+        HIPASSERT(l.minUs <= l.p50Us && l.p50Us <= l.p90Us && l.p90Us <= l.p99Us);
+        HIPASSERT(l.p99Us <= l.p999Us && l.p999Us <= l.maxUs);
+        HIPASSERT(l.totalUs >= l.maxUs);
+    }
+}
+
+
+void latencyWork()
+{
+    size_t Nbytes = N*sizeof(int);
+    int *A_d, *A_h;
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    HIPCHECK(hipHostMalloc((void**)&A_h, Nbytes));
+
+    for (int i = 0; i < 10; i++) {
+        HIPCHECK(hipMalloc(&A_d, Nbytes));
+        HIPCHECK(hipFree(A_d));
+    }
+
+    // Calls from a thread which has exited are still counted:
+    HIPCHECK(hipMalloc(&A_d, Nbytes));
+    std::thread t([=]() {
+        for (int i = 0; i < 20; i++) {
+            HIPCHECK(hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+        }
+    });
+    t.join();
+    for (int i = 0; i < 20; i++) {
+        HIPCHECK(hipMemcpyAsync(A_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    }
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    checkLatency("hipMalloc", 11);
+    checkLatency("hipFree", 10);
+    checkLatency("hipMemcpyAsync", 40);
+    checkLatency("hipStreamSynchronize", 1);
+    checkLatency("hipDeviceReset", 0);
+
+    hipApiLatency_t l;
+    HIPASSERT(hipApiGetLatency(nullptr, &l) == hipErrorInvalidValue);
+    HIPASSERT(hipApiGetLatency("hipMalloc", nullptr) == hipErrorInvalidValue);
+
+    HIPCHECK(hipFree(A_d));
+    HIPCHECK(hipHostFree(A_h));
+    HIPCHECK(hipStreamDestroy(stream));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HipTest::runChildWithEnv({{"HIP_API_LATENCY", "2"}}, latencyWork, LATENCY_FILE);
+
+    // Summary printed at exit:
+    std::istringstream f(HipTest::readFile(LATENCY_FILE));
+    std::string line;
+    bool header = false, memcpyAsync = false;
+    while (std::getline(f, line)) {
+        if (line.find("HIP API latency:") == 0) {
+            header = true;
+        } else if (line.find(" hipMemcpyAsync") != std::string::npos) {
+            std::istringstream ss(line);
+            double totalMs;
+            unsigned long count;
+            ss >> totalMs >> count;
+            memcpyAsync = (count == 40);
+        }
+    }
+    unlink(LATENCY_FILE);
+    HIPASSERT(header && memcpyAsync);
+
+    // Recording is off in this process:
+    hipApiLatency_t l;
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+    HIPASSERT(hipApiGetLatency("hipSetDevice", &l) == hipErrorProfilerDisabled);
+
+    passed();
+}
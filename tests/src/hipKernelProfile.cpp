@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+// Per-kernel statistics (HIP_PROFILE_KERNELS).  A child process launches vectorADD with two geometries, and
+// hipProfilerStop ends the capture window and prints the summary to stderr.  The parent checks the launch
+// counts in each row.
+
+/* HIT_START
+ * BUILD: %t %s test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sstream>
+#include <string>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define PROFILE_FILE "/tmp/hipKernelProfile.txt"
+
+
+void profileWork()
+{
+    int *A_d, *B_d, *C_d;
+    int *A_h, *B_h, *C_h;
+    HipTest::initArrays(&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, false);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    for (int i = 0; i < 5; i++) {
+        hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, 0, A_d, B_d, C_d, N);
+    }
+    for (int i = 0; i < 3; i++) {
+        hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock/2), 0, 0, A_d, B_d, C_d, N);
+    }
+    HIPCHECK(hipDeviceSynchronize());
+    HIPCHECK(hipProfilerStop());
+
+    HipTest::freeArrays(A_d, B_d, C_d, A_h, B_h, C_h, false);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HipTest::runChildWithEnv({{"HIP_PROFILE_KERNELS", "1"}}, profileWork, PROFILE_FILE);
+    std::istringstream f(HipTest::readFile(PROFILE_FILE));
+
+    // The summary from hipProfilerStop has both geometries.  Recording is stopped, so nothing is printed at exit.
+    std::string line;
+    int summaries = 0, fives = 0, threes = 0;
+    while (std::getline(f, line)) {
+        if (line.find("HIP kernel profile:") == 0) {
+            summaries++;
+        } else if (line.find("vectorADD") != std::string::npos) {
+            std::istringstream ss(line);
+            double totalMs;
+            unsigned long count;
+            ss >> totalMs >> count;
+            HIPASSERT(totalMs > 0);
+            if (count == 5) {
+                fives++;
+            } else if (count == 3) {
+                threes++;
+            }
+        }
+    }
+    unlink(PROFILE_FILE);
+
+    HIPASSERT(summaries == 1);
+    HIPASSERT(fives == 1 && threes == 1);
+
+    passed();
+}
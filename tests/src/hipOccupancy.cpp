@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Occupancy calculator.  The hello_world kernel of vcpy_isa.co is loaded with hipModuleLoad, so its resources
+// are read from the code object.  Then vectorADD, a hipLaunchKernel kernel, is looked up by name.  For both, the
+// reported block counts and suggested block size are checked against the device limits.  The name lookup needs
+// the ROCr loader extension; without it only the module kernel is checked.
+
+/* HIT_START
+ * BUILD: %t %s test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <unistd.h>
+#include <string>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define fileName "vcpy_isa.co"
+#define kernel_name "hello_world"
+
+
+// The code object sits next to this source; fall back to the working directory like the other module tests.
+std::string codeObjectPath()
+{
+    std::string src(__FILE__);
+    std::string path = src.substr(0, src.rfind('/') + 1) + fileName;
+    return (access(path.c_str(), R_OK) == 0) ? path : fileName;
+}
+
+
+void checkSuggestion(const hipDeviceProp_t &props, int gridSize, int blockSize)
+{
+    printf("info: suggested gridSize:%d blockSize:%d\n", gridSize, blockSize);
+    HIPASSERT(blockSize > 0);
+    HIPASSERT(blockSize % props.warpSize == 0);
+    HIPASSERT(blockSize <= props.maxThreadsPerBlock);
+    HIPASSERT(gridSize > 0);
+    HIPASSERT(gridSize % props.multiProcessorCount == 0);
+}
+
+
+void moduleOccupancy(const hipDeviceProp_t &props)
+{
+    hipModule_t module;
+    hipFunction_t function;
+    HIPCHECK(hipModuleLoad(&module, codeObjectPath().c_str()));
+    HIPCHECK(hipModuleGetFunction(&function, module, kernel_name));
+
+    int numBlocks = 0;
+    HIPCHECK(hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, function, threadsPerBlock, 0));
+    printf("info: module kernel: %d blocks of %d threads per CU\n", numBlocks, threadsPerBlock);
+    HIPASSERT(numBlocks > 0);
+    if (props.maxThreadsPerMultiProcessor) {
+        HIPASSERT(numBlocks * (int)threadsPerBlock <= props.maxThreadsPerMultiProcessor);
+    }
+
+    HIPCHECK(hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, function, props.maxThreadsPerBlock + 1, 0));
+    HIPASSERT(numBlocks == 0);
+    HIPCHECK(hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, function, threadsPerBlock, props.sharedMemPerBlock + 1));
+    HIPASSERT(numBlocks == 0);
+
+    int gridSize = 0, blockSize = 0;
+    HIPCHECK(hipModuleOccupancyMaxPotentialBlockSize(&gridSize, &blockSize, function, 0, 0));
+    checkSuggestion(props, gridSize, blockSize);
+    HIPCHECK(hipModuleOccupancyMaxPotentialBlockSize(&gridSize, &blockSize, function, 0, 128));
+    HIPASSERT((blockSize > 0) && (blockSize <= 128));
+
+    HIPCHECK_API(hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, nullptr, threadsPerBlock, 0),
+                 hipErrorInvalidDeviceFunction);
+    HIPCHECK_API(hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, function, 0, 0), hipErrorInvalidValue);
+
+    HIPCHECK(hipModuleUnload(module));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipDeviceProp_t props;
+    HIPCHECK(hipGetDeviceProperties(&props, 0));
+
+    moduleOccupancy(props);
+
+    int *A_d, *B_d, *C_d;
+    int *A_h, *B_h, *C_h;
+    HipTest::initArrays(&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, false);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, 0, A_d, B_d, C_d, N);
+    HIPCHECK(hipDeviceSynchronize());
+
+    int numBlocks = 0;
+    hipError_t e = hipOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, HipTest::vectorADD<int>, threadsPerBlock, 0);
+    if (e == hipErrorNotSupported) {
+        printf("info: occupancy of hipLaunchKernel kernels is not supported by this runtime, checked the module kernel only\n");
+        HipTest::freeArrays(A_d, B_d, C_d, A_h, B_h, C_h, false);
+        passed();
+    }
+    HIPCHECK(e);
+    printf("info: %d blocks of %d threads per CU\n", numBlocks, threadsPerBlock);
+    HIPASSERT(numBlocks > 0);
+    if (props.maxThreadsPerMultiProcessor) {
+        HIPASSERT(numBlocks * (int)threadsPerBlock <= props.maxThreadsPerMultiProcessor);
+    }
+
+    // A block larger than the device allows never fits.
+    HIPCHECK(hipOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, HipTest::vectorADD<int>, props.maxThreadsPerBlock + 1, 0));
+    HIPASSERT(numBlocks == 0);
+
+    // As does one which needs more LDS than a workgroup may have.
+    HIPCHECK(hipOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, HipTest::vectorADD<int>, threadsPerBlock, props.sharedMemPerBlock + 1));
+    HIPASSERT(numBlocks == 0);
+
+    // dynamicSMemSize and blockSizeLimit default to 0, as with CUDA:
+    int gridSize = 0, blockSize = 0;
+    HIPCHECK(hipOccupancyMaxPotentialBlockSize(&gridSize, &blockSize, HipTest::vectorADD<int>));
+    checkSuggestion(props, gridSize, blockSize);
+
+    HIPCHECK(hipOccupancyMaxPotentialBlockSize(&gridSize, &blockSize, HipTest::vectorADD<int>, 0, 128));
+    HIPASSERT((blockSize > 0) && (blockSize <= 128));
+
+    HIPCHECK_API(hipHccOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, "noSuchKernel", threadsPerBlock, 0),
+                 hipErrorInvalidDeviceFunction);
+    HIPCHECK_API(hipHccOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, "HipTest::vectorADD", 0, 0),
+                 hipErrorInvalidValue);
+
+    HipTest::freeArrays(A_d, B_d, C_d, A_h, B_h, C_h, false);
+    passed();
+}
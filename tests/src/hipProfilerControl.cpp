@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+// Runtime profiling control.  A child process records the timeline with HIP_PROFILE_START_PAUSED=1 and opens
+// three capture windows: with hipProfilerStart/Stop, with HIP_PROFILE_SIGNAL and with HIP_PROFILE_CONTROL_FILE.
+// Each window calls a different API.  HIP_PROFILE_MAX_WINDOWS=2, so the parent expects only the files of the
+// last two windows, each with its own API and nothing recorded while paused.
+
+/* HIT_START
+ * BUILD: %t %s test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define TIMELINE_FILE   "/tmp/hipProfilerControl.json"
+#define CONTROL_FILE    "/tmp/hipProfilerControl.ctl"
+
+
+// Longer than the control thread's poll interval:
+void waitForControl()
+{
+    usleep(500*1000);
+}
+
+
+void writeControl(const char *command)
+{
+    std::ofstream f(CONTROL_FILE);
+    f << command << "\n";
+}
+
+
+void controlWork()
+{
+    int *A_d;
+    HIPCHECK(hipMalloc(&A_d, N*sizeof(int)));
+    HIPCHECK(hipMemset(A_d, 0, N*sizeof(int)));     // paused, not recorded
+
+    HIPCHECK(hipProfilerStart());
+    HIPCHECK(hipDeviceSynchronize());
+    HIPCHECK(hipProfilerStop());
+
+    raise(SIGUSR2);
+    waitForControl();
+    int device;
+    HIPCHECK(hipGetDevice(&device));
+    raise(SIGUSR2);
+    waitForControl();
+
+    writeControl("start");
+    waitForControl();
+    int count;
+    HIPCHECK(hipGetDeviceCount(&count));
+    writeControl("stop");
+    waitForControl();
+
+    HIPCHECK(hipFree(A_d));                         // paused, not recorded
+}
+
+
+void removeFiles()
+{
+    unlink(TIMELINE_FILE);
+    unlink(CONTROL_FILE);
+    for (int i = 0; i < 4; i++) {
+        unlink((std::string(TIMELINE_FILE) + "." + std::to_string(i)).c_str());
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    removeFiles();
+    HipTest::runChildWithEnv({{"HIP_TIMELINE_FILE", TIMELINE_FILE},
+                              {"HIP_PROFILE_START_PAUSED", "1"},
+                              {"HIP_PROFILE_SIGNAL", std::to_string(SIGUSR2)},
+                              {"HIP_PROFILE_CONTROL_FILE", CONTROL_FILE},
+                              {"HIP_PROFILE_MAX_WINDOWS", "2"}}, controlWork);
+
+    // Window 0 was rotated out, and nothing was written under the plain name:
+    HIPASSERT(access(TIMELINE_FILE, F_OK) != 0);
+    HIPASSERT(access((std::string(TIMELINE_FILE) + ".0").c_str(), F_OK) != 0);
+
+    std::string window1 = HipTest::readFile(std::string(TIMELINE_FILE) + ".1");
+    std::string window2 = HipTest::readFile(std::string(TIMELINE_FILE) + ".2");
+    HIPASSERT(window1.find("\"name\":\"hipGetDevice\"") != std::string::npos);
+    HIPASSERT(window1.find("\"name\":\"hipGetDeviceCount\"") == std::string::npos);
+    HIPASSERT(window2.find("\"name\":\"hipGetDeviceCount\"") != std::string::npos);
+    HIPASSERT(window2.find("\"name\":\"hipGetDevice\"") == std::string::npos);
+    for (auto &w : {window1, window2}) {
+        HIPASSERT(w.find("\"name\":\"hipMemset\"") == std::string::npos);
+        HIPASSERT(w.find("\"name\":\"hipFree\"") == std::string::npos);
+        HIPASSERT(w.find("\"name\":\"hipDeviceSynchronize\"") == std::string::npos);
+    }
+
+    removeFiles();
+    passed();
+}
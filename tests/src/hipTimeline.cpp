@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Timeline recorder (HIP_TIMELINE_FILE).  A child process runs APIs, a kernel, copies and an event record, and
+// the timeline is written when it exits.  The parent checks the Chrome trace JSON for each kind of event, and
+// that HIP_TIMELINE_MAX_EVENTS bounds the number of events kept.
+
+/* HIT_START
+ * BUILD: %t %s test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define TIMELINE_FILE "/tmp/hipTimeline.json"
+
+
+void timelineWork()
+{
+    size_t Nbytes = N*sizeof(int);
+    int *A_d, *B_d, *C_d;
+    int *A_h, *B_h, *C_h;
+    HipTest::initArrays(&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, true);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    hipStream_t stream;
+    hipEvent_t e;
+    HIPCHECK(hipStreamCreate(&stream));
+    HIPCHECK(hipEventCreate(&e));
+
+    HIPCHECK(hipMemcpy(A_d, A_h, Nbytes, hipMemcpyHostToDevice));
+    HIPCHECK(hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+    HIPCHECK(hipEventRecord(e, stream));
+    HIPCHECK(hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+
+    HIPCHECK(hipEventDestroy(e));
+    HIPCHECK(hipStreamDestroy(stream));
+    HipTest::freeArrays(A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+// Run timelineWork in a child process and return the timeline it wrote.
+std::string runChild(const char *maxEvents)
+{
+    std::vector<std::pair<std::string, std::string>> env = {{"HIP_TIMELINE_FILE", TIMELINE_FILE}};
+    if (maxEvents) {
+        env.push_back({"HIP_TIMELINE_MAX_EVENTS", maxEvents});
+    }
+
+    unlink(TIMELINE_FILE);
+    HipTest::runChildWithEnv(env, timelineWork);
+
+    std::string json = HipTest::readFile(TIMELINE_FILE);
+    HIPASSERT(!json.empty());
+    unlink(TIMELINE_FILE);
+    return json;
+}
+
+
+int count(const std::string &s, const std::string &pattern)
+{
+    int cnt = 0;
+    for (size_t pos = s.find(pattern); pos != std::string::npos; pos = s.find(pattern, pos + 1)) {
+        cnt++;
+    }
+    return cnt;
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    std::string json = runChild(nullptr);
+    HIPASSERT(json.find("{\"displayTimeUnit\"") == 0);
+    HIPASSERT(json.rfind("]}") != std::string::npos);
+
+    HIPASSERT(count(json, "\"name\":\"hipMemcpy\",\"cat\":\"api\"") == 1);
+    HIPASSERT(count(json, "\"name\":\"hipMemcpyAsync\",\"cat\":\"api\"") == 2);
+    HIPASSERT(count(json, "\"name\":\"hipEventRecord\",\"cat\":\"event\"") == 1);
+    HIPASSERT(count(json, "\"cat\":\"kernel\"") == 1);
+    HIPASSERT(count(json, "\"name\":\"hcMemcpyHostToDevice\",\"cat\":\"copy\"") >= 2);
+    HIPASSERT(count(json, "\"name\":\"hcMemcpyDeviceToHost\",\"cat\":\"copy\"") >= 1);
+    HIPASSERT(count(json, "\"name\":\"process_name\"") >= 2);      // host and device
+    HIPASSERT(count(json, "\"args\":{\"name\":\"stream#") >= 1);
+
+    // Bounded memory - the first 4 events are kept, the rest are dropped:
+    json = runChild("4");
+    HIPASSERT(count(json, "\"ph\":\"X\"") + count(json, "\"ph\":\"i\"") == 4);
+
+    passed();
+}
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Binary API trace (HIP_TRACE_FILE).  A child process runs a few APIs from two threads and exits, which flushes
+// the trace.  The parent then parses the file and checks that every API was recorded with its arguments.
+
+/* HIT_START
+ * BUILD: %t %s test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define TRACE_FILE "/tmp/hipTraceBinary.bin"
+
+// Matches ihipTraceRecord_t in src/hip_trace.h.
+struct TraceRecord {
+    uint16_t apiId;
+    uint8_t  kind;
+    uint8_t  argCnt;
+    uint32_t tid;
+    uint64_t apiSeqNum;
+    uint64_t timestamp;
+    uint8_t  argType[8];
+    uint64_t arg[8];
+};
+
+
+void tracedApis()
+{
+    size_t Nbytes = N*sizeof(int);
+    int *A_d;
+    int *A_h = (int*)malloc(Nbytes);
+    memset(A_h, 0, Nbytes);
+
+    HIPCHECK(hipMalloc(&A_d, Nbytes));
+    HIPCHECK(hipMemcpy(A_d, A_h, Nbytes, hipMemcpyHostToDevice));
+    HIPCHECK(hipFree(A_d));
+    HIPASSERT(hipSetDevice(-1) == hipErrorInvalidDevice);
+
+    free(A_h);
+}
+
+
+void traceWork()
+{
+    tracedApis();
+    std::thread t(tracedApis);
+    t.join();
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    unlink(TRACE_FILE);
+    pid_t pid = HipTest::runChildWithEnv({{"HIP_TRACE_FILE", TRACE_FILE}}, traceWork);
+
+    FILE *f = fopen(TRACE_FILE, "rb");
+    HIPASSERT(f);
+    char magic[8];
+    uint32_t version, recordSize;
+    uint64_t freqHz, tracePid;
+    HIPASSERT(fread(magic, 8, 1, f) == 1 && memcmp(magic, "HIPTRACE", 8) == 0);
+    HIPASSERT(fread(&version, 4, 1, f) == 1 && version == 1);
+    HIPASSERT(fread(&recordSize, 4, 1, f) == 1 && recordSize == sizeof(TraceRecord));
+    HIPASSERT(fread(&freqHz, 8, 1, f) == 1);
+    HIPASSERT(fread(&tracePid, 8, 1, f) == 1 && tracePid == pid);
+
+    std::map<uint16_t, std::string> apiNames;
+    std::vector<TraceRecord> records;
+    uint32_t chunk[2];
+    while (fread(chunk, sizeof(chunk), 1, f) == 1) {
+        for (uint32_t i = 0; i < chunk[1]; i++) {
+            if (chunk[0] == 2) {
+                TraceRecord r;
+                HIPASSERT(fread(&r, sizeof(r), 1, f) == 1);
+                records.push_back(r);
+            } else if (chunk[0] == 4) {
+                uint64_t drop[2];
+                HIPASSERT(fread(drop, sizeof(drop), 1, f) == 1);
+                failed("trace dropped %lu records\n", drop[1]);
+            } else {
+                uint16_t hdr[2];
+                char name[256];
+                HIPASSERT(fread(hdr, sizeof(hdr), 1, f) == 1 && hdr[1] < sizeof(name));
+                HIPASSERT(fread(name, 1, hdr[1], f) == hdr[1]);
+                name[hdr[1]] = 0;
+                if (chunk[0] == 1) {
+                    apiNames[hdr[0]] = name;
+                }
+            }
+        }
+    }
+    fclose(f);
+    unlink(TRACE_FILE);
+
+    // Each thread: hipMalloc, hipMemcpy, hipFree and a failing hipSetDevice, each with an entry and an exit record.
+    std::map<std::string, int> enters;
+    std::map<uint32_t, uint64_t> lastSeqNum;
+    int exits = 0, errors = 0;
+    for (auto &r : records) {
+        HIPASSERT(apiNames.count(r.apiId));
+        const std::string &api = apiNames[r.apiId];
+        if (r.kind == 1) {
+            enters[api]++;
+            HIPASSERT(r.apiSeqNum > lastSeqNum[r.tid]);  // records of a thread are in order
+            lastSeqNum[r.tid] = r.apiSeqNum;
+            if (api == "hipMemcpy") {
+                HIPASSERT(r.argCnt == 4);
+                HIPASSERT(r.arg[2] == N*sizeof(int));
+                HIPASSERT(r.argType[3] == 5 && r.arg[3] == hipMemcpyHostToDevice);
+            }
+        } else {
+            HIPASSERT(r.kind == 2 && r.argCnt == 1);
+            exits++;
+            errors += (r.arg[0] != hipSuccess);
+        }
+    }
+
+    HIPASSERT(enters["hipMalloc"] == 2);
+    HIPASSERT(enters["hipMemcpy"] == 2);
+    HIPASSERT(enters["hipFree"] == 2);
+    HIPASSERT(errors >= 2);
+    HIPASSERT(lastSeqNum.size() == 2);
+    HIPASSERT(exits >= 8);
+
+    passed();
+}
@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// hipHostMallocHugePages: huge-page backed pinned memory must behave like any other pinned allocation, whether
+// or not the host has huge pages available (the runtime falls back to 4KB pages).  hipHostGetFlags must only report
+// hipHostMallocHugePages when /proc/self/smaps shows huge pages, and kernels must be able to use the host address.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <fstream>
+#include <string>
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+// True if the mapping containing p is backed by huge pages (hugetlb or THP), from /proc/self/smaps.
+bool backedByHugePages(void *p)
+{
+    std::ifstream f("/proc/self/smaps");
+    std::string line;
+    bool inMapping = false;
+    while (std::getline(f, line)) {
+        unsigned long start, end;
+        size_t kb;
+        if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2) {
+            inMapping = (start <= (uintptr_t)p) && ((uintptr_t)p < end);
+        } else if (inMapping && (sscanf(line.c_str(), "KernelPageSize: %zu kB", &kb) == 1) && (kb > 4)) {
+            return true;
+        } else if (inMapping && (sscanf(line.c_str(), "AnonHugePages: %zu kB", &kb) == 1) && (kb > 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void hugePageTest(size_t numElements)
+{
+    printf ("test: %s N=%zu\n", __func__, numElements);
+    size_t Nbytes = numElements*sizeof(int);
+
+    int *A_h, *C_h;
+    HIPCHECK(hipHostMalloc((void**)&A_h, Nbytes, hipHostMallocHugePages));
+    HIPCHECK(hipHostMalloc((void**)&C_h, Nbytes, hipHostMallocHugePages));
+
+    for (size_t i=0; i<numElements; i++) {
+        A_h[i] = (int)(i * 7);
+    }
+
+    // The flag is only reported when the pages really are huge (4KB fallback memory may still get THP=always pages):
+    unsigned flags = 0;
+    HIPCHECK(hipHostGetFlags(&flags, A_h));
+    const bool huge = backedByHugePages(A_h);
+    printf ("  flags:0x%x huge pages:%d\n", flags, huge);
+    if ((flags & hipHostMallocHugePages) && !huge) {
+        failed("hipHostGetFlags returned 0x%x but smaps says huge pages:%d\n", flags, huge);
+    }
+
+    int *A_d;
+    HIPCHECK(hipMalloc(&A_d, Nbytes));
+    HIPCHECK(hipMemcpy(A_d, A_h, Nbytes, hipMemcpyHostToDevice));
+    HIPCHECK(hipMemcpyAsync(C_h, A_d, Nbytes, hipMemcpyDeviceToHost, 0));
+    HIPCHECK(hipDeviceSynchronize());
+
+    for (size_t i=0; i<numElements; i++) {
+        if (C_h[i] != A_h[i]) {
+            failed("mismatch at %zu: expected %d got %d\n", i, A_h[i], C_h[i]);
+        }
+    }
+
+    // Like any hipHostMalloc memory, the device address is the host address: A_d = A_h + A_h.
+    int *A_hd;
+    HIPCHECK(hipHostGetDevicePointer((void**)&A_hd, A_h, 0));
+    HIPASSERT(A_hd == A_h);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, numElements);
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, 0,
+                    static_cast<const int*>(A_h), static_cast<const int*>(A_h), A_d, numElements);
+    HIPCHECK(hipMemcpy(C_h, A_d, Nbytes, hipMemcpyDeviceToHost));
+
+    for (size_t i=0; i<numElements; i++) {
+        if (C_h[i] != 2*A_h[i]) {
+            failed("kernel mismatch at %zu: expected %d got %d\n", i, 2*A_h[i], C_h[i]);
+        }
+    }
+
+    HIPCHECK(hipFree(A_d));
+    HIPCHECK(hipHostFree(A_h));
+    HIPCHECK(hipHostFree(C_h));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    hugePageTest(1000);                 // much smaller than one huge page.
+    hugePageTest(3*1024*1024 + 17);     // not a multiple of 2MB.
+    hugePageTest(64*1024*1024);
+
+    passed();
+}
@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Pinned host memory placed on a NUMA node: hipHostMalloc, staged async copies and hipHostFree with the default
+// (closest node), a forced node and placement disabled.  The node each page landed on is read back with move_pages.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN_NAMED: %t hipHostMallocNuma-closest --tests 0x1
+ * RUN_NAMED: %t hipHostMallocNuma-node0 --tests 0x2
+ * RUN_NAMED: %t hipHostMallocNuma-off --tests 0x4
+ * HIT_END
+ */
+
+#include <glob.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <vector>
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+// Node the pinned memory is expected on, or -1 if it can't be predicted.
+int expectedNode()
+{
+    if (p_tests & 0x2) {
+        return 0;
+    }
+    if (!(p_tests & 0x1)) {
+        return -1;
+    }
+
+    // Closest node: the one the device's PCI function is attached to.
+    hipDeviceProp_t props;
+    HIPCHECK(hipGetDeviceProperties(&props, p_gpuDevice));
+    char pattern[128];
+    snprintf(pattern, sizeof(pattern), "/sys/bus/pci/devices/*:%02x:%02x.0/numa_node", props.pciBusID, props.pciDeviceID);
+
+    int node = -1;
+    glob_t g;
+    if ((glob(pattern, 0, NULL, &g) == 0) && (g.gl_pathc == 1)) {
+        FILE *f = fopen(g.gl_pathv[0], "r");
+        if (f) {
+            if (fscanf(f, "%d", &node) != 1) {
+                node = -1;
+            }
+            fclose(f);
+        }
+    }
+    globfree(&g);
+    return node;
+}
+
+
+// Check every page of [p, p+sizeBytes) is on one node, and on expected if that is known.
+void checkPlacement(void *p, size_t sizeBytes, int expected)
+{
+#if defined(SYS_move_pages)
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    std::vector<void*> pages;
+    for (size_t off=0; off<sizeBytes; off+=pageSize) {
+        pages.push_back(static_cast<char*>(p) + off);
+    }
+    std::vector<int> status(pages.size(), -1);
+
+    // With no target nodes, move_pages only reports where each page is:
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), NULL, status.data(), 0) != 0) {
+        printf ("  move_pages not available, placement not checked\n");
+        return;
+    }
+
+    printf ("  %zu pages on node %d, expected %d\n", pages.size(), status[0], expected);
+    HIPASSERT(status[0] >= 0);
+    for (auto s : status) {
+        HIPASSERT(s == status[0]);
+    }
+    if (expected >= 0) {
+        HIPASSERT(status[0] == expected);
+    }
+#endif
+}
+
+
+void pinnedRoundTrip(size_t numElements)
+{
+    printf ("test: %s N=%zu\n", __func__, numElements);
+    size_t Nbytes = numElements*sizeof(int);
+
+    int *A_d, *B_d, *C_d;
+    int *A_h, *B_h, *C_h;
+
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, numElements, true/*usePinnedHost*/);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, numElements);
+
+    // Device pointer of pinned host memory must still be valid:
+    int *A_hd;
+    HIPCHECK(hipHostGetDevicePointer((void**)&A_hd, A_h, 0));
+
+    HIPCHECK(hipMemcpy(A_d, A_h, Nbytes, hipMemcpyHostToDevice));
+    HIPCHECK(hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, 0));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, 0, A_d, B_d, C_d, numElements);
+    HIPCHECK(hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, 0));
+    HIPCHECK(hipDeviceSynchronize());
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, numElements);
+
+    if (!(p_tests & 0x4)) {
+        checkPlacement(A_h, Nbytes, expectedNode());
+        checkPlacement(C_h, Nbytes, expectedNode());
+    }
+
+    // Staged copy of pageable memory uses staging buffers from the same pool:
+    int *P_h = (int*)malloc(Nbytes);
+    HIPCHECK(hipMemcpyAsync(P_h, C_d, Nbytes, hipMemcpyDeviceToHost, 0));
+    HIPCHECK(hipDeviceSynchronize());
+    HipTest::checkVectorADD(A_h, B_h, P_h, numElements);
+    free(P_h);
+
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    // Placement is chosen when HIP initializes:
+    if (p_tests & 0x2) {
+        setenv("HIP_HOST_NUMA_NODE", "0", 1);
+    } else if (p_tests & 0x4) {
+        setenv("HIP_HOST_NUMA_NODE", "-2", 1);
+    }
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    pinnedRoundTrip(N);
+    pinnedRoundTrip(16*1024*1024);
+
+    passed();
+}
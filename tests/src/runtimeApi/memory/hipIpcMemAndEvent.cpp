@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Share device memory and an interprocess event with a child process.
+// The child's stream waits on the parent's event in the device queue, then reads the shared buffer.
+// Also checks that handles are cached: repeated gets return the same bytes, and repeated opens the same pointer.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+struct Handles {
+    hipIpcMemHandle_t   mem;
+    hipIpcEventHandle_t event;
+};
+
+
+void readAll(int fd, void *dst, size_t sizeBytes)
+{
+    char *p = (char*)dst;
+    while (sizeBytes) {
+        ssize_t n = read(fd, p, sizeBytes);
+        if (n <= 0) {
+            failed("pipe read failed");
+        }
+        p += n;
+        sizeBytes -= n;
+    }
+}
+
+
+// Child: open the handles, wait on the event in a stream and check the data.
+int consumer(int fd)
+{
+    Handles h;
+    readAll(fd, &h, sizeof(h));
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    size_t Nbytes = N*sizeof(int);
+
+    int *A_d, *A_d2;
+    HIPCHECK(hipIpcOpenMemHandle((void**)&A_d, h.mem, hipIpcMemLazyEnablePeerAccess));
+    HIPCHECK(hipIpcOpenMemHandle((void**)&A_d2, h.mem, hipIpcMemLazyEnablePeerAccess));
+    HIPASSERT(A_d == A_d2);
+
+    hipEvent_t e;
+    HIPCHECK(hipIpcOpenEventHandle(&e, h.event));
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    int *A_h;
+    HIPCHECK(hipHostMalloc(&A_h, Nbytes));
+    HIPCHECK(hipStreamWaitEvent(stream, e, 0));
+    HIPCHECK(hipMemcpyAsync(A_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+    HIPCHECK(hipEventQuery(e));
+
+    for (size_t i = 0; i < N; i++) {
+        if (A_h[i] != (int)i) {
+            failed("mismatch at %zu: %d\n", i, A_h[i]);
+        }
+    }
+
+    HIPCHECK(hipIpcCloseMemHandle(A_d));
+    HIPCHECK(hipIpcCloseMemHandle(A_d));
+    HIPCHECK_API(hipIpcCloseMemHandle(A_d), hipErrorInvalidResourceHandle);
+
+    HIPCHECK(hipEventDestroy(e));
+    HIPCHECK(hipStreamDestroy(stream));
+    HIPCHECK(hipHostFree(A_h));
+
+    return 0;
+}
+
+
+// Parent: fill a buffer on a stream, record the event behind it and hand both to the child without waiting.
+void producer(int fd, pid_t child)
+{
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    size_t Nbytes = N*sizeof(int);
+
+    hipEvent_t timed;
+    HIPCHECK_API(hipEventCreateWithFlags(&timed, hipEventInterprocess), hipErrorInvalidValue);
+
+    hipEvent_t e;
+    HIPCHECK(hipEventCreateWithFlags(&e, hipEventInterprocess | hipEventDisableTiming));
+
+    int *A_d, *A_h;
+    HIPCHECK(hipMalloc(&A_d, Nbytes));
+    HIPCHECK(hipHostMalloc(&A_h, Nbytes));
+    for (size_t i = 0; i < N; i++) {
+        A_h[i] = i;
+    }
+
+    Handles h, h2, h3;
+    HIPCHECK(hipIpcGetMemHandle(&h.mem, A_d));
+    HIPCHECK(hipIpcGetMemHandle(&h2.mem, A_d));
+    HIPCHECK(hipIpcGetMemHandle(&h3.mem, A_d + 16));
+    HIPASSERT(memcmp(&h.mem, &h2.mem, sizeof(h.mem)) == 0);
+    HIPASSERT(memcmp(&h.mem, &h3.mem, sizeof(h.mem)) == 0);
+
+    HIPCHECK(hipIpcGetEventHandle(&h.event, e));
+    HIPCHECK(hipIpcGetEventHandle(&h2.event, e));
+    HIPASSERT(memcmp(&h.event, &h2.event, sizeof(h.event)) == 0);
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    HIPCHECK(hipMemsetAsync(A_d, 0, Nbytes, stream));
+    HIPCHECK(hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK(hipEventRecord(e, stream));
+
+    if (write(fd, &h, sizeof(h)) != sizeof(h)) {
+        failed("pipe write failed");
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        failed("consumer failed, status=%d\n", status);
+    }
+
+    HIPCHECK(hipEventSynchronize(e));
+    HIPCHECK(hipEventDestroy(e));
+    HIPCHECK(hipStreamDestroy(stream));
+    HIPCHECK(hipHostFree(A_h));
+    HIPCHECK(hipFree(A_d));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    // Fork before HIP initializes - the runtime cannot be shared across fork.
+    int fds[2];
+    if (pipe(fds) != 0) {
+        failed("pipe failed");
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[1]);
+        exit(consumer(fds[0]));
+    }
+
+    close(fds[0]);
+    producer(fds[1], child);
+
+    passed();
+}
@@ -0,0 +1,158 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Managed memory: the host and a kernel share the same pointers with no explicit copies.
+// Also checks the advice and prefetch bookkeeping, pointer attributes and argument validation.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+void sharedAccessTest()
+{
+    printf ("test: %s\n", __func__);
+    size_t Nbytes = N*sizeof(int);
+
+    int *A, *B, *C;
+    HIPCHECK(hipMallocManaged((void**)&A, Nbytes));
+    HIPCHECK(hipMallocManaged((void**)&B, Nbytes));
+    HIPCHECK(hipMallocManaged((void**)&C, Nbytes, hipMemAttachGlobal));
+
+    for (size_t i=0; i<N; i++) {
+        A[i] = i;
+        B[i] = 2*i;
+        C[i] = -1;
+    }
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    HIPCHECK(hipMemPrefetchAsync(A, Nbytes, p_gpuDevice, stream));
+    HIPCHECK(hipMemPrefetchAsync(B, Nbytes, p_gpuDevice, stream));
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A, B, C, N);
+
+    HIPCHECK(hipMemPrefetchAsync(C, Nbytes, hipCpuDeviceId, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    HipTest::checkVectorADD(A, B, C, N);
+
+    // Host writes after the kernel are seen by the next kernel:
+    for (size_t i=0; i<N; i++) {
+        A[i] = 1;
+    }
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A, B, C, N);
+    HIPCHECK(hipStreamSynchronize(stream));
+    for (size_t i=0; i<N; i++) {
+        HIPASSERT(C[i] == (int)(2*i + 1));
+    }
+
+    hipPointerAttribute_t attr;
+    HIPCHECK(hipPointerGetAttributes(&attr, A));
+    HIPASSERT(attr.isManaged == 1);
+    HIPCHECK(hipPointerGetAttributes(&attr, A + N/2));
+    HIPASSERT(attr.isManaged == 1);
+
+    int lastPrefetch;
+    HIPCHECK(hipMemRangeGetAttribute(&lastPrefetch, sizeof(lastPrefetch), hipMemRangeAttributeLastPrefetchLocation, C, Nbytes));
+    HIPASSERT(lastPrefetch == hipCpuDeviceId);
+
+    HIPCHECK(hipStreamDestroy(stream));
+    HIPCHECK(hipFree(A));
+    HIPCHECK(hipFree(B));
+    HIPCHECK(hipFree(C));
+}
+
+
+void adviceTest()
+{
+    printf ("test: %s\n", __func__);
+    size_t Nbytes = N*sizeof(int);
+
+    int *A;
+    HIPCHECK(hipMallocManaged((void**)&A, Nbytes));
+
+    int value;
+    HIPCHECK(hipMemRangeGetAttribute(&value, sizeof(value), hipMemRangeAttributeReadMostly, A, Nbytes));
+    HIPASSERT(value == 0);
+    HIPCHECK(hipMemAdvise(A, Nbytes, hipMemAdviseSetReadMostly, 0));
+    HIPCHECK(hipMemRangeGetAttribute(&value, sizeof(value), hipMemRangeAttributeReadMostly, A, Nbytes));
+    HIPASSERT(value == 1);
+
+    HIPCHECK(hipMemRangeGetAttribute(&value, sizeof(value), hipMemRangeAttributePreferredLocation, A, Nbytes));
+    HIPASSERT(value == hipInvalidDeviceId);
+    HIPCHECK(hipMemAdvise(A, Nbytes, hipMemAdviseSetPreferredLocation, p_gpuDevice));
+    HIPCHECK(hipMemRangeGetAttribute(&value, sizeof(value), hipMemRangeAttributePreferredLocation, A, Nbytes));
+    HIPASSERT(value == p_gpuDevice);
+
+    int accessedBy[4];
+    HIPCHECK(hipMemAdvise(A, Nbytes, hipMemAdviseSetAccessedBy, hipCpuDeviceId));
+    HIPCHECK(hipMemAdvise(A, Nbytes, hipMemAdviseSetAccessedBy, p_gpuDevice));
+    HIPCHECK(hipMemAdvise(A, Nbytes, hipMemAdviseSetAccessedBy, p_gpuDevice));
+    HIPCHECK(hipMemRangeGetAttribute(accessedBy, sizeof(accessedBy), hipMemRangeAttributeAccessedBy, A, Nbytes));
+    HIPASSERT(accessedBy[0] == hipCpuDeviceId);
+    HIPASSERT(accessedBy[1] == p_gpuDevice);
+    HIPASSERT(accessedBy[2] == hipInvalidDeviceId);
+    HIPCHECK(hipMemAdvise(A, Nbytes, hipMemAdviseUnsetAccessedBy, hipCpuDeviceId));
+    HIPCHECK(hipMemRangeGetAttribute(accessedBy, sizeof(accessedBy), hipMemRangeAttributeAccessedBy, A, Nbytes));
+    HIPASSERT(accessedBy[0] == p_gpuDevice);
+    HIPASSERT(accessedBy[1] == hipInvalidDeviceId);
+
+    // Bad arguments:
+    int *D;
+    HIPCHECK(hipMalloc(&D, Nbytes));
+    HIPCHECK_API(hipMemAdvise(D, Nbytes, hipMemAdviseSetReadMostly, 0), hipErrorInvalidValue);
+    HIPCHECK_API(hipMemAdvise(A, Nbytes + 1, hipMemAdviseSetReadMostly, 0), hipErrorInvalidValue);
+    HIPCHECK_API(hipMemAdvise(A, Nbytes, hipMemAdviseSetPreferredLocation, 1000), hipErrorInvalidDevice);
+    HIPCHECK_API(hipMemPrefetchAsync(D, Nbytes, p_gpuDevice, 0), hipErrorInvalidValue);
+    HIPCHECK_API(hipMemPrefetchAsync(A, Nbytes, 1000, 0), hipErrorInvalidDevice);
+    HIPCHECK_API(hipMallocManaged((void**)&D, 0), hipErrorInvalidValue);
+    HIPCHECK_API(hipMallocManaged((void**)&D, Nbytes, 0x10), hipErrorInvalidValue);
+#ifdef __HIP_PLATFORM_HCC__
+    // Memory attached to the host needs per-stream attach, which is not supported:
+    HIPCHECK_API(hipMallocManaged((void**)&D, Nbytes, hipMemAttachHost), hipErrorNotSupported);
+#endif
+
+    hipPointerAttribute_t attr;
+    HIPCHECK(hipPointerGetAttributes(&attr, D));
+    HIPASSERT(attr.isManaged == 0);
+
+    HIPCHECK(hipFree(D));
+    HIPCHECK(hipFree(A));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    sharedAccessTest();
+    adviceTest();
+
+    passed();
+}
@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Virtual memory management: grow a device buffer in place by mapping more chunks into a reserved range.
+// Data written before the growth must still be there afterwards, at the same address, and copies may span chunks.
+// Also checks reservations with a large alignment.  Without the ROCr hsa_amd_vmem API every entry point must
+// report hipErrorNotSupported.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+// Map one chunk at ptr and make it read-write on p_gpuDevice.
+hipMemGenericAllocationHandle_t mapChunk(char *ptr, size_t size, const hipMemAllocationProp &prop)
+{
+    hipMemGenericAllocationHandle_t h;
+    HIPCHECK(hipMemCreate(&h, size, &prop, 0));
+    HIPCHECK(hipMemMap(ptr, size, 0, h, 0));
+
+    hipMemAccessDesc access;
+    access.location = prop.location;
+    access.flags = hipMemAccessFlagsProtReadWrite;
+    HIPCHECK(hipMemSetAccess(ptr, size, &access, 1));
+
+    return h;
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    hipMemAllocationProp prop;
+    memset(&prop, 0, sizeof(prop));
+    prop.type = hipMemAllocationTypePinned;
+    prop.location.type = hipMemLocationTypeDevice;
+    prop.location.id = p_gpuDevice;
+
+    size_t granularity;
+    hipError_t e = hipMemGetAllocationGranularity(&granularity, &prop, hipMemAllocationGranularityRecommended);
+    if (e == hipErrorNotSupported) {
+        printf("virtual memory management not supported by this runtime, checking the other APIs agree\n");
+        void *p;
+        hipMemGenericAllocationHandle_t h = nullptr;
+        hipMemAccessDesc access;
+        access.location = prop.location;
+        access.flags = hipMemAccessFlagsProtReadWrite;
+        HIPCHECK_API(hipMemAddressReserve(&p, 1<<21, 0, NULL, 0), hipErrorNotSupported);
+        HIPCHECK_API(hipMemCreate(&h, 1<<21, &prop, 0), hipErrorNotSupported);
+        HIPCHECK_API(hipMemMap(NULL, 1<<21, 0, h, 0), hipErrorNotSupported);
+        HIPCHECK_API(hipMemSetAccess(NULL, 1<<21, &access, 1), hipErrorNotSupported);
+        HIPCHECK_API(hipMemUnmap(NULL, 1<<21), hipErrorNotSupported);
+        HIPCHECK_API(hipMemRelease(h), hipErrorNotSupported);
+        HIPCHECK_API(hipMemAddressFree(NULL, 1<<21), hipErrorNotSupported);
+        passed();
+    }
+    HIPCHECK(e);
+
+    // Alignment larger than the granularity is honored:
+    const size_t bigAlign = 16 * granularity;
+    for (int i = 0; i < 4; i++) {
+        char *aligned;
+        HIPCHECK(hipMemAddressReserve((void**)&aligned, granularity, bigAlign, NULL, 0));
+        HIPASSERT(((uintptr_t)aligned % bigAlign) == 0);
+        HIPCHECK(hipMemAddressFree(aligned, granularity));
+    }
+
+    const size_t chunks = 4;
+    char *base;
+    HIPCHECK(hipMemAddressReserve((void**)&base, chunks * granularity, 0, NULL, 0));
+
+    char *host;
+    HIPCHECK(hipHostMalloc((void**)&host, chunks * granularity));
+
+    // Grow one chunk at a time.  Each step fills the new chunk and checks the whole buffer.
+    hipMemGenericAllocationHandle_t handles[chunks];
+    for (size_t c = 0; c < chunks; c++) {
+        handles[c] = mapChunk(base + c * granularity, granularity, prop);
+        HIPCHECK(hipMemset(base + c * granularity, (int)(c + 1), granularity));
+
+        size_t bytes = (c + 1) * granularity;
+        memset(host, 0, bytes);
+        HIPCHECK(hipMemcpy(host, base, bytes, hipMemcpyDeviceToHost));
+        for (size_t i = 0; i < bytes; i += 4096) {
+            if (host[i] != (char)(i / granularity + 1)) {
+                failed("mismatch at %zu after growing to %zu chunks: %d\n", i, c + 1, host[i]);
+            }
+        }
+    }
+
+    // Bad arguments:
+    HIPCHECK_API(hipMemMap(host, granularity, 0, handles[0], 0), hipErrorInvalidValue);
+    HIPCHECK_API(hipMemUnmap(base + 1, granularity), hipErrorInvalidValue);
+    HIPCHECK_API(hipMemAddressFree(base, chunks * granularity), hipErrorInvalidValue); // still mapped
+
+    for (size_t c = 0; c < chunks; c++) {
+        HIPCHECK(hipMemUnmap(base + c * granularity, granularity));
+        HIPCHECK(hipMemRelease(handles[c]));
+    }
+    HIPCHECK(hipMemAddressFree(base, chunks * granularity));
+    HIPCHECK(hipHostFree(host));
+
+    passed();
+}
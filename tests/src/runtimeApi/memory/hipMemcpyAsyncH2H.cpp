@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Async host-to-host copies in a busy stream run as stream-ordered host tasks.  Check they see the results of
+// earlier commands, and that later commands see their results - including a staged H2D copy which reads the
+// pageable destination of an H2H copy still pending in the stream.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+void h2hStreamTest(hipStream_t stream, size_t numElements)
+{
+    printf ("test: %s stream=%p N=%zu\n", __func__, stream, numElements);
+    size_t Nbytes = numElements*sizeof(int);
+
+    int *A_d, *B_d, *C_d;
+    int *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, numElements, true);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, numElements);
+
+    int *C2_h, *C3_h, *C4_h;
+    int *C2_d, *C3_d;
+    HIPCHECK ( hipHostMalloc((void**)&C2_h, Nbytes));
+    HIPCHECK ( hipMalloc(&C2_d, Nbytes));
+    HIPCHECK ( hipMalloc(&C3_d, Nbytes));
+    C4_h = (int*)malloc(Nbytes);
+    C3_h = (int*)malloc(Nbytes);
+    memset(C2_h, 0, Nbytes);
+    memset(C3_h, 0, Nbytes);
+
+    HIPCHECK ( hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK ( hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, numElements);
+    HIPCHECK ( hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+
+    // Stream is busy: H2H must wait for the D2H above, and the H2D below must wait for the H2H.
+    HIPCHECK ( hipMemcpyAsync(C2_h, C_h, Nbytes, hipMemcpyHostToHost, stream));
+    HIPCHECK ( hipMemcpyAsync(C3_h, C2_h, Nbytes, hipMemcpyHostToHost, stream));
+    HIPCHECK ( hipMemcpyAsync(C3_d, C3_h, Nbytes, hipMemcpyHostToDevice, stream));  // pageable source written above.
+    HIPCHECK ( hipMemcpyAsync(C2_d, C2_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK ( hipMemsetAsync(C_d, 0, Nbytes, stream));
+    HIPCHECK ( hipMemcpyAsync(C_h, C2_d, Nbytes, hipMemcpyDeviceToHost, stream));
+
+    HIPCHECK ( hipMemcpyAsync(C4_h, C3_d, Nbytes, hipMemcpyDeviceToHost, stream));
+
+    HIPCHECK ( hipStreamSynchronize(stream));
+    HIPCHECK ( hipStreamQuery(stream));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, numElements);
+    HipTest::checkVectorADD(A_h, B_h, C3_h, numElements);
+    HipTest::checkVectorADD(A_h, B_h, C4_h, numElements);
+
+    HIPCHECK ( hipHostFree(C2_h));
+    HIPCHECK ( hipFree(C2_d));
+    HIPCHECK ( hipFree(C3_d));
+    free(C3_h);
+    free(C4_h);
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    h2hStreamTest(0, N);
+    h2hStreamTest(stream, N);
+    h2hStreamTest(stream, 16*1024*1024);  // large enough to be split across the copy pool.
+
+    HIPCHECK(hipStreamDestroy(stream));
+
+    passed();
+}
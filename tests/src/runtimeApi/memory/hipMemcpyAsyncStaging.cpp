@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Async copies to and from pageable host memory, through the staging engine.
+// Uses small staging buffers so each copy is split into many chunks.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+//---
+// H2D, kernel, D2H all on one stream with unpinned host memory.  The host buffers are
+// modified right after the async H2D returns, which is legal for pageable sources.
+void stagedStreamTest(hipStream_t stream)
+{
+    printf ("test: %s stream=%p\n", __func__, stream);
+    size_t Nbytes = N*sizeof(int);
+
+    int *A_d, *B_d, *C_d;
+    int *A_h, *B_h, *C_h;
+
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, false);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    HIPCHECK ( hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK ( hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+
+    // Source has been staged - keep a reference copy and clobber the original.
+    int *A_ref = (int*)malloc(Nbytes);
+    int *B_ref = (int*)malloc(Nbytes);
+    memcpy(A_ref, A_h, Nbytes);
+    memcpy(B_ref, B_h, Nbytes);
+    memset(A_h, 0xff, Nbytes);
+    memset(B_h, 0xff, Nbytes);
+
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+
+    HIPCHECK ( hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK ( hipStreamSynchronize(stream));
+    HIPCHECK ( hipStreamQuery(stream));
+
+    HipTest::checkVectorADD(A_ref, B_ref, C_h, N);
+
+    // Event recorded after a staged D2H must not complete before the host data lands.
+    hipEvent_t e;
+    HIPCHECK ( hipEventCreate(&e));
+    memset(C_h, 0, Nbytes);
+    HIPCHECK ( hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK ( hipEventRecord(e, stream));
+    HIPCHECK ( hipEventSynchronize(e));
+    HipTest::checkVectorADD(A_ref, B_ref, C_h, N);
+    HIPCHECK ( hipEventDestroy(e));
+
+    free(A_ref);
+    free(B_ref);
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, false);
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Staging env vars are read when HIP initializes:
+    setenv("HIP_STAGING_SIZE", "64", 1);
+    setenv("HIP_STAGING_BUFFERS", "2", 1);
+
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    stagedStreamTest(0);
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    stagedStreamTest(stream);
+    HIPCHECK(hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Batched and gather/scatter copies.  One batch mixes adjacent ranges (coalesced), small ranges (blit kernel),
+// large ranges (DMA) and ranges on pageable host memory in both directions (staged).  Gather/scatter indices
+// whose offset overflows the address space must be rejected.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <stdint.h>
+#include <vector>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+void checkBytes(const char *expected, const char *actual, size_t sizeBytes, const char *what)
+{
+    for (size_t i=0; i<sizeBytes; i++) {
+        if (expected[i] != actual[i]) {
+            failed("%s: mismatch at byte %zu, expected 0x%x got 0x%x\n", what, i, expected[i] & 0xff, actual[i] & 0xff);
+        }
+    }
+}
+
+
+//---
+// H2D from pinned and pageable memory, D2D, then D2H, each as a single batch.
+void batchTest(hipStream_t stream)
+{
+    printf ("test: %s stream=%p\n", __func__, stream);
+
+    const size_t Nbytes = 4*1024*1024;
+    const size_t smallSize = 1000;           // unaligned size, goes through the byte-copy path of the kernel.
+    const size_t largeSize = 1024*1024;      // above HIP_COPY_BATCH_BLIT_THRESHOLD, one DMA command.
+
+    char *A_d, *B_d;
+    char *A_pinned, *B_pinned, *A_pageable, *B_pageable;
+    HIPCHECK(hipMalloc(&A_d, Nbytes));
+    HIPCHECK(hipMalloc(&B_d, Nbytes));
+    HIPCHECK(hipHostMalloc((void**)&A_pinned, Nbytes));
+    HIPCHECK(hipHostMalloc((void**)&B_pinned, Nbytes));
+    A_pageable = (char*)malloc(Nbytes);
+    B_pageable = (char*)malloc(Nbytes);
+
+    for (size_t i=0; i<Nbytes; i++) {
+        A_pinned[i]   = (char)(i * 7 + 1);
+        A_pageable[i] = (char)(i * 13 + 5);
+    }
+    HIPCHECK(hipMemset(A_d, 0, Nbytes));
+
+    // Ranges 0-63 are adjacent 256-byte slices and coalesce into one range.
+    std::vector<void*> dsts;
+    std::vector<const void*> srcs;
+    std::vector<size_t> sizes;
+    for (int i=0; i<64; i++) {
+        dsts.push_back(A_d + i*256);
+        srcs.push_back(A_pinned + i*256);
+        sizes.push_back(256);
+    }
+    size_t off = 64*1024;
+    for (int i=0; i<32; i++, off += 2*smallSize) {
+        dsts.push_back(A_d + off);
+        srcs.push_back(A_pinned + off);
+        sizes.push_back(smallSize);
+    }
+    dsts.push_back(A_d + Nbytes/2);
+    srcs.push_back(A_pinned + Nbytes/2);
+    sizes.push_back(largeSize);
+
+    dsts.push_back(A_d + Nbytes - 4096);
+    srcs.push_back(A_pageable + Nbytes - 4096);
+    sizes.push_back(4096);
+
+    HIPCHECK(hipMemcpyBatchAsync(dsts.data(), srcs.data(), sizes.data(), dsts.size(), hipMemcpyHostToDevice, stream));
+
+    // D2D of the same ranges, then D2H back into pinned memory:
+    std::vector<void*> d2dDsts;
+    std::vector<const void*> d2dSrcs;
+    std::vector<void*> d2hDsts;
+    std::vector<const void*> d2hSrcs;
+    for (size_t i=0; i<dsts.size(); i++) {
+        size_t rangeOff = (char*)dsts[i] - A_d;
+        d2dDsts.push_back(B_d + rangeOff);
+        d2dSrcs.push_back(A_d + rangeOff);
+        d2hDsts.push_back(B_pinned + rangeOff);
+        d2hSrcs.push_back(B_d + rangeOff);
+    }
+    // The last range goes back to pageable memory:
+    d2hDsts.back() = B_pageable + ((char*)dsts.back() - A_d);
+    HIPCHECK(hipMemcpyBatchAsync(d2dDsts.data(), d2dSrcs.data(), sizes.data(), sizes.size(), hipMemcpyDeviceToDevice, stream));
+    HIPCHECK(hipMemcpyBatchAsync(d2hDsts.data(), d2hSrcs.data(), sizes.data(), sizes.size(), hipMemcpyDeviceToHost, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    for (size_t i=0; i<dsts.size(); i++) {
+        const char *expected = (const char*)srcs[i];
+        checkBytes(expected, (const char*)d2hDsts[i], sizes[i], "batch");
+    }
+
+    HIPCHECK(hipFree(A_d));
+    HIPCHECK(hipFree(B_d));
+    HIPCHECK(hipHostFree(A_pinned));
+    HIPCHECK(hipHostFree(B_pinned));
+    free(A_pageable);
+    free(B_pageable);
+}
+
+
+//---
+// Gather rows of a device table into a packed buffer, then scatter them back to new positions.
+void gatherScatterTest(hipStream_t stream)
+{
+    printf ("test: %s stream=%p\n", __func__, stream);
+
+    const size_t rows = 4096;
+    const size_t rowSize = 128;
+    const size_t count = 512;
+
+    char *table_d, *packed_d, *scattered_d;
+    char *table_h, *result_h;
+    HIPCHECK(hipMalloc(&table_d, rows*rowSize));
+    HIPCHECK(hipMalloc(&packed_d, count*rowSize));
+    HIPCHECK(hipMalloc(&scattered_d, rows*rowSize));
+    HIPCHECK(hipHostMalloc((void**)&table_h, rows*rowSize));
+    HIPCHECK(hipHostMalloc((void**)&result_h, rows*rowSize));
+
+    for (size_t i=0; i<rows*rowSize; i++) {
+        table_h[i] = (char)(i / rowSize);
+    }
+    HIPCHECK(hipMemcpy(table_d, table_h, rows*rowSize, hipMemcpyHostToDevice));
+    HIPCHECK(hipMemset(scattered_d, 0, rows*rowSize));
+
+    // Mix of runs of consecutive rows (coalesced) and scattered rows:
+    std::vector<size_t> gatherIdx(count), scatterIdx(count);
+    for (size_t i=0; i<count; i++) {
+        gatherIdx[i]  = (i < count/2) ? (100 + i) : ((i * 37) % rows);
+        scatterIdx[i] = rows - 1 - i;
+    }
+
+    HIPCHECK(hipMemcpyGatherScatterAsync(packed_d, NULL, table_d, gatherIdx.data(), rowSize, count, hipMemcpyDeviceToDevice, stream));
+    HIPCHECK(hipMemcpyGatherScatterAsync(scattered_d, scatterIdx.data(), packed_d, NULL, rowSize, count, hipMemcpyDeviceToDevice, stream));
+    HIPCHECK(hipMemcpyAsync(result_h, scattered_d, rows*rowSize, hipMemcpyDeviceToHost, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    for (size_t i=0; i<count; i++) {
+        checkBytes(table_h + gatherIdx[i]*rowSize, result_h + scatterIdx[i]*rowSize, rowSize, "gather/scatter");
+    }
+
+    // Offsets past the end of the address space:
+    size_t badIdx[2] = {0, SIZE_MAX / rowSize};
+    HIPCHECK_API(hipMemcpyGatherScatterAsync(packed_d, NULL, table_d, badIdx, rowSize, 2, hipMemcpyDeviceToDevice, stream),
+                 hipErrorInvalidValue);
+    HIPCHECK_API(hipMemcpyGatherScatterAsync(scattered_d, badIdx, packed_d, NULL, rowSize, 2, hipMemcpyDeviceToDevice, stream),
+                 hipErrorInvalidValue);
+
+    HIPCHECK(hipFree(table_d));
+    HIPCHECK(hipFree(packed_d));
+    HIPCHECK(hipFree(scattered_d));
+    HIPCHECK(hipHostFree(table_h));
+    HIPCHECK(hipHostFree(result_h));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    batchTest(0);
+    gatherScatterTest(0);
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    batchTest(stream);
+    gatherScatterTest(stream);
+    HIPCHECK(hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,182 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// hipMemcpyFromFileAsync / hipMemcpyToFileAsync through small bounce buffers, so each copy runs many chunks.
+// Covers unaligned offsets, stream ordering with a kernel, an event and a write followed by a read, O_DIRECT
+// where the filesystem allows it, and writes which fail after the call returned.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+void fileCopyTest(const char *path, bool directIo, hipStream_t stream)
+{
+    printf ("test: %s direct=%d stream=%p\n", __func__, directIo, stream);
+
+    const size_t numElements = 300000;
+    const size_t Nbytes = numElements*sizeof(int);
+    const int64_t fileOffset = 8192 + 12;  // not 4KB aligned.
+
+    // Reference file: a header, then numElements ints.
+    int *ref_h = (int*)malloc(Nbytes);
+    for (size_t i=0; i<numElements; i++) {
+        ref_h[i] = (int)(i * 13 + 1);
+    }
+    int fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0) {
+        failed("can't create %s\n", path);
+    }
+    if (pwrite(fd, ref_h, Nbytes, fileOffset) != (ssize_t)Nbytes) {
+        failed("can't write %s\n", path);
+    }
+    close(fd);
+
+    fd = open(path, O_RDWR | (directIo ? O_DIRECT : 0));
+    if (fd < 0) {
+        printf ("  skipped: can't open %s%s\n", path, directIo ? " with O_DIRECT" : "");
+        free(ref_h);
+        return;
+    }
+
+    int *A_d, *B_d, *C_d;
+    int *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, numElements, false);
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, numElements);
+
+    // File -> A_d, then a kernel on the same stream consumes it:
+    HIPCHECK(hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK(hipMemcpyFromFileAsync(A_d, fd, fileOffset, Nbytes, stream));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, numElements);
+    HIPCHECK(hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+    HipTest::checkVectorADD(ref_h, B_h, C_h, numElements);
+
+    if (!directIo) {
+        // C_d -> file at an unaligned offset, completion observed through an event:
+        hipEvent_t e;
+        HIPCHECK(hipEventCreate(&e));
+        HIPCHECK(hipMemcpyToFileAsync(fd, fileOffset, C_d, Nbytes, stream));
+        HIPCHECK(hipEventRecord(e, stream));
+        HIPCHECK(hipEventSynchronize(e));
+        HIPCHECK(hipEventDestroy(e));
+
+        memset(C_h, 0, Nbytes);
+        if (pread(fd, C_h, Nbytes, fileOffset) != (ssize_t)Nbytes) {
+            failed("can't read back %s\n", path);
+        }
+        HipTest::checkVectorADD(ref_h, B_h, C_h, numElements);
+
+        // Reading past end of file fails:
+        if (hipMemcpyFromFileAsync(A_d, fd, fileOffset + 4096, Nbytes, stream) != hipErrorInvalidValue) {
+            failed("read past end of file did not fail\n");
+        }
+
+        // Write past the end of the file and read it straight back without synchronizing: the read is ordered
+        // after the write by the stream, and must not be rejected against the old file size.
+        const int64_t appendOffset = fileOffset + Nbytes + 100;
+        HIPCHECK(hipMemsetAsync(A_d, 0, Nbytes, stream));
+        HIPCHECK(hipMemcpyToFileAsync(fd, appendOffset, C_d, Nbytes, stream));
+        HIPCHECK(hipMemcpyFromFileAsync(A_d, fd, appendOffset, Nbytes, stream));
+        HIPCHECK(hipMemcpyAsync(C_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+        HIPCHECK(hipStreamSynchronize(stream));
+        HipTest::checkVectorADD(ref_h, B_h, C_h, numElements);
+    }
+
+    close(fd);
+    unlink(path);
+    free(ref_h);
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, false);
+}
+
+
+// A write to a read-only descriptor fails on the I/O thread.  The error is reported once, by whichever of stream
+// or event synchronization or query sees it first.
+void fileErrorTest(const char *path, hipStream_t stream)
+{
+    printf ("test: %s stream=%p\n", __func__, stream);
+
+    const size_t Nbytes = 100000;
+    int fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0) {
+        failed("can't create %s\n", path);
+    }
+    close(fd);
+    fd = open(path, O_RDONLY);
+
+    char *A_d;
+    HIPCHECK(hipMalloc(&A_d, Nbytes));
+
+    HIPCHECK(hipMemcpyToFileAsync(fd, 0, A_d, Nbytes, stream));
+    HIPCHECK_API(hipStreamSynchronize(stream), hipErrorUnknown);
+    HIPCHECK(hipStreamSynchronize(stream));
+    HIPCHECK(hipStreamQuery(stream));
+
+    hipEvent_t e;
+    HIPCHECK(hipEventCreate(&e));
+    HIPCHECK(hipMemcpyToFileAsync(fd, 0, A_d, Nbytes, stream));
+    HIPCHECK(hipEventRecord(e, stream));
+    HIPCHECK_API(hipEventSynchronize(e), hipErrorUnknown);
+    HIPCHECK(hipEventQuery(e));
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    HIPCHECK(hipMemcpyToFileAsync(fd, 0, A_d, Nbytes, stream));
+    HIPCHECK(hipEventRecord(e, stream));
+    hipError_t q;
+    while ((q = hipEventQuery(e)) == hipErrorNotReady) {}
+    HIPASSERT(q == hipErrorUnknown);
+    HIPCHECK(hipStreamSynchronize(stream));     // already reported by the query.
+    HIPCHECK(hipEventDestroy(e));
+
+    HIPCHECK(hipFree(A_d));
+    close(fd);
+    unlink(path);
+}
+
+
+int main(int argc, char *argv[])
+{
+    // 64KB bounce buffers - read only when HIP initializes:
+    setenv("HIP_FILE_IO_SIZE", "64", 1);
+
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    char path[] = "hipMemcpyFile.tmp";
+
+    fileCopyTest(path, false, 0);
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    fileCopyTest(path, false, stream);
+    fileCopyTest(path, true, stream);
+    fileErrorTest(path, stream);
+    HIPCHECK(hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Staged copies whose host-side part is split across the host copy pool.  The threshold is set low so every
+// chunk is split, and odd sizes and unaligned host pointers exercise the ends of each piece.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+void copyTest(size_t sizeBytes, size_t hostOffset, bool async)
+{
+    printf ("test: %s sizeBytes=%zu hostOffset=%zu async=%d\n", __func__, sizeBytes, hostOffset, async);
+
+    char *src_h = (char*)malloc(sizeBytes + hostOffset);
+    char *dst_h = (char*)malloc(sizeBytes + hostOffset);
+    char *d;
+    HIPCHECK(hipMalloc(&d, sizeBytes));
+
+    for (size_t i=0; i<sizeBytes; i++) {
+        src_h[hostOffset + i] = (char)(i * 7 + 3);
+    }
+    memset(dst_h, 0, sizeBytes + hostOffset);
+
+    if (async) {
+        HIPCHECK(hipMemcpyAsync(d, src_h + hostOffset, sizeBytes, hipMemcpyHostToDevice, 0));
+        HIPCHECK(hipMemcpyAsync(dst_h + hostOffset, d, sizeBytes, hipMemcpyDeviceToHost, 0));
+        HIPCHECK(hipStreamSynchronize(0));
+    } else {
+        HIPCHECK(hipMemcpy(d, src_h + hostOffset, sizeBytes, hipMemcpyHostToDevice));
+        HIPCHECK(hipMemcpy(dst_h + hostOffset, d, sizeBytes, hipMemcpyDeviceToHost));
+    }
+
+    for (size_t i=0; i<sizeBytes; i++) {
+        if (dst_h[hostOffset + i] != src_h[hostOffset + i]) {
+            failed("mismatch at byte %zu: got %d expected %d\n", i, dst_h[hostOffset + i], src_h[hostOffset + i]);
+        }
+    }
+
+    HIPCHECK(hipFree(d));
+    free(src_h);
+    free(dst_h);
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Staging env vars are read when HIP initializes:
+    setenv("HIP_STAGING_SIZE", "256", 1);
+    setenv("HIP_PARALLEL_COPY_THREADS", "3", 1);
+    setenv("HIP_PARALLEL_COPY_THRESHOLD", "16", 1);
+
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    const size_t sizes[] = {16*1024, 100*1000 + 1, 256*1024, 3*256*1024 + 4095, 8*1024*1024 + 13};
+    for (auto sizeBytes : sizes) {
+        for (size_t hostOffset : {0, 1, 61}) {
+            copyTest(sizeBytes, hostOffset, true);
+            copyTest(sizeBytes, hostOffset, false);
+        }
+    }
+
+    passed();
+}
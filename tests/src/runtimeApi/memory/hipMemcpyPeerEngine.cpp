@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// hipMemcpyPeer / hipMemcpyPeerAsync between two devices, through the bounce buffers (no peer access),
+// directly (peer access enabled) and split across both devices' DMA engines (large copies with peer access both ways).
+// Small bounce buffers and split threshold are used so each path runs with several chunks.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+void peerCopyTest(int srcDevice, int dstDevice, size_t numElements, bool async, const char *what)
+{
+    printf ("test: %s %s dev%d->dev%d N=%zu async=%d\n", __func__, what, srcDevice, dstDevice, numElements, async);
+    size_t Nbytes = numElements*sizeof(int);
+
+    int *src_d, *dst_d;
+    int *src_h, *dst_h;
+    src_h = (int*)malloc(Nbytes);
+    dst_h = (int*)malloc(Nbytes);
+    for (size_t i=0; i<numElements; i++) {
+        src_h[i] = (int)(i * 3 + 7);
+    }
+
+    HIPCHECK(hipSetDevice(srcDevice));
+    HIPCHECK(hipMalloc(&src_d, Nbytes));
+    HIPCHECK(hipMemcpy(src_d, src_h, Nbytes, hipMemcpyHostToDevice));
+
+    HIPCHECK(hipSetDevice(dstDevice));
+    HIPCHECK(hipMalloc(&dst_d, Nbytes));
+    HIPCHECK(hipMemset(dst_d, 0, Nbytes));
+
+    HIPCHECK(hipSetDevice(srcDevice));
+    if (async) {
+        hipStream_t stream;
+        HIPCHECK(hipStreamCreate(&stream));
+        HIPCHECK(hipMemcpyPeerAsync(dst_d, dstDevice, src_d, srcDevice, Nbytes, stream));
+        // Stream-ordered after the peer copy:
+        HIPCHECK(hipMemcpyAsync(dst_h, dst_d, Nbytes, hipMemcpyDeviceToHost, stream));
+        HIPCHECK(hipStreamSynchronize(stream));
+        HIPCHECK(hipStreamDestroy(stream));
+    } else {
+        HIPCHECK(hipMemcpyPeer(dst_d, dstDevice, src_d, srcDevice, Nbytes));
+        HIPCHECK(hipMemcpy(dst_h, dst_d, Nbytes, hipMemcpyDeviceToHost));
+    }
+
+    for (size_t i=0; i<numElements; i++) {
+        if (dst_h[i] != src_h[i]) {
+            failed("mismatch at %zu: expected %d got %d\n", i, src_h[i], dst_h[i]);
+        }
+    }
+
+    HIPCHECK(hipFree(src_d));
+    HIPCHECK(hipFree(dst_d));
+    free(src_h);
+    free(dst_h);
+}
+
+
+int main(int argc, char *argv[])
+{
+    // 64KB bounce buffers, split copies of 1MB and up:
+    setenv("HIP_PEER_STAGING_SIZE", "64", 1);
+    setenv("HIP_PEER_SPLIT_THRESHOLD", "1", 1);
+
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int numDevices = 0;
+    HIPCHECK(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+        printf ("skipped: requires two devices\n");
+        passed();
+    }
+
+    int dev0 = 0;
+    int dev1 = 1;
+    const size_t smallN = 100000;          // ~400KB - several bounce buffer chunks.
+    const size_t largeN = 4*1024*1024;     // 16MB - split when peers are mapped.
+
+    for (int async=0; async<2; async++) {
+        peerCopyTest(dev0, dev1, smallN, async, "staged");
+        peerCopyTest(dev0, dev1, largeN, async, "staged");
+    }
+
+    int canAccess01 = 0, canAccess10 = 0;
+    HIPCHECK(hipDeviceCanAccessPeer(&canAccess01, dev0, dev1));
+    HIPCHECK(hipDeviceCanAccessPeer(&canAccess10, dev1, dev0));
+    if (canAccess01 && canAccess10) {
+        HIPCHECK(hipSetDevice(dev0));
+        HIPCHECK(hipDeviceEnablePeerAccess(dev1, 0));
+        HIPCHECK(hipSetDevice(dev1));
+        HIPCHECK(hipDeviceEnablePeerAccess(dev0, 0));
+
+        for (int async=0; async<2; async++) {
+            peerCopyTest(dev0, dev1, smallN, async, "direct");
+            peerCopyTest(dev0, dev1, largeN, async, "split");
+            peerCopyTest(dev1, dev0, largeN, async, "split");
+        }
+    }
+
+    passed();
+}
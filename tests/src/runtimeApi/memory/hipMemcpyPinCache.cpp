@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Repeated copies from the same pageable buffer with the pin cache enabled.
+// The buffer becomes pinned after HIP_PIN_CACHE_HITS copies; results must not change, and
+// hipHostRegister/hipHostUnregister must still work on the cached buffer.  Freeing a cached buffer
+// must drop its pin, so a new allocation at the same address is pageable again.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+
+// The memtracker only knows pinned or HIP-allocated host memory.
+static bool isPinned(void *p)
+{
+    hipPointerAttribute_t attr;
+    return hipPointerGetAttributes(&attr, p) != hipErrorUnknown;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Pin cache env vars are read when HIP initializes:
+    setenv("HIP_PIN_CACHE", "64", 1);
+    setenv("HIP_PIN_CACHE_HITS", "2", 1);
+
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    const size_t numElements = 1024*1024;
+    const size_t Nbytes = numElements * sizeof(int);
+
+    int *A_h = (int*)malloc(Nbytes);
+    int *B_h = (int*)malloc(Nbytes);
+    int *A_d;
+    HIPCHECK(hipMalloc(&A_d, Nbytes));
+    HIPASSERT(!isPinned(A_h));
+
+    for (int iter=0; iter<4; iter++) {
+        for (size_t i=0; i<numElements; i++) {
+            A_h[i] = iter*1000 + i;
+        }
+        HIPCHECK(hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, 0));
+        HIPCHECK(hipMemcpyAsync(B_h, A_d, Nbytes, hipMemcpyDeviceToHost, 0));
+        HIPCHECK(hipDeviceSynchronize());
+
+        for (size_t i=0; i<numElements; i++) {
+            HIPASSERT(B_h[i] == A_h[i]);
+        }
+    }
+
+    // Both buffers are now cached:
+    HIPASSERT(isPinned(A_h));
+    HIPASSERT(isPinned(B_h));
+
+    // Explicit registration must still succeed on a cached buffer:
+    HIPCHECK(hipHostRegister(A_h, Nbytes, 0));
+    HIPCHECK(hipHostUnregister(A_h));
+    HIPASSERT(!isPinned(A_h));
+
+    // hipHostUnregister drops the cached pin:
+    HIPCHECK(hipHostUnregister(B_h));
+    HIPASSERT(!isPinned(B_h));
+
+    // Make B_h hot again, then free it.  The allocator usually hands the same address back; it must not be pinned.
+    for (int iter=0; iter<2; iter++) {
+        HIPCHECK(hipMemcpy(B_h, A_d, Nbytes, hipMemcpyDeviceToHost));
+    }
+    HIPASSERT(isPinned(B_h));
+    int *oldB_h = B_h;
+    free(B_h);
+    B_h = (int*)malloc(Nbytes);
+    if (B_h == oldB_h) {
+        HIPASSERT(!isPinned(B_h));
+    }
+    memset(B_h, 0, Nbytes);
+    HIPCHECK(hipMemcpy(B_h, A_d, Nbytes, hipMemcpyDeviceToHost));
+    for (size_t i=0; i<numElements; i++) {
+        HIPASSERT(B_h[i] == A_h[i]);
+    }
+
+    HIPCHECK(hipFree(A_d));
+    free(A_h);
+    free(B_h);
+
+    passed();
+}
@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Copy path selection with the built-in thresholds.  Each copy is recorded in the timeline with the path it took:
+// small D2D copies use the blit kernel, small H2D copies from pinned memory avoid SDMA (CPU stores with a large
+// BAR, the blit kernel without), and large copies use SDMA.  No calibration runs, so no policy file is written.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define TIMELINE_FILE "/tmp/hipMemcpyPolicy.json"
+
+static const size_t smallH2d = 8*1024;
+static const size_t smallD2d = 4*1024;
+static const size_t largeBytes = 4*1024*1024;
+
+
+static bool hasCopy(const std::string &json, const char *path, size_t bytes)
+{
+    std::string pattern = std::string("\"path\":\"") + path + "\",\"bytes\":" + std::to_string(bytes) + "}";
+    return json.find(pattern) != std::string::npos;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Env vars are read when HIP initializes.  HOME points at an empty directory to catch a policy file:
+    char home[] = "/tmp/hipMemcpyPolicy.XXXXXX";
+    HIPASSERT(mkdtemp(home) != nullptr);
+    setenv("HOME", home, 1);
+    unsetenv("HIP_COPY_CALIBRATE");
+    unsetenv("HIP_COPY_POLICY_FILE");
+    unsetenv("HIP_COPY_H2D_CPU_THRESHOLD");
+    unsetenv("HIP_COPY_BLIT_THRESHOLD");
+    setenv("HIP_TIMELINE_FILE", TIMELINE_FILE, 1);
+    unlink(TIMELINE_FILE ".0");
+
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    char *A_h, *B_h, *A_d, *B_d;
+    HIPCHECK(hipHostMalloc((void**)&A_h, largeBytes));
+    HIPCHECK(hipHostMalloc((void**)&B_h, largeBytes));
+    HIPCHECK(hipMalloc(&A_d, largeBytes));
+    HIPCHECK(hipMalloc(&B_d, largeBytes));
+    for (size_t i=0; i<largeBytes; i++) {
+        A_h[i] = (char)(i * 7);
+    }
+
+    HIPCHECK(hipMemcpy(A_d, A_h, smallH2d, hipMemcpyHostToDevice));
+    HIPCHECK(hipMemcpy(A_d, A_h, largeBytes, hipMemcpyHostToDevice));
+    HIPCHECK(hipMemcpy(B_d, A_d, smallD2d, hipMemcpyDeviceToDevice));
+    HIPCHECK(hipMemcpy(B_d, A_d, largeBytes, hipMemcpyDeviceToDevice));
+    HIPCHECK(hipMemcpy(B_h, B_d, largeBytes, hipMemcpyDeviceToHost));
+    HIPASSERT(memcmp(A_h, B_h, largeBytes) == 0);
+
+    // Closes the recording window and writes it to <file>.0:
+    HIPCHECK(hipProfilerStop());
+
+    std::ifstream f(TIMELINE_FILE ".0");
+    HIPASSERT(f.good());
+    std::stringstream ss;
+    ss << f.rdbuf();
+    std::string json = ss.str();
+    unlink(TIMELINE_FILE ".0");
+
+    HIPASSERT(hasCopy(json, "blit", smallD2d));
+    HIPASSERT(hasCopy(json, "cpu", smallH2d) || hasCopy(json, "blit", smallH2d));
+    HIPASSERT(hasCopy(json, "sdma", largeBytes));
+    HIPASSERT(!hasCopy(json, "sdma", smallD2d) && !hasCopy(json, "sdma", smallH2d));
+
+    // Calibration is opt-in, so nothing was written under HOME:
+    char hostname[256] = "unknown";
+    gethostname(hostname, sizeof(hostname)-1);
+    std::string policyFile = std::string(home) + "/.hip_copy_policy." + hostname;
+    HIPASSERT(access(policyFile.c_str(), F_OK) != 0);
+    rmdir(home);
+
+    HIPCHECK(hipHostFree(A_h));
+    HIPCHECK(hipHostFree(B_h));
+    HIPCHECK(hipFree(A_d));
+    HIPCHECK(hipFree(B_d));
+
+    passed();
+}
@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Copies to and from a __device__ variable by name, with offsets, and the symbol address/size queries.
+// Also reuses one name buffer for two different names, which must not hit the wrong cached entry.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define NUM 1024
+
+#ifdef __HIP_PLATFORM_HCC__
+__attribute__((address_space(1))) int symA[NUM];
+__attribute__((address_space(1))) int symB[NUM];
+#endif
+
+#ifdef __HIP_PLATFORM_NVCC__
+__device__ int symA[NUM];
+__device__ int symB[NUM];
+#endif
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    const size_t Nbytes = NUM*sizeof(int);
+    int *in  = (int*)malloc(Nbytes);
+    int *out = (int*)malloc(Nbytes);
+    for (int i=0; i<NUM; i++) {
+        in[i] = i;
+    }
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    // Fill symA in two halves, the second with an offset; read it back the same way.
+    HIPCHECK(hipMemcpyToSymbol(HIP_SYMBOL(symA), in, Nbytes/2, 0, hipMemcpyHostToDevice));
+    HIPCHECK(hipMemcpyToSymbolAsync(HIP_SYMBOL(symA), in + NUM/2, Nbytes/2, Nbytes/2, hipMemcpyHostToDevice, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    memset(out, 0, Nbytes);
+    HIPCHECK(hipMemcpyFromSymbol(out, HIP_SYMBOL(symA), Nbytes/2, 0, hipMemcpyDeviceToHost));
+    HIPCHECK(hipMemcpyFromSymbolAsync(out + NUM/2, HIP_SYMBOL(symA), Nbytes/2, Nbytes/2, hipMemcpyDeviceToHost, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+    for (int i=0; i<NUM; i++) {
+        HIPASSERT(out[i] == i);
+    }
+
+    // The address is stable and works with the ordinary copy APIs.
+    void *addrA, *addrA2, *addrB;
+    HIPCHECK(hipGetSymbolAddress(&addrA, HIP_SYMBOL(symA)));
+    HIPCHECK(hipGetSymbolAddress(&addrA2, HIP_SYMBOL(symA)));
+    HIPCHECK(hipGetSymbolAddress(&addrB, HIP_SYMBOL(symB)));
+    HIPASSERT(addrA == addrA2);
+    HIPASSERT(addrA != addrB);
+
+    HIPCHECK(hipMemcpy(addrB, addrA, Nbytes, hipMemcpyDeviceToDevice));
+    memset(out, 0, Nbytes);
+    HIPCHECK(hipMemcpyFromSymbol(out, HIP_SYMBOL(symB), Nbytes, 0, hipMemcpyDeviceToHost));
+    for (int i=0; i<NUM; i++) {
+        HIPASSERT(out[i] == i);
+    }
+
+#ifdef __HIP_PLATFORM_HCC__
+    // Same buffer, different names:
+    char name[16];
+    void *p;
+    strcpy(name, "symA");
+    HIPCHECK(hipGetSymbolAddress(&p, name));
+    HIPASSERT(p == addrA);
+    strcpy(name, "symB");
+    HIPCHECK(hipGetSymbolAddress(&p, name));
+    HIPASSERT(p == addrB);
+
+    HIPCHECK_API(hipGetSymbolAddress(&p, "noSuchSymbol"), hipErrorInvalidSymbol);
+    HIPCHECK_API(hipMemcpyToSymbol("noSuchSymbol", in, Nbytes, 0, hipMemcpyHostToDevice), hipErrorInvalidSymbol);
+
+    size_t size;
+    hipError_t e = hipGetSymbolSize(&size, HIP_SYMBOL(symA));
+    if (e == hipErrorNotSupported) {
+        printf("symbol sizes not reported by this runtime\n");
+    } else {
+        HIPCHECK(e);
+        HIPASSERT(size == Nbytes);
+        HIPCHECK_API(hipMemcpyToSymbol(HIP_SYMBOL(symA), in, Nbytes, 4, hipMemcpyHostToDevice), hipErrorInvalidValue);
+        // offset + count wraps to a small value:
+        HIPCHECK_API(hipMemcpyFromSymbol(out, HIP_SYMBOL(symA), 8, SIZE_MAX - 3, hipMemcpyDeviceToHost), hipErrorInvalidValue);
+    }
+    // A range which wraps the address space is rejected even when the size is unknown:
+    HIPCHECK_API(hipMemcpyToSymbol(HIP_SYMBOL(symA), in, SIZE_MAX, 16, hipMemcpyHostToDevice), hipErrorInvalidValue);
+#endif
+
+    HIPCHECK(hipStreamDestroy(stream));
+    free(in);
+    free(out);
+
+    passed();
+}
@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Peer access enabled after many allocations already exist on the peer.  Enable returns before the allocations
+// are remapped; the copies and kernels which follow must still see every allocation.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define NUM_ALLOCS 256
+
+
+__global__ void
+readPeer(hipLaunchParm lp, int *dst, const int *peerSrc, size_t numElements)
+{
+    size_t offset = (hipBlockIdx_x * hipBlockDim_x + hipThreadIdx_x);
+    size_t stride = hipBlockDim_x * hipGridDim_x;
+
+    for (size_t i=offset; i<numElements; i+=stride) {
+        dst[i] = peerSrc[i] + 1;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int numDevices = 0;
+    HIPCHECK(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+        printf ("skipped: requires two devices\n");
+        passed();
+    }
+
+    int canAccess = 0;
+    HIPCHECK(hipDeviceCanAccessPeer(&canAccess, 0, 1));
+    if (!canAccess) {
+        printf ("skipped: dev0 cannot access dev1\n");
+        passed();
+    }
+
+    const size_t numElements = 64*1024;
+    const size_t Nbytes = numElements*sizeof(int);
+    int *src_h = (int*)malloc(Nbytes);
+    int *dst_h = (int*)malloc(Nbytes);
+
+    // Allocations on dev1 made before the peer set changes:
+    int *peer_d[NUM_ALLOCS];
+    HIPCHECK(hipSetDevice(1));
+    for (int i=0; i<NUM_ALLOCS; i++) {
+        for (size_t j=0; j<numElements; j++) {
+            src_h[j] = i*1000 + j;
+        }
+        HIPCHECK(hipMalloc(&peer_d[i], Nbytes));
+        HIPCHECK(hipMemcpy(peer_d[i], src_h, Nbytes, hipMemcpyHostToDevice));
+    }
+
+    HIPCHECK(hipSetDevice(0));
+    HIPCHECK(hipDeviceEnablePeerAccess(1, 0));
+
+    int *dst_d;
+    HIPCHECK(hipMalloc(&dst_d, Nbytes));
+
+    // Copy from the last allocation first - the background remap is unlikely to have reached it:
+    for (int i=NUM_ALLOCS-1; i>=0; i-=37) {
+        HIPCHECK(hipMemcpy(dst_d, peer_d[i], Nbytes, hipMemcpyDeviceToDevice));
+        HIPCHECK(hipMemcpy(dst_h, dst_d, Nbytes, hipMemcpyDeviceToHost));
+        for (size_t j=0; j<numElements; j++) {
+            if (dst_h[j] != (int)(i*1000 + j)) {
+                failed("copy alloc %d mismatch at %zu: expected %d got %d\n", i, j, (int)(i*1000 + j), dst_h[j]);
+            }
+        }
+    }
+
+    // Kernels read peer memory directly:
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, numElements);
+    for (int i=NUM_ALLOCS-2; i>=0; i-=41) {
+        hipLaunchKernel(readPeer, dim3(blocks), dim3(threadsPerBlock), 0, 0, dst_d, peer_d[i], numElements);
+        HIPCHECK(hipMemcpy(dst_h, dst_d, Nbytes, hipMemcpyDeviceToHost));
+        for (size_t j=0; j<numElements; j++) {
+            if (dst_h[j] != (int)(i*1000 + j + 1)) {
+                failed("kernel alloc %d mismatch at %zu: expected %d got %d\n", i, j, (int)(i*1000 + j + 1), dst_h[j]);
+            }
+        }
+    }
+
+    // Free while remaps may still be in flight:
+    HIPCHECK(hipDeviceDisablePeerAccess(1));
+    HIPCHECK(hipSetDevice(1));
+    for (int i=0; i<NUM_ALLOCS; i++) {
+        HIPCHECK(hipFree(peer_d[i]));
+    }
+
+    HIPCHECK(hipSetDevice(0));
+    HIPCHECK(hipFree(dst_d));
+    free(src_h);
+    free(dst_h);
+
+    passed();
+}
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Several threads allocate and free on one device while another thread toggles peer access to it, so the
+// allocations race with peer snapshot updates.  Every allocation must remain usable by the peer afterwards.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include <thread>
+#include <atomic>
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+std::atomic<bool> g_done(false);
+
+
+void allocThenFree(int iterations, int burstSize)
+{
+    HIPCHECK(hipSetDevice(1));
+
+    int **ptrs = new int*[burstSize];
+    for (int i=0; i<iterations; i++) {
+        for (int j=0; j<burstSize; j++) {
+            HIPCHECK(hipMalloc(&ptrs[j], 4096 * (j+1)));
+        }
+        for (int j=0; j<burstSize; j++) {
+            HIPCHECK(hipFree(ptrs[j]));
+        }
+    }
+    delete [] ptrs;
+}
+
+
+void togglePeer()
+{
+    HIPCHECK(hipSetDevice(0));
+    while (!g_done) {
+        HIPCHECK(hipDeviceEnablePeerAccess(1, 0));
+        HIPCHECK(hipDeviceDisablePeerAccess(1));
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int numDevices = 0;
+    HIPCHECK(hipGetDeviceCount(&numDevices));
+    int canAccess = 0;
+    if (numDevices >= 2) {
+        HIPCHECK(hipDeviceCanAccessPeer(&canAccess, 0, 1));
+    }
+    if (!canAccess) {
+        printf ("skipped: requires two devices with peer access\n");
+        passed();
+    }
+
+    std::thread toggler(togglePeer);
+    std::thread t1(allocThenFree, 100, 10);
+    std::thread t2(allocThenFree, 1000, 1);
+    std::thread t3(allocThenFree, 10, 100);
+    t1.join();
+    t2.join();
+    t3.join();
+    g_done = true;
+    toggler.join();
+
+    // Allocations made after the final enable must be visible to the peer:
+    HIPCHECK(hipSetDevice(0));
+    HIPCHECK(hipDeviceEnablePeerAccess(1, 0));
+
+    const size_t Nbytes = 1024*sizeof(int);
+    int *src_h = (int*)malloc(Nbytes);
+    int *dst_h = (int*)malloc(Nbytes);
+    for (int i=0; i<1024; i++) {
+        src_h[i] = i * 5;
+    }
+
+    int *peer_d, *dst_d;
+    HIPCHECK(hipSetDevice(1));
+    HIPCHECK(hipMalloc(&peer_d, Nbytes));
+    HIPCHECK(hipMemcpy(peer_d, src_h, Nbytes, hipMemcpyHostToDevice));
+    HIPCHECK(hipSetDevice(0));
+    HIPCHECK(hipMalloc(&dst_d, Nbytes));
+    HIPCHECK(hipMemcpy(dst_d, peer_d, Nbytes, hipMemcpyDeviceToDevice));
+    HIPCHECK(hipMemcpy(dst_h, dst_d, Nbytes, hipMemcpyDeviceToHost));
+    for (int i=0; i<1024; i++) {
+        if (dst_h[i] != src_h[i]) {
+            failed("mismatch at %d: expected %d got %d\n", i, src_h[i], dst_h[i]);
+        }
+    }
+
+    HIPCHECK(hipFree(dst_d));
+    HIPCHECK(hipFree(peer_d));
+    free(src_h);
+    free(dst_h);
+
+    passed();
+}
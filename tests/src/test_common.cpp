@@ -19,6 +19,11 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <sstream>
 #include "test_common.h"
 
 // standard global variables that can be set on command line
@@ -155,4 +160,40 @@ unsigned setNumBlocks(unsigned blocksPerCU, unsigned threadsPerBlock, size_t N)
 }
 
 
+pid_t runChildWithEnv(const std::vector<std::pair<std::string, std::string>> &env, const std::function<void()> &work,
+                      const char *stderrFile)
+{
+    pid_t pid = fork();
+    HIPASSERT(pid >= 0);
+    if (pid == 0) {
+        for (auto &v : env) {
+            setenv(v.first.c_str(), v.second.c_str(), 1);
+        }
+        if (stderrFile) {
+            HIPASSERT(freopen(stderrFile, "w", stderr));
+        }
+        HIPCHECK(hipSetDevice(p_gpuDevice));
+        work();
+        exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    HIPASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    return pid;
+}
+
+
+std::string readFile(const std::string &fileName)
+{
+    std::ifstream f(fileName);
+    if (!f.good()) {
+        return "";
+    }
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+
 }// namespace HipTest
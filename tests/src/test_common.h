@@ -20,7 +20,12 @@ THE SOFTWARE.
 #include <iostream>
 #include <iomanip>
 #include <sys/time.h>
+#include <sys/types.h>
 #include <stddef.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "hip/hip_runtime.h"
 #include "hip/hip_texture.h"
@@ -128,6 +133,14 @@ int parseStandardArguments(int argc, char *argv[], bool failOnUndefinedArg);
 
 unsigned setNumBlocks(unsigned blocksPerCU, unsigned threadsPerBlock, size_t N);
 
+// Runs work() in a forked child with the env variables set and p_gpuDevice selected.  If stderrFile is set, the
+// child's stderr is written there.  Fails the test unless the child exits with status 0.  Returns the child's pid.
+pid_t runChildWithEnv(const std::vector<std::pair<std::string, std::string>> &env, const std::function<void()> &work,
+                      const char *stderrFile = nullptr);
+
+// Contents of fileName, or "" if it can't be read.
+std::string readFile(const std::string &fileName);
+
 
 template <typename T>
 __global__ void
@@ -0,0 +1,305 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// 3D and layered arrays: hipMemcpy3D between host, pitched device memory and arrays, tex3D and tex2DLayered
+// against the CPU reference sampler, and hipMemcpyToArray with a row offset.
+
+/* HIT_START
+ * BUILD: %t %s ../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define W 19
+#define H 13
+#define D 11
+#define SAMPLES 16
+
+
+__global__ void
+sample3DKernel(hipLaunchParm lp, hipTextureObject_t tex, float *out, float scale, float bias)
+{
+    int x = hipThreadIdx_x;
+    int y = hipThreadIdx_y;
+    int z = hipBlockIdx_x;
+    out[(z*SAMPLES + y)*SAMPLES + x] = tex3D<float>(tex, x*scale + bias, y*scale + bias, z*scale + bias);
+}
+
+
+__global__ void
+sampleLayeredKernel(hipLaunchParm lp, hipTextureObject_t tex, float *out, float scale, float bias)
+{
+    int x = hipThreadIdx_x;
+    int y = hipThreadIdx_y;
+    int layer = hipBlockIdx_x;
+    out[(layer*SAMPLES + y)*SAMPLES + x] = tex2DLayered<float>(tex, x*scale + bias, y*scale + bias, layer);
+}
+
+
+void checkClose(float got, float expected, const char *what, int i)
+{
+    if (fabsf(got - expected) > 1e-4f * (1.0f + fabsf(expected))) {
+        printf("%s mismatch at %d: got %f expected %f\n", what, i, got, expected);
+        failed("mismatch");
+    }
+}
+
+
+hipTextureDesc makeTexDesc(hipTextureAddressMode mode, hipTextureFilterMode filter, bool normalized)
+{
+    hipTextureDesc texDesc;
+    memset(&texDesc, 0, sizeof(texDesc));
+    texDesc.addressMode[0] = texDesc.addressMode[1] = texDesc.addressMode[2] = mode;
+    texDesc.filterMode = filter;
+    texDesc.readMode = hipReadModeElementType;
+    texDesc.normalizedCoords = normalized;
+    return texDesc;
+}
+
+
+void readBack(hipArray *array, float *out, size_t w, size_t h, size_t d)
+{
+    hipMemcpy3DParms p;
+    memset(&p, 0, sizeof(p));
+    p.srcArray = array;
+    p.dstPtr = make_hipPitchedPtr(out, w*sizeof(float), w, h);
+    p.extent = make_hipExtent(w, h, d);
+    p.kind = hipMemcpyDeviceToHost;
+    HIPCHECK(hipMemcpy3D(&p));
+}
+
+
+void test3D()
+{
+    printf("test: %s\n", __func__);
+
+    const size_t N = W*H*D;
+    float *ref = (float*)malloc(N*sizeof(float));
+    float *out = (float*)malloc(N*sizeof(float));
+    for (size_t i = 0; i < N; i++) {
+        ref[i] = (float)((i * 7919) % 1000) / 10.0f;
+    }
+
+    hipChannelFormatDesc desc = hipCreateChannelDesc<float>();
+    hipArray *array;
+    HIPCHECK(hipMalloc3DArray(&array, &desc, make_hipExtent(W, H, D)));
+
+    // Whole array from the host.
+    hipMemcpy3DParms p;
+    memset(&p, 0, sizeof(p));
+    p.srcPtr = make_hipPitchedPtr(ref, W*sizeof(float), W, H);
+    p.dstArray = array;
+    p.extent = make_hipExtent(W, H, D);
+    p.kind = hipMemcpyHostToDevice;
+    HIPCHECK(hipMemcpy3D(&p));
+
+    // Box from pitched device memory, straddling brick boundaries.
+    const size_t bw = 9, bh = 6, bd = 5;
+    hipPitchedPtr dev;
+    HIPCHECK(hipMalloc3D(&dev, make_hipExtent(bw*sizeof(float), bh, bd)));
+    float box[bw*bh*bd];
+    for (size_t i = 0; i < bw*bh*bd; i++) {
+        box[i] = -(float)i;
+    }
+    memset(&p, 0, sizeof(p));
+    p.srcPtr = make_hipPitchedPtr(box, bw*sizeof(float), bw*sizeof(float), bh);
+    p.dstPtr = dev;
+    p.extent = make_hipExtent(bw*sizeof(float), bh, bd);
+    p.kind = hipMemcpyHostToDevice;
+    HIPCHECK(hipMemcpy3D(&p));
+
+    memset(&p, 0, sizeof(p));
+    p.srcPtr = dev;
+    p.dstArray = array;
+    p.dstPos = make_hipPos(5, 3, 4);
+    p.extent = make_hipExtent(bw, bh, bd);
+    p.kind = hipMemcpyDeviceToDevice;
+    HIPCHECK(hipMemcpy3D(&p));
+    for (size_t z = 0; z < bd; z++) {
+        for (size_t y = 0; y < bh; y++) {
+            for (size_t x = 0; x < bw; x++) {
+                ref[((4+z)*H + 3+y)*W + 5+x] = box[(z*bh + y)*bw + x];
+            }
+        }
+    }
+
+    // Single row from the host, which goes through the scratch buffer.
+    float row[W];
+    for (int i = 0; i < W; i++) {
+        row[i] = 1000.0f + i;
+    }
+    memset(&p, 0, sizeof(p));
+    p.srcPtr = make_hipPitchedPtr(row, W*sizeof(float), W, 1);
+    p.dstArray = array;
+    p.dstPos = make_hipPos(0, H-1, D-1);
+    p.extent = make_hipExtent(W, 1, 1);
+    p.kind = hipMemcpyHostToDevice;
+    HIPCHECK(hipMemcpy3D(&p));
+    memcpy(&ref[((D-1)*H + H-1)*W], row, sizeof(row));
+
+    readBack(array, out, W, H, D);
+    for (size_t i = 0; i < N; i++) {
+        checkClose(out[i], ref[i], "readback", i);
+    }
+
+    hipResourceDesc resDesc;
+    memset(&resDesc, 0, sizeof(resDesc));
+    resDesc.resType = hipResourceTypeArray;
+    resDesc.res.array.array = array;
+
+    const hipTextureDesc texDescs[] = {
+        makeTexDesc(hipAddressModeClamp, hipFilterModePoint,  false),
+        makeTexDesc(hipAddressModeWrap,  hipFilterModeLinear, true),
+    };
+
+    float *out_d;
+    const size_t S = SAMPLES*SAMPLES*SAMPLES;
+    float out_h[S];
+    HIPCHECK(hipMalloc(&out_d, sizeof(out_h)));
+
+    for (auto &texDesc : texDescs) {
+        hipTextureObject_t tex;
+        HIPCHECK(hipCreateTextureObject(&tex, &resDesc, &texDesc, NULL));
+
+        const float scale = texDesc.normalizedCoords ? 1.3f/SAMPLES : 1.3f*W/SAMPLES;
+        const float bias = texDesc.normalizedCoords ? -0.1f : -2.3f;
+        hipLaunchKernel(sample3DKernel, dim3(SAMPLES), dim3(SAMPLES, SAMPLES), 0, 0, tex, out_d, scale, bias);
+        HIPCHECK(hipMemcpy(out_h, out_d, sizeof(out_h), hipMemcpyDeviceToHost));
+
+        for (int z = 0; z < SAMPLES; z++) {
+            for (int y = 0; y < SAMPLES; y++) {
+                for (int x = 0; x < SAMPLES; x++) {
+                    const int i = (z*SAMPLES + y)*SAMPLES + x;
+                    checkClose(out_h[i], hipTexSampleReference3D<float>(texDesc, ref, W, H, D,
+                               x*scale + bias, y*scale + bias, z*scale + bias), "tex3D", i);
+                }
+            }
+        }
+        HIPCHECK(hipDestroyTextureObject(tex));
+    }
+
+    HIPCHECK(hipFree(out_d));
+    HIPCHECK(hipFree(dev.ptr));
+    HIPCHECK(hipFreeArray(array));
+    free(ref);
+    free(out);
+}
+
+
+void testLayered()
+{
+    printf("test: %s\n", __func__);
+
+    const int layers = 3;
+    float ref[W*H*layers];
+    for (int i = 0; i < W*H*layers; i++) {
+        ref[i] = (float)((i * 31) % 97);
+    }
+
+    hipChannelFormatDesc desc = hipCreateChannelDesc<float>();
+    hipArray *array;
+    HIPCHECK(hipMalloc3DArray(&array, &desc, make_hipExtent(W, H, layers), hipArrayLayered | hipArrayTiled));
+
+    hipMemcpy3DParms p;
+    memset(&p, 0, sizeof(p));
+    p.srcPtr = make_hipPitchedPtr(ref, W*sizeof(float), W, H);
+    p.dstArray = array;
+    p.extent = make_hipExtent(W, H, layers);
+    p.kind = hipMemcpyHostToDevice;
+    HIPCHECK(hipMemcpy3D(&p));
+
+    hipResourceDesc resDesc;
+    memset(&resDesc, 0, sizeof(resDesc));
+    resDesc.resType = hipResourceTypeArray;
+    resDesc.res.array.array = array;
+    hipTextureDesc texDesc = makeTexDesc(hipAddressModeMirror, hipFilterModeLinear, false);
+    hipTextureObject_t tex;
+    HIPCHECK(hipCreateTextureObject(&tex, &resDesc, &texDesc, NULL));
+
+    float *out_d;
+    float out_h[SAMPLES*SAMPLES*layers];
+    HIPCHECK(hipMalloc(&out_d, sizeof(out_h)));
+    const float scale = 1.3f*W/SAMPLES, bias = -2.3f;
+    hipLaunchKernel(sampleLayeredKernel, dim3(layers), dim3(SAMPLES, SAMPLES), 0, 0, tex, out_d, scale, bias);
+    HIPCHECK(hipMemcpy(out_h, out_d, sizeof(out_h), hipMemcpyDeviceToHost));
+
+    for (int l = 0; l < layers; l++) {
+        for (int y = 0; y < SAMPLES; y++) {
+            for (int x = 0; x < SAMPLES; x++) {
+                const int i = (l*SAMPLES + y)*SAMPLES + x;
+                checkClose(out_h[i], hipTexSampleReference2D<float>(texDesc, &ref[l*W*H], W, H,
+                           x*scale + bias, y*scale + bias), "tex2DLayered", i);
+            }
+        }
+    }
+
+    HIPCHECK(hipDestroyTextureObject(tex));
+    HIPCHECK(hipFree(out_d));
+    HIPCHECK(hipFreeArray(array));
+}
+
+
+// hipMemcpyToArray starting part-way through a row, for both layouts.
+void testToArrayOffset(unsigned flags)
+{
+    printf("test: %s flags=0x%x\n", __func__, flags);
+
+    float ref[W*H];
+    memset(ref, 0, sizeof(ref));
+
+    hipChannelFormatDesc desc = hipCreateChannelDesc<float>();
+    hipArray *array;
+    HIPCHECK(hipMallocArray(&array, &desc, W, H, flags));
+    HIPCHECK(hipMemcpyToArray(array, 0, 0, ref, sizeof(ref), hipMemcpyHostToDevice));
+
+    const size_t count = 3*W + 5;
+    float src[count];
+    for (size_t i = 0; i < count; i++) {
+        src[i] = 1.0f + i;
+    }
+    HIPCHECK(hipMemcpyToArray(array, 7*sizeof(float), 2, src, sizeof(src), hipMemcpyHostToDevice));
+    memcpy(&ref[2*W + 7], src, sizeof(src));
+
+    float out[W*H];
+    readBack(array, out, W, H, 1);
+    for (int i = 0; i < W*H; i++) {
+        checkClose(out[i], ref[i], "hipMemcpyToArray", i);
+    }
+
+    HIPCHECK(hipFreeArray(array));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    test3D();
+    testLayered();
+    testToArrayOffset(hipArrayDefault);
+    testToArrayOffset(hipArrayMorton);
+
+    passed();
+}
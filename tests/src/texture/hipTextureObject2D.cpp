@@ -0,0 +1,204 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Samples texture objects on the device and compares against the CPU reference sampler, for each array layout,
+// filter mode, address mode and read mode.
+
+/* HIT_START
+ * BUILD: %t %s ../test_common.cpp
+ * RUN: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "test_common.h"
+
+#define W 67
+#define H 45
+#define SAMPLES_X 96
+#define SAMPLES_Y 64
+
+
+// Samples a grid of coordinates which extends past the edges, so the address modes are exercised.
+__global__ void
+sampleKernel(hipLaunchParm lp, hipTextureObject_t tex, float *out, float scaleX, float scaleY)
+{
+    int x = hipBlockIdx_x * hipBlockDim_x + hipThreadIdx_x;
+    int y = hipBlockIdx_y * hipBlockDim_y + hipThreadIdx_y;
+    if (x < SAMPLES_X && y < SAMPLES_Y) {
+        float u = (x - SAMPLES_X/8 + 0.3f) * scaleX;
+        float v = (y - SAMPLES_Y/8 + 0.6f) * scaleY;
+        out[y*SAMPLES_X + x] = tex2D<float>(tex, u, v);
+    }
+}
+
+
+template <typename E>
+void checkSamples(hipTextureObject_t tex, const hipTextureDesc &texDesc, const E *ref)
+{
+    float *out_d;
+    float out_h[SAMPLES_X*SAMPLES_Y];
+    HIPCHECK(hipMalloc(&out_d, sizeof(out_h)));
+
+    const float scaleX = texDesc.normalizedCoords ? 1.25f/SAMPLES_X : 1.25f*W/SAMPLES_X;
+    const float scaleY = texDesc.normalizedCoords ? 1.25f/SAMPLES_Y : 1.25f*H/SAMPLES_Y;
+
+    hipLaunchKernel(sampleKernel, dim3(SAMPLES_X/16, SAMPLES_Y/16), dim3(16, 16), 0, 0, tex, out_d, scaleX, scaleY);
+    HIPCHECK(hipMemcpy(out_h, out_d, sizeof(out_h), hipMemcpyDeviceToHost));
+
+    for (int y = 0; y < SAMPLES_Y; y++) {
+        for (int x = 0; x < SAMPLES_X; x++) {
+            float u = (x - SAMPLES_X/8 + 0.3f) * scaleX;
+            float v = (y - SAMPLES_Y/8 + 0.6f) * scaleY;
+            float expected = hipTexSampleReference2D<float>(texDesc, ref, W, H, u, v);
+            float got = out_h[y*SAMPLES_X + x];
+            if (fabsf(got - expected) > 1e-4f * (1.0f + fabsf(expected))) {
+                printf("mismatch at sample (%d,%d) coord (%f,%f): got %f expected %f\n", x, y, u, v, got, expected);
+                failed("texture sample mismatch");
+            }
+        }
+    }
+
+    HIPCHECK(hipFree(out_d));
+}
+
+
+hipTextureDesc makeTexDesc(hipTextureAddressMode mode, hipTextureFilterMode filter, hipTextureReadMode readMode,
+                           bool normalized)
+{
+    hipTextureDesc texDesc;
+    memset(&texDesc, 0, sizeof(texDesc));
+    texDesc.addressMode[0] = texDesc.addressMode[1] = texDesc.addressMode[2] = mode;
+    texDesc.filterMode = filter;
+    texDesc.readMode = readMode;
+    texDesc.borderColor[0] = -1.0f;
+    texDesc.normalizedCoords = normalized;
+    return texDesc;
+}
+
+
+// Float array in each layout, filled with a full copy and then patched with a partial one.
+void testArray(unsigned flags)
+{
+    printf("test: %s flags=0x%x\n", __func__, flags);
+
+    float *ref = (float*)malloc(W*H*sizeof(float));
+    for (int i = 0; i < W*H; i++) {
+        ref[i] = (float)((i * 7919) % 1000) / 10.0f;
+    }
+
+    hipChannelFormatDesc desc = hipCreateChannelDesc<float>();
+    hipArray *array;
+    HIPCHECK(hipMallocArray(&array, &desc, W, H, flags));
+    HIPCHECK(hipMemcpy2DToArray(array, 0, 0, ref, W*sizeof(float), W*sizeof(float), H, hipMemcpyHostToDevice));
+
+    // Partial copy of a block which straddles tile boundaries.
+    float patch[10*13];
+    for (int i = 0; i < 10*13; i++) {
+        patch[i] = -(float)i;
+    }
+    HIPCHECK(hipMemcpy2DToArray(array, 5*sizeof(float), 6, patch, 13*sizeof(float), 13*sizeof(float), 10,
+                                hipMemcpyHostToDevice));
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 13; x++) {
+            ref[(6+y)*W + 5+x] = patch[y*13 + x];
+        }
+    }
+
+    hipResourceDesc resDesc;
+    memset(&resDesc, 0, sizeof(resDesc));
+    resDesc.resType = hipResourceTypeArray;
+    resDesc.res.array.array = array;
+
+    const hipTextureDesc texDescs[] = {
+        makeTexDesc(hipAddressModeClamp,  hipFilterModePoint,  hipReadModeElementType, false),
+        makeTexDesc(hipAddressModeWrap,   hipFilterModePoint,  hipReadModeElementType, true),
+        makeTexDesc(hipAddressModeMirror, hipFilterModeLinear, hipReadModeElementType, true),
+        makeTexDesc(hipAddressModeBorder, hipFilterModeLinear, hipReadModeElementType, false),
+    };
+
+    for (auto &texDesc : texDescs) {
+        hipTextureObject_t tex;
+        HIPCHECK(hipCreateTextureObject(&tex, &resDesc, &texDesc, NULL));
+
+        hipTextureDesc got;
+        HIPCHECK(hipGetTextureObjectTextureDesc(&got, tex));
+        HIPASSERT(got.filterMode == texDesc.filterMode);
+
+        checkSamples(tex, texDesc, ref);
+        HIPCHECK(hipDestroyTextureObject(tex));
+    }
+
+    HIPCHECK(hipFreeArray(array));
+    free(ref);
+}
+
+
+// 8-bit pitched memory read as normalized float with linear filtering.
+void testPitchNormalized()
+{
+    printf("test: %s\n", __func__);
+
+    unsigned char ref[W*H];
+    for (int i = 0; i < W*H; i++) {
+        ref[i] = (unsigned char)(i * 31);
+    }
+
+    void *data_d;
+    size_t pitch;
+    HIPCHECK(hipMallocPitch(&data_d, &pitch, W, H));
+    HIPCHECK(hipMemcpy2D(data_d, pitch, ref, W, W, H, hipMemcpyHostToDevice));
+
+    hipResourceDesc resDesc;
+    memset(&resDesc, 0, sizeof(resDesc));
+    resDesc.resType = hipResourceTypePitch2D;
+    resDesc.res.pitch2D.devPtr = data_d;
+    resDesc.res.pitch2D.desc = hipCreateChannelDesc<unsigned char>();
+    resDesc.res.pitch2D.width = W;
+    resDesc.res.pitch2D.height = H;
+    resDesc.res.pitch2D.pitchInBytes = pitch;
+
+    hipTextureDesc texDesc = makeTexDesc(hipAddressModeClamp, hipFilterModeLinear, hipReadModeNormalizedFloat, true);
+    hipTextureObject_t tex;
+    HIPCHECK(hipCreateTextureObject(&tex, &resDesc, &texDesc, NULL));
+    checkSamples(tex, texDesc, ref);
+    HIPCHECK(hipDestroyTextureObject(tex));
+
+    // Linear filtering of integers needs normalized reads.
+    texDesc.readMode = hipReadModeElementType;
+    HIPASSERT(hipCreateTextureObject(&tex, &resDesc, &texDesc, NULL) == hipErrorInvalidValue);
+
+    HIPCHECK(hipFree(data_d));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    testArray(hipArrayDefault);
+    testArray(hipArrayTiled);
+    testArray(hipArrayMorton);
+    testPitchNormalized();
+
+    passed();
+}